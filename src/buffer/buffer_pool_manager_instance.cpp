@@ -50,17 +50,33 @@ BufferPoolManagerInstance::~BufferPoolManagerInstance() {
 
 bool BufferPoolManagerInstance::FlushPgImp(page_id_t page_id) {
   // Make sure you call DiskManager::WritePage!
-//   std::lock_guard<std::mutex> lg(pt_latch_);
+  std::lock_guard<std::mutex> pg_lg(pg_latch_);
+  std::lock_guard<std::mutex> pt_lg(pt_latch_);
   if(!page_table_.count(page_id)){
     return false;
   }
+  return FlushFrame(page_table_[page_id]);
+}
 
-  frame_id_t f_id = page_table_[page_id];
+bool BufferPoolManagerInstance::FlushFrame(frame_id_t f_id) {
   if(!pages_[f_id].IsDirty()){
     return false;
   }
 
-  disk_manager_->WritePage(page_id, pages_[f_id].data_);
+  // Write-ahead logging: the log records describing this page must reach disk before the page does.
+  if (enable_logging && log_manager_ != nullptr) {
+    // Changes still waiting in a transaction's log arena have no lsn yet, put them into the log first.
+    log_manager_->PublishArenaOf(&pages_[f_id]);
+    lsn_t page_lsn = pages_[f_id].GetLSN();
+    if (page_lsn != INVALID_LSN && page_lsn < log_manager_->GetNextLSN() &&
+        page_lsn > log_manager_->GetPersistentLSN()) {
+      log_manager_->WaitUntilPersistent(page_lsn);
+    }
+  }
+
+  // Changes made while the page is being written set a new recLSN, they may or may not make it to disk.
+  pages_[f_id].rec_lsn_ = INVALID_LSN;
+  disk_manager_->WritePage(pages_[f_id].page_id_, pages_[f_id].data_);
   pages_[f_id].is_dirty_ = false;
   return true;
 }
@@ -70,11 +86,30 @@ void BufferPoolManagerInstance::FlushAllPgsImp() {
   std::lock_guard<std::mutex> pg_lg(pg_latch_);
   for (size_t i = 0; i < pool_size_; ++i) {
     if(pages_[i].IsDirty()){
-      FlushPgImp(pages_[i].page_id_);
+      FlushFrame(i);
     }
   }
 }
 
+std::vector<std::pair<page_id_t, lsn_t>> BufferPoolManagerInstance::GetDirtyPageTable() {
+  // A change holds its page's write latch from appending its log record until it has set the page LSN. Passing
+  // through every frame's latch once makes every change logged before this call show up in the recLSNs below.
+  for (size_t i = 0; i < pool_size_; ++i) {
+    pages_[i].RLatch();
+    pages_[i].RUnlatch();
+  }
+
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_page_table;
+  std::lock_guard<std::mutex> pg_lg(pg_latch_);
+  for (size_t i = 0; i < pool_size_; ++i) {
+    lsn_t rec_lsn = pages_[i].GetRecLSN();
+    if (pages_[i].page_id_ != INVALID_PAGE_ID && rec_lsn != INVALID_LSN) {
+      dirty_page_table.emplace_back(pages_[i].page_id_, rec_lsn);
+    }
+  }
+  return dirty_page_table;
+}
+
 // 从lru获取一个f_id，并且根据其是否为脏页刷回到磁盘中
 frame_id_t BufferPoolManagerInstance::GetPageFromLRU(){
   frame_id_t f_id; 
@@ -87,7 +122,7 @@ frame_id_t BufferPoolManagerInstance::GetPageFromLRU(){
   page_id_t p_id = pages_[f_id].GetPageId();
 
   if(pages_[f_id].IsDirty()){
-    if (!FlushPgImp(p_id)){
+    if (!FlushFrame(f_id)){
       // 刷入磁盘脏页失败
       return INVALID_PAGE_ID;
     }
@@ -116,6 +151,9 @@ Page *BufferPoolManagerInstance::NewPgImp(page_id_t *page_id) {
   // 2.   Pick a victim page P from either the free list or the replacer. Always pick from the free list first.
   // 3.   Update P's metadata, zero out memory and add P to the page table.
   // 4.   Set the page ID output parameter. Return a pointer to P.
+  // Same latch order as FetchPgImp.
+  std::lock_guard<std::mutex> pg_lg(pg_latch_);
+  std::lock_guard<std::mutex> pt_lg(pt_latch_);
   std::unique_lock<std::mutex> free_ul(free_latch_);
   frame_id_t f_id;
 
@@ -123,9 +161,6 @@ Page *BufferPoolManagerInstance::NewPgImp(page_id_t *page_id) {
     return nullptr;
   }
 
-  std::lock_guard<std::mutex> pg_lg(pg_latch_);
-  std::lock_guard<std::mutex> pt_lg(pt_latch_);
-
   if(!free_list_.empty()){
     f_id = free_list_.front();
     free_list_.pop_front();
@@ -139,6 +174,7 @@ Page *BufferPoolManagerInstance::NewPgImp(page_id_t *page_id) {
   page_id_t p_id = AllocatePage();
   pages_[f_id].ResetMemory();
   pages_[f_id].is_dirty_ = false;
+  pages_[f_id].rec_lsn_ = INVALID_LSN;
   pages_[f_id].pin_count_ = 1;
   pages_[f_id].page_id_ = p_id;
   page_table_.insert({p_id, f_id});
@@ -176,9 +212,6 @@ Page *BufferPoolManagerInstance::FetchPgImp(page_id_t page_id) {
   if ( !free_list_.empty() ){
     f_id = free_list_.front();
     free_list_.pop_front();
-    pages_[f_id].pin_count_++;
-
-    return &pages_[f_id];
   } else {
     if((f_id = GetPageFromLRU()) == INVALID_PAGE_ID){
       return nullptr;
@@ -191,11 +224,45 @@ Page *BufferPoolManagerInstance::FetchPgImp(page_id_t page_id) {
   disk_manager_->ReadPage(page_id, pages_[f_id].data_);
   pages_[f_id].pin_count_ = 1;
   pages_[f_id].is_dirty_ = false;
+  pages_[f_id].rec_lsn_ = INVALID_LSN;
   pages_[f_id].page_id_ = page_id;
 
   return &pages_[f_id];
 }
 
+void BufferPoolManagerInstance::PrefetchPgImp(page_id_t page_id) {
+  std::unique_lock<std::mutex> pg_ul(pg_latch_);
+  std::unique_lock<std::mutex> pt_ul(pt_latch_);
+  if(page_table_.count(page_id)){
+    return;
+  }
+
+  frame_id_t f_id;
+  std::unique_lock<std::mutex> free_ul(free_latch_);
+  if (!free_list_.empty()) {
+    f_id = free_list_.front();
+    free_list_.pop_front();
+  } else {
+    if((f_id = GetPageFromLRU()) == INVALID_PAGE_ID){
+      return;
+    }
+  }
+  free_ul.unlock();
+  page_table_.insert({page_id, f_id});
+  pages_[f_id].pin_count_ = 1;
+  pages_[f_id].is_dirty_ = false;
+  pages_[f_id].rec_lsn_ = INVALID_LSN;
+  pages_[f_id].page_id_ = page_id;
+  // Nobody holds the latch of a frame that was free or evicted.
+  pages_[f_id].WLatch();
+  pt_ul.unlock();
+  pg_ul.unlock();
+
+  disk_manager_->ReadPage(page_id, pages_[f_id].data_);
+  pages_[f_id].WUnlatch();
+  UnpinPgImp(page_id, false);
+}
+
 //  不需要刷盘，因为delete是一个上层调用的动作
 bool BufferPoolManagerInstance::DeletePgImp(page_id_t page_id) {
   // 0.   Make sure you call DeallocatePage!
@@ -207,6 +274,7 @@ bool BufferPoolManagerInstance::DeletePgImp(page_id_t page_id) {
   std::lock_guard<std::mutex> pt_lg(pt_latch_);
 
   if(!page_table_.count(page_id)){
+    DeallocatePage(page_id);
     return true;
   }
 
@@ -216,11 +284,14 @@ bool BufferPoolManagerInstance::DeletePgImp(page_id_t page_id) {
     return false;
   }
 
-//   disk_manager_->DeallocatePage(page_id);
+  DeallocatePage(page_id);
   pages_[f_id].ResetMemory();
   pages_[f_id].is_dirty_ = false;
+  pages_[f_id].rec_lsn_ = INVALID_LSN;
   pages_[f_id].page_id_ = INVALID_PAGE_ID;
   page_table_.erase(page_id);
+  // A free frame must not be chosen as a victim as well, once reused it would be evicted while pinned.
+  replacer_->Pin(f_id);
 
   std::lock_guard<std::mutex> free_lg(free_latch_);
   free_list_.push_back(f_id);
@@ -258,17 +329,46 @@ bool BufferPoolManagerInstance::UnpinPgImp(page_id_t page_id, bool is_dirty) {
 
   // 设置脏页或者否
   pages_[frame_id].is_dirty_ |= is_dirty;
+  // Some changes are not logged themselves (linking a table page to a new one), redo them from the page LSN on.
+  // The header page has no LSN, its recLSN is set when a root change is logged.
+  lsn_t page_lsn = page_id == HEADER_PAGE_ID ? INVALID_LSN : pages_[frame_id].GetLSN();
+  if (enable_logging && is_dirty && page_lsn != INVALID_LSN && pages_[frame_id].GetRecLSN() == INVALID_LSN) {
+    lsn_t no_rec_lsn = INVALID_LSN;
+    pages_[frame_id].rec_lsn_.compare_exchange_strong(no_rec_lsn, page_lsn);
+  }
 
   return true;
 }
 
 page_id_t BufferPoolManagerInstance::AllocatePage() {
+  if (epochs_.GetRetiredCount() > 0) {
+    epochs_.Reclaim();
+  }
+  {
+    std::scoped_lock free_page_ids_latch(free_page_ids_latch_);
+    if (!free_page_ids_.empty()) {
+      page_id_t page_id = *free_page_ids_.begin();
+      free_page_ids_.erase(free_page_ids_.begin());
+      return page_id;
+    }
+  }
   const page_id_t next_page_id = next_page_id_;
   next_page_id_ += num_instances_;
   ValidatePageId(next_page_id);
   return next_page_id;
 }
 
+void BufferPoolManagerInstance::DeallocatePage(page_id_t page_id) {
+  if (page_id < 0 || page_id >= next_page_id_) {
+    return;
+  }
+  ValidatePageId(page_id);
+  epochs_.Retire([this, page_id] {
+    std::scoped_lock free_page_ids_latch(free_page_ids_latch_);
+    free_page_ids_.insert(page_id);
+  });
+}
+
 void BufferPoolManagerInstance::ValidatePageId(const page_id_t page_id) const {
   assert(page_id % num_instances_ == instance_index_);  // allocated pages mod back to this BPI
 }
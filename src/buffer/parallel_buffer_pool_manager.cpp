@@ -27,6 +27,11 @@ size_t ParallelBufferPoolManager::GetPoolSize() {
   return 0;
 }
 
+std::vector<std::pair<page_id_t, lsn_t>> ParallelBufferPoolManager::GetDirtyPageTable() {
+  // Concatenate the dirty page tables of all BufferPoolManagerInstances
+  return {};
+}
+
 BufferPoolManager *ParallelBufferPoolManager::GetBufferPoolManager(page_id_t page_id) {
   // Get BufferPoolManager responsible for handling given page id. You can use this method in your other methods.
   return nullptr;
@@ -18,6 +18,16 @@ std::atomic<bool> enable_logging(false);
 
 std::chrono::duration<int64_t> log_timeout = std::chrono::seconds(1);
 
+std::chrono::milliseconds async_commit_delay = std::chrono::milliseconds(10);
+
+std::chrono::milliseconds checkpoint_interval = std::chrono::seconds(30);
+
+std::chrono::milliseconds replica_poll_interval = std::chrono::milliseconds(10);
+
+std::chrono::milliseconds vacuum_interval = std::chrono::seconds(1);
+
+std::chrono::milliseconds vacuum_cost_delay = std::chrono::milliseconds(10);
+
 std::chrono::milliseconds cycle_detection_interval = std::chrono::milliseconds(50);
 
 }  // namespace bustub
@@ -0,0 +1,146 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// epoch_manager.cpp
+//
+// Identification: src/common/epoch_manager.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/epoch_manager.h"
+
+#include <thread>  // NOLINT
+
+namespace bustub {
+
+void EpochGuard::Release() {
+  if (manager_ != nullptr) {
+    manager_->Exit(slot_);
+    manager_ = nullptr;
+  }
+}
+
+EpochManager::~EpochManager() {
+  for (auto &slot : slots_) {
+    for (auto &[epoch, free] : slot.retired_) {
+      free();
+    }
+  }
+}
+
+EpochGuard EpochManager::Protect() {
+  size_t slot = ClaimSlot();
+  Enter(slot);
+  return EpochGuard(this, slot);
+}
+
+void EpochManager::Retire(std::function<void()> free) {
+  size_t slot_index = ClaimSlot();
+  auto &slot = slots_[slot_index];
+  size_t retired;
+  {
+    std::scoped_lock retired_latch(slot.retired_latch_);
+    // The object is unlinked already, a reader that enters from now on cannot find it.
+    slot.retired_.emplace_back(global_epoch_.load(), std::move(free));
+    retired = slot.retired_.size();
+  }
+  retired_count_++;
+  slot.claimed_.store(false, std::memory_order_release);
+  if (retired >= static_cast<size_t>(EPOCH_RETIRE_THRESHOLD)) {
+    TryAdvance();
+    FreeSafe(&slot);
+  }
+}
+
+void EpochManager::Reclaim() {
+  TryAdvance();
+  TryAdvance();
+  for (auto &slot : slots_) {
+    FreeSafe(&slot);
+  }
+}
+
+void EpochManager::Synchronize() {
+  // A guard taken before the call announced this epoch or an older one, the epoch cannot move on twice while it is
+  // held.
+  uint64_t epoch = global_epoch_.load();
+  while (global_epoch_.load() < epoch + 2) {
+    if (!TryAdvance()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+size_t EpochManager::ClaimSlot() {
+  // A thread starts looking at the slot it had last, a free one is usually found on the first try.
+  thread_local size_t last_slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % EPOCH_SLOTS;
+  size_t slot = last_slot;
+  while (true) {
+    for (size_t i = 0; i < EPOCH_SLOTS; i++, slot = (slot + 1) % EPOCH_SLOTS) {
+      bool claimed = false;
+      auto &claimed_flag = slots_[slot].claimed_;
+      if (!claimed_flag.load(std::memory_order_relaxed) && claimed_flag.compare_exchange_strong(claimed, true)) {
+        last_slot = slot;
+        return slot;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+void EpochManager::Enter(size_t slot) {
+  // The epoch announced must still be the global one once it is visible, or the epoch could move on twice unseen.
+  uint64_t epoch = global_epoch_.load();
+  while (true) {
+    slots_[slot].epoch_.store(epoch);
+    uint64_t current = global_epoch_.load();
+    if (current == epoch) {
+      return;
+    }
+    epoch = current;
+  }
+}
+
+void EpochManager::Exit(size_t slot) {
+  slots_[slot].epoch_.store(QUIESCENT, std::memory_order_release);
+  slots_[slot].claimed_.store(false, std::memory_order_release);
+}
+
+bool EpochManager::TryAdvance() {
+  uint64_t epoch = global_epoch_.load();
+  for (const auto &slot : slots_) {
+    uint64_t announced = slot.epoch_.load();
+    if (announced != QUIESCENT && announced != epoch) {
+      return false;
+    }
+  }
+  return global_epoch_.compare_exchange_strong(epoch, epoch + 1);
+}
+
+void EpochManager::FreeSafe(Slot *slot) {
+  uint64_t epoch = global_epoch_.load();
+  std::vector<std::function<void()>> safe;
+  {
+    std::scoped_lock retired_latch(slot->retired_latch_);
+    auto &retired = slot->retired_;
+    size_t kept = 0;
+    for (auto &entry : retired) {
+      if (entry.first + 2 <= epoch) {
+        safe.push_back(std::move(entry.second));
+      } else {
+        retired[kept++] = std::move(entry);
+      }
+    }
+    retired.resize(kept);
+  }
+  // The objects are freed without the latch, freeing one may take other latches.
+  for (auto &free : safe) {
+    free();
+  }
+  retired_count_ -= safe.size();
+}
+
+}  // namespace bustub
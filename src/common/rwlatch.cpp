@@ -0,0 +1,121 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// rwlatch.cpp
+//
+// Identification: src/common/rwlatch.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/rwlatch.h"
+
+#include <algorithm>
+#include <climits>
+#include <thread>  // NOLINT
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bustub {
+
+namespace {
+
+/** Spinning only pays off if the holder of the latch can run meanwhile. */
+const bool SPIN_PAYS_OFF = std::thread::hardware_concurrency() > 1;
+
+/** Tell the CPU the thread is spinning. */
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+}  // namespace
+
+void ReaderWriterLatch::WLockSlow() {
+  int spins = 0;
+  // Enter once no other writer has, new readers wait from then on.
+  uint32_t state = state_.load(std::memory_order_relaxed);
+  while (true) {
+    if ((state & WRITER) == 0) {
+      if (state_.compare_exchange_weak(state, state | WRITER, std::memory_order_acquire)) {
+        break;
+      }
+      continue;
+    }
+    Wait(state, &spins);
+    state = state_.load(std::memory_order_relaxed);
+  }
+  // Then wait for the readers inside to leave.
+  state = state_.load(std::memory_order_acquire);
+  while ((state & READERS) != 0) {
+    Wait(state, &spins);
+    state = state_.load(std::memory_order_acquire);
+  }
+  UpdateSpinEstimate(spins);
+}
+
+void ReaderWriterLatch::RLockSlow() {
+  int spins = 0;
+  uint32_t state = state_.load(std::memory_order_relaxed);
+  while (true) {
+    if ((state & WRITER) == 0 && (state & READERS) != READERS) {
+      if (state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+        break;
+      }
+      continue;
+    }
+    Wait(state, &spins);
+    state = state_.load(std::memory_order_relaxed);
+  }
+  UpdateSpinEstimate(spins);
+}
+
+void ReaderWriterLatch::Wait(uint32_t state, int *spins) {
+  int limit = std::min(RWLATCH_SPIN_LIMIT, 2 * spin_estimate_.load(std::memory_order_relaxed) + 10);
+  if (SPIN_PAYS_OFF && *spins >= 0 && *spins < limit) {
+    ++*spins;
+    CpuRelax();
+    return;
+  }
+  *spins = -1;
+  // The thread releasing the latch only wakes anybody up if it finds PARKED set.
+  if ((state & PARKED) == 0) {
+    if (!state_.compare_exchange_strong(state, state | PARKED, std::memory_order_relaxed)) {
+      return;
+    }
+    state |= PARKED;
+  }
+  Park(state);
+}
+
+void ReaderWriterLatch::Park(uint32_t state) {
+#ifdef __linux__
+  static_assert(sizeof(state_) == sizeof(uint32_t), "a futex is a 32 bit word");
+  // Returns right away if the word does not hold state anymore.
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state_), FUTEX_WAIT_PRIVATE, state, nullptr, nullptr, 0);
+#else
+  std::this_thread::yield();
+#endif
+}
+
+void ReaderWriterLatch::WakeAll() {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+void ReaderWriterLatch::UpdateSpinEstimate(int spins) {
+  int estimate = spin_estimate_.load(std::memory_order_relaxed);
+  spin_estimate_.store(estimate + (std::max(spins, 0) - estimate) / 8, std::memory_order_relaxed);
+}
+
+}  // namespace bustub
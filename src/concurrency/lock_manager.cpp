@@ -15,28 +15,650 @@
 #include <utility>
 #include <vector>
 
+#include "common/macros.h"
+
 namespace bustub {
 
 bool LockManager::LockShared(Transaction *txn, const RID &rid) {
+  if (!CanLock(txn)) {
+    return false;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED) {
+    AbortImplicitly(txn, AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    AbortImplicitly(txn, AbortReason::LOCK_ON_SHRINKING);
+  }
+  if (txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (!Acquire(txn, rid, LockMode::SHARED, false)) {
+    return false;
+  }
   txn->GetSharedLockSet()->emplace(rid);
   return true;
 }
 
 bool LockManager::LockExclusive(Transaction *txn, const RID &rid) {
+  if (!CanLock(txn)) {
+    return false;
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    AbortImplicitly(txn, AbortReason::LOCK_ON_SHRINKING);
+  }
+  if (txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (txn->IsSharedLocked(rid)) {
+    return LockUpgrade(txn, rid);
+  }
+  if (!Acquire(txn, rid, LockMode::EXCLUSIVE, false)) {
+    return false;
+  }
   txn->GetExclusiveLockSet()->emplace(rid);
   return true;
 }
 
 bool LockManager::LockUpgrade(Transaction *txn, const RID &rid) {
-  txn->GetSharedLockSet()->erase(rid);
+  if (!CanLock(txn)) {
+    return false;
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    AbortImplicitly(txn, AbortReason::LOCK_ON_SHRINKING);
+  }
+  if (txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (!txn->IsSharedLocked(rid)) {
+    return LockExclusive(txn, rid);
+  }
+  if (!Acquire(txn, rid, LockMode::EXCLUSIVE, true)) {
+    return false;
+  }
   txn->GetExclusiveLockSet()->emplace(rid);
   return true;
 }
 
+bool LockManager::LockInstant(Transaction *txn, const RID &rid) {
+  if (!CanLock(txn)) {
+    return false;
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    AbortImplicitly(txn, AbortReason::LOCK_ON_SHRINKING);
+  }
+  if (txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (txn->IsSharedLocked(rid)) {
+    return LockUpgrade(txn, rid);
+  }
+  if (!Acquire(txn, rid, LockMode::EXCLUSIVE, false)) {
+    return false;
+  }
+  // Released right away, this does not end the growing phase.
+  ReleaseLock(txn, rid);
+  return true;
+}
+
 bool LockManager::Unlock(Transaction *txn, const RID &rid) {
+  // A read-only transaction holds no locks.
+  if (txn->IsReadOnly()) {
+    return false;
+  }
+  bool exclusive = txn->IsExclusiveLocked(rid);
   txn->GetSharedLockSet()->erase(rid);
   txn->GetExclusiveLockSet()->erase(rid);
+  if (!ReleaseLock(txn, rid)) {
+    return false;
+  }
+
+  // Under READ_COMMITTED shared locks are released early, that does not end the growing phase.
+  if (txn->GetState() == TransactionState::GROWING && (exclusive || txn->HoldsSharedLocks())) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  return true;
+}
+
+bool LockManager::LockTable(Transaction *txn, LockMode lock_mode, table_oid_t oid) {
+  if (!CanLock(txn)) {
+    return false;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED && lock_mode != LockMode::EXCLUSIVE &&
+      lock_mode != LockMode::INTENTION_EXCLUSIVE) {
+    AbortImplicitly(txn, AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    AbortImplicitly(txn, AbortReason::LOCK_ON_SHRINKING);
+  }
+
+  auto table_locks = txn->GetTableLockMap();
+  auto held = table_locks->find(oid);
+  bool upgrade = held != table_locks->end();
+  if (upgrade) {
+    if (Covers(held->second, lock_mode)) {
+      return true;
+    }
+    // Upgrade to the weakest mode that covers both.
+    for (auto mode : {LockMode::SHARED, LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE,
+                      LockMode::EXCLUSIVE}) {
+      if (Covers(mode, held->second) && Covers(mode, lock_mode)) {
+        lock_mode = mode;
+        break;
+      }
+    }
+  }
+  if (!Acquire(txn, TableKey(oid), lock_mode, upgrade)) {
+    return false;
+  }
+  (*table_locks)[oid] = lock_mode;
+  return true;
+}
+
+bool LockManager::UnlockTable(Transaction *txn, table_oid_t oid) {
+  // A read-only transaction holds no locks.
+  if (txn->IsReadOnly()) {
+    return false;
+  }
+  auto table_locks = txn->GetTableLockMap();
+  auto held = table_locks->find(oid);
+  if (held == table_locks->end()) {
+    return false;
+  }
+  auto rows = txn->GetRowLockMap()->find(oid);
+  if (rows != txn->GetRowLockMap()->end() && !rows->second.empty()) {
+    AbortImplicitly(txn, AbortReason::TABLE_UNLOCKED_BEFORE_UNLOCKING_ROWS);
+  }
+  auto lock_mode = held->second;
+  table_locks->erase(held);
+  if (!ReleaseLock(txn, TableKey(oid))) {
+    return false;
+  }
+
+  if (txn->GetState() == TransactionState::GROWING &&
+      (lock_mode == LockMode::EXCLUSIVE ||
+       (txn->HoldsSharedLocks() &&
+        (lock_mode == LockMode::SHARED || lock_mode == LockMode::SHARED_INTENTION_EXCLUSIVE)))) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  return true;
+}
+
+bool LockManager::LockRow(Transaction *txn, LockMode lock_mode, table_oid_t oid, const RID &rid) {
+  if (lock_mode != LockMode::SHARED && lock_mode != LockMode::EXCLUSIVE) {
+    AbortImplicitly(txn, AbortReason::ATTEMPTED_INTENTION_LOCK_ON_ROW);
+  }
+  if (!CanLock(txn)) {
+    return false;
+  }
+  auto table_locks = txn->GetTableLockMap();
+  auto held = table_locks->find(oid);
+  if (held != table_locks->end() && Covers(held->second, lock_mode)) {
+    return true;
+  }
+
+  auto intention = lock_mode == LockMode::SHARED ? LockMode::INTENTION_SHARED : LockMode::INTENTION_EXCLUSIVE;
+  if (!LockTable(txn, intention, oid)) {
+    return false;
+  }
+  if (!(lock_mode == LockMode::SHARED ? LockShared(txn, rid) : LockExclusive(txn, rid))) {
+    return false;
+  }
+  auto &rows = (*txn->GetRowLockMap())[oid];
+  rows.emplace(rid);
+  if (rows.size() > escalation_threshold_) {
+    Escalate(txn, oid);
+  }
+  return true;
+}
+
+bool LockManager::UnlockRow(Transaction *txn, table_oid_t oid, const RID &rid) {
+  // A read-only transaction holds no locks.
+  if (txn->IsReadOnly()) {
+    return false;
+  }
+  auto rows = txn->GetRowLockMap()->find(oid);
+  if (rows != txn->GetRowLockMap()->end()) {
+    rows->second.erase(rid);
+  }
+  return Unlock(txn, rid);
+}
+
+void LockManager::Escalate(Transaction *txn, table_oid_t oid) {
+  auto &rows = (*txn->GetRowLockMap())[oid];
+  bool exclusive =
+      std::any_of(rows.begin(), rows.end(), [txn](const RID &rid) { return txn->IsExclusiveLocked(rid); });
+  // Under IX, shared rows are covered by SIX, which leaves the transaction free to lock more rows exclusively.
+  auto lock_mode = LockMode::SHARED;
+  if (exclusive) {
+    lock_mode = LockMode::EXCLUSIVE;
+  } else if (txn->GetTableLockMap()->at(oid) == LockMode::INTENTION_EXCLUSIVE) {
+    lock_mode = LockMode::SHARED_INTENTION_EXCLUSIVE;
+  }
+  if (!LockTable(txn, lock_mode, oid)) {
+    return;
+  }
+  for (const auto &rid : rows) {
+    txn->GetSharedLockSet()->erase(rid);
+    txn->GetExclusiveLockSet()->erase(rid);
+    ReleaseLock(txn, rid);
+  }
+  rows.clear();
+  escalation_count_++;
+}
+
+bool LockManager::ReleaseLock(Transaction *txn, const RID &rid) {
+  auto *partition = GetPartition(rid);
+  std::scoped_lock partition_latch(partition->latch_);
+  auto queue = partition->lock_table_.find(rid);
+  if (queue == partition->lock_table_.end()) {
+    return false;
+  }
+  auto &requests = queue->second.request_queue_;
+  auto request = std::find_if(requests.begin(), requests.end(), [txn](const LockRequest &lock_request) {
+    return lock_request.txn_id_ == txn->GetTransactionId();
+  });
+  if (request == requests.end() || !request->granted_) {
+    return false;
+  }
+  Release(partition, rid, &queue->second, request);
+  return true;
+}
+
+bool LockManager::Acquire(Transaction *txn, const RID &rid, LockMode lock_mode, bool upgrade) {
+  auto *partition = GetPartition(rid);
+  std::unique_lock partition_latch(partition->latch_);
+  auto *queue = GetQueue(partition, rid);
+  auto &requests = queue->request_queue_;
+  txn_id_t txn_id = txn->GetTransactionId();
+
+  auto position = requests.end();
+  if (upgrade) {
+    if (queue->upgrading_ != INVALID_TXN_ID) {
+      partition_latch.unlock();
+      AbortImplicitly(txn, AbortReason::UPGRADE_CONFLICT);
+    }
+    // Give up the lock held and wait in front of every request that has not been granted yet.
+    auto held = std::find_if(requests.begin(), requests.end(),
+                             [txn_id](const LockRequest &lock_request) { return lock_request.txn_id_ == txn_id; });
+    BUSTUB_ASSERT(held != requests.end() && held->granted_, "An upgrade needs a granted lock.");
+    partition->free_requests_.splice(partition->free_requests_.end(), requests, held);
+    if (rid.GetPageId() == INVALID_PAGE_ID) {
+      txn->GetTableLockMap()->erase(rid.GetSlotNum());
+    } else {
+      txn->GetSharedLockSet()->erase(rid);
+    }
+    position = std::find_if(requests.begin(), requests.end(),
+                            [](const LockRequest &lock_request) { return !lock_request.granted_; });
+    queue->upgrading_ = txn_id;
+  }
+
+  std::list<LockRequest>::iterator request;
+  if (partition->free_requests_.empty()) {
+    request = requests.emplace(position, txn, lock_mode);
+  } else {
+    request = partition->free_requests_.begin();
+    requests.splice(position, partition->free_requests_, request);
+    *request = LockRequest(txn, lock_mode);
+  }
+
+  if (!IsGrantable(*queue, request)) {
+    request->since_ = std::chrono::steady_clock::now();
+    waiting_count_++;
+    // The deadlock detector aborts the transaction to wake it up.
+    queue->cv_.wait(partition_latch, [&] {
+      return txn->GetState() == TransactionState::ABORTED || IsGrantable(*queue, request);
+    });
+    waiting_count_--;
+  }
+  if (upgrade) {
+    queue->upgrading_ = INVALID_TXN_ID;
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    Release(partition, rid, queue, request);
+    partition_latch.unlock();
+    throw TransactionAbortException(txn_id, AbortReason::DEADLOCK);
+  }
+  request->granted_ = true;
+  return true;
+}
+
+LockManager::LockRequestQueue *LockManager::GetQueue(LockTablePartition *partition, const RID &rid) {
+  auto queue = partition->lock_table_.find(rid);
+  if (queue != partition->lock_table_.end()) {
+    return &queue->second;
+  }
+  if (partition->free_queues_.empty()) {
+    return &partition->lock_table_[rid];
+  }
+  auto node = std::move(partition->free_queues_.back());
+  partition->free_queues_.pop_back();
+  node.key() = rid;
+  return &partition->lock_table_.insert(std::move(node)).position->second;
+}
+
+void LockManager::Release(LockTablePartition *partition, const RID &rid, LockRequestQueue *queue,
+                          std::list<LockRequest>::iterator request) {
+  auto &requests = queue->request_queue_;
+  if (partition->free_requests_.size() < LOCK_POOL_SIZE) {
+    partition->free_requests_.splice(partition->free_requests_.end(), requests, request);
+  } else {
+    requests.erase(request);
+  }
+
+  if (!requests.empty()) {
+    queue->cv_.notify_all();
+    return;
+  }
+  // Nobody waits on the queue, it can go back to the pool.
+  if (partition->free_queues_.size() < LOCK_POOL_SIZE) {
+    partition->free_queues_.emplace_back(partition->lock_table_.extract(rid));
+  } else {
+    partition->lock_table_.erase(rid);
+  }
+}
+
+bool LockManager::IsGrantable(const LockRequestQueue &queue, std::list<LockRequest>::iterator request) {
+  for (auto ahead = queue.request_queue_.begin(); ahead != request; ++ahead) {
+    if (!AreCompatible(ahead->lock_mode_, request->lock_mode_)) {
+      return false;
+    }
+  }
   return true;
 }
 
+bool LockManager::Covers(LockMode held, LockMode wanted) {
+  switch (held) {
+    case LockMode::EXCLUSIVE:
+      return true;
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return wanted != LockMode::EXCLUSIVE;
+    case LockMode::SHARED:
+    case LockMode::INTENTION_EXCLUSIVE:
+      return wanted == held || wanted == LockMode::INTENTION_SHARED;
+    case LockMode::INTENTION_SHARED:
+      return wanted == held;
+  }
+  return false;
+}
+
+bool LockManager::AreCompatible(LockMode first, LockMode second) {
+  switch (first) {
+    case LockMode::INTENTION_SHARED:
+      return second != LockMode::EXCLUSIVE;
+    case LockMode::INTENTION_EXCLUSIVE:
+      return second == LockMode::INTENTION_SHARED || second == LockMode::INTENTION_EXCLUSIVE;
+    case LockMode::SHARED:
+      return second == LockMode::INTENTION_SHARED || second == LockMode::SHARED;
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return second == LockMode::INTENTION_SHARED;
+    case LockMode::EXCLUSIVE:
+      return false;
+  }
+  return false;
+}
+
+bool LockManager::CanLock(Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+  }
+  return txn->GetState() != TransactionState::ABORTED;
+}
+
+void LockManager::AbortImplicitly(Transaction *txn, AbortReason abort_reason) {
+  txn->SetState(TransactionState::ABORTED);
+  throw TransactionAbortException(txn->GetTransactionId(), abort_reason);
+}
+
+void LockManager::RunCycleDetection() {
+  std::scoped_lock scoped_latch(latch_);
+  if (cycle_detection_thread_ != nullptr) {
+    return;
+  }
+  stop_requested_ = false;
+  cycle_detection_thread_ = new std::thread(&LockManager::CycleDetectionLoop, this);
+}
+
+void LockManager::StopCycleDetection() {
+  {
+    std::scoped_lock scoped_latch(latch_);
+    if (cycle_detection_thread_ == nullptr) {
+      return;
+    }
+    stop_requested_ = true;
+  }
+  cv_.notify_one();
+  cycle_detection_thread_->join();
+  delete cycle_detection_thread_;
+  cycle_detection_thread_ = nullptr;
+}
+
+void LockManager::CycleDetectionLoop() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (!cv_.wait_for(lock, cycle_detection_interval, [this] { return stop_requested_; })) {
+    if (waiting_count_ == 0) {
+      continue;
+    }
+    lock.unlock();
+    BreakDeadlocks();
+    lock.lock();
+  }
+}
+
+void LockManager::AddEdge(txn_id_t t1, txn_id_t t2) {
+  std::scoped_lock graph_latch(graph_latch_);
+  auto &edges = waits_for_[t1];
+  auto edge = std::lower_bound(edges.begin(), edges.end(), t2);
+  if (edge == edges.end() || *edge != t2) {
+    edges.insert(edge, t2);
+  }
+  // A new edge can close a cycle anywhere.
+  acyclic_.clear();
+  search_order_.clear();
+  PublishEdgeList();
+}
+
+void LockManager::RemoveEdge(txn_id_t t1, txn_id_t t2) {
+  std::scoped_lock graph_latch(graph_latch_);
+  auto edges = waits_for_.find(t1);
+  if (edges == waits_for_.end()) {
+    return;
+  }
+  auto edge = std::lower_bound(edges->second.begin(), edges->second.end(), t2);
+  if (edge != edges->second.end() && *edge == t2) {
+    edges->second.erase(edge);
+    PublishEdgeList();
+  }
+}
+
+bool LockManager::HasCycle(txn_id_t *txn_id) {
+  std::scoped_lock graph_latch(graph_latch_);
+  std::vector<txn_id_t> cycle;
+  if (!FindCycle(&cycle)) {
+    return false;
+  }
+  *txn_id = *std::max_element(cycle.begin(), cycle.end());
+  return true;
+}
+
+std::vector<std::pair<txn_id_t, txn_id_t>> LockManager::GetEdgeList() {
+  auto guard = epochs_.Protect();
+  return *edge_list_.load();
+}
+
+void LockManager::PublishEdgeList() {
+  auto *edge_list = new std::vector<std::pair<txn_id_t, txn_id_t>>();
+  for (const auto &[t1, edges] : waits_for_) {
+    for (auto t2 : edges) {
+      edge_list->emplace_back(t1, t2);
+    }
+  }
+  std::sort(edge_list->begin(), edge_list->end());
+  epochs_.RetireObject(edge_list_.exchange(edge_list));
+}
+
+void LockManager::BreakDeadlocks() {
+  std::scoped_lock graph_latch(graph_latch_);
+  waits_for_.clear();
+  waiters_.clear();
+  acyclic_.clear();
+  search_order_.clear();
+  // The graph is put together one partition at a time. A deadlock stays put until it is broken, so every edge of it is
+  // found, but an edge may be gone by the time a later partition is read: every cycle is checked again before a
+  // transaction on it is aborted.
+  for (auto &partition : partitions_) {
+    std::scoped_lock partition_latch(partition.latch_);
+    for (const auto &[rid, queue] : partition.lock_table_) {
+      AddQueueEdges(rid, queue);
+    }
+  }
+  for (auto &[txn_id, edges] : waits_for_) {
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  }
+
+  std::vector<txn_id_t> cycle;
+  while (FindCycle(&cycle)) {
+    AbortCycle(cycle);
+  }
+  PublishEdgeList();
+}
+
+void LockManager::AddQueueEdges(const RID &rid, const LockRequestQueue &queue) {
+  // A request waits for the requests ahead of it it conflicts with. An exclusive request that waits conflicts with
+  // everything ahead of it, so the requests behind it only get edges as far as it: every cycle through the requests
+  // further ahead also goes through the exclusive one.
+  auto &requests = queue.request_queue_;
+  auto from = requests.begin();
+  for (auto request = requests.begin(); request != requests.end(); ++request) {
+    if (request->granted_) {
+      continue;
+    }
+    auto &edges = waits_for_[request->txn_id_];
+    waiters_[request->txn_id_] = {rid, request->since_};
+    for (auto ahead = from; ahead != request; ++ahead) {
+      if (!AreCompatible(ahead->lock_mode_, request->lock_mode_)) {
+        edges.push_back(ahead->txn_id_);
+      }
+    }
+    if (request->lock_mode_ == LockMode::EXCLUSIVE) {
+      from = request;
+    }
+  }
+}
+
+bool LockManager::FindCycle(std::vector<txn_id_t> *cycle) {
+  if (search_order_.empty()) {
+    for (const auto &[txn_id, edges] : waits_for_) {
+      search_order_.push_back(txn_id);
+    }
+    std::sort(search_order_.begin(), search_order_.end());
+    search_from_ = 0;
+  }
+
+  // Depth-first search without recursion: the path holds every transaction on it with the index of its next edge.
+  std::vector<std::pair<txn_id_t, size_t>> path;
+  std::unordered_map<txn_id_t, size_t> on_path;
+  for (; search_from_ < search_order_.size(); search_from_++) {
+    auto start = search_order_[search_from_];
+    if (acyclic_.count(start) != 0) {
+      continue;
+    }
+    path.emplace_back(start, 0);
+    on_path[start] = 0;
+    while (!path.empty()) {
+      auto txn_id = path.back().first;
+      auto edges = waits_for_.find(txn_id);
+      if (edges == waits_for_.end() || path.back().second == edges->second.size()) {
+        acyclic_.insert(txn_id);
+        on_path.erase(txn_id);
+        path.pop_back();
+        continue;
+      }
+      auto next = edges->second[path.back().second++];
+      if (acyclic_.count(next) != 0) {
+        continue;
+      }
+      auto on_cycle = on_path.find(next);
+      if (on_cycle != on_path.end()) {
+        cycle->clear();
+        for (auto i = on_cycle->second; i < path.size(); i++) {
+          cycle->push_back(path[i].first);
+        }
+        return true;
+      }
+      on_path[next] = path.size();
+      path.emplace_back(next, 0);
+    }
+  }
+  return false;
+}
+
+void LockManager::AbortCycle(const std::vector<txn_id_t> &cycle) {
+  // Every partition the cycle waits in is latched at once, in the order of the partitions. Nothing else holds more
+  // than one partition latch.
+  std::vector<LockTablePartition *> partitions;
+  for (auto txn_id : cycle) {
+    partitions.push_back(GetPartition(waiters_[txn_id].rid_));
+  }
+  std::sort(partitions.begin(), partitions.end());
+  partitions.erase(std::unique(partitions.begin(), partitions.end()), partitions.end());
+  std::vector<std::unique_lock<std::mutex>> partition_latches;
+  partition_latches.reserve(partitions.size());
+  for (auto *partition : partitions) {
+    partition_latches.emplace_back(partition->latch_);
+  }
+
+  // A transaction waits for the next one on the cycle, the last one for the first.
+  std::vector<std::pair<LockRequestQueue *, LockRequest *>> waits;
+  for (size_t i = 0; i < cycle.size(); i++) {
+    auto holder = cycle[(i + 1) % cycle.size()];
+    auto wait = FindWait(cycle[i], holder);
+    if (wait.second == nullptr) {
+      // The edge is stale, the cycle was never there.
+      auto &edges = waits_for_[cycle[i]];
+      edges.erase(std::lower_bound(edges.begin(), edges.end(), holder));
+      return;
+    }
+    waits.push_back(wait);
+  }
+
+  // The deadlock began with the last wait on its cycle.
+  auto victim = std::max_element(cycle.begin(), cycle.end()) - cycle.begin();
+  auto began = waits.front().second->since_;
+  for (const auto &wait : waits) {
+    began = std::max(began, wait.second->since_);
+  }
+  auto lasted = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - began);
+  deadlock_count_++;
+  deadlock_time_ += lasted.count();
+  max_deadlock_time_ = std::max<int64_t>(max_deadlock_time_, lasted.count());
+  // While its request waits, the transaction cannot go away. Without its edges, it is on no cycle anymore.
+  waits[victim].second->txn_->SetState(TransactionState::ABORTED);
+  waits[victim].first->cv_.notify_all();
+  waits_for_.erase(cycle[victim]);
+}
+
+std::pair<LockManager::LockRequestQueue *, LockManager::LockRequest *> LockManager::FindWait(txn_id_t txn_id,
+                                                                                             txn_id_t holder) {
+  const auto &rid = waiters_[txn_id].rid_;
+  auto *partition = GetPartition(rid);
+  auto queue = partition->lock_table_.find(rid);
+  if (queue == partition->lock_table_.end()) {
+    return {nullptr, nullptr};
+  }
+  auto &requests = queue->second.request_queue_;
+  auto request = std::find_if(requests.begin(), requests.end(),
+                              [txn_id](const LockRequest &lock_request) { return lock_request.txn_id_ == txn_id; });
+  if (request == requests.end() || request->granted_) {
+    return {nullptr, nullptr};
+  }
+  bool waits = std::any_of(requests.begin(), request, [&](const LockRequest &ahead) {
+    return ahead.txn_id_ == holder && !AreCompatible(ahead.lock_mode_, request->lock_mode_);
+  });
+  if (!waits) {
+    return {nullptr, nullptr};
+  }
+  return {&queue->second, &*request};
+}
+
 }  // namespace bustub
@@ -12,35 +12,92 @@
 
 #include "concurrency/transaction_manager.h"
 
+#include <algorithm>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 #include "catalog/catalog.h"
 #include "storage/table/table_heap.h"
 
 namespace bustub {
 
-std::unordered_map<txn_id_t, Transaction *> TransactionManager::txn_map = {};
-std::shared_mutex TransactionManager::txn_map_mutex = {};
-
 Transaction *TransactionManager::Begin(Transaction *txn, IsolationLevel isolation_level) {
-  // Acquire the global transaction latch in shared mode.
-  global_txn_latch_.RLock();
-
   if (txn == nullptr) {
     txn = new Transaction(next_txn_id_++, isolation_level);
   }
-  txn_map_mutex.lock();
-  txn_map[txn->GetTransactionId()] = txn;
-  txn_map_mutex.unlock();
+  // Hold off checkpoints until the transaction finishes, through the barrier of its shard only.
+  txns_.EnterBarrier(txn->GetTransactionId());
+  lsn_t begin_lsn = INVALID_LSN;
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::BEGIN);
+    begin_lsn = log_manager_->AppendLogRecord(&log_record);
+    txn->SetPrevLSN(begin_lsn);
+  }
+  // The snapshot is taken under the latch of its shard, so that the vacuum either sees the transaction or an older
+  // snapshot.
+  txns_.Add(txn, begin_lsn, last_commit_ts_);
+  return txn;
+}
+
+Transaction *TransactionManager::BeginReadOnly(Transaction *txn, IsolationLevel isolation_level) {
+  BUSTUB_ASSERT(isolation_level == IsolationLevel::SNAPSHOT_ISOLATION ||
+                    isolation_level == IsolationLevel::READ_COMMITTED,
+                "A read-only transaction reads a snapshot or the latest committed versions.");
+  if (txn == nullptr) {
+    txn = new Transaction(next_txn_id_++, isolation_level, true);
+  }
+  BUSTUB_ASSERT(txn->IsReadOnly(), "The transaction was not declared read-only.");
+  std::scoped_lock read_only_latch(read_only_latch_);
+  txn->SetReadTs(last_commit_ts_.load());
+  read_only_snapshots_[txn->GetReadTs()]++;
   return txn;
 }
 
-void TransactionManager::Commit(Transaction *txn) {
+bool TransactionManager::Commit(Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    EndReadOnly(txn, TransactionState::COMMITTED);
+    return true;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC && !CommitOptimistic(txn)) {
+    return false;
+  }
+  auto write_set = txn->GetWriteSet();
+  // First committer wins: a snapshot may not overwrite a version committed after it was taken.
+  if (txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION) {
+    for (const auto &item : *write_set) {
+      if (item.table_->GetVersionStore()->HasWriteConflict(item.rid_, txn)) {
+        Abort(txn);
+        return false;
+      }
+    }
+  }
   txn->SetState(TransactionState::COMMITTED);
 
+  // Stamp the new versions, a snapshot taken before the commit timestamp is published keeps reading the old ones.
+  {
+    std::scoped_lock commit_latch(commit_latch_);
+    timestamp_t commit_ts = last_commit_ts_.load() + 1;
+    for (const auto &item : *write_set) {
+      item.table_->GetVersionStore()->Commit(item.rid_, txn, commit_ts);
+    }
+    txn->SetCommitTs(commit_ts);
+    last_commit_ts_.store(commit_ts);
+  }
+
+  // The rows written, whose replaced versions are dropped once the transaction is gone if no snapshot needs them.
+  std::vector<std::pair<VersionStore *, RID>> written;
+  std::unordered_set<RID> deleted;
+  written.reserve(write_set->size());
+  for (const auto &item : *write_set) {
+    written.emplace_back(item.table_->GetVersionStore(), item.rid_);
+    if (item.wtype_ == WType::DELETE) {
+      deleted.insert(item.rid_);
+    }
+  }
+
   // Perform all deletes before we commit.
-  auto write_set = txn->GetWriteSet();
   while (!write_set->empty()) {
     auto &item = write_set->back();
     auto table = item.table_;
@@ -52,16 +109,121 @@ void TransactionManager::Commit(Transaction *txn) {
   }
   write_set->clear();
 
+  if (enable_logging) {
+    // The COMMIT record goes into the log together with whatever is left in the transaction's log arena.
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::COMMIT);
+    log_manager_->AppendToArena(txn, &log_record, nullptr);
+    lsn_t lsn = log_manager_->PublishArena(txn);
+    log_manager_->ReleaseArena(txn->GetLogArena());
+    if (txn->IsAsyncCommit()) {
+      // Acknowledged right away, the flush thread writes the record out within async_commit_delay.
+      log_manager_->FlushWithinDelay(lsn);
+    } else {
+      // The commit is only acknowledged once its record is durable. Concurrent commits share the same flush.
+      log_manager_->WaitUntilPersistent(lsn);
+    }
+  }
+
+  // Only leave the active transaction table once the final record is logged, a checkpoint must not miss a loser.
+  txns_.Remove(txn->GetTransactionId());
   // Release all the locks.
   ReleaseLocks(txn);
-  // Release the global transaction latch.
-  global_txn_latch_.RUnlock();
+  // Without a snapshot older than the commit, nobody reads the replaced versions anymore.
+  if (!written.empty()) {
+    timestamp_t oldest_ts = GetOldestReadTs();
+    for (const auto &[versions, rid] : written) {
+      versions->Trim(rid, oldest_ts, deleted.count(rid) != 0);
+    }
+  }
+  txns_.LeaveBarrier(txn->GetTransactionId());
+  return true;
+}
+
+bool TransactionManager::CommitOptimistic(Transaction *txn) {
+  auto write_set = txn->GetWriteSet();
+  // The words of the written rows are locked in one global order, so that committing writers cannot deadlock.
+  std::vector<std::pair<TableHeap *, size_t>> locked;
+  for (const auto &item : *write_set) {
+    locked.emplace_back(item.table_, RecordVersionTable::WordOf(item.rid_));
+  }
+  std::sort(locked.begin(), locked.end());
+  locked.erase(std::unique(locked.begin(), locked.end()), locked.end());
+  for (const auto &[table, word] : locked) {
+    table->GetRecordVersions()->Lock(word);
+  }
+
+  // Every row read is still at the version read, and no other writer is about to change it.
+  bool valid = true;
+  for (const auto &read : *txn->GetReadSet()) {
+    size_t word = RecordVersionTable::WordOf(read.rid_);
+    uint64_t version = read.table_->GetRecordVersions()->Read(word);
+    if ((version & ~RecordVersionTable::LOCK_BIT) != read.version_ ||
+        ((version & RecordVersionTable::LOCK_BIT) != 0 &&
+         !std::binary_search(locked.begin(), locked.end(), std::make_pair(read.table_, word)))) {
+      valid = false;
+      break;
+    }
+  }
+  txn->GetReadSet()->clear();
+  if (!valid) {
+    for (const auto &[table, word] : locked) {
+      table->GetRecordVersions()->Unlock(word, false);
+    }
+    Abort(txn);
+    return false;
+  }
+
+  // Install the buffered writes. The write set ends up holding what rolls back the installed ones, and the hidden
+  // inserts, should an install fail.
+  std::deque<TableWriteRecord> buffered;
+  buffered.swap(*write_set);
+  bool installed = true;
+  for (auto &item : buffered) {
+    if (installed) {
+      installed = item.table_->InstallWrite(&item, txn);
+      if (installed) {
+        write_set->push_back(item);
+        continue;
+      }
+    }
+    if (item.wtype_ == WType::INSERT) {
+      write_set->push_back(item);
+    }
+  }
+  if (!installed) {
+    txn->SetState(TransactionState::ABORTED);
+    Rollback(txn);
+  }
+  for (const auto &[table, word] : locked) {
+    table->GetRecordVersions()->Unlock(word, true);
+  }
+  return installed;
 }
 
 void TransactionManager::Abort(Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    EndReadOnly(txn, TransactionState::ABORTED);
+    return;
+  }
+  // The updates and deletes of an optimistic transaction never left its write set, only its inserts are undone.
+  if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC) {
+    auto write_set = txn->GetWriteSet();
+    write_set->erase(std::remove_if(write_set->begin(), write_set->end(),
+                                    [](const TableWriteRecord &item) { return item.wtype_ != WType::INSERT; }),
+                     write_set->end());
+    txn->GetReadSet()->clear();
+  }
   txn->SetState(TransactionState::ABORTED);
+  Rollback(txn);
+}
+
+void TransactionManager::Rollback(Transaction *txn) {
   // Rollback before releasing the lock.
   auto table_write_set = txn->GetWriteSet();
+  std::vector<std::pair<TableHeap *, RID>> written;
+  for (const auto &item : *table_write_set) {
+    written.emplace_back(item.table_, item.rid_);
+  }
   while (!table_write_set->empty()) {
     auto &item = table_write_set->back();
     auto table = item.table_;
@@ -76,6 +238,10 @@ void TransactionManager::Abort(Transaction *txn) {
     table_write_set->pop_back();
   }
   table_write_set->clear();
+  // The pages hold the versions the transaction replaced again.
+  for (const auto &[table, rid] : written) {
+    table->GetVersionStore()->Abort(rid, txn);
+  }
   // Rollback index updates
   auto index_write_set = txn->GetIndexWriteSet();
   while (!index_write_set->empty()) {
@@ -102,14 +268,59 @@ void TransactionManager::Abort(Transaction *txn) {
   table_write_set->clear();
   index_write_set->clear();
 
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ABORT);
+    log_manager_->AppendToArena(txn, &log_record, nullptr);
+    log_manager_->PublishArena(txn);
+    log_manager_->ReleaseArena(txn->GetLogArena());
+  }
+
+  // Only leave the active transaction table once the final record is logged, a checkpoint must not miss a loser.
+  txns_.Remove(txn->GetTransactionId());
   // Release all the locks.
   ReleaseLocks(txn);
-  // Release the global transaction latch.
-  global_txn_latch_.RUnlock();
+  txns_.LeaveBarrier(txn->GetTransactionId());
+}
+
+void TransactionManager::EndReadOnly(Transaction *txn, TransactionState state) {
+  txn->SetState(state);
+  std::scoped_lock read_only_latch(read_only_latch_);
+  auto snapshot = read_only_snapshots_.find(txn->GetReadTs());
+  if (--snapshot->second == 0) {
+    read_only_snapshots_.erase(snapshot);
+  }
 }
 
-void TransactionManager::BlockAllTransactions() { global_txn_latch_.WLock(); }
+void TransactionManager::BlockAllTransactions() { txns_.CloseBarriers(); }
 
-void TransactionManager::ResumeTransactions() { global_txn_latch_.WUnlock(); }
+void TransactionManager::ResumeTransactions() { txns_.OpenBarriers(); }
+
+std::vector<std::pair<txn_id_t, lsn_t>> TransactionManager::GetActiveTransactionTable(lsn_t *oldest_lsn) {
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txn_table;
+  *oldest_lsn = INVALID_LSN;
+  txns_.ForEach([&](Transaction *txn, lsn_t begin_lsn) {
+    active_txn_table.emplace_back(txn->GetTransactionId(), txn->GetPrevLSN());
+    if (begin_lsn != INVALID_LSN && (*oldest_lsn == INVALID_LSN || begin_lsn < *oldest_lsn)) {
+      *oldest_lsn = begin_lsn;
+    }
+  });
+  return active_txn_table;
+}
+
+timestamp_t TransactionManager::GetOldestReadTs() {
+  // A transaction the scan misses began after the last commit timestamp was read, it reads as of that one or later.
+  timestamp_t oldest_ts = last_commit_ts_.load();
+  // Transactions that lock what they read never read an older version.
+  txns_.ForEach([&oldest_ts](Transaction *txn, lsn_t) {
+    if (txn->ReadsVersions()) {
+      oldest_ts = std::min(oldest_ts, txn->GetReadTs());
+    }
+  });
+  std::scoped_lock read_only_latch(read_only_latch_);
+  if (!read_only_snapshots_.empty()) {
+    oldest_ts = std::min(oldest_ts, read_only_snapshots_.begin()->first);
+  }
+  return oldest_ts;
+}
 
 }  // namespace bustub
@@ -0,0 +1,87 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry.cpp
+//
+// Identification: src/concurrency/transaction_registry.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "concurrency/transaction_registry.h"
+
+#include <utility>
+
+namespace bustub {
+
+TransactionRegistry::~TransactionRegistry() {
+  for (auto &shard : shards_) {
+    for (auto &chain : shard.chains_) {
+      for (auto *entry = chain.load(); entry != nullptr;) {
+        auto *next = entry->next_.load();
+        delete entry;
+        entry = next;
+      }
+    }
+  }
+}
+
+void TransactionRegistry::Add(Transaction *txn, lsn_t begin_lsn, const std::atomic<timestamp_t> &last_commit_ts) {
+  auto *shard = ShardOf(txn->GetTransactionId());
+  auto *chain = ChainOf(shard, txn->GetTransactionId());
+  std::scoped_lock shard_latch(shard->latch_);
+  txn->SetReadTs(last_commit_ts.load());
+  // The entry is complete before it is linked in, a Find that sees it sees all of it.
+  chain->store(new Entry{txn->GetTransactionId(), txn, begin_lsn, {chain->load()}});
+}
+
+void TransactionRegistry::Remove(txn_id_t txn_id) {
+  auto *shard = ShardOf(txn_id);
+  std::scoped_lock shard_latch(shard->latch_);
+  for (auto *link = ChainOf(shard, txn_id); link->load() != nullptr; link = &link->load()->next_) {
+    auto *entry = link->load();
+    if (entry->txn_id_ == txn_id) {
+      // A Find standing on the entry still follows its link to the rest of the chain.
+      link->store(entry->next_.load());
+      epochs_.RetireObject(entry);
+      return;
+    }
+  }
+}
+
+TransactionHandle TransactionRegistry::Find(txn_id_t txn_id) {
+  auto guard = epochs_.Protect();
+  for (auto *entry = ChainOf(ShardOf(txn_id), txn_id)->load(); entry != nullptr; entry = entry->next_.load()) {
+    if (entry->txn_id_ == txn_id) {
+      return TransactionHandle(std::move(guard), entry->txn_);
+    }
+  }
+  return TransactionHandle(std::move(guard), nullptr);
+}
+
+void TransactionRegistry::ForEach(const std::function<void(Transaction *, lsn_t)> &visit) {
+  for (auto &shard : shards_) {
+    std::scoped_lock shard_latch(shard.latch_);
+    for (auto &chain : shard.chains_) {
+      for (auto *entry = chain.load(); entry != nullptr; entry = entry->next_.load()) {
+        visit(entry->txn_, entry->begin_lsn_);
+      }
+    }
+  }
+}
+
+void TransactionRegistry::CloseBarriers() {
+  for (auto &shard : shards_) {
+    shard.barrier_.WLock();
+  }
+}
+
+void TransactionRegistry::OpenBarriers() {
+  for (auto &shard : shards_) {
+    shard.barrier_.WUnlock();
+  }
+}
+
+}  // namespace bustub
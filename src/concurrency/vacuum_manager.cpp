@@ -0,0 +1,117 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// vacuum_manager.cpp
+//
+// Identification: src/concurrency/vacuum_manager.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "concurrency/vacuum_manager.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace bustub {
+
+void VacuumManager::AddTable(TableHeap *table, const Schema *schema, std::vector<Index *> indexes) {
+  std::scoped_lock vacuum_latch(vacuum_latch_);
+  table->GetVersionStore()->KeepDeletedVersions();
+  targets_.push_back({table, schema, std::move(indexes)});
+}
+
+void VacuumManager::Vacuum() {
+  std::scoped_lock vacuum_latch(vacuum_latch_);
+  // The pages unlinked by the last round had a whole round for everyone to leave them. A page still pinned is tried
+  // again next time.
+  std::vector<page_id_t> pinned_pages;
+  for (auto page_id : unlinked_pages_) {
+    if (buffer_pool_manager_->DeletePage(page_id)) {
+      freed_page_count_++;
+    } else {
+      pinned_pages.push_back(page_id);
+    }
+  }
+  unlinked_pages_ = std::move(pinned_pages);
+
+  timestamp_t oldest_ts = transaction_manager_->GetOldestReadTs();
+  for (const auto &target : targets_) {
+    VacuumTable(target, oldest_ts);
+  }
+}
+
+void VacuumManager::VacuumTable(const VacuumTarget &target, timestamp_t oldest_ts) {
+  Transaction index_txn(INVALID_TXN_ID);
+  std::vector<RID> rids;
+  auto remove_entries = [&](const Tuple &version) {
+    Tuple tuple(version);
+    for (auto *index : target.indexes_) {
+      Tuple key = tuple.KeyFromTuple(*target.schema_, *index->GetKeySchema(), index->GetKeyAttrs());
+      // Another row may have the key by now, only an entry for the row that is gone is removed.
+      rids.clear();
+      index->ScanKey(key, &rids, &index_txn);
+      if (std::find(rids.begin(), rids.end(), tuple.GetRid()) != rids.end()) {
+        index->DeleteEntry(key, tuple.GetRid(), &index_txn);
+        removed_entry_count_++;
+      }
+    }
+  };
+
+  page_id_t page_id = target.table_->GetFirstPageId();
+  while (page_id != INVALID_PAGE_ID && Throttle()) {
+    bool unlinked = false;
+    page_id_t next_page_id = target.table_->VacuumPage(page_id, oldest_ts, remove_entries, &unlinked);
+    if (unlinked) {
+      unlinked_pages_.push_back(page_id);
+    }
+    page_id = next_page_id;
+  }
+}
+
+bool VacuumManager::Throttle() {
+  std::unique_lock<std::mutex> lock(latch_);
+  if (++cost_ > cost_limit_) {
+    cost_ = 1;
+    cv_.wait_for(lock, cost_delay_, [this] { return stop_requested_; });
+  }
+  return !stop_requested_;
+}
+
+void VacuumManager::RunVacuumThread() {
+  std::scoped_lock scoped_latch(latch_);
+  if (vacuum_thread_ != nullptr) {
+    return;
+  }
+  stop_requested_ = false;
+  vacuum_thread_ = new std::thread(&VacuumManager::VacuumThreadLoop, this);
+}
+
+void VacuumManager::StopVacuumThread() {
+  {
+    std::scoped_lock scoped_latch(latch_);
+    if (vacuum_thread_ == nullptr) {
+      return;
+    }
+    stop_requested_ = true;
+  }
+  cv_.notify_all();
+  vacuum_thread_->join();
+  delete vacuum_thread_;
+  vacuum_thread_ = nullptr;
+  std::scoped_lock scoped_latch(latch_);
+  stop_requested_ = false;
+}
+
+void VacuumManager::VacuumThreadLoop() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (!cv_.wait_for(lock, vacuum_interval, [this] { return stop_requested_; })) {
+    lock.unlock();
+    Vacuum();
+    lock.lock();
+  }
+}
+
+}  // namespace bustub
@@ -0,0 +1,143 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// version_store.cpp
+//
+// Identification: src/concurrency/version_store.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "concurrency/version_store.h"
+
+#include <limits>
+
+namespace bustub {
+
+bool VersionStore::CanWrite(const RID &rid, Transaction *txn) {
+  std::scoped_lock latch(latch_);
+  auto chain = chains_.find(rid);
+  return chain == chains_.end() || chain->second.writer_ == INVALID_TXN_ID ||
+         chain->second.writer_ == txn->GetTransactionId();
+}
+
+void VersionStore::BeforeWrite(const RID &rid, Transaction *txn, const Tuple *tuple) {
+  std::scoped_lock latch(latch_);
+  auto &chain = chains_[rid];
+  if (chain.writer_ == txn->GetTransactionId()) {
+    return;
+  }
+  chain.writer_ = txn->GetTransactionId();
+  version_count_++;
+  chain.versions_.push_back({tuple == nullptr ? Tuple{} : *tuple, tuple != nullptr, chain.begin_ts_, 0});
+}
+
+bool VersionStore::HasWriteConflict(const RID &rid, Transaction *txn) {
+  std::scoped_lock latch(latch_);
+  auto chain = chains_.find(rid);
+  if (chain == chains_.end() || chain->second.writer_ != txn->GetTransactionId()) {
+    return false;
+  }
+  // Inserting into a slot a row was deleted from does not write that row.
+  const auto &replaced = chain->second.versions_.back();
+  return replaced.exists_ && replaced.begin_ts_ > txn->GetReadTs();
+}
+
+void VersionStore::Commit(const RID &rid, Transaction *txn, timestamp_t commit_ts) {
+  std::scoped_lock latch(latch_);
+  auto chain = chains_.find(rid);
+  if (chain == chains_.end() || chain->second.writer_ != txn->GetTransactionId()) {
+    return;
+  }
+  chain->second.versions_.back().end_ts_ = commit_ts;
+  chain->second.begin_ts_ = commit_ts;
+  chain->second.writer_ = INVALID_TXN_ID;
+}
+
+void VersionStore::Abort(const RID &rid, Transaction *txn) {
+  std::scoped_lock latch(latch_);
+  auto chain = chains_.find(rid);
+  if (chain == chains_.end() || chain->second.writer_ != txn->GetTransactionId()) {
+    return;
+  }
+  chain->second.versions_.pop_back();
+  chain->second.writer_ = INVALID_TXN_ID;
+  version_count_--;
+  if (chain->second.versions_.empty()) {
+    chains_.erase(chain);
+  }
+}
+
+bool VersionStore::Read(const RID &rid, Transaction *txn, bool on_page, Tuple *tuple) {
+  std::scoped_lock latch(latch_);
+  auto chain = chains_.find(rid);
+  if (chain == chains_.end()) {
+    return on_page;
+  }
+  // A read-only transaction under read committed sees the latest committed version, whenever it reads.
+  timestamp_t read_ts = txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED
+                            ? std::numeric_limits<timestamp_t>::max()
+                            : txn->GetReadTs();
+  const auto &versions = chain->second;
+  if (versions.writer_ == txn->GetTransactionId() ||
+      (versions.writer_ == INVALID_TXN_ID && versions.begin_ts_ <= read_ts)) {
+    return on_page;
+  }
+  for (auto version = versions.versions_.rbegin(); version != versions.versions_.rend(); ++version) {
+    if (version->begin_ts_ <= read_ts) {
+      if (!version->exists_) {
+        return false;
+      }
+      *tuple = version->tuple_;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool VersionStore::Prune(const RID &rid, timestamp_t oldest_ts, std::vector<Tuple> *dropped) {
+  std::scoped_lock latch(latch_);
+  auto chain = chains_.find(rid);
+  if (chain == chains_.end()) {
+    return false;
+  }
+  // A version replaced at or before the oldest snapshot is seen by none, neither is anything older. The version a
+  // pending change replaced has no end yet.
+  auto &versions = chain->second.versions_;
+  auto seen = versions.begin();
+  while (seen != versions.end() && seen->end_ts_ != 0 && seen->end_ts_ <= oldest_ts) {
+    if (seen->exists_) {
+      dropped->push_back(seen->tuple_);
+    }
+    ++seen;
+  }
+  version_count_ -= seen - versions.begin();
+  versions.erase(versions.begin(), seen);
+  if (versions.empty() && chain->second.writer_ == INVALID_TXN_ID) {
+    chains_.erase(chain);
+    return false;
+  }
+  return true;
+}
+
+void VersionStore::Trim(const RID &rid, timestamp_t oldest_ts, bool deleted) {
+  if (deleted && keep_deleted_) {
+    return;
+  }
+  std::vector<Tuple> dropped;
+  Prune(rid, oldest_ts, &dropped);
+}
+
+bool VersionStore::HasVersions(const RID &rid) {
+  std::scoped_lock latch(latch_);
+  return chains_.find(rid) != chains_.end();
+}
+
+size_t VersionStore::GetVersionCount() {
+  std::scoped_lock latch(latch_);
+  return version_count_;
+}
+
+}  // namespace bustub
@@ -15,8 +15,11 @@
 #include <list>
 #include <mutex>  // NOLINT
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "buffer/lru_replacer.h"
+#include "common/epoch_manager.h"
 #include "recovery/log_manager.h"
 #include "storage/disk/disk_manager.h"
 #include "storage/page/page.h"
@@ -84,9 +87,31 @@ class BufferPoolManager {
     GradingCallback(callback, CallbackType::AFTER, INVALID_PAGE_ID);
   }
 
+  /**
+   * Read a page into the buffer pool and leave it unpinned, for a caller that knows it will fetch the page soon.
+   * @param page_id id of the page to read
+   */
+  void PrefetchPage(page_id_t page_id) { PrefetchPgImp(page_id); }
+
   /** @return size of the buffer pool */
   virtual size_t GetPoolSize() = 0;
 
+  /**
+   * Collects the dirty page table for a fuzzy checkpoint. Every log record appended before the call is reflected in it.
+   * @return the dirty pages and their recovery LSNs
+   */
+  virtual std::vector<std::pair<page_id_t, lsn_t>> GetDirtyPageTable() = 0;
+
+  /** @return the log manager that changes to the pages in this pool are logged to, nullptr if there is none */
+  virtual LogManager *GetLogManager() { return nullptr; }
+
+  /**
+   * A caller that holds a guard of this manager can follow a page id it read without a pin or latch: if the page is
+   * deleted meanwhile, its id is not handed out again until the guard is released.
+   * @return the epoch manager deleted page ids are retired to, nullptr if they are reused right away
+   */
+  virtual EpochManager *GetEpochManager() { return nullptr; }
+
  protected:
   /**
    * Grading function. Do not modify!
@@ -141,5 +166,15 @@ class BufferPoolManager {
    * Flushes all the pages in the buffer pool to disk.
    */
   virtual void FlushAllPgsImp() = 0;
+
+  /**
+   * Read a page into the buffer pool, unpinned.
+   * @param page_id id of the page to read
+   */
+  virtual void PrefetchPgImp(page_id_t page_id) {
+    if (FetchPgImp(page_id) != nullptr) {
+      UnpinPgImp(page_id, false);
+    }
+  }
 };
 }  // namespace bustub
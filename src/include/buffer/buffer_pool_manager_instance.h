@@ -14,6 +14,7 @@
 
 #include <list>
 #include <mutex>  // NOLINT
+#include <set>
 #include <unordered_map>
 
 #include "buffer/buffer_pool_manager.h"
@@ -55,9 +56,15 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   /** @return size of the buffer pool */
   size_t GetPoolSize() override { return pool_size_; }
 
+  EpochManager *GetEpochManager() override { return &epochs_; }
+
   /** @return pointer to all the pages in the buffer pool */
   Page *GetPages() { return pages_; }
 
+  std::vector<std::pair<page_id_t, lsn_t>> GetDirtyPageTable() override;
+
+  LogManager *GetLogManager() override { return log_manager_; }
+
   frame_id_t GetPageFromLRU();
 
  protected:
@@ -102,6 +109,21 @@ class BufferPoolManagerInstance : public BufferPoolManager {
    */
   void FlushAllPgsImp() override;
 
+  /**
+   * Reads a page into the buffer pool, unpinned. Unlike FetchPgImp the disk read happens outside the buffer pool
+   * latches, with the page write-latched instead: fetches of other pages go on meanwhile, and whoever fetches this
+   * page and latches it before reading waits for the read to finish.
+   * @param page_id id of the page to read
+   */
+  void PrefetchPgImp(page_id_t page_id) override;
+
+  /**
+   * Writes a frame out if it is dirty, the caller holds pg_latch_.
+   * @param frame_id the frame to flush
+   * @return false if the frame was clean
+   */
+  bool FlushFrame(frame_id_t frame_id);
+
   /**
    * Allocate a page on disk.∂
    * @return the id of the allocated page
@@ -109,12 +131,11 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   page_id_t AllocatePage();
 
   /**
-   * Deallocate a page on disk.
+   * Deallocate a page on disk. Its id is retired to epochs_, and handed out again by AllocatePage once no guard taken
+   * before the deallocation is held anymore.
    * @param page_id id of the page to deallocate
    */
-  void DeallocatePage(__attribute__((unused)) page_id_t page_id) {
-    // This is a no-nop right now without a more complex data structure to track deallocated pages
-  }
+  void DeallocatePage(page_id_t page_id);
 
   /**
    * Validate that the page_id being used is accessible to this BPI. This can be used in all of the functions to
@@ -131,6 +152,11 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   const uint32_t instance_index_ = 0;
   /** Each BPI maintains its own counter for page_ids to hand out, must ensure they mod back to its instance_index_ */
   std::atomic<page_id_t> next_page_id_ = instance_index_;
+  /** The ids of deallocated pages, reused lowest first before next_page_id_ grows. */
+  std::set<page_id_t> free_page_ids_;
+  std::mutex free_page_ids_latch_;
+  /** Holds back deallocated page ids from free_page_ids_, declared after it so that it is destroyed first. */
+  EpochManager epochs_;
 
   /** Array of buffer pool pages. */
   // 存放的应该是frame_id
@@ -138,7 +164,7 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   /** Pointer to the disk manager. */
   DiskManager *disk_manager_ __attribute__((__unused__));
   /** Pointer to the log manager. */
-  LogManager *log_manager_ __attribute__((__unused__));
+  LogManager *log_manager_;
   /** Page table for keeping track of buffer pool pages. */
   /* page_id -> frame_id*/
   std::unordered_map<page_id_t, frame_id_t> page_table_;
@@ -39,6 +39,8 @@ class ParallelBufferPoolManager : public BufferPoolManager {
   /** @return size of the buffer pool */
   size_t GetPoolSize() override;
 
+  std::vector<std::pair<page_id_t, lsn_t>> GetDirtyPageTable() override;
+
  protected:
   /**
    * @param page_id id of page
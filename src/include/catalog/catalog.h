@@ -127,12 +127,12 @@ class Catalog {
       return NULL_TABLE_INFO;
     }
 
-    // Construct the table heap
-    auto table = std::make_unique<TableHeap>(bpm_, lock_manager_, log_manager_, txn);
-
     // Fetch the table OID for the new table
     const auto table_oid = next_table_oid_.fetch_add(1);
 
+    // Construct the table heap, its rows are locked under the table OID
+    auto table = std::make_unique<TableHeap>(bpm_, lock_manager_, log_manager_, txn, table_oid);
+
     // Construct the table information
     auto meta = std::make_unique<TableInfo>(schema, table_name, std::move(table), table_oid);
     auto *tmp = meta.get();
@@ -10,6 +10,9 @@
 //
 //===----------------------------------------------------------------------===//
 
+#pragma once
+
+#include <memory>
 #include <string>
 
 #include "buffer/buffer_pool_manager_instance.h"
@@ -18,16 +21,31 @@
 #include "recovery/checkpoint_manager.h"
 #include "recovery/log_manager.h"
 #include "storage/disk/disk_manager.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/disk/disk_manager_throttled.h"
 
 namespace bustub {
 
+/** Where a BustubInstance keeps its pages and its log. */
+enum class DiskBackend {
+  /** The database and log files named after db_file_name. */
+  FILE,
+  /** Memory only, nothing survives the instance. */
+  MEMORY,
+  /** The database and log files, behind a simulated device with the given latency and bandwidth. */
+  THROTTLED_FILE,
+  /** Memory only, behind a simulated device with the given latency and bandwidth. */
+  THROTTLED_MEMORY,
+};
+
 class BustubInstance {
  public:
-  explicit BustubInstance(const std::string &db_file_name) {
+  explicit BustubInstance(const std::string &db_file_name, DiskBackend disk_backend = DiskBackend::FILE,
+                          const DiskThrottleConfig &throttle_config = DiskThrottleConfig::LocalSsd()) {
     enable_logging = false;
 
     // storage related
-    disk_manager_ = new DiskManager(db_file_name);
+    disk_manager_ = MakeDiskManager(db_file_name, disk_backend, throttle_config);
 
     // log related
     log_manager_ = new LogManager(disk_manager_);
@@ -54,6 +72,28 @@ class BustubInstance {
     delete disk_manager_;
   }
 
+  /**
+   * Creates the disk manager for the given backend.
+   * @param db_file_name the database file, unused by the memory backends
+   * @param disk_backend the backend to create
+   * @param throttle_config the simulated device, only used by the throttled backends
+   * @return a new disk manager owned by the caller
+   */
+  static DiskManager *MakeDiskManager(const std::string &db_file_name, DiskBackend disk_backend,
+                                      const DiskThrottleConfig &throttle_config) {
+    switch (disk_backend) {
+      case DiskBackend::FILE:
+        return new DiskManager(db_file_name);
+      case DiskBackend::MEMORY:
+        return new DiskManagerMemory();
+      case DiskBackend::THROTTLED_FILE:
+        return new DiskManagerThrottled(std::make_unique<DiskManager>(db_file_name), throttle_config);
+      case DiskBackend::THROTTLED_MEMORY:
+        return new DiskManagerThrottled(std::make_unique<DiskManagerMemory>(), throttle_config);
+    }
+    UNREACHABLE("unknown disk backend");
+  }
+
   DiskManager *disk_manager_;
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
@@ -27,6 +27,21 @@ extern std::atomic<bool> enable_logging;
 /** If ENABLE_LOGGING is true, the log should be flushed to disk every LOG_TIMEOUT. */
 extern std::chrono::duration<int64_t> log_timeout;
 
+/** A transaction committed asynchronously becomes durable at most ASYNC_COMMIT_DELAY after its commit returns. */
+extern std::chrono::milliseconds async_commit_delay;
+
+/** When the checkpoint thread is running, a fuzzy checkpoint is taken every CHECKPOINT_INTERVAL. */
+extern std::chrono::milliseconds checkpoint_interval;
+
+/** A running replica looks for new log records from its primary every REPLICA_POLL_INTERVAL. */
+extern std::chrono::milliseconds replica_poll_interval;
+
+/** When the vacuum thread is running, every table is vacuumed every VACUUM_INTERVAL. */
+extern std::chrono::milliseconds vacuum_interval;
+
+/** The vacuum naps for VACUUM_COST_DELAY after visiting VACUUM_COST_LIMIT pages. */
+extern std::chrono::milliseconds vacuum_cost_delay;
+
 static constexpr int INVALID_PAGE_ID = -1;                                    // invalid page id
 static constexpr int INVALID_TXN_ID = -1;                                     // invalid transaction id
 static constexpr int INVALID_LSN = -1;                                        // invalid log sequence number
@@ -35,11 +50,26 @@ static constexpr int PAGE_SIZE = 4096;                                        //
 static constexpr int BUFFER_POOL_SIZE = 10;                                   // size of buffer pool
 static constexpr int LOG_BUFFER_SIZE = ((BUFFER_POOL_SIZE + 1) * PAGE_SIZE);  // size of a log buffer in byte
 static constexpr int BUCKET_SIZE = 50;                                        // size of extendible hash bucket
+static constexpr int LOG_SEGMENT_SIZE = 16 * 1024 * 1024;                     // size of a log segment file in byte
+static constexpr int LOG_SEGMENT_SPARES = 2;                                  // retired log segments kept for reuse
+static constexpr int RECOVERY_WORKERS = 4;                                    // threads redo and undo run on
+static constexpr int LOG_ARENA_SIZE = 4 * PAGE_SIZE;                          // a txn's log arena is published when full
+static constexpr int LOCK_TABLE_PARTITIONS = 64;                              // independently latched lock table parts
+static constexpr int LOCK_POOL_SIZE = 128;                                    // free queues and requests per partition
+static constexpr int LOCK_ESCALATION_THRESHOLD = 1000;                        // row locks on a table before escalation
+static constexpr int VACUUM_COST_LIMIT = 64;                                  // pages vacuumed between two naps
+static constexpr int RECORD_VERSION_WORDS = 4096;                             // version words per table for OCC
+static constexpr int TXN_REGISTRY_SHARDS = 64;                                // latched parts of the txn registry
+static constexpr int TXN_REGISTRY_CHAINS = 16;                                // txn chains per registry shard
+static constexpr int EPOCH_SLOTS = 128;                                       // threads inside an epoch at once
+static constexpr int EPOCH_RETIRE_THRESHOLD = 64;                             // retired objects before an epoch advance
+static constexpr int RWLATCH_SPIN_LIMIT = 128;                                // most spins before a latch waiter parks
 
 using frame_id_t = int32_t;    // frame id type
 using page_id_t = int32_t;     // page id type
 using txn_id_t = int32_t;      // transaction id type
 using lsn_t = int32_t;         // log sequence number type
+using timestamp_t = int64_t;   // commit timestamp type
 using slot_offset_t = size_t;  // slot offset type
 using oid_t = uint16_t;
 
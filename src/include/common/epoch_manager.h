@@ -0,0 +1,131 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// epoch_manager.h
+//
+// Identification: src/include/common/epoch_manager.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "common/config.h"
+#include "common/macros.h"
+
+namespace bustub {
+
+class EpochManager;
+
+/**
+ * EpochGuard keeps the thread that holds it inside an epoch: nothing retired while it is held is freed before it is
+ * released. Guards are taken with EpochManager::Protect and released when they go out of scope.
+ */
+class EpochGuard {
+ public:
+  EpochGuard(EpochGuard &&other) noexcept : manager_(other.manager_), slot_(other.slot_) { other.manager_ = nullptr; }
+  ~EpochGuard() { Release(); }
+
+  DISALLOW_COPY(EpochGuard);
+  EpochGuard &operator=(EpochGuard &&other) = delete;
+
+  /** Leave the epoch before the guard goes out of scope. */
+  void Release();
+
+ private:
+  friend class EpochManager;
+  EpochGuard(EpochManager *manager, size_t slot) : manager_(manager), slot_(slot) {}
+
+  EpochManager *manager_;
+  size_t slot_;
+};
+
+/**
+ * EpochManager defers freeing what lock-free readers may still be looking at, epoch-based reclamation style.
+ *
+ * A reader holds an EpochGuard while it follows pointers it did not latch. The guard takes one of EPOCH_SLOTS slots
+ * and announces the global epoch in it. A writer that unlinks an object retires it instead of freeing it, and the
+ * object is freed once the global epoch is two past the one it was retired in: by then every reader that could have
+ * seen it has released its guard.
+ *
+ * The global epoch moves on when every announced epoch has caught up with it. That is tried whenever a slot has
+ * EPOCH_RETIRE_THRESHOLD objects retired into it, and by Reclaim. Everything still retired is freed when the manager
+ * is destroyed, no guard may be held by then.
+ */
+class EpochManager {
+ public:
+  EpochManager() = default;
+  ~EpochManager();
+
+  DISALLOW_COPY_AND_MOVE(EpochManager);
+
+  /** @return a guard that keeps what is retired from now on from being freed until it is released */
+  EpochGuard Protect();
+
+  /**
+   * Free an object once no reader can be looking at it anymore. It may be called with or without a guard held.
+   * @param free frees the object, it may not retire anything itself
+   */
+  void Retire(std::function<void()> free);
+
+  /** Retire an object that is freed with delete. */
+  template <typename T>
+  void RetireObject(T *object) {
+    Retire([object] { delete object; });
+  }
+
+  /** Try to move the global epoch on twice, and free everything that is safe to free. */
+  void Reclaim();
+
+  /** Wait until every guard taken before the call is released. The calling thread may not hold a guard itself. */
+  void Synchronize();
+
+  /** @return the global epoch */
+  uint64_t GetEpoch() const { return global_epoch_.load(); }
+
+  /** @return the number of objects retired and not freed yet */
+  size_t GetRetiredCount() const { return retired_count_.load(); }
+
+ private:
+  friend class EpochGuard;
+
+  /** A slot announces the epoch of the guard holding it, the objects retired into it wait in it. */
+  struct alignas(64) Slot {
+    std::atomic<bool> claimed_{false};
+    std::atomic<uint64_t> epoch_{QUIESCENT};
+    std::mutex retired_latch_;
+    std::vector<std::pair<uint64_t, std::function<void()>>> retired_;
+  };
+
+  static constexpr uint64_t QUIESCENT = UINT64_MAX;
+
+  /** @return a slot claimed for the calling thread */
+  size_t ClaimSlot();
+
+  /** Announce the global epoch in a claimed slot. */
+  void Enter(size_t slot);
+
+  /** Leave the epoch and hand the slot back. */
+  void Exit(size_t slot);
+
+  /** Move the global epoch on if every guard has seen the current one. @return true if it moved */
+  bool TryAdvance();
+
+  /** Free the objects of a slot retired two epochs or more before the global one. */
+  void FreeSafe(Slot *slot);
+
+  std::array<Slot, EPOCH_SLOTS> slots_;
+  std::atomic<uint64_t> global_epoch_{0};
+  std::atomic<size_t> retired_count_{0};
+};
+
+}  // namespace bustub
@@ -12,25 +12,29 @@
 
 #pragma once
 
-#include <climits>
-#include <condition_variable>  // NOLINT
-#include <mutex>               // NOLINT
+#include <atomic>
+#include <cstdint>
 
+#include "common/config.h"
 #include "common/macros.h"
 
 namespace bustub {
 
 /**
- * Reader-Writer latch backed by std::mutex.
+ * Reader-Writer latch built on one atomic word.
+ *
+ * The word holds the number of readers, a bit for a writer that holds the latch or waits for the readers to leave,
+ * and a bit for threads parked on the word. Writers are preferred: once a writer has entered, new readers wait until
+ * it has released the latch. Taking or releasing an uncontended latch is one atomic instruction.
+ *
+ * A thread that has to wait spins first, for up to RWLATCH_SPIN_LIMIT rounds and fewer if spinning has not paid off
+ * on this latch lately, then parks on the word with a futex. Releasing the latch only wakes threads up if one has
+ * parked. Without futexes (on other systems than Linux) waiting threads yield instead of parking.
  */
 class ReaderWriterLatch {
-  using mutex_t = std::mutex;
-  using cond_t = std::condition_variable;
-  static const uint32_t MAX_READERS = UINT_MAX;
-
  public:
   ReaderWriterLatch() = default;
-  ~ReaderWriterLatch() { std::lock_guard<mutex_t> guard(mutex_); }
+  ~ReaderWriterLatch() = default;
 
   DISALLOW_COPY(ReaderWriterLatch);
 
@@ -38,13 +42,9 @@ class ReaderWriterLatch {
    * Acquire a write latch.
    */
   void WLock() {
-    std::unique_lock<mutex_t> latch(mutex_);
-    while (writer_entered_) {
-      reader_.wait(latch);
-    }
-    writer_entered_ = true;
-    while (reader_count_ > 0) {
-      writer_.wait(latch);
+    uint32_t state = 0;
+    if (!state_.compare_exchange_strong(state, WRITER, std::memory_order_acquire)) {
+      WLockSlow();
     }
   }
 
@@ -52,45 +52,60 @@ class ReaderWriterLatch {
    * Release a write latch.
    */
   void WUnlock() {
-    std::lock_guard<mutex_t> guard(mutex_);
-    writer_entered_ = false;
-    reader_.notify_all();
+    if ((state_.fetch_and(~(WRITER | PARKED), std::memory_order_release) & PARKED) != 0) {
+      WakeAll();
+    }
   }
 
   /**
    * Acquire a read latch.
    */
   void RLock() {
-    std::unique_lock<mutex_t> latch(mutex_);
-    while (writer_entered_ || reader_count_ == MAX_READERS) {
-      reader_.wait(latch);
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    if ((state & WRITER) != 0 || (state & READERS) == READERS ||
+        !state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+      RLockSlow();
     }
-    reader_count_++;
   }
 
   /**
    * Release a read latch.
    */
   void RUnlock() {
-    std::lock_guard<mutex_t> guard(mutex_);
-    reader_count_--;
-    if (writer_entered_) {
-      if (reader_count_ == 0) {
-        writer_.notify_one();
-      }
-    } else {
-      if (reader_count_ == MAX_READERS - 1) {
-        reader_.notify_one();
-      }
+    uint32_t state = state_.fetch_sub(1, std::memory_order_release) - 1;
+    // The last reader to leave lets in a writer that waits for the readers, any reader leaves room for a new one.
+    if ((state & PARKED) != 0 && ((state & (WRITER | READERS)) == WRITER || (state & READERS) == READERS - 1)) {
+      state_.fetch_and(~PARKED, std::memory_order_relaxed);
+      WakeAll();
     }
   }
 
  private:
-  mutex_t mutex_;
-  cond_t writer_;
-  cond_t reader_;
-  uint32_t reader_count_{0};
-  bool writer_entered_{false};
+  static constexpr uint32_t WRITER = 1U << 31;
+  static constexpr uint32_t PARKED = 1U << 30;
+  static constexpr uint32_t READERS = PARKED - 1;
+
+  void WLockSlow();
+  void RLockSlow();
+
+  /**
+   * Wait for the word to change from the given state: spin for a round, or park once spinning is over.
+   * @param[in,out] spins how many rounds were spun so far, -1 once the thread has parked
+   */
+  void Wait(uint32_t state, int *spins);
+
+  /** Park on the word if it still holds state, which has PARKED set. */
+  void Park(uint32_t state);
+
+  /** Wake every thread parked on the word. */
+  void WakeAll();
+
+  /** Fold the rounds an acquisition spun into the estimate of how long spinning pays off, none if it parked. */
+  void UpdateSpinEstimate(int spins);
+
+  std::atomic<uint32_t> state_{0};
+  /** Roughly how many rounds waiters have had to spin before the latch was theirs. */
+  std::atomic<int> spin_estimate_{RWLATCH_SPIN_LIMIT / 2};
 };
 
 }  // namespace bustub
@@ -13,15 +13,21 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
 #include <list>
 #include <memory>
-#include <mutex>  // NOLINT
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "common/config.h"
+#include "common/epoch_manager.h"
 #include "common/rid.h"
 #include "concurrency/transaction.h"
 
@@ -30,40 +36,82 @@ namespace bustub {
 class TransactionManager;
 
 /**
- * LockManager handles transactions asking for locks on records.
+ * LockManager handles transactions asking for locks on records and tables, under strict two-phase locking.
+ *
+ * Locks are hierarchical: LockRow takes the intention lock on the table a row belongs to before it locks the row, and
+ * a table lock in a mode that covers the row makes the row lock unnecessary. Once a transaction holds more than
+ * escalation_threshold row locks on a table, they are escalated: the table lock is strengthened to cover them all and
+ * the row locks are released. The RID based calls (LockShared, LockExclusive, LockUpgrade, LockInstant) lock rows
+ * outside of any table: they take no intention lock, so a table lock does not conflict with them. The two APIs must not
+ * be mixed on one table, a table S or X lock, whether taken or escalated to, would not exclude the RID based locks of
+ * other transactions on its rows. TableHeap locks its rows with LockRow. The key locks of a BPlusTree stay RID based:
+ * they share the queues of the rows its keys point to, but a table lock does not exclude them.
+ *
+ * The lock table is split into LOCK_TABLE_PARTITIONS partitions by the hash of the RID, each behind a latch of its
+ * own, so that transactions locking different rows rarely contend on a latch. Every RID has a queue of requests and a
+ * condition variable its waiters block on. Requests are granted in order: a request waits for every request ahead of
+ * it that it is not compatible with, an upgrade waits in front of every request that has not been granted yet.
+ * The nodes of released requests and the queues of RIDs nobody locks anymore are kept by their partition for reuse.
+ *
+ * Deadlocks are detected, not prevented. While any request waits, the cycle detection thread builds a waits-for graph
+ * from the lock queues every cycle_detection_interval, and breaks every cycle in it by aborting its youngest
+ * transaction, whose lock call then throws a TransactionAbortException with AbortReason::DEADLOCK. Every change to the
+ * graph publishes its edge list as an immutable snapshot, so it is read without stalling the detector; a replaced
+ * snapshot is freed through an EpochManager.
  */
 class LockManager {
-  enum class LockMode { SHARED, EXCLUSIVE };
-
   class LockRequest {
    public:
-    LockRequest(txn_id_t txn_id, LockMode lock_mode) : txn_id_(txn_id), lock_mode_(lock_mode), granted_(false) {}
+    LockRequest(Transaction *txn, LockMode lock_mode)
+        : txn_(txn), txn_id_(txn->GetTransactionId()), lock_mode_(lock_mode), granted_(false) {}
 
+    Transaction *txn_;
     txn_id_t txn_id_;
     LockMode lock_mode_;
     bool granted_;
+    /** When the request started waiting, if it had to. */
+    std::chrono::steady_clock::time_point since_;
   };
 
   class LockRequestQueue {
    public:
     std::list<LockRequest> request_queue_;
-    // for notifying blocked transactions on this rid
+    // for notifying blocked transactions on this rid or table
     std::condition_variable cv_;
     // txn_id of an upgrading transaction (if any)
     txn_id_t upgrading_ = INVALID_TXN_ID;
   };
 
+  using LockTableMap = std::unordered_map<RID, LockRequestQueue>;
+
+  /** A part of the lock table, aligned so that the latches of neighbouring partitions do not share a cache line. */
+  struct alignas(64) LockTablePartition {
+    std::mutex latch_;
+    LockTableMap lock_table_;
+    /** Nodes of released requests, spliced into a queue by the next request. */
+    std::list<LockRequest> free_requests_;
+    /** Queues of RIDs that are not locked anymore, inserted again under the next RID. */
+    std::vector<LockTableMap::node_type> free_queues_;
+  };
+
  public:
   /**
-   * Creates a new lock manager configured for the deadlock prevention policy.
+   * Creates a new lock manager configured for deadlock detection, the cycle detection thread is running.
+   * @param escalation_threshold how many row locks a transaction can hold on a table before they are escalated
    */
-  LockManager() = default;
+  explicit LockManager(size_t escalation_threshold = LOCK_ESCALATION_THRESHOLD)
+      : escalation_threshold_(escalation_threshold) {
+    RunCycleDetection();
+  }
 
-  ~LockManager() = default;
+  ~LockManager() {
+    StopCycleDetection();
+    delete edge_list_.load();
+  }
 
   /*
    * [LOCK_NOTE]: For all locking functions, we:
-   * 1. return false if the transaction is aborted; and
+   * 1. return false if the transaction is aborted, and abort a read-only transaction, which has no lock sets; and
    * 2. block on wait, return true when the lock request is granted; and
    * 3. it is undefined behavior to try locking an already locked RID in the
    * same transaction, i.e. the transaction is responsible for keeping track of
@@ -71,7 +119,7 @@ class LockManager {
    */
 
   /**
-   * Acquire a lock on RID in shared mode. See [LOCK_NOTE] in header file.
+   * Acquire a lock on RID in shared mode, outside of any table lock. See [LOCK_NOTE] in header file.
    * @param txn the transaction requesting the shared lock
    * @param rid the RID to be locked in shared mode
    * @return true if the lock is granted, false otherwise
@@ -79,7 +127,7 @@ class LockManager {
   bool LockShared(Transaction *txn, const RID &rid);
 
   /**
-   * Acquire a lock on RID in exclusive mode. See [LOCK_NOTE] in header file.
+   * Acquire a lock on RID in exclusive mode, outside of any table lock. See [LOCK_NOTE] in header file.
    * @param txn the transaction requesting the exclusive lock
    * @param rid the RID to be locked in exclusive mode
    * @return true if the lock is granted, false otherwise
@@ -95,6 +143,16 @@ class LockManager {
    */
   bool LockUpgrade(Transaction *txn, const RID &rid);
 
+  /**
+   * Wait until the RID can be locked in exclusive mode, without keeping the lock: an insert into an index checks this
+   * way that no transaction holds the next key of the key inserted. A transaction that holds a shared lock on the RID
+   * has it upgraded and keeps it.
+   * @param txn the transaction checking the lock
+   * @param rid the RID to be checked
+   * @return true if the RID could be locked, false otherwise
+   */
+  bool LockInstant(Transaction *txn, const RID &rid);
+
   /**
    * Release the lock held by the transaction.
    * @param txn the transaction releasing the lock, it should actually hold the
@@ -104,11 +162,195 @@ class LockManager {
    */
   bool Unlock(Transaction *txn, const RID &rid);
 
+  /**
+   * Acquire a lock on a table, or strengthen the lock the transaction holds on it. See [LOCK_NOTE] in header file.
+   * A transaction holding IS and asking for S, for example, ends up holding S, one holding IX and asking for S holds
+   * SIX. A mode weaker than the one held is granted right away.
+   * @param txn the transaction requesting the lock
+   * @param lock_mode the mode to lock the table in
+   * @param oid the table to be locked
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockTable(Transaction *txn, LockMode lock_mode, table_oid_t oid);
+
+  /**
+   * Release the table lock held by the transaction, once it has released the locks on the table's rows.
+   * @param txn the transaction releasing the lock
+   * @param oid the table that is locked by the transaction
+   * @return true if the unlock is successful, false otherwise
+   */
+  bool UnlockTable(Transaction *txn, table_oid_t oid);
+
+  /**
+   * Acquire a lock on a row of a table, taking the intention lock on the table first. See [LOCK_NOTE] in header file.
+   * Every transaction locking rows of the table has to go through LockRow, not the RID based calls: the table locks and
+   * escalation only isolate transactions that take intention locks.
+   * @param txn the transaction requesting the lock
+   * @param lock_mode SHARED or EXCLUSIVE
+   * @param oid the table the row belongs to
+   * @param rid the row to be locked
+   * @return true if the lock is granted, or the table lock held already covers the row, false otherwise
+   */
+  bool LockRow(Transaction *txn, LockMode lock_mode, table_oid_t oid, const RID &rid);
+
+  /**
+   * Release a row lock taken with LockRow.
+   * @param txn the transaction releasing the lock
+   * @param oid the table the row belongs to
+   * @param rid the row that is locked by the transaction
+   * @return true if the unlock is successful, false otherwise
+   */
+  bool UnlockRow(Transaction *txn, table_oid_t oid, const RID &rid);
+
+  /** @return how many times row locks were escalated to a table lock */
+  size_t GetEscalationCount() { return escalation_count_; }
+
+  /** Start the thread that breaks deadlocks every cycle_detection_interval. */
+  void RunCycleDetection();
+  void StopCycleDetection();
+
+  /*** Waits-for graph: the edge t1 -> t2 means that t1 waits for a lock t2 holds or waits for before it. ***/
+
+  /** Adds an edge from t1 -> t2. */
+  void AddEdge(txn_id_t t1, txn_id_t t2);
+
+  /** Removes an edge from t1 -> t2. */
+  void RemoveEdge(txn_id_t t1, txn_id_t t2);
+
+  /**
+   * Checks if the graph has a cycle, returning the newest transaction ID in the cycle if so. The search starts at the
+   * lowest transaction ID and follows the edges in order of transaction ID, so the same graph finds the same cycle.
+   * @param[out] txn_id if the graph has a cycle, will contain the newest transaction ID
+   * @return false if the graph has no cycle, otherwise stores the newest transaction ID in the cycle to txn_id
+   */
+  bool HasCycle(txn_id_t *txn_id);
+
+  /** @return the list of all edges in the graph sorted, used for testing only! */
+  std::vector<std::pair<txn_id_t, txn_id_t>> GetEdgeList();
+
+  /** @return how many deadlocks were broken */
+  size_t GetDeadlockCount() { return deadlock_count_; }
+
+  /** @return how long the broken deadlocks lasted in total, each from the wait that closed its cycle until its break */
+  std::chrono::microseconds GetDeadlockTime() { return std::chrono::microseconds(deadlock_time_); }
+
+  /** @return how long the longest deadlock lasted */
+  std::chrono::microseconds GetMaxDeadlockTime() { return std::chrono::microseconds(max_deadlock_time_); }
+
  private:
-  std::mutex latch_;
+  /** A transaction waiting in the waits-for graph. */
+  struct Waiter {
+    RID rid_;
+    std::chrono::steady_clock::time_point since_;
+  };
+  /** @return the partition of the lock table the RID belongs to */
+  LockTablePartition *GetPartition(const RID &rid) {
+    auto hash = std::hash<RID>()(rid);
+    return &partitions_[(hash ^ (hash >> 32)) % LOCK_TABLE_PARTITIONS];
+  }
+
+  /** @return the key a table's lock queue has in the lock table, no row has a RID on INVALID_PAGE_ID */
+  static RID TableKey(table_oid_t oid) { return RID(INVALID_PAGE_ID, oid); }
+
+  /**
+   * Queue a request and block until it is granted or the transaction is aborted.
+   * @param upgrade true if the transaction trades the lock it holds on the RID or table for this request
+   * @return true if the request is granted
+   */
+  bool Acquire(Transaction *txn, const RID &rid, LockMode lock_mode, bool upgrade);
+
+  /** Release a lock without ending the growing phase. @return false if the transaction holds no lock there */
+  bool ReleaseLock(Transaction *txn, const RID &rid);
+
+  /** Trade the transaction's row locks on the table for a table lock that covers them. */
+  void Escalate(Transaction *txn, table_oid_t oid);
+
+  /** @return true if a transaction holding the first mode needs no lock in the second one */
+  static bool Covers(LockMode held, LockMode wanted);
+
+  /** @return true if two transactions can hold locks in the two modes at once */
+  static bool AreCompatible(LockMode first, LockMode second);
+
+  /** @return the queue of the RID, taken from the pool if the RID has none. The partition latch must be held. */
+  LockRequestQueue *GetQueue(LockTablePartition *partition, const RID &rid);
+
+  /** Take a request off its queue and wake the waiters. The partition latch must be held. */
+  void Release(LockTablePartition *partition, const RID &rid, LockRequestQueue *queue,
+               std::list<LockRequest>::iterator request);
+
+  /** @return true if nothing ahead of the request in its queue conflicts with it */
+  static bool IsGrantable(const LockRequestQueue &queue, std::list<LockRequest>::iterator request);
+
+  /** Abort the transaction if it is read-only, it has no lock sets. @return false if the transaction is aborted */
+  static bool CanLock(Transaction *txn);
+
+  /** Set the transaction aborted and throw a TransactionAbortException. */
+  [[noreturn]] static void AbortImplicitly(Transaction *txn, AbortReason abort_reason);
+
+  /** The body of the cycle detection thread. */
+  void CycleDetectionLoop();
+
+  /** Build the waits-for graph from the lock table and abort a transaction of every cycle in it. */
+  void BreakDeadlocks();
 
-  /** Lock table for lock requests. */
-  std::unordered_map<RID, LockRequestQueue> lock_table_;
+  /** Add the edges of the requests waiting in the queue. The graph latch must be held. */
+  void AddQueueEdges(const RID &rid, const LockRequestQueue &queue);
+
+  /**
+   * Look for a cycle, skipping the transactions known to be on none. The graph latch must be held.
+   * @param[out] cycle the transactions on the cycle found
+   * @return true if a cycle was found
+   */
+  bool FindCycle(std::vector<txn_id_t> *cycle);
+
+  /** Replace the published edge list with the edges of the graph. The graph latch must be held. */
+  void PublishEdgeList();
+
+  /**
+   * Check that every edge of a cycle is still there, under the latches of the partitions it waits in, and abort the
+   * youngest transaction on it. A stale edge is removed from the graph instead. The graph latch must be held.
+   */
+  void AbortCycle(const std::vector<txn_id_t> &cycle);
+
+  /**
+   * @return the queue where the transaction waits for the holder, and its request, nullptrs if it does not wait for it
+   * anymore. The partition latch must be held.
+   */
+  std::pair<LockRequestQueue *, LockRequest *> FindWait(txn_id_t txn_id, txn_id_t holder);
+
+  /** Row locks a transaction can hold on one table before they are escalated. */
+  const size_t escalation_threshold_;
+  std::atomic<size_t> escalation_count_{0};
+
+  /** Lock table for lock requests, split into partitions. */
+  std::array<LockTablePartition, LOCK_TABLE_PARTITIONS> partitions_;
+  /** How many requests are blocked, the detector has nothing to do while there are none. */
+  std::atomic<int> waiting_count_{0};
+
+  /** Protects the waits-for graph. */
+  std::mutex graph_latch_;
+  /** Waits-for graph, every transaction's edges sorted by the transaction ID they lead to. */
+  std::unordered_map<txn_id_t, std::vector<txn_id_t>> waits_for_;
+  /** Where the transactions in the graph wait, filled in by the detector. */
+  std::unordered_map<txn_id_t, Waiter> waiters_;
+  /** Transactions a search found to be on no cycle, removing edges cannot put them on one. */
+  std::unordered_set<txn_id_t> acyclic_;
+  /** The transactions in the order searches start from, and where the next one starts: all before it are acyclic. */
+  std::vector<txn_id_t> search_order_;
+  size_t search_from_{0};
+  /** The edges of the graph as of its last change, retired to epochs_ when replaced. */
+  std::atomic<const std::vector<std::pair<txn_id_t, txn_id_t>> *> edge_list_{
+      new std::vector<std::pair<txn_id_t, txn_id_t>>()};
+  EpochManager epochs_;
+
+  std::atomic<size_t> deadlock_count_{0};
+  std::atomic<int64_t> deadlock_time_{0};
+  std::atomic<int64_t> max_deadlock_time_{0};
+
+  std::thread *cycle_detection_thread_{nullptr};
+  bool stop_requested_{false};
+  std::mutex latch_;
+  std::condition_variable cv_;
 };
 
 }  // namespace bustub
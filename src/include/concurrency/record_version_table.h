@@ -0,0 +1,76 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// record_version_table.h
+//
+// Identification: src/include/concurrency/record_version_table.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <thread>  // NOLINT
+
+#include "common/config.h"
+#include "common/rid.h"
+
+namespace bustub {
+
+/**
+ * RecordVersionTable holds the version words optimistic transactions validate their reads against, Silo style.
+ *
+ * A word counts the changes to the rows that hash to it, its top bit is a lock taken by a committing writer while it
+ * installs its changes. Rows share words, so a change to one row also fails the validation of a read of another that
+ * hashes to the same word; RECORD_VERSION_WORDS keeps that rare.
+ */
+class RecordVersionTable {
+ public:
+  static constexpr uint64_t LOCK_BIT = 1ULL << 63;
+
+  /** @return the word of a row, the page id is spread out so that the same slot on different pages does not collide */
+  static size_t WordOf(const RID &rid) {
+    return (static_cast<size_t>(rid.GetPageId()) * 40503 + rid.GetSlotNum()) % RECORD_VERSION_WORDS;
+  }
+
+  /** @return the version of a word, waiting while a writer holds it */
+  uint64_t StableRead(size_t word) {
+    uint64_t version = words_[word].load();
+    while ((version & LOCK_BIT) != 0) {
+      std::this_thread::yield();
+      version = words_[word].load();
+    }
+    return version;
+  }
+
+  /** @return the version of a word, with the lock bit set if a writer holds it */
+  uint64_t Read(size_t word) { return words_[word].load(); }
+
+  /** Take the lock of a word. */
+  void Lock(size_t word) {
+    uint64_t version = words_[word].load();
+    while ((version & LOCK_BIT) != 0 || !words_[word].compare_exchange_weak(version, version | LOCK_BIT)) {
+      if ((version & LOCK_BIT) != 0) {
+        std::this_thread::yield();
+        version = words_[word].load();
+      }
+    }
+  }
+
+  /**
+   * Release the lock of a word.
+   * @param changed true to move the word to a new version, for the readers of the rows that were changed
+   */
+  void Unlock(size_t word, bool changed) {
+    uint64_t version = words_[word].load() & ~LOCK_BIT;
+    words_[word].store(changed ? version + 1 : version);
+  }
+
+ private:
+  std::atomic<uint64_t> words_[RECORD_VERSION_WORDS]{};
+};
+
+}  // namespace bustub
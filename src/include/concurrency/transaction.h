@@ -17,10 +17,13 @@
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "common/config.h"
 #include "common/logger.h"
+#include "recovery/log_arena.h"
 #include "storage/page/page.h"
 #include "storage/table/tuple.h"
 
@@ -44,9 +47,30 @@ namespace bustub {
 enum class TransactionState { GROWING, SHRINKING, COMMITTED, ABORTED };
 
 /**
- * Transaction isolation level.
+ * Transaction isolation level. Under SNAPSHOT_ISOLATION, reads see the database as of when the transaction began
+ * without taking locks, and the commit fails if another transaction committed a write to a row it wrote since then.
+ * A read-only transaction under READ_COMMITTED reads the latest committed version of a row, also without locks.
+ * OPTIMISTIC transactions are serializable without locks: they remember the version of every row they read, buffer
+ * their writes, and the commit fails if one of the rows they read has changed since. They are only serializable with
+ * each other, a table is either written optimistically or with locks.
+ * SERIALIZABLE transactions lock like REPEATABLE_READ ones, and also lock the key ranges their B+ tree lookups and
+ * scans pass over, so that no row appears in a range they read.
  */
-enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED };
+enum class IsolationLevel {
+  READ_UNCOMMITTED,
+  REPEATABLE_READ,
+  READ_COMMITTED,
+  SNAPSHOT_ISOLATION,
+  OPTIMISTIC,
+  SERIALIZABLE
+};
+
+/**
+ * Lock modes. Rows are locked SHARED or EXCLUSIVE. A table is also locked in an intention mode by a transaction that
+ * locks its rows: INTENTION_SHARED to lock rows SHARED, INTENTION_EXCLUSIVE to lock them in either mode, and
+ * SHARED_INTENTION_EXCLUSIVE to read the whole table and lock some of its rows EXCLUSIVE.
+ */
+enum class LockMode { SHARED, EXCLUSIVE, INTENTION_SHARED, INTENTION_EXCLUSIVE, SHARED_INTENTION_EXCLUSIVE };
 
 /**
  * Type of write operation.
@@ -68,12 +92,28 @@ class TableWriteRecord {
 
   RID rid_;
   WType wtype_;
-  /** The tuple is only used for the update operation. */
+  /**
+   * The tuple is only used for the update operation. It is the old value, or the new value while the update of an
+   * optimistic transaction is buffered.
+   */
   Tuple tuple_;
   /** The table heap specifies which table this write record is for. */
   TableHeap *table_;
 };
 
+/**
+ * TableReadRecord tracks a read of an optimistic transaction, validated at commit.
+ */
+class TableReadRecord {
+ public:
+  TableReadRecord(RID rid, uint64_t version, TableHeap *table) : rid_(rid), version_(version), table_(table) {}
+
+  RID rid_;
+  /** The version of the row when it was read. */
+  uint64_t version_;
+  TableHeap *table_;
+};
+
 /**
  * WriteRecord tracks information related to a write.
  */
@@ -107,7 +147,9 @@ enum class AbortReason {
   UNLOCK_ON_SHRINKING,
   UPGRADE_CONFLICT,
   DEADLOCK,
-  LOCKSHARED_ON_READ_UNCOMMITTED
+  LOCKSHARED_ON_READ_UNCOMMITTED,
+  ATTEMPTED_INTENTION_LOCK_ON_ROW,
+  TABLE_UNLOCKED_BEFORE_UNLOCKING_ROWS
 };
 
 /**
@@ -137,6 +179,12 @@ class TransactionAbortException : public std::exception {
         return "Transaction " + std::to_string(txn_id_) + " aborted on deadlock\n";
       case AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED:
         return "Transaction " + std::to_string(txn_id_) + " aborted on lockshared on READ_UNCOMMITTED\n";
+      case AbortReason::ATTEMPTED_INTENTION_LOCK_ON_ROW:
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted because rows can not be locked in intention modes\n";
+      case AbortReason::TABLE_UNLOCKED_BEFORE_UNLOCKING_ROWS:
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted because it unlocked a table while still holding locks on its rows\n";
     }
     // Todo: Should fail with unreachable.
     return "";
@@ -148,18 +196,32 @@ class TransactionAbortException : public std::exception {
  */
 class Transaction {
  public:
-  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ)
+  /**
+   * @param txn_id the id of the transaction
+   * @param isolation_level the isolation level of the transaction
+   * @param read_only true for a transaction that never writes. It reads the version store without taking locks, and
+   * only has a page set for latching index pages: its lock sets, write sets and read set are null.
+   */
+  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ,
+                       bool read_only = false)
       : state_(TransactionState::GROWING),
         isolation_level_(isolation_level),
+        read_only_(read_only),
         thread_id_(std::this_thread::get_id()),
         txn_id_(txn_id),
-        prev_lsn_(INVALID_LSN),
-        shared_lock_set_{new std::unordered_set<RID>},
-        exclusive_lock_set_{new std::unordered_set<RID>} {
+        prev_lsn_(INVALID_LSN) {
+    page_set_ = std::make_shared<std::deque<bustub::Page *>>();
+    if (read_only) {
+      return;
+    }
+    shared_lock_set_ = std::make_shared<std::unordered_set<RID>>();
+    exclusive_lock_set_ = std::make_shared<std::unordered_set<RID>>();
+    table_lock_map_ = std::make_shared<std::unordered_map<table_oid_t, LockMode>>();
+    row_lock_map_ = std::make_shared<std::unordered_map<table_oid_t, std::unordered_set<RID>>>();
     // Initialize the sets that will be tracked.
     table_write_set_ = std::make_shared<std::deque<TableWriteRecord>>();
+    table_read_set_ = std::make_shared<std::vector<TableReadRecord>>();
     index_write_set_ = std::make_shared<std::deque<IndexWriteRecord>>();
-    page_set_ = std::make_shared<std::deque<bustub::Page *>>();
     deleted_page_set_ = std::make_shared<std::unordered_set<page_id_t>>();
   }
 
@@ -176,9 +238,26 @@ class Transaction {
   /** @return the isolation level of this transaction */
   inline IsolationLevel GetIsolationLevel() const { return isolation_level_; }
 
+  /** @return true if the transaction was declared read-only */
+  inline bool IsReadOnly() const { return read_only_; }
+
+  /**
+   * @return true if the transaction reads the version store instead of locking: under snapshot isolation, and when it
+   * is read-only
+   */
+  inline bool ReadsVersions() const { return isolation_level_ == IsolationLevel::SNAPSHOT_ISOLATION || read_only_; }
+
+  /** @return true if the transaction keeps its shared locks until it ends */
+  inline bool HoldsSharedLocks() const {
+    return isolation_level_ == IsolationLevel::REPEATABLE_READ || isolation_level_ == IsolationLevel::SERIALIZABLE;
+  }
+
   /** @return the list of table write records of this transaction */
   inline std::shared_ptr<std::deque<TableWriteRecord>> GetWriteSet() { return table_write_set_; }
 
+  /** @return the rows an optimistic transaction read, with their versions */
+  inline std::shared_ptr<std::vector<TableReadRecord>> GetReadSet() { return table_read_set_; }
+
   /** @return the list of index write records of this transaction */
   inline std::shared_ptr<std::deque<IndexWriteRecord>> GetIndexWriteSet() { return index_write_set_; }
 
@@ -228,6 +307,31 @@ class Transaction {
   /** @return true if rid is exclusively locked by this transaction */
   bool IsExclusiveLocked(const RID &rid) { return exclusive_lock_set_->find(rid) != exclusive_lock_set_->end(); }
 
+  /** @return true if the row of the table is shared locked by this transaction, or its table lock covers reading it */
+  bool IsSharedLocked(table_oid_t oid, const RID &rid) {
+    auto held = table_lock_map_->find(oid);
+    return IsSharedLocked(rid) ||
+           (held != table_lock_map_->end() &&
+            (held->second == LockMode::SHARED || held->second == LockMode::SHARED_INTENTION_EXCLUSIVE));
+  }
+
+  /**
+   * @return true if the row of the table is exclusively locked by this transaction, or its table is, say after its row
+   * locks were escalated
+   */
+  bool IsExclusiveLocked(table_oid_t oid, const RID &rid) {
+    auto held = table_lock_map_->find(oid);
+    return IsExclusiveLocked(rid) || (held != table_lock_map_->end() && held->second == LockMode::EXCLUSIVE);
+  }
+
+  /** @return the mode every table this transaction has locked is locked in */
+  inline std::shared_ptr<std::unordered_map<table_oid_t, LockMode>> GetTableLockMap() { return table_lock_map_; }
+
+  /** @return the rows this transaction has locked through LockManager::LockRow, by table */
+  inline std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> GetRowLockMap() {
+    return row_lock_map_;
+  }
+
   /** @return the current state of the transaction */
   inline TransactionState GetState() { return state_; }
 
@@ -246,11 +350,38 @@ class Transaction {
    */
   inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
 
+  /** @return true if Commit returns without waiting for the COMMIT record to become durable */
+  inline bool IsAsyncCommit() const { return async_commit_; }
+
+  /**
+   * Choose whether Commit waits for durability. An asynchronous commit returns as soon as its COMMIT record is in the
+   * log buffer and is made durable within async_commit_delay, a crash before that loses it.
+   * @param async_commit true to commit asynchronously
+   */
+  inline void SetAsyncCommit(bool async_commit) { async_commit_ = async_commit; }
+
+  /** @return the commit timestamp of the last transaction that committed before this one began */
+  inline timestamp_t GetReadTs() const { return read_ts_; }
+
+  /** Set the timestamp of the snapshot the transaction reads. */
+  inline void SetReadTs(timestamp_t read_ts) { read_ts_ = read_ts; }
+
+  /** @return the commit timestamp of the transaction, once it has committed */
+  inline timestamp_t GetCommitTs() const { return commit_ts_; }
+
+  /** Set the commit timestamp of the transaction. */
+  inline void SetCommitTs(timestamp_t commit_ts) { commit_ts_ = commit_ts; }
+
+  /** @return the arena the transaction's log records wait in until they are published */
+  inline LogArena *GetLogArena() { return &log_arena_; }
+
  private:
-  /** The current transaction state. */
-  TransactionState state_;
+  /** The current transaction state, the deadlock detector aborts transactions from a thread of its own. */
+  std::atomic<TransactionState> state_;
   /** The isolation level of the transaction. */
   IsolationLevel isolation_level_;
+  /** Whether the transaction was declared read-only. */
+  bool read_only_;
   /** The thread ID, used in single-threaded transactions. */
   std::thread::id thread_id_;
   /** The ID of this transaction. */
@@ -258,10 +389,19 @@ class Transaction {
 
   /** The undo set of table tuples. */
   std::shared_ptr<std::deque<TableWriteRecord>> table_write_set_;
+  /** The rows read by an optimistic transaction. */
+  std::shared_ptr<std::vector<TableReadRecord>> table_read_set_;
   /** The undo set of indexes. */
   std::shared_ptr<std::deque<IndexWriteRecord>> index_write_set_;
   /** The LSN of the last record written by the transaction. */
   lsn_t prev_lsn_;
+  /** The snapshot the transaction reads, and the timestamp its writes become visible at. */
+  timestamp_t read_ts_{0};
+  timestamp_t commit_ts_{0};
+  /** Whether Commit skips waiting for durability. */
+  bool async_commit_{false};
+  /** The log records that are not in the log yet. */
+  LogArena log_arena_;
 
   /** Concurrent index: the pages that were latched during index operation. */
   // 一个page组成的双端队列，在index操作过程中加锁的
@@ -274,6 +414,10 @@ class Transaction {
   std::shared_ptr<std::unordered_set<RID>> shared_lock_set_;
   /** LockManager: the set of exclusive-locked tuples held by this transaction. */
   std::shared_ptr<std::unordered_set<RID>> exclusive_lock_set_;
+  /** LockManager: the tables locked by this transaction, with their lock mode. */
+  std::shared_ptr<std::unordered_map<table_oid_t, LockMode>> table_lock_map_;
+  /** LockManager: the row locks above that were taken under a table lock, by table. */
+  std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> row_lock_map_;
 };
 
 }  // namespace bustub
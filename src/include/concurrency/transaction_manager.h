@@ -13,13 +13,17 @@
 #pragma once
 
 #include <atomic>
-#include <shared_mutex>
+#include <map>
+#include <mutex>  // NOLINT
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction.h"
+#include "concurrency/transaction_registry.h"
 #include "recovery/log_manager.h"
 
 namespace bustub {
@@ -44,10 +48,24 @@ class TransactionManager {
   Transaction *Begin(Transaction *txn = nullptr, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ);
 
   /**
-   * Commits a transaction.
+   * Begins a read-only transaction. It takes no locks and writes no log records, so it neither holds off checkpoints
+   * nor enters the registry of running transactions: it only registers its snapshot with the vacuum.
+   * @param txn an optional read-only transaction object to be initialized, otherwise a new one is created.
+   * @param isolation_level SNAPSHOT_ISOLATION to read the database as of now, READ_COMMITTED to read the latest
+   * committed version of every row whenever it is read
+   * @return an initialized transaction
+   */
+  Transaction *BeginReadOnly(Transaction *txn = nullptr,
+                             IsolationLevel isolation_level = IsolationLevel::SNAPSHOT_ISOLATION);
+
+  /**
+   * Commits a transaction. A transaction under snapshot isolation is aborted instead if another transaction committed
+   * a write to one of the tuples it wrote after it began. An optimistic transaction is aborted instead if a tuple it
+   * read changed since.
    * @param txn the transaction to commit
+   * @return true if the transaction committed
    */
-  void Commit(Transaction *txn);
+  bool Commit(Transaction *txn);
 
   /**
    * Aborts a transaction
@@ -56,39 +74,72 @@ class TransactionManager {
   void Abort(Transaction *txn);
 
   /**
-   * Global list of running transactions
+   * Locates and returns the running transaction with the given transaction ID. The transaction may finish while the
+   * handle is held, but it is not freed meanwhile if its owner frees it with Retire.
+   * @param txn_id the id of the transaction to be found
+   * @return a handle on the transaction with the given transaction id, on nullptr if it is not running
    */
-
-  /** The transaction map is a global list of all the running transactions in the system. */
-  static std::unordered_map<txn_id_t, Transaction *> txn_map;
-  static std::shared_mutex txn_map_mutex;
+  TransactionHandle GetTransaction(txn_id_t txn_id) { return txns_.Find(txn_id); }
 
   /**
-   * Locates and returns the transaction with the given transaction ID.
-   * @param txn_id the id of the transaction to be found, it must exist!
-   * @return the transaction with the given transaction id
+   * Frees a committed or aborted transaction once no handle found on it is held anymore. A transaction nobody looks
+   * up with GetTransaction can just be deleted instead.
+   * @param txn the finished transaction
    */
-  static Transaction *GetTransaction(txn_id_t txn_id) {
-    TransactionManager::txn_map_mutex.lock_shared();
-    assert(TransactionManager::txn_map.find(txn_id) != TransactionManager::txn_map.end());
-    auto *res = TransactionManager::txn_map[txn_id];
-    assert(res != nullptr);
-    TransactionManager::txn_map_mutex.unlock_shared();
-    return res;
-  }
+  void Retire(Transaction *txn) { txns_.Retire(txn); }
 
-  /** Prevents all transactions from performing operations, used for checkpointing. */
+  /**
+   * Prevents all transactions from performing operations, used for checkpointing. It waits for the running ones to
+   * finish, shard by shard of the registry, and keeps new ones from beginning until ResumeTransactions.
+   */
   void BlockAllTransactions();
 
   /** Resumes all transactions, used for checkpointing. */
   void ResumeTransactions();
 
+  /**
+   * Collects the active transaction table for a fuzzy checkpoint.
+   * @param[out] oldest_lsn the lsn of the oldest BEGIN record of a running transaction, INVALID_LSN if there is none
+   * @return the running transactions and the lsn of the last record each of them has logged
+   */
+  std::vector<std::pair<txn_id_t, lsn_t>> GetActiveTransactionTable(lsn_t *oldest_lsn);
+
+  /**
+   * An asynchronously committed transaction survives a crash once the durable lsn reaches its commit lsn, which is its
+   * prev lsn after Commit returns.
+   * @return the lsn of the most recent durable log record, INVALID_LSN if nothing is durable or logging is off
+   */
+  lsn_t GetDurableLSN() { return log_manager_ == nullptr ? INVALID_LSN : log_manager_->GetPersistentLSN(); }
+
+  /** @return the commit timestamp of the most recently committed transaction, the snapshot a new transaction reads */
+  timestamp_t GetLastCommitTs() const { return last_commit_ts_.load(); }
+
+  /**
+   * @return the snapshot of the oldest running transaction that reads versions, no snapshot older than this can be
+   * taken anymore
+   */
+  timestamp_t GetOldestReadTs();
+
  private:
+  /**
+   * Validates the reads of an optimistic transaction and installs its writes, or aborts it.
+   * @return true if the transaction can go on to commit
+   */
+  bool CommitOptimistic(Transaction *txn);
+
+  /** Rolls back the writes of an aborted transaction, whose write set holds what undoes them, and finishes it. */
+  void Rollback(Transaction *txn);
+
+  /** Finishes a read-only transaction, all there is to do is unregister its snapshot. */
+  void EndReadOnly(Transaction *txn, TransactionState state);
+
   /**
    * Releases all the locks held by the given transaction.
    * @param txn the transaction whose locks should be released
    */
   void ReleaseLocks(Transaction *txn) {
+    // Rows are unlocked before the tables they belong to.
+    txn->GetRowLockMap()->clear();
     std::unordered_set<RID> lock_set;
     for (auto item : *txn->GetExclusiveLockSet()) {
       lock_set.emplace(item);
@@ -99,14 +150,30 @@ class TransactionManager {
     for (auto locked_rid : lock_set) {
       lock_manager_->Unlock(txn, locked_rid);
     }
+    std::vector<table_oid_t> tables;
+    for (const auto &[oid, lock_mode] : *txn->GetTableLockMap()) {
+      tables.push_back(oid);
+    }
+    for (auto oid : tables) {
+      lock_manager_->UnlockTable(txn, oid);
+    }
   }
 
   std::atomic<txn_id_t> next_txn_id_{0};
+  /** Commit timestamps are handed out in order under commit_latch_, and published once every write is stamped. */
+  std::atomic<timestamp_t> last_commit_ts_{0};
+  std::mutex commit_latch_;
   LockManager *lock_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
+  LogManager *log_manager_;
 
-  /** The global transaction latch is used for checkpointing. */
-  ReaderWriterLatch global_txn_latch_;
+  /**
+   * The transactions begun and not yet finished by this manager, with the lsn of their BEGIN record. Its barriers
+   * are used for checkpointing.
+   */
+  TransactionRegistry txns_;
+  /** The snapshots of the running read-only transactions, with how many read each. */
+  std::map<timestamp_t, size_t> read_only_snapshots_;
+  std::mutex read_only_latch_;
 };
 
 }  // namespace bustub
@@ -0,0 +1,140 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry.h
+//
+// Identification: src/include/concurrency/transaction_registry.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "common/config.h"
+#include "common/epoch_manager.h"
+#include "common/rwlatch.h"
+#include "concurrency/transaction.h"
+
+namespace bustub {
+
+/**
+ * TransactionHandle is a running transaction found in a TransactionRegistry. The transaction may finish while the
+ * handle is held, but it stays readable until the handle is released if its owner frees it with Retire.
+ */
+class TransactionHandle {
+ public:
+  TransactionHandle(TransactionHandle &&other) noexcept = default;
+  ~TransactionHandle() = default;
+
+  DISALLOW_COPY(TransactionHandle);
+  TransactionHandle &operator=(TransactionHandle &&other) = delete;
+
+  /** @return the transaction, nullptr if none was found */
+  Transaction *Get() const { return txn_; }
+  Transaction *operator->() const { return txn_; }
+  explicit operator bool() const { return txn_ != nullptr; }
+
+ private:
+  friend class TransactionRegistry;
+  TransactionHandle(EpochGuard guard, Transaction *txn) : guard_(std::move(guard)), txn_(txn) {}
+
+  EpochGuard guard_;
+  Transaction *txn_;
+};
+
+/**
+ * TransactionRegistry holds the running transactions of a transaction manager, with the lsn of their BEGIN record.
+ *
+ * The registry is split into TXN_REGISTRY_SHARDS shards by transaction id, each with its own latch. Transaction ids
+ * are handed out in order, so transactions that begin at the same time land in different shards. Within a shard, a
+ * transaction is chained into one of TXN_REGISTRY_CHAINS chains, again by its id, so adding and removing one takes
+ * constant time as long as no more transactions run at once than the registry has chains. A transaction is removed
+ * when it finishes, the registry only ever holds the running ones.
+ *
+ * Find takes no latch: a chain is only changed by linking its entries in and out, and a removed entry is retired to an
+ * EpochManager and freed once no Find can still be reading it. The handle Find returns holds the same epoch, and the
+ * owner of a finished transaction retires it the same way with Retire, so the memory of finished transactions is
+ * reclaimed as the epochs move on.
+ *
+ * Every shard also has a barrier that checkpoints close: a transaction holds the barrier of its shard open from Begin
+ * until it finishes, and CloseBarriers waits for all of them, so running transactions never share a latch.
+ */
+class TransactionRegistry {
+ public:
+  TransactionRegistry() = default;
+  ~TransactionRegistry();
+
+  DISALLOW_COPY_AND_MOVE(TransactionRegistry);
+
+  /**
+   * Add a transaction. Its snapshot is taken while its shard is latched, so that a scan of the registry either sees
+   * the transaction or a snapshot at least as new as the last commit timestamp the scan read before it.
+   * @param txn the transaction
+   * @param begin_lsn the lsn of its BEGIN record
+   * @param last_commit_ts the commit timestamp the transaction reads as of
+   */
+  void Add(Transaction *txn, lsn_t begin_lsn, const std::atomic<timestamp_t> &last_commit_ts);
+
+  /** Remove a finished transaction. */
+  void Remove(txn_id_t txn_id);
+
+  /** Free a finished transaction once no handle found on it is held anymore. */
+  void Retire(Transaction *txn) { epochs_.RetireObject(txn); }
+
+  /** @return a handle on the running transaction with the given id, on nullptr if there is none */
+  TransactionHandle Find(txn_id_t txn_id);
+
+  /**
+   * Call visit with every running transaction and the lsn of its BEGIN record, one shard at a time. The shard stays
+   * latched while it is visited, so no transaction visited can finish meanwhile.
+   */
+  void ForEach(const std::function<void(Transaction *, lsn_t)> &visit);
+
+  /** Pass the barrier of the shard of a beginning transaction, waiting while the barriers are closed. */
+  void EnterBarrier(txn_id_t txn_id) { ShardOf(txn_id)->barrier_.RLock(); }
+
+  /** Leave the barrier of the shard of a finished transaction. */
+  void LeaveBarrier(txn_id_t txn_id) { ShardOf(txn_id)->barrier_.RUnlock(); }
+
+  /** Close the barrier of every shard, once every transaction that passed it has left. */
+  void CloseBarriers();
+
+  /** Open the barriers again. */
+  void OpenBarriers();
+
+ private:
+  struct Entry {
+    txn_id_t txn_id_;
+    Transaction *txn_;
+    lsn_t begin_lsn_;
+    std::atomic<Entry *> next_;
+  };
+
+  struct alignas(64) Shard {
+    /** Serializes the changes to the shard. */
+    std::mutex latch_;
+    /** Held in shared mode by the running transactions of the shard, and exclusively by a checkpoint. */
+    ReaderWriterLatch barrier_;
+    std::array<std::atomic<Entry *>, TXN_REGISTRY_CHAINS> chains_{};
+  };
+
+  Shard *ShardOf(txn_id_t txn_id) { return &shards_[static_cast<size_t>(txn_id) % TXN_REGISTRY_SHARDS]; }
+
+  /** @return the chain of the shard the transaction is in */
+  static std::atomic<Entry *> *ChainOf(Shard *shard, txn_id_t txn_id) {
+    return &shard->chains_[static_cast<size_t>(txn_id) / TXN_REGISTRY_SHARDS % TXN_REGISTRY_CHAINS];
+  }
+
+  std::array<Shard, TXN_REGISTRY_SHARDS> shards_;
+  EpochManager epochs_;
+};
+
+}  // namespace bustub
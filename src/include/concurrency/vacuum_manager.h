@@ -0,0 +1,116 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// vacuum_manager.h
+//
+// Identification: src/include/concurrency/vacuum_manager.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <thread>              // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "catalog/schema.h"
+#include "concurrency/transaction_manager.h"
+#include "storage/index/index.h"
+#include "storage/table/table_heap.h"
+
+namespace bustub {
+
+/**
+ * VacuumManager reclaims what no snapshot needs anymore from the tables it is given.
+ *
+ * A vacuum round walks the pages of every table. It drops the row versions no running transaction can see, removes
+ * the index entries of rows that are gone for good and releases the empty slots at the end of each page. Pages left
+ * without slots are unlinked from their table, and handed back to the buffer pool one round later, when nobody can
+ * still be on the way through them.
+ *
+ * To keep out of the way of foreground work, a round naps for cost_delay after every cost_limit pages it visits.
+ */
+class VacuumManager {
+ public:
+  VacuumManager(TransactionManager *transaction_manager, BufferPoolManager *buffer_pool_manager,
+                size_t cost_limit = VACUUM_COST_LIMIT, std::chrono::milliseconds cost_delay = vacuum_cost_delay)
+      : transaction_manager_(transaction_manager),
+        buffer_pool_manager_(buffer_pool_manager),
+        cost_limit_(cost_limit),
+        cost_delay_(cost_delay) {}
+
+  ~VacuumManager() {
+    if (vacuum_thread_ != nullptr) {
+      StopVacuumThread();
+    }
+  }
+
+  /**
+   * Vacuum a table from now on. Tables are not removed again, they have to outlive the manager.
+   * @param table the table
+   * @param schema the schema of its tuples
+   * @param indexes the indexes on the table, whose entries for the rows that are gone get removed
+   */
+  void AddTable(TableHeap *table, const Schema *schema, std::vector<Index *> indexes = {});
+
+  /** Vacuum every table once. */
+  void Vacuum();
+
+  /** Start a thread that vacuums every table every vacuum_interval. */
+  void RunVacuumThread();
+  void StopVacuumThread();
+
+  /** @return the number of pages handed back to the buffer pool */
+  size_t GetFreedPageCount() const { return freed_page_count_; }
+
+  /** @return the number of index entries removed */
+  size_t GetRemovedEntryCount() const { return removed_entry_count_; }
+
+ private:
+  struct VacuumTarget {
+    TableHeap *table_;
+    const Schema *schema_;
+    std::vector<Index *> indexes_;
+  };
+
+  /** Walk the pages of one table. */
+  void VacuumTable(const VacuumTarget &target, timestamp_t oldest_ts);
+
+  /**
+   * Count a page about to be visited, and nap first if cost_limit pages were visited since the last nap.
+   * @return false if the vacuum thread is being stopped
+   */
+  bool Throttle();
+
+  /** The body of the vacuum thread. */
+  void VacuumThreadLoop();
+
+  TransactionManager *transaction_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  size_t cost_limit_;
+  std::chrono::milliseconds cost_delay_;
+  size_t cost_{0};
+
+  /** Held for a whole round, rounds do not overlap. */
+  std::mutex vacuum_latch_;
+  std::vector<VacuumTarget> targets_;
+  /** The pages unlinked by the last round, deleted by the next one. */
+  std::vector<page_id_t> unlinked_pages_;
+
+  std::atomic<size_t> freed_page_count_{0};
+  std::atomic<size_t> removed_entry_count_{0};
+
+  std::thread *vacuum_thread_{nullptr};
+  bool stop_requested_{false};
+  std::mutex latch_;
+  std::condition_variable cv_;
+};
+
+}  // namespace bustub
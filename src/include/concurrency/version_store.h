@@ -0,0 +1,122 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// version_store.h
+//
+// Identification: src/include/concurrency/version_store.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "common/config.h"
+#include "common/rid.h"
+#include "concurrency/transaction.h"
+#include "storage/table/tuple.h"
+
+namespace bustub {
+
+/**
+ * VersionStore keeps the older versions of the rows of a table heap, for transactions reading a snapshot.
+ *
+ * The table page holds the newest version of every row, committed or not. Before a transaction first changes a row,
+ * the version it replaces is pushed onto the row's version chain here, stamped with the commit timestamp it was
+ * written at. The chain also remembers the transaction whose change is pending and, once that one commits, the
+ * timestamp of the version on the page. A snapshot at timestamp ts sees the newest version that was committed at ts
+ * or before, a transaction always sees its own changes.
+ *
+ * The versions a commit replaced are trimmed right away when no snapshot older than the commit is running, so only a
+ * running snapshot keeps versions around. What an older snapshot still sees is left to the vacuum. Trimming only
+ * drops versions nobody can read, it does not need the page.
+ *
+ * Writers of a row are serialized: by the row lock, or for transactions under snapshot isolation, by CanWrite. The
+ * table heap latches the page around every call, so the page and the chain change together.
+ */
+class VersionStore {
+ public:
+  /** A version of a row older than the one on the page. */
+  struct TupleVersion {
+    Tuple tuple_;
+    /** False if the row did not exist in this version. */
+    bool exists_;
+    /** The version was committed at begin_ts_ and replaced at end_ts_. */
+    timestamp_t begin_ts_;
+    timestamp_t end_ts_;
+  };
+
+  /** @return false if another transaction has a change to the row pending */
+  bool CanWrite(const RID &rid, Transaction *txn);
+
+  /**
+   * Save the version of a row the transaction replaces, unless the transaction has changed the row before.
+   * @param tuple the replaced version, nullptr if the row did not exist
+   */
+  void BeforeWrite(const RID &rid, Transaction *txn, const Tuple *tuple);
+
+  /** @return true if a version of a row the transaction changed was committed after the transaction began */
+  bool HasWriteConflict(const RID &rid, Transaction *txn);
+
+  /** Stamp the transaction's change to the row with its commit timestamp. */
+  void Commit(const RID &rid, Transaction *txn, timestamp_t commit_ts);
+
+  /** Forget the transaction's change to the row, once the page holds the replaced version again. */
+  void Abort(const RID &rid, Transaction *txn);
+
+  /**
+   * Find the version of a row the transaction sees.
+   * @param on_page true if the page holds the row and it is not marked deleted
+   * @param[in,out] tuple the row as on the page, replaced with an older version if that is the one seen
+   * @return true if the transaction sees the row
+   */
+  bool Read(const RID &rid, Transaction *txn, bool on_page, Tuple *tuple);
+
+  /**
+   * Drop the versions of a row that no snapshot at or after oldest_ts sees, for the vacuum.
+   * @param[out] dropped the dropped versions in which the row existed, oldest first
+   * @return true if the row still has older versions
+   */
+  bool Prune(const RID &rid, timestamp_t oldest_ts, std::vector<Tuple> *dropped);
+
+  /**
+   * Drop the versions of a row that no snapshot at or after oldest_ts sees, once the transaction that wrote it commits.
+   * The versions of a deleted row are left to the vacuum, if the table has one: they lead it to the row's index
+   * entries.
+   * @param deleted true if the row was deleted
+   */
+  void Trim(const RID &rid, timestamp_t oldest_ts, bool deleted);
+
+  /** Leave the versions of deleted rows to the vacuum, from now on. */
+  void KeepDeletedVersions() { keep_deleted_ = true; }
+
+  /** @return true if the row has older versions or a pending change */
+  bool HasVersions(const RID &rid);
+
+  /** @return the number of versions kept for all rows */
+  size_t GetVersionCount();
+
+ private:
+  /** The versions of a row older than the one on the page, the newest at the back. */
+  struct VersionChain {
+    /** The transaction whose change to the row is pending, if any. */
+    txn_id_t writer_{INVALID_TXN_ID};
+    /** When the version on the page was committed. */
+    timestamp_t begin_ts_{0};
+    std::vector<TupleVersion> versions_;
+  };
+
+  std::mutex latch_;
+  std::unordered_map<RID, VersionChain> chains_;
+  size_t version_count_{0};
+  /** True once a vacuum removes the index entries of the deleted rows. */
+  std::atomic<bool> keep_deleted_{false};
+};
+
+}  // namespace bustub
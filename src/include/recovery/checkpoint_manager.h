@@ -12,6 +12,12 @@
 
 #pragma once
 
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <thread>              // NOLINT
+#include <utility>
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/transaction_manager.h"
 #include "recovery/log_manager.h"
@@ -19,7 +25,15 @@
 namespace bustub {
 
 /**
- * CheckpointManager creates consistent checkpoints by blocking all other transactions temporarily.
+ * CheckpointManager takes ARIES-style fuzzy checkpoints while transactions keep running.
+ *
+ * A checkpoint logs a BEGIN_CHECKPOINT record, then an END_CHECKPOINT record holding the active transaction table and
+ * the dirty page table with each page's recLSN. Nothing is flushed on the way. Once the records are durable the log
+ * master record is pointed at the checkpoint, and at the redo point: the oldest of the recLSNs, the running
+ * transactions' first records and the checkpoint itself. The log segments before the redo point are recycled.
+ *
+ * The checkpoint thread writes out the pages of the last dirty page table in the background, so that the redo point
+ * of the next checkpoint can move past them.
  */
 class CheckpointManager {
  public:
@@ -29,15 +43,42 @@ class CheckpointManager {
         log_manager_(log_manager),
         buffer_pool_manager_(buffer_pool_manager) {}
 
-  ~CheckpointManager() = default;
+  ~CheckpointManager() {
+    if (checkpoint_thread_ != nullptr) {
+      StopCheckpointThread();
+    }
+  }
 
+  /** Log the checkpoint records, without blocking transactions or flushing pages. */
   void BeginCheckpoint();
+
+  /** Wait for the checkpoint records to become durable, point the log master record at them and truncate the log. */
   void EndCheckpoint();
 
+  /** Start a thread that takes a checkpoint every checkpoint_interval and flushes the dirty pages it found. */
+  void RunCheckpointThread();
+  void StopCheckpointThread();
+
  private:
-  TransactionManager *transaction_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** The body of the checkpoint thread. */
+  void CheckpointThreadLoop();
+
+  TransactionManager *transaction_manager_;
+  LogManager *log_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+
+  /** The BEGIN_CHECKPOINT and END_CHECKPOINT records of the checkpoint in progress. */
+  lsn_t begin_lsn_{INVALID_LSN};
+  lsn_t end_lsn_{INVALID_LSN};
+  /** Recovery of the checkpoint in progress needs no log record older than this. */
+  lsn_t redo_lsn_{INVALID_LSN};
+  /** The dirty page table of the checkpoint in progress. */
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_page_table_;
+
+  std::thread *checkpoint_thread_{nullptr};
+  bool stop_requested_{false};
+  std::mutex latch_;
+  std::condition_variable cv_;
 };
 
 }  // namespace bustub
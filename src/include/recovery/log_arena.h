@@ -0,0 +1,62 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_arena.h
+//
+// Identification: src/include/recovery/log_arena.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "common/config.h"
+#include "common/macros.h"
+
+namespace bustub {
+
+class LogManager;
+class Page;
+
+/**
+ * LogArena is a transaction's private log buffer. The transaction's table changes serialize their log records here
+ * instead of reserving space in the shared log buffer one record at a time. The log manager publishes the whole arena
+ * with a single reservation, which is when the records get their lsns. See LogManager::AppendToArena.
+ */
+class LogArena {
+  friend class LogManager;
+
+ public:
+  LogArena() = default;
+
+  /** A transaction that ends without committing or aborting loses what it has not published, as in a crash. */
+  ~LogArena();
+
+  DISALLOW_COPY_AND_MOVE(LogArena);
+
+  /** @return true if no record is waiting to be published */
+  bool IsEmpty() {
+    std::scoped_lock arena_latch(latch_);
+    return record_count_ == 0;
+  }
+
+ private:
+  /** Held while records are added or published, the arena may be published by other threads. */
+  std::mutex latch_;
+  /** The serialized records, their lsn and prev lsn fields are filled in when they are published. */
+  std::vector<char> bytes_;
+  int record_count_{0};
+  /** Every page the records change, with the index of the last record that changes it. */
+  std::vector<std::pair<Page *, int>> pages_;
+  /** The log manager the arena is registered with, nullptr while it is not. */
+  LogManager *log_manager_{nullptr};
+  txn_id_t txn_id_{INVALID_TXN_ID};
+};
+
+}  // namespace bustub
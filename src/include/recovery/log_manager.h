@@ -13,10 +13,18 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <condition_variable>  // NOLINT
-#include <future>              // NOLINT
-#include <mutex>               // NOLINT
-
+#include <cstdint>
+#include <future>  // NOLINT
+#include <map>
+#include <mutex>  // NOLINT
+#include <shared_mutex>
+#include <thread>  // NOLINT
+#include <unordered_map>
+
+#include "concurrency/transaction.h"
 #include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
 
@@ -25,20 +33,43 @@ namespace bustub {
 /**
  * LogManager maintains a separate thread that is awakened whenever the log buffer is full or whenever a timeout
  * happens. When the thread is awakened, the log buffer's content is written into the disk log file.
+ *
+ * The log is double-buffered: records are appended to the active buffer while the flush thread writes out the other
+ * one, and the two trade places whenever a flush starts. Every transaction waiting for durability is released by the
+ * same flush, so concurrent commits share a single WriteLog.
+ *
+ * Appends do not take a latch. The next lsn, the active buffer and the first free byte in it live in one atomic word,
+ * so a single compare-and-swap hands out both the lsn and the space for a record. Threads then serialize their records
+ * in parallel and publish how many bytes they have filled; the flush thread seals the active buffer with the same kind
+ * of compare-and-swap and waits only until the bytes before the seal are filled.
+ *
+ * A transaction's table changes do not reserve space one record at a time. Their records are serialized into the
+ * transaction's log arena and published together, with one reservation, when the transaction commits or aborts, when
+ * the arena fills up, or when the log has to be forced for one of the pages they change. Until then a changed page
+ * names the transaction whose arena holds its changes. Another transaction that changes the page publishes that arena
+ * first, so the changes of every page are logged in the order they were made, and the buffer pool publishes it before
+ * it writes the page out.
  */
 class LogManager {
  public:
   explicit LogManager(DiskManager *disk_manager)
-      : next_lsn_(0), persistent_lsn_(INVALID_LSN), disk_manager_(disk_manager) {
-    log_buffer_ = new char[LOG_BUFFER_SIZE];
-    flush_buffer_ = new char[LOG_BUFFER_SIZE];
+      : reservation_(0),
+        persistent_lsn_(INVALID_LSN),
+        flush_thread_(nullptr),
+        flushed_offset_(disk_manager->GetLogTail()),
+        disk_manager_(disk_manager) {
+    log_buffers_[0] = new char[LOG_BUFFER_SIZE];
+    log_buffers_[1] = new char[LOG_BUFFER_SIZE];
   }
 
   ~LogManager() {
-    delete[] log_buffer_;
-    delete[] flush_buffer_;
-    log_buffer_ = nullptr;
-    flush_buffer_ = nullptr;
+    if (flush_thread_ != nullptr) {
+      StopFlushThread();
+    }
+    delete[] log_buffers_[0];
+    delete[] log_buffers_[1];
+    log_buffers_[0] = nullptr;
+    log_buffers_[1] = nullptr;
   }
 
   void RunFlushThread();
@@ -46,29 +77,161 @@ class LogManager {
 
   lsn_t AppendLogRecord(LogRecord *log_record);
 
-  inline lsn_t GetNextLSN() { return next_lsn_; }
+  /**
+   * Append a record of a change to a page to the transaction's log arena, the caller holds the page's write latch. If
+   * another transaction's arena holds changes to the page it is published first. The record gets its lsn and prev lsn
+   * when the arena is published, which also sets the page lsn.
+   * @param txn the transaction making the change
+   * @param log_record the record
+   * @param page the changed page, nullptr if the record changes no page
+   */
+  void AppendToArena(Transaction *txn, LogRecord *log_record, Page *page);
+
+  /**
+   * Move the records in the transaction's log arena into the log buffer with a single reservation.
+   * @return the lsn of the transaction's last record in the log
+   */
+  lsn_t PublishArena(Transaction *txn);
+
+  /** Publish the arena that holds changes to the page, if there is one, before the page is written out. */
+  void PublishArenaOf(Page *page);
+
+  /** Stop tracking a transaction's log arena, once the transaction is over. */
+  void ReleaseArena(LogArena *arena);
+
+  /** Wait for the arenas being published to have set their pages' lsns and their transactions' prev lsns. */
+  void WaitForArenaPublishes();
+
+  /**
+   * Block until every log record up to and including lsn is on disk, forcing a flush if it is not.
+   * @param lsn the log sequence number that must become durable
+   */
+  void WaitUntilPersistent(lsn_t lsn);
+
+  /**
+   * Make sure every log record up to and including lsn is written out within async_commit_delay, without waiting for it.
+   * Without a flush thread the log is flushed right away.
+   * @param lsn the log sequence number that must become durable
+   */
+  void FlushWithinDelay(lsn_t lsn);
+
+  /**
+   * Continue the log after a restart, recovery calls this with one past the last lsn it found, before anything is
+   * appended.
+   * @param lsn the lsn the next appended record gets
+   */
+  void SetNextLSN(lsn_t lsn);
+
+  /**
+   * Find where a durable log record lives in the log. Only the flushes done since this log manager started, or since
+   * the last SetNextLSN, are known.
+   * @param lsn the lsn of the record, no greater than the persistent lsn
+   * @param[out] offset offset of the flush that wrote the record
+   * @param[out] first_lsn lsn of the record at offset, the first one of that flush
+   * @return false if the flush that wrote lsn is not known
+   */
+  bool GetFlushedLocation(lsn_t lsn, int64_t *offset, lsn_t *first_lsn);
+
+  /**
+   * Forget the flushes before the one holding lsn, once the log before it has been truncated.
+   * @param lsn the oldest lsn that may still be looked up
+   */
+  void TrimFlushedLocations(lsn_t lsn);
+
+  inline lsn_t GetNextLSN() { return ReservedLSN(reservation_.load()); }
   inline lsn_t GetPersistentLSN() { return persistent_lsn_; }
   inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
-  inline char *GetLogBuffer() { return log_buffer_; }
+  inline DiskManager *GetDiskManager() { return disk_manager_; }
+  inline char *GetLogBuffer() { return log_buffers_[ReservedBuffer(reservation_.load())]; }
 
  private:
-  // TODO(students): you may add your own member variables
-
-  /** The atomic counter which records the next log sequence number. */
-  std::atomic<lsn_t> next_lsn_;
+  /*
+   * Layout of the reservation word:
+   * ---------------------------------------------------
+   * | next lsn (32) | active buffer (1) | offset (31) |
+   * ---------------------------------------------------
+   */
+  static constexpr uint64_t OFFSET_MASK = (1ULL << 31) - 1;
+  static constexpr uint64_t BUFFER_BIT = 1ULL << 31;
+  static constexpr int LSN_SHIFT = 32;
+
+  static lsn_t ReservedLSN(uint64_t reservation) { return static_cast<lsn_t>(reservation >> LSN_SHIFT); }
+  static int ReservedBuffer(uint64_t reservation) { return (reservation & BUFFER_BIT) != 0 ? 1 : 0; }
+  static int ReservedOffset(uint64_t reservation) { return static_cast<int>(reservation & OFFSET_MASK); }
+
+  /**
+   * Seal the active buffer, switch appends to the other one, and write out the sealed buffer once every reservation in
+   * it has been filled. Only one thread flushes at a time.
+   */
+  void FlushLogBuffer();
+
+  /** The body of the flush thread. */
+  void FlushThreadLoop();
+
+  /**
+   * Reserve room for records in the active log buffer, waiting for a flush if it is full.
+   * @param size the size of the records in bytes
+   * @param count the number of records
+   * @param[out] buffer the log buffer the room is in
+   * @param[out] offset where the room starts in the buffer
+   * @return the lsn of the first record
+   */
+  lsn_t Reserve(int size, int count, int *buffer, int *offset);
+
+  /** PublishArena with the arena latch held. */
+  lsn_t PublishArenaLocked(Transaction *txn);
+
+  /**
+   * Serialize a log record, the layout is described in log_record.h.
+   * @param log_record the record, with its lsn already assigned
+   * @param dest where to write log_record->GetSize() bytes
+   */
+  static void SerializeLogRecord(const LogRecord &log_record, char *dest);
+
+  /** The next lsn, the active buffer and its first free byte, see the layout above. */
+  std::atomic<uint64_t> reservation_;
   /** The log records before and including the persistent lsn have been written to disk. */
   std::atomic<lsn_t> persistent_lsn_;
 
-  char *log_buffer_;
-  char *flush_buffer_;
+  /** The two log buffers, the active one is named by the reservation word. */
+  char *log_buffers_[2];
+  /** Number of bytes of each buffer that have been completely serialized. */
+  std::atomic<int> filled_bytes_[2]{};
 
+  /** Serializes flushes, held for the whole seal-wait-write sequence. */
+  std::mutex flush_latch_;
+  /** Protects the flags below and pairs with the condition variables; never taken on the append fast path. */
   std::mutex latch_;
 
-  std::thread *flush_thread_ __attribute__((__unused__));
+  std::thread *flush_thread_;
 
-  std::condition_variable cv_;
+  /** Set when someone needs the log buffer flushed before the next timeout. */
+  bool flush_requested_{false};
+  /** Set by StopFlushThread, the flush thread exits after its final flush. */
+  bool stop_requested_{false};
+  /** Set when an asynchronous commit is waiting in the log buffer, the next flush must start by the deadline. */
+  bool deadline_flush_requested_{false};
+  std::chrono::steady_clock::time_point flush_deadline_;
 
-  DiskManager *disk_manager_ __attribute__((__unused__));
+  /** Wakes up the flush thread. */
+  std::condition_variable cv_;
+  /** Wakes up appenders waiting for room in the log buffer. */
+  std::condition_variable append_cv_;
+  /** Wakes up transactions waiting for their records to become durable. */
+  std::condition_variable persistent_cv_;
+
+  /** The first lsn of every flush and the log offset it was written at, protected by latch_. */
+  std::map<lsn_t, int64_t> flushed_locations_;
+  /** The log offset the next flush is written at, only touched under flush_latch_. */
+  int64_t flushed_offset_;
+
+  /** The transactions whose log arenas are in use, so that their arenas can be published for a page. */
+  std::unordered_map<txn_id_t, Transaction *> arena_txns_;
+  std::shared_mutex arena_txns_latch_;
+  /** Shared by arena publishes while they set lsns, taken exclusively to wait for them. */
+  std::shared_mutex publish_latch_;
+
+  DiskManager *disk_manager_;
 };
 
 }  // namespace bustub
@@ -13,7 +13,10 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "storage/table/tuple.h"
@@ -32,6 +35,37 @@ enum class LogRecordType {
   ABORT,
   /** Creating a new page in the table heap. */
   NEWPAGE,
+  /** A fuzzy checkpoint starts, the tables in the matching END_CHECKPOINT are as of this point. */
+  BEGIN_CHECKPOINT,
+  END_CHECKPOINT,
+  /** An update that keeps the tuple's size, only the changed byte ranges are logged. */
+  UPDATE_DELTA,
+  /*
+   * Changes to B+ tree pages. They are redo-only and belong to no transaction: an index change that has to be taken
+   * back is undone by a logical index operation, see INDEX_KEY_INSERT, whose page changes are logged in turn.
+   */
+  /** An entry inserted into an index page, the entries from its position on move up. */
+  INDEX_INSERT,
+  /** An entry removed from an index page, the entries after it move down. */
+  INDEX_DELETE,
+  /** The used part of an index page after a split, merge or redistribution, or for a new page. */
+  INDEX_PAGE,
+  /** A new parent page id written into an index page. */
+  INDEX_SET_PARENT,
+  /** A new root page id for an index in the header page. The header page has no lsn, redoing this is idempotent. */
+  INDEX_ROOT,
+  /**
+   * An empty table page taken out of its table by the vacuum, the pages before and after it now link to each other.
+   * Redo-only, it belongs to no transaction.
+   */
+  UNLINKPAGE,
+  /**
+   * A key a transaction inserted into an index, logged ahead of the page changes. It changes no page by itself and is
+   * never redone, undo removes the key again.
+   */
+  INDEX_KEY_INSERT,
+  /** A key a transaction removed from an index, undo puts it back. */
+  INDEX_KEY_DELETE,
 };
 
 /**
@@ -53,10 +87,28 @@ enum class LogRecordType {
  *-----------------------------------------------------------------------------------
  * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size | new_tuple_data |
  *-----------------------------------------------------------------------------------
- * For new page type log record
- *--------------------------
- * | HEADER | prev_page_id |
- *--------------------------
+ * For delta update type log record, offset and length are 16 bits each
+ *---------------------------------------------------------------------------------------------
+ * | HEADER | tuple_rid | tuple_size | range_count | (offset, length, old_bytes, new_bytes) ... |
+ *---------------------------------------------------------------------------------------------
+ * For new page type log record, and for the unlink type, whose page_id is the page after the unlinked one
+ *------------------------------------
+ * | HEADER | prev_page_id | page_id |
+ *------------------------------------
+ * For index type log records, value is the entry position for INDEX_INSERT/INDEX_DELETE and the parent page id for
+ * INDEX_SET_PARENT. The bytes are the inserted or removed entry, the page image for INDEX_PAGE and the index name
+ * for INDEX_ROOT, whose page_id is the new root.
+ *----------------------------------------------------
+ * | HEADER | page_id | value | byte_count | bytes |
+ *----------------------------------------------------
+ * For index key type log records, the key is the index's key type as it is in memory
+ *-------------------------------------------------------------------------
+ * | HEADER | rid | name_size | index_name | key_size | key |
+ *-------------------------------------------------------------------------
+ * For end checkpoint type log record, prevLSN is the lsn of its BEGIN_CHECKPOINT
+ *-------------------------------------------------------------------------------------
+ * | HEADER | txn_count | (txn_id, last_lsn) ... | page_count | (page_id, rec_lsn) ... |
+ *-------------------------------------------------------------------------------------
  */
 class LogRecord {
   friend class LogManager;
@@ -85,20 +137,26 @@ class LogRecord {
     size_ = HEADER_SIZE + sizeof(RID) + sizeof(int32_t) + tuple.GetLength();
   }
 
-  // constructor for UPDATE type
+  // constructor for UPDATE type, and for UPDATE_DELTA type if both tuples have the same size
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &update_rid,
             const Tuple &old_tuple, const Tuple &new_tuple)
-      : txn_id_(txn_id),
-        prev_lsn_(prev_lsn),
-        log_record_type_(log_record_type),
-        update_rid_(update_rid),
-        old_tuple_(old_tuple),
-        new_tuple_(new_tuple) {
+      : txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type), update_rid_(update_rid) {
+    if (log_record_type == LogRecordType::UPDATE_DELTA) {
+      assert(old_tuple.GetLength() == new_tuple.GetLength());
+      EncodeDelta(old_tuple.GetData(), new_tuple.GetData(), old_tuple.GetLength());
+      // calculate log record size, each range costs its offset and length plus both images
+      size_ = HEADER_SIZE + sizeof(RID) + 2 * sizeof(int32_t) + delta_ranges_.size() * DELTA_RANGE_HEADER_SIZE +
+              delta_images_.size();
+      return;
+    }
+    assert(log_record_type == LogRecordType::UPDATE);
+    old_tuple_ = old_tuple;
+    new_tuple_ = new_tuple;
     // calculate log record size
     size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() + new_tuple.GetLength() + 2 * sizeof(int32_t);
   }
 
-  // constructor for NEWPAGE type
+  // constructor for NEWPAGE and UNLINKPAGE type
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t prev_page_id, page_id_t page_id)
       : size_(HEADER_SIZE),
         txn_id_(txn_id),
@@ -110,6 +168,46 @@ class LogRecord {
     size_ = HEADER_SIZE + sizeof(page_id_t) * 2;
   }
 
+  // constructor for END_CHECKPOINT type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            std::vector<std::pair<txn_id_t, lsn_t>> active_txn_table,
+            std::vector<std::pair<page_id_t, lsn_t>> dirty_page_table)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        active_txn_table_(std::move(active_txn_table)),
+        dirty_page_table_(std::move(dirty_page_table)) {
+    // calculate log record size, header size + two counts + the entries of both tables
+    size_ = HEADER_SIZE + 2 * sizeof(int32_t) +
+            (active_txn_table_.size() + dirty_page_table_.size()) * (sizeof(int32_t) + sizeof(lsn_t));
+  }
+
+  // constructor for the index types, they are redo-only and carry no transaction
+  LogRecord(LogRecordType log_record_type, page_id_t page_id, int32_t index_value, const char *index_bytes,
+            uint32_t byte_count)
+      : log_record_type_(log_record_type),
+        page_id_(page_id),
+        index_value_(index_value),
+        index_bytes_(index_bytes, index_bytes + byte_count) {
+    assert(log_record_type >= LogRecordType::INDEX_INSERT && log_record_type <= LogRecordType::INDEX_ROOT);
+    // calculate log record size, header size + page id + value + byte count + bytes
+    size_ = HEADER_SIZE + sizeof(page_id_t) + 2 * sizeof(int32_t) + byte_count;
+  }
+
+  // constructor for INDEX_KEY_INSERT/INDEX_KEY_DELETE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, std::string index_name, const char *key,
+            uint32_t key_size, const RID &rid)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        index_bytes_(key, key + key_size),
+        index_name_(std::move(index_name)),
+        index_rid_(rid) {
+    assert(log_record_type == LogRecordType::INDEX_KEY_INSERT || log_record_type == LogRecordType::INDEX_KEY_DELETE);
+    // calculate log record size, header size + rid + both sizes + name + key
+    size_ = HEADER_SIZE + sizeof(RID) + 2 * sizeof(int32_t) + index_name_.size() + key_size;
+  }
+
   ~LogRecord() = default;
 
   inline Tuple &GetDeleteTuple() { return delete_tuple_; }
@@ -128,6 +226,39 @@ class LogRecord {
 
   inline page_id_t GetNewPageRecord() { return prev_page_id_; }
 
+  inline std::vector<std::pair<txn_id_t, lsn_t>> &GetActiveTxnTable() { return active_txn_table_; }
+
+  inline std::vector<std::pair<page_id_t, lsn_t>> &GetDirtyPageTable() { return dirty_page_table_; }
+
+  inline uint32_t GetDeltaTupleSize() const { return delta_tuple_size_; }
+
+  inline page_id_t GetIndexPageId() const { return page_id_; }
+
+  inline int32_t GetIndexValue() const { return index_value_; }
+
+  inline const std::vector<char> &GetIndexBytes() const { return index_bytes_; }
+
+  inline const std::string &GetIndexName() const { return index_name_; }
+
+  inline const RID &GetIndexRID() const { return index_rid_; }
+
+  inline bool IsIndexRecord() const {
+    return log_record_type_ >= LogRecordType::INDEX_INSERT && log_record_type_ <= LogRecordType::INDEX_ROOT;
+  }
+
+  /**
+   * Write the images of a delta update over a copy of the tuple.
+   * @param tuple_data the tuple's bytes, GetDeltaTupleSize() of them
+   * @param redo true to write the new bytes, false to write the old ones back
+   */
+  inline void ApplyDelta(char *tuple_data, bool redo) const {
+    const char *image = delta_images_.data();
+    for (const auto &[offset, length] : delta_ranges_) {
+      memcpy(tuple_data + offset, image + (redo ? length : 0), length);
+      image += 2 * length;
+    }
+  }
+
   inline int32_t GetSize() { return size_; }
 
   inline lsn_t GetLSN() { return lsn_; }
@@ -138,6 +269,8 @@ class LogRecord {
 
   inline LogRecordType &GetLogRecordType() { return log_record_type_; }
 
+  inline LogRecordType GetLogRecordType() const { return log_record_type_; }
+
   // For debug purpose
   inline std::string ToString() const {
     std::ostringstream os;
@@ -152,6 +285,35 @@ class LogRecord {
   }
 
  private:
+  /** Bytes of a delta range's offset and length. */
+  static constexpr size_t DELTA_RANGE_HEADER_SIZE = 2 * sizeof(uint16_t);
+
+  /**
+   * Find the byte ranges where two tuples of the same size differ. Runs separated by fewer unchanged bytes than a range
+   * header costs are merged.
+   */
+  void EncodeDelta(const char *old_data, const char *new_data, uint32_t size) {
+    delta_tuple_size_ = size;
+    uint32_t pos = 0;
+    while (pos < size) {
+      if (old_data[pos] == new_data[pos]) {
+        pos++;
+        continue;
+      }
+      uint32_t begin = pos;
+      uint32_t end = pos + 1;
+      for (uint32_t scan = end; scan < size && scan - end <= DELTA_RANGE_HEADER_SIZE / 2; scan++) {
+        if (old_data[scan] != new_data[scan]) {
+          end = scan + 1;
+        }
+      }
+      delta_ranges_.emplace_back(static_cast<uint16_t>(begin), static_cast<uint16_t>(end - begin));
+      delta_images_.insert(delta_images_.end(), old_data + begin, old_data + end);
+      delta_images_.insert(delta_images_.end(), new_data + begin, new_data + end);
+      pos = end;
+    }
+  }
+
   // the length of log record(for serialization, in bytes)
   int32_t size_{0};
   // must have fields
@@ -176,6 +338,24 @@ class LogRecord {
   // case4: for new page operation
   page_id_t prev_page_id_{INVALID_PAGE_ID};
   page_id_t page_id_{INVALID_PAGE_ID};
+
+  // case5: for end checkpoint, the running transactions with their last lsn and the dirty pages with their recLSN
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txn_table_;
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_page_table_;
+
+  // case6: for delta update, the (offset, length) of every changed range, and their old then new bytes one range
+  // after the other
+  uint32_t delta_tuple_size_{0};
+  std::vector<std::pair<uint16_t, uint16_t>> delta_ranges_;
+  std::vector<char> delta_images_;
+
+  // case7: for index page changes, page_id_ is the page (or the new root), see the layout above
+  int32_t index_value_{0};
+  std::vector<char> index_bytes_;
+
+  // case8: for index key changes, index_bytes_ is the key
+  std::string index_name_;
+  RID index_rid_;
   static const int HEADER_SIZE = 20;
 };  // namespace bustub
 
@@ -13,22 +13,53 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
 #include <mutex>  // NOLINT
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/lock_manager.h"
+#include "recovery/log_manager.h"
 #include "recovery/log_record.h"
 
 namespace bustub {
 
 /**
  * Read log file from disk, redo and undo.
+ *
+ * Recovery starts at the redo point named by the log master record rather than at the beginning of the log, and stops
+ * at the first record that is torn, zeroed, or does not continue the lsn sequence (stale data in a recycled segment).
+ * Once the end of the log is found the disk manager and, if given, the log manager are told where to continue the log.
+ *
+ * Redo first runs an analysis pass that rebuilds the active transaction table and the dirty page table, starting from
+ * the tables in the last checkpoint's END_CHECKPOINT record, then repeats history only for the dirty pages and only
+ * from their recLSN on.
+ *
+ * Redo is parallel: one thread reads the log and routes every record to the worker that owns its page (page id modulo
+ * the number of workers), so each page still sees its records in log order while different pages are redone at the
+ * same time. Undo rolls back each loser transaction on a worker of its own. With a log manager every change undo makes
+ * is logged like the change it reverts, chained to the loser's records, and an ABORT record ends each loser: if the
+ * system crashes again, redo repeats what undo did and analysis no longer counts the finished losers as active.
+ *
+ * The analysis pass also lists the pages redo will touch in the order it will first touch them. A prefetcher reads
+ * them into the buffer pool ahead of the redo cursor, at most half a buffer pool ahead, so the workers find their
+ * pages resident instead of waiting for the disk.
  */
 class LogRecovery {
  public:
-  LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager)
-      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager), offset_(0) {
+  LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager, LogManager *log_manager = nullptr,
+              size_t num_workers = RECOVERY_WORKERS)
+      : disk_manager_(disk_manager),
+        buffer_pool_manager_(buffer_pool_manager),
+        log_manager_(log_manager),
+        num_workers_(std::max<size_t>(num_workers, 1)),
+        offset_(0) {
     log_buffer_ = new char[LOG_BUFFER_SIZE];
   }
 
@@ -39,18 +70,151 @@ class LogRecovery {
 
   void Redo();
   void Undo();
+
+  /**
+   * Name an index whose key records Undo reverses. The keys losers inserted into or removed from an index that is not
+   * named here stay as they are.
+   * @param index_name the name the index logs its keys with
+   * @param undo reverses a key record, see BPlusTree::UndoKeyRecord
+   */
+  void AddIndex(const std::string &index_name, std::function<void(const LogRecord &)> undo) {
+    indexes_[index_name] = std::move(undo);
+  }
   bool DeserializeLogRecord(const char *data, LogRecord *log_record);
 
+  /**
+   * Apply the log from offset on to the pages it changes, for a replica following the log of a live primary. Every
+   * record goes through the redo path in log order and the pages' lsns skip what they already reflect, no analysis
+   * is done and nothing is undone: the transactions are still running on the primary.
+   * @param[in,out] offset offset of the first record, moved past the last record replayed
+   * @param lsn lsn of the first record
+   * @return one past the lsn of the last record replayed
+   */
+  lsn_t Replay(int64_t *offset, lsn_t lsn);
+
  private:
-  DiskManager *disk_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** The records routed to one redo worker, handed over in batches. */
+  struct RedoPartition {
+    std::mutex latch_;
+    std::condition_variable cv_;
+    std::deque<std::vector<LogRecord>> batches_;
+    bool closed_{false};
+    /** The batch the log reader is filling, not shared. */
+    std::vector<LogRecord> pending_;
+  };
+
+  /**
+   * Read the log record at the given offset.
+   * @param offset logical offset of the record in the log
+   * @param[out] log_record the record
+   * @param buffer LOG_BUFFER_SIZE bytes to read the record into
+   * @return false if there is no complete record at offset
+   */
+  bool ReadLogRecord(int64_t offset, LogRecord *log_record, char *buffer);
+
+  /**
+   * Read the log sequentially until the lsn sequence breaks, leaving offset_ at the end of the last record.
+   * @param offset offset of the first record
+   * @param lsn lsn of the first record
+   * @param visit called with every record and its offset
+   * @return one past the lsn of the last record
+   */
+  lsn_t ScanLog(int64_t offset, lsn_t lsn, const std::function<void(const LogRecord &, int64_t)> &visit);
+
+  /** @return the page a log record changes, INVALID_PAGE_ID if it does not change a page */
+  static page_id_t GetPageId(const LogRecord &log_record);
+
+  /** @return true if the page was dirty at the crash and may not reflect the record with this lsn */
+  bool NeedsRedo(page_id_t page_id, lsn_t lsn);
+
+  /** @return the redo worker that owns a page */
+  size_t RedoWorkerOf(page_id_t page_id) const { return static_cast<size_t>(page_id) % num_workers_; }
+
+  /** Hand a record to the redo worker that owns a page, waiting while the worker is too far behind. */
+  void DispatchRedo(std::vector<RedoPartition> *partitions, size_t worker, const LogRecord &log_record);
+
+  /** Hand a partition's pending records to its worker. */
+  void FlushRedoBatch(RedoPartition *partition);
+
+  /** The body of a redo worker: apply every record routed to it to the pages it owns. */
+  void RedoWorkerLoop(RedoPartition *partition, size_t worker);
+
+  /** Advance the redo cursor past a record, waking up the prefetcher if it waits for that. */
+  void AdvanceRedoCursor(lsn_t lsn);
 
+  /**
+   * The body of the prefetcher: read the pages of redo_pages_ in order, staying at most window pages ahead of the redo
+   * cursor.
+   */
+  void PrefetchLoop(size_t window);
+
+  /** Apply a log record to its page, if the page does not reflect it yet. */
+  void RedoLogRecord(const LogRecord &log_record);
+
+  /**
+   * Link the previous page to the one a NEWPAGE record created, or to the one after the page an UNLINKPAGE record
+   * took out. This is not logged on its own.
+   */
+  void RedoPageLink(const LogRecord &log_record);
+
+  /** @return true if the record also changes the link of its previous page */
+  static bool LinksPrevPage(const LogRecord &log_record) {
+    return log_record.log_record_type_ == LogRecordType::NEWPAGE ||
+           log_record.log_record_type_ == LogRecordType::UNLINKPAGE;
+  }
+
+  /** Point an index at the root an INDEX_ROOT record names. The header page has no lsn, this is always redone. */
+  void RedoIndexRoot(const LogRecord &log_record);
+
+  /**
+   * Revert the effect of a log record of a transaction that did not commit. With a log manager the compensation is
+   * logged as a record of the transaction, and the page's lsn moves to it.
+   * @param log_record the record to revert
+   * @param prev_lsn the last lsn of the transaction
+   * @return the last lsn of the transaction, the compensation's if it was logged
+   */
+  lsn_t UndoLogRecord(const LogRecord &log_record, lsn_t prev_lsn);
+
+  /**
+   * Revert a key record of a transaction that did not commit through its index, logging the opposite key record as
+   * the compensation if there is a log manager.
+   * @param log_record an INDEX_KEY_INSERT or INDEX_KEY_DELETE record
+   * @param prev_lsn the last lsn of the transaction
+   * @return the last lsn of the transaction
+   */
+  lsn_t UndoKeyRecord(const LogRecord &log_record, lsn_t prev_lsn);
+
+  /** Records per batch handed to a redo worker, and batches a worker may have queued. */
+  static constexpr size_t REDO_BATCH_SIZE = 256;
+  static constexpr size_t REDO_MAX_BATCHES = 16;
+
+  DiskManager *disk_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  LogManager *log_manager_;
+  /** Number of threads redo and undo are spread over. */
+  size_t num_workers_;
+
+  /** The indexes undo can reverse key records in, by name. */
+  std::unordered_map<std::string, std::function<void(const LogRecord &)>> indexes_;
   /** Maintain active transactions and its corresponding latest lsn. */
   std::unordered_map<txn_id_t, lsn_t> active_txn_;
   /** Mapping the log sequence number to log file offset for undos. */
-  std::unordered_map<lsn_t, int> lsn_mapping_;
+  std::unordered_map<lsn_t, int64_t> lsn_mapping_;
+  /** The pages that may have been dirty at the crash, with the lsn of the oldest change they may be missing. */
+  std::unordered_map<page_id_t, lsn_t> dirty_page_table_;
+  /** The dirty pages ordered by the lsn of the first record redo applies to them. */
+  std::vector<std::pair<lsn_t, page_id_t>> redo_pages_;
+
+  /** The lsn of the last record the log reader has handed to the redo workers. */
+  std::atomic<lsn_t> redo_cursor_{INVALID_LSN};
+  /** The prefetcher sleeps until the redo cursor reaches this lsn. */
+  std::atomic<lsn_t> prefetch_wait_lsn_{INVALID_LSN};
+  bool redo_done_{false};
+  std::mutex prefetch_latch_;
+  std::condition_variable prefetch_cv_;
 
-  int offset_ __attribute__((__unused__));
+  /** Offset of the log buffer's first byte in the log. */
+  int64_t offset_;
   char *log_buffer_;
 };
 
@@ -0,0 +1,103 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_replica.h
+//
+// Identification: src/include/recovery/log_replica.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <thread>              // NOLINT
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/rwlatch.h"
+#include "recovery/log_recovery.h"
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/**
+ * LogReplica keeps a read replica of a primary up to date by shipping its log through the shared directory.
+ *
+ * The replica runs in a process of its own, with a disk manager that follows the primary's log (see DiskManager) and
+ * a buffer pool of its own. The primary enables log shipping on its disk manager. The replay thread polls the tail the
+ * primary publishes and runs every new record through the redo path, in log order, against the replica's pages.
+ *
+ * The replica serves read-only queries from its buffer pool. Replay latches each page it changes, a query that reads
+ * several pages and needs them to agree holds the replay latch for reading, so that it sees the state of the primary
+ * as of one lsn. Records of transactions that are still running are replayed too, as they are on the primary's pages.
+ *
+ * A replica starts from an empty database file at the beginning of the log, or from a copy of the primary's database
+ * file at the redo point of the checkpoint the copy was taken after. It has to keep up with the primary's
+ * checkpoints: the log the primary truncates can no longer be shipped.
+ */
+class LogReplica {
+ public:
+  /**
+   * @param disk_manager a disk manager following the primary's log
+   * @param buffer_pool_manager the replica's buffer pool
+   * @param start_offset offset of the first record to replay
+   * @param start_lsn lsn of the first record to replay
+   */
+  LogReplica(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager, int64_t start_offset = 0,
+             lsn_t start_lsn = 0)
+      : disk_manager_(disk_manager),
+        recovery_(disk_manager, buffer_pool_manager, nullptr, 1),
+        offset_(start_offset),
+        next_lsn_(start_lsn) {}
+
+  ~LogReplica() {
+    if (replay_thread_ != nullptr) {
+      StopReplayThread();
+    }
+  }
+
+  /** Replay everything the primary has published so far. */
+  void CatchUp();
+
+  /** Start a thread that catches up every replica_poll_interval. */
+  void RunReplayThread();
+  void StopReplayThread();
+
+  /** @return the lsn of the last record replayed, INVALID_LSN if there is none yet */
+  lsn_t GetReplayedLSN() const { return next_lsn_ - 1; }
+
+  /** @return the last lsn the primary has made durable, as far as the replica knows */
+  lsn_t GetPrimaryLSN() { return disk_manager_->RefreshLogTail(); }
+
+  /** @return how many log records the replica is behind the durable log of the primary */
+  lsn_t GetReplicationLag() { return std::max(GetPrimaryLSN() - GetReplayedLSN(), 0); }
+
+  /** Keep replay from changing the pages while a query reads them. */
+  void RLatch() { replay_latch_.RLock(); }
+  void RUnlatch() { replay_latch_.RUnlock(); }
+
+ private:
+  /** The body of the replay thread. */
+  void ReplayThreadLoop();
+
+  DiskManager *disk_manager_;
+  LogRecovery recovery_;
+
+  /** Where replay continues: the offset and lsn of the next record. */
+  int64_t offset_;
+  std::atomic<lsn_t> next_lsn_;
+  /** Replay holds it for writing, queries that need a consistent state for reading. */
+  ReaderWriterLatch replay_latch_;
+
+  std::thread *replay_thread_{nullptr};
+  bool stop_requested_{false};
+  std::mutex latch_;
+  std::condition_variable cv_;
+};
+
+}  // namespace bustub
@@ -13,6 +13,7 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <fstream>
 #include <future>  // NOLINT
 #include <mutex>   // NOLINT
@@ -22,85 +23,222 @@
 
 namespace bustub {
 
+/**
+ * The log master record tells recovery where to start reading the log. It is kept outside of the log and replaced
+ * atomically whenever a checkpoint completes.
+ */
+struct LogMasterRecord {
+  /** Lsn of the BEGIN_CHECKPOINT record of the last complete checkpoint, INVALID_LSN if there is none. */
+  lsn_t checkpoint_lsn_{INVALID_LSN};
+  /** The oldest offset recovery may still need, recovery starts scanning there and the log before it is truncated. */
+  int64_t redo_offset_{0};
+  /** Lsn of the first log record at redo_offset_. */
+  lsn_t redo_lsn_{0};
+  /** Size of the log segment files, fixed when the log is created. */
+  int64_t segment_size_{LOG_SEGMENT_SIZE};
+};
+
 /**
  * DiskManager takes care of the allocation and deallocation of pages within a database. It performs the reading and
  * writing of pages to and from disk, providing a logical file layer within the context of a database management system.
+ *
+ * The log is split into fixed-size segment files named <db>.log.<n>, next to the <db>.log master record. Log offsets
+ * are logical and never reused: offset o lives in segment o / segment_size. Segments are preallocated when first
+ * written and, once a checkpoint makes them obsolete, renamed to become future segments instead of being deleted. A
+ * recycled segment still holds stale records past the log tail, so readers must check lsn continuity. After a
+ * restart the tail is not known until recovery has scanned the log and called SetLogTail.
+ *
+ * With log shipping enabled, every flush also publishes the new log tail and the last lsn it holds in <db>.log.tail.
+ * A replica's disk manager follows that log instead of keeping one of its own: it reads the primary's segments, up to
+ * the tail the primary last published, and never writes them.
  */
 class DiskManager {
  public:
   /**
    * Creates a new disk manager that writes to the specified database file.
    * @param db_file the file name of the database file to write to
+   * @param log_segment_size the size of the log segment files, only used when a new log is created
+   */
+  explicit DiskManager(const std::string &db_file, int64_t log_segment_size = LOG_SEGMENT_SIZE);
+
+  /**
+   * Creates a disk manager for a replica, which keeps its pages in its own database file and reads the log of a
+   * primary that has log shipping enabled.
+   * @param db_file the file name of the replica's database file
+   * @param primary_db_file the file name of the primary's database file, its log lives next to it
    */
-  explicit DiskManager(const std::string &db_file);
+  DiskManager(const std::string &db_file, const std::string &primary_db_file);
 
-  ~DiskManager() = default;
+  virtual ~DiskManager() = default;
 
   /**
    * Shut down the disk manager and close all the file resources.
    */
-  void ShutDown();
+  virtual void ShutDown();
 
   /**
    * Write a page to the database file.
    * @param page_id id of the page
    * @param page_data raw page data
    */
-  void WritePage(page_id_t page_id, const char *page_data);
+  virtual void WritePage(page_id_t page_id, const char *page_data);
 
   /**
    * Read a page from the database file.
    * @param page_id id of the page
    * @param[out] page_data output buffer
    */
-  void ReadPage(page_id_t page_id, char *page_data);
+  virtual void ReadPage(page_id_t page_id, char *page_data);
 
   /**
-   * Flush the entire log buffer into disk.
+   * Flush the entire log buffer into disk, at the log tail. It returns once the segment is synced.
    * @param log_data raw log data
    * @param size size of log entry
    */
-  void WriteLog(char *log_data, int size);
+  virtual void WriteLog(char *log_data, int size);
 
   /**
-   * Read a log entry from the log file.
+   * Read a log entry from the log file. Bytes past the log tail read as zeros.
    * @param[out] log_data output buffer
    * @param size size of the log entry
-   * @param offset offset of the log entry in the file
-   * @return true if the read was successful, false otherwise
+   * @param offset logical offset of the log entry in the log
+   * @return true if the read was successful, false if offset is truncated or past the log tail
+   */
+  virtual bool ReadLog(char *log_data, int size, int64_t offset);
+
+  /** @return the logical offset the next WriteLog lands at */
+  virtual int64_t GetLogTail();
+
+  /**
+   * Move the log tail, recovery calls this once it has found the end of the valid log.
+   * @param offset the offset the next WriteLog lands at
+   */
+  virtual void SetLogTail(int64_t offset);
+
+  /**
+   * Discard the log before offset. Segments that lie entirely before it are recycled or deleted.
+   * @param offset the oldest offset that must stay readable
+   */
+  virtual void TruncateLog(int64_t offset);
+
+  /** Publish the log tail after every flush from now on, so that replicas can follow the log. */
+  virtual void EnableLogShipping();
+
+  /**
+   * Tell replicas that the log up to the current tail is on disk, does nothing unless log shipping is enabled.
+   * @param last_lsn the lsn of the last record before the tail
    */
-  bool ReadLog(char *log_data, int size, int offset);
+  virtual void PublishLogTail(lsn_t last_lsn);
+
+  /**
+   * Move a replica's log tail to the one its primary last published.
+   * @return the lsn of the last record before the tail, INVALID_LSN if nothing was published yet
+   */
+  virtual lsn_t RefreshLogTail();
+
+  /** @return the log master record */
+  virtual LogMasterRecord ReadLogMaster();
+
+  /**
+   * Atomically and durably replace the log master record, once the pages written so far are on disk.
+   * @param master the new master record
+   */
+  virtual void WriteLogMaster(const LogMasterRecord &master);
 
   /** @return the number of disk flushes */
-  int GetNumFlushes() const;
+  virtual int GetNumFlushes() const;
 
   /** @return true iff the in-memory content has not been flushed yet */
-  bool GetFlushState() const;
+  virtual bool GetFlushState() const;
 
   /** @return the number of disk writes */
-  int GetNumWrites() const;
+  virtual int GetNumWrites() const;
 
   /**
    * Sets the future which is used to check for non-blocking flushes.
    * @param f the non-blocking flush check
    */
-  inline void SetFlushLogFuture(std::future<void> *f) { flush_log_f_ = f; }
+  virtual void SetFlushLogFuture(std::future<void> *f) { flush_log_f_ = f; }
 
   /** Checks if the non-blocking flush future was set. */
-  inline bool HasFlushLogFuture() { return flush_log_f_ != nullptr; }
+  virtual bool HasFlushLogFuture() { return flush_log_f_ != nullptr; }
+
+ protected:
+  /** Used by backends that do not keep their pages in a database file. */
+  DiskManager() = default;
+
+  int num_flushes_{0};
+  int num_writes_{0};
+  bool flush_log_{false};
+  std::future<void> *flush_log_f_{nullptr};
 
  private:
   int GetFileSize(const std::string &file_name);
-  // stream to write log file
+
+  /** @return the file name of the given log segment */
+  std::string SegmentName(int64_t segment) const;
+
+  /** Create the given log segment if it does not exist yet, and allocate all of its blocks. */
+  void PreallocateSegment(int64_t segment);
+
+  /**
+   * Point io at the given log segment, reopening it only if it is not the one already open.
+   * @param io the stream to reuse
+   * @param[in,out] io_segment the segment io is currently open on
+   * @param segment the segment to open
+   * @return false if the segment does not exist
+   */
+  bool OpenSegment(std::fstream *io, int64_t *io_segment, int64_t segment);
+
+  /** Hand what log_io_ wrote to the OS and wait until it is on disk. */
+  void SyncLogSegment();
+
+  /** @return the directory holding the log master record and segments */
+  std::string LogDirectory() const;
+
+  /** Wait until a file, or the entries of a directory, are on disk. */
+  static void SyncPath(const std::string &path);
+
+  /** Remove the log segments left behind by a log whose master record is gone. */
+  void RemoveStaleSegments();
+
+  /** Open the database file, creating it if it does not exist. */
+  void OpenDbFile();
+
+  /** The published log tail, check guards against reading it half written. */
+  struct PublishedLogTail {
+    int64_t offset_;
+    int64_t last_lsn_;
+    int64_t check_;
+  };
+  static constexpr int64_t LOG_TAIL_MAGIC = 0x6c6f677461696c;
+
+  // stream to write the current log segment
   std::fstream log_io_;
+  int64_t log_io_segment_{-1};
+  // descriptor of the segment log_io_ is open on, to sync it
+  int log_sync_fd_{-1};
+  // stream to read log segments
+  std::fstream log_read_io_;
+  int64_t log_read_segment_{-1};
+  // the log master record, the segments are named after it
   std::string log_name_;
+  LogMasterRecord log_master_;
+  // the log segments hold [log_start_, (last_segment_ + 1) * segment size), the valid log ends at log_tail_
+  int64_t log_start_{0};
+  int64_t log_tail_{0};
+  int64_t last_segment_{-1};
+  // a replica reads the log of its primary and never writes it
+  bool follower_{false};
+  // stream to publish the log tail to replicas, open while log shipping is enabled
+  std::fstream log_tail_io_;
+  // the last lsn a replica has seen published
+  lsn_t published_lsn_{INVALID_LSN};
+  // protects the log streams and the offsets above
+  std::mutex log_io_latch_;
   // stream to write db file
   std::fstream db_io_;
   std::string file_name_;
-  int num_flushes_;
-  int num_writes_;
-  bool flush_log_;
-  std::future<void> *flush_log_f_;
   // With multiple buffer pool instances, need to protect file access
   std::mutex db_io_latch_;
 };
@@ -0,0 +1,94 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_memory.h
+//
+// Identification: src/include/storage/disk/disk_manager_memory.h
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "common/config.h"
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/**
+ * DiskManagerMemory replicates the utility of DiskManager in memory. Pages and the log never touch the file system, so
+ * it is meant for CPU-bound benchmarks of the buffer pool, the indexes and the executors.
+ */
+class DiskManagerMemory : public DiskManager {
+ public:
+  /**
+   * Creates a new in-memory disk manager.
+   * @param initial_pages the number of pages to reserve room for up front
+   */
+  explicit DiskManagerMemory(size_t initial_pages = 0);
+
+  ~DiskManagerMemory() override = default;
+
+  void ShutDown() override {}
+
+  /**
+   * Write a page to memory.
+   * @param page_id id of the page
+   * @param page_data raw page data
+   */
+  void WritePage(page_id_t page_id, const char *page_data) override;
+
+  /**
+   * Read a page from memory. Pages that were never written read as zeros.
+   * @param page_id id of the page
+   * @param[out] page_data output buffer
+   */
+  void ReadPage(page_id_t page_id, char *page_data) override;
+
+  /**
+   * Append the log buffer to the in-memory log.
+   * @param log_data raw log data
+   * @param size size of log entry
+   */
+  void WriteLog(char *log_data, int size) override;
+
+  /**
+   * Read a log entry from the in-memory log.
+   * @param[out] log_data output buffer
+   * @param size size of the log entry
+   * @param offset offset of the log entry in the log
+   * @return true if the read was successful, false otherwise
+   */
+  bool ReadLog(char *log_data, int size, int64_t offset) override;
+
+  int64_t GetLogTail() override;
+
+  void SetLogTail(int64_t offset) override;
+
+  void TruncateLog(int64_t offset) override;
+
+  LogMasterRecord ReadLogMaster() override;
+
+  void WriteLogMaster(const LogMasterRecord &master) override;
+
+ private:
+  /** Protects pages_. */
+  std::mutex pages_latch_;
+  /** Page contents indexed by page id, allocated on first write. */
+  std::vector<std::unique_ptr<char[]>> pages_;
+  /** Protects log_, log_start_ and log_master_. */
+  std::mutex log_latch_;
+  /** The log from log_start_ on, in the order it was written. */
+  std::vector<char> log_;
+  /** Logical offset of the first byte of log_, everything before it has been truncated. */
+  int64_t log_start_{0};
+  LogMasterRecord log_master_;
+};
+
+}  // namespace bustub
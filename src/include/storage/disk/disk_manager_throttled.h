@@ -0,0 +1,114 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_throttled.h
+//
+// Identification: src/include/storage/disk/disk_manager_throttled.h
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "common/config.h"
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/**
+ * The device characteristics a DiskManagerThrottled simulates.
+ */
+struct DiskThrottleConfig {
+  /** Time until the first byte of a page or log read is available. */
+  std::chrono::microseconds read_latency_{0};
+  /** Time until a page write or a log flush is acknowledged. */
+  std::chrono::microseconds write_latency_{0};
+  /** Sustained transfer rate shared by all reads and writes, 0 means unlimited. */
+  uint64_t bandwidth_bytes_per_sec_{0};
+
+  /** @return a profile resembling a local NVMe SSD */
+  static DiskThrottleConfig LocalSsd() {
+    return {std::chrono::microseconds(80), std::chrono::microseconds(20), 2000ULL * 1024 * 1024};
+  }
+
+  /** @return a profile resembling a network-attached block volume */
+  static DiskThrottleConfig NetworkVolume() {
+    return {std::chrono::microseconds(1000), std::chrono::microseconds(1500), 250ULL * 1024 * 1024};
+  }
+};
+
+/**
+ * DiskManagerThrottled wraps another DiskManager and delays every page and log I/O as if it went to a slower device.
+ * Each request pays a fixed latency, and all requests share one transfer channel capped at the configured bandwidth,
+ * so concurrent I/Os queue behind each other like they would on a real device.
+ */
+class DiskManagerThrottled : public DiskManager {
+ public:
+  /**
+   * Creates a new throttled disk manager.
+   * @param backend the disk manager that actually stores the pages and the log
+   * @param config the latency and bandwidth to simulate
+   */
+  DiskManagerThrottled(std::unique_ptr<DiskManager> backend, const DiskThrottleConfig &config)
+      : backend_(std::move(backend)), config_(config) {}
+
+  ~DiskManagerThrottled() override = default;
+
+  void ShutDown() override { backend_->ShutDown(); }
+
+  void WritePage(page_id_t page_id, const char *page_data) override;
+
+  void ReadPage(page_id_t page_id, char *page_data) override;
+
+  void WriteLog(char *log_data, int size) override;
+
+  bool ReadLog(char *log_data, int size, int64_t offset) override;
+
+  int64_t GetLogTail() override { return backend_->GetLogTail(); }
+
+  void SetLogTail(int64_t offset) override { backend_->SetLogTail(offset); }
+
+  void TruncateLog(int64_t offset) override { backend_->TruncateLog(offset); }
+
+  LogMasterRecord ReadLogMaster() override;
+
+  void WriteLogMaster(const LogMasterRecord &master) override;
+
+  int GetNumFlushes() const override { return backend_->GetNumFlushes(); }
+
+  bool GetFlushState() const override { return backend_->GetFlushState(); }
+
+  int GetNumWrites() const override { return backend_->GetNumWrites(); }
+
+  void SetFlushLogFuture(std::future<void> *f) override { backend_->SetFlushLogFuture(f); }
+
+  bool HasFlushLogFuture() override { return backend_->HasFlushLogFuture(); }
+
+  /** @return the throttled disk manager's backend */
+  DiskManager *GetBackend() { return backend_.get(); }
+
+ private:
+  /**
+   * Blocks the caller until an I/O of the given size would have completed on the simulated device.
+   * @param bytes the number of bytes transferred
+   * @param latency the fixed per-request latency
+   */
+  void Throttle(size_t bytes, std::chrono::microseconds latency);
+
+  std::unique_ptr<DiskManager> backend_;
+  const DiskThrottleConfig config_;
+  /** Protects channel_free_at_. */
+  std::mutex channel_latch_;
+  /** The point in time at which the simulated transfer channel becomes idle. */
+  std::chrono::steady_clock::time_point channel_free_at_{};
+};
+
+}  // namespace bustub
@@ -10,10 +10,14 @@
 //===----------------------------------------------------------------------===//
 #pragma once
 
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <optional>
 #include <queue>
 #include <string>
 #include <vector>
 
+#include "concurrency/lock_manager.h"
 #include "concurrency/transaction.h"
 #include "storage/index/index_iterator.h"
 #include "storage/page/b_plus_tree_internal_page.h"
@@ -32,6 +36,22 @@ namespace bustub {
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
  * (4) Implement index iterator for range scan
+ *
+ * Given a lock manager, the tree locks key ranges for SERIALIZABLE transactions (next-key locking). A key is locked as
+ * the RID stored with it, the end of the index as end_rid_. Locking a key locks the gap before it too: lookups and
+ * scans lock every key they land on in shared mode, including the first key past what they read. An insert locks its
+ * own key exclusive, then checks that nobody holds the key after it; a remove locks its key and the one after it
+ * exclusive until the transaction ends. Locks are never waited for while the tree is latched.
+ *
+ * There is no latch over the whole tree. Lookups couple pages optimistically, they validate the version of every page
+ * they read instead of latching it (see FindLeafPageOptimistic). Inserts and removes find their leaf the same way and
+ * write latch only the leaf, as long as it cannot split or fall below half full; otherwise they start over and latch
+ * from the root down, keeping latched every page that a split or merge may reach. Every change to the root page id is
+ * made while the old root is write latched, and a search that read the root's version checks the id again after.
+ *
+ * With logging on, every page change is logged redo-only. The keys a transaction inserts and removes are logged as
+ * well, ahead of the page changes and in the transaction's chain, so that recovery can take back those of a loser
+ * (see UndoKeyRecord).
  */
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTree {
@@ -40,23 +60,36 @@ class BPlusTree {
 
  public:
   explicit BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE);
+                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE,
+                     LockManager *lock_manager = nullptr);
 
   // Returns true if this B+ tree has no keys and values.
   bool IsEmpty() const;
 
-  // Insert a key-value pair into this B+ tree.
+  // Insert a key-value pair into this B+ tree. A read-only transaction is aborted.
   bool Insert(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
 
-  // Remove a key and its value from this B+ tree.
+  // Remove a key and its value from this B+ tree. A read-only transaction is aborted.
   void Remove(const KeyType &key, Transaction *transaction = nullptr);
 
+  /**
+   * Take back the key change of a transaction that did not commit: remove the key an INDEX_KEY_INSERT record inserted,
+   * or put back the one an INDEX_KEY_DELETE record removed. For recovery, see LogRecovery::AddIndex.
+   */
+  void UndoKeyRecord(const LogRecord &log_record);
+
+  /** Take up the root the header page has for the tree, as after a restart. @return false if it has none */
+  bool LoadRootPageId();
+
+  /** @return the name the tree's root and key records are logged with */
+  const std::string &GetIndexName() const { return index_name_; }
+
   // return the value associated with a given key
   bool GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction = nullptr);
 
-  // index iterator
-  INDEXITERATOR_TYPE Begin();
-  INDEXITERATOR_TYPE Begin(const KeyType &key);
+  // index iterator, a SERIALIZABLE transaction has the keys it passes locked
+  INDEXITERATOR_TYPE Begin(Transaction *transaction = nullptr);
+  INDEXITERATOR_TYPE Begin(const KeyType &key, Transaction *transaction = nullptr);
   INDEXITERATOR_TYPE End();
 
   void Print(BufferPoolManager *bpm) {
@@ -76,9 +109,22 @@ class BPlusTree {
 
   // read data from file and remove one by one
   void RemoveFromFile(const std::string &file_name, Transaction *transaction = nullptr);
-  // expose for test purpose
+  // expose for test purpose, returns nullptr if the tree is empty
   Page *FindLeafPage(const KeyType &key, Transaction *txn, int mode, bool leftMost = false);
 
+  /**
+   * Find the leaf page a key belongs in without latching a page: every page's version is read before it is looked at
+   * and validated after, the search starts over from the root when a page changed under it.
+   * @param[out] version the version of the leaf, for the caller to validate what it read there
+   * @param left_most find the leftmost leaf instead, the key is ignored
+   * @return the leaf page, pinned, or nullptr if the tree is empty
+   */
+  Page *FindLeafPageOptimistic(const KeyType &key, uint64_t *version, bool left_most = false);
+
+  /**
+   * Delete the pages in the transaction's deleted page set, once their latches are released. A page an optimistic
+   * reader still has pinned is kept back and tried again by the next call.
+   */
   void DeletePages(Transaction *txn);
 
   void ReleaseTxnPage(Transaction *txn, int mode);
@@ -86,7 +132,8 @@ class BPlusTree {
   bool CheckSafe(BPlusTreePage* page_ptr, int mode);
 
  private:
-  void StartNewTree(const KeyType &key, const ValueType &value);
+  /** @return false if another insert started the tree first, nothing is inserted then */
+  bool StartNewTree(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
 
   bool InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
 
@@ -106,10 +153,64 @@ class BPlusTree {
   template <typename N>
   void Redistribute(N *neighbor_node, N *node, int index);
 
-  bool AdjustRoot(BPlusTreePage *node);
+  bool AdjustRoot(BPlusTreePage *node, Transaction *transaction);
 
   void UpdateRootPageId(int insert_record = 0);
 
+  /**
+   * Log a key the transaction inserts (INDEX_KEY_INSERT) or removes (INDEX_KEY_DELETE), before the page records of
+   * the change. Nothing is logged for a change made outside of a transaction.
+   */
+  void LogKey(LogRecordType type, const KeyType &key, const ValueType &value, Transaction *transaction);
+
+  /**
+   * Find the leaf for an insert (mode 1) or a remove (mode 2) optimistically, and write latch it alone if the
+   * operation cannot split or merge it.
+   * @return the leaf page, pinned and write latched, or nullptr if the caller has to latch from the root down
+   */
+  Page *LatchLeafOptimistic(const KeyType &key, int mode);
+
+  /** Find the leaf a scan goes on at without latching it, see IndexIterator::Seek. */
+  Page *SeekLeaf(const KeyType *key, bool inclusive, uint64_t *version, int *idx);
+
+  /** @return a guard that keeps the ids of pages deleted meanwhile from being handed out again, if the pool has one */
+  std::optional<EpochGuard> ProtectPageIds() {
+    std::optional<EpochGuard> guard;
+    if (EpochManager *epochs = buffer_pool_manager_->GetEpochManager(); epochs != nullptr) {
+      guard.emplace(epochs->Protect());
+    }
+    return guard;
+  }
+
+  /** @return true if the transaction's lookups and scans lock the key ranges they read */
+  bool LocksRanges(Transaction *transaction) const {
+    return lock_manager_ != nullptr && transaction != nullptr &&
+           transaction->GetIsolationLevel() == IsolationLevel::SERIALIZABLE;
+  }
+
+  /** @return true if the transaction's inserts and removes lock keys, for the lookups and scans that lock ranges */
+  bool LocksKeys(Transaction *transaction) const {
+    return lock_manager_ != nullptr && transaction != nullptr && !transaction->ReadsVersions() &&
+           transaction->GetIsolationLevel() != IsolationLevel::OPTIMISTIC;
+  }
+
+  /** @return what the first key at or after (inclusive) or after the key is locked as, end_rid_ if there is none */
+  RID NextKeyLock(const KeyType &key, bool inclusive);
+
+  /**
+   * Lock the first key at or after (inclusive) or after the key, again until it is the same key after the lock.
+   * @param lock_mode SHARED or EXCLUSIVE
+   * @param instant true to only wait until the key can be locked exclusive, see LockManager::LockInstant
+   */
+  void LockNextKey(const KeyType &key, bool inclusive, Transaction *transaction, LockMode lock_mode,
+                   bool instant = false);
+
+  /** @return the size of one key and value pair of node, what index log records are measured in */
+  int EntrySize(const BPlusTreePage *node) const {
+    return static_cast<int>(node->IsLeafPage() ? sizeof(std::pair<KeyType, ValueType>)
+                                               : sizeof(std::pair<KeyType, page_id_t>));
+  }
+
   /* Debug Routines for FREE!! */
   void ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::ofstream &out) const;
 
@@ -117,12 +218,19 @@ class BPlusTree {
 
   // member variable
   std::string index_name_;
-  page_id_t root_page_id_;
+  /** Changed only while the old root is write latched, INVALID_PAGE_ID while the tree is empty. */
+  std::atomic<page_id_t> root_page_id_;
   BufferPoolManager *buffer_pool_manager_;
   KeyComparator comparator_;
   int leaf_max_size_;
   int internal_max_size_;
-  ReaderWriterLatch root_latch_;
+  LockManager *lock_manager_;
+  /** What the end of the index is locked as, no row has a RID on END_OF_INDEX_PAGE_ID. */
+  RID end_rid_;
+  static constexpr page_id_t END_OF_INDEX_PAGE_ID = INVALID_PAGE_ID - 1;
+  /** Pages out of the tree that were still pinned when they were to be deleted, see DeletePages. */
+  std::vector<page_id_t> pinned_deleted_pages_;
+  std::mutex pinned_deleted_pages_latch_;
 };
 
 }  // namespace bustub
@@ -26,7 +26,9 @@ namespace bustub {
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeIndex : public Index {
  public:
-  BPlusTreeIndex(std::unique_ptr<IndexMetadata> &&metadata, BufferPoolManager *buffer_pool_manager);
+  /** @param lock_manager locks the key ranges SERIALIZABLE transactions read, nullptr to lock nothing */
+  BPlusTreeIndex(std::unique_ptr<IndexMetadata> &&metadata, BufferPoolManager *buffer_pool_manager,
+                 LockManager *lock_manager = nullptr);
 
   void InsertEntry(const Tuple &key, RID rid, Transaction *transaction) override;
 
@@ -34,9 +36,9 @@ class BPlusTreeIndex : public Index {
 
   void ScanKey(const Tuple &key, std::vector<RID> *result, Transaction *transaction) override;
 
-  INDEXITERATOR_TYPE GetBeginIterator();
+  INDEXITERATOR_TYPE GetBeginIterator(Transaction *transaction = nullptr);
 
-  INDEXITERATOR_TYPE GetBeginIterator(const KeyType &key);
+  INDEXITERATOR_TYPE GetBeginIterator(const KeyType &key, Transaction *transaction = nullptr);
 
   INDEXITERATOR_TYPE GetEndIterator();
 
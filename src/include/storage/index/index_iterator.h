@@ -13,6 +13,9 @@
  * For range scan of b+ tree
  */
 #pragma once
+#include <functional>
+
+#include "concurrency/lock_manager.h"
 #include "storage/page/b_plus_tree_leaf_page.h"
 
 namespace bustub {
@@ -23,9 +26,25 @@ INDEX_TEMPLATE_ARGUMENTS
 class IndexIterator {
   using LeafPage = BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>;
  public:
-  // you may define your own constructor based on your member variables
+  /**
+   * Find the leaf a scan goes on at without latching it, the leaf is returned pinned with the version it was read at.
+   * idx is set to the first entry at or past the key, after it unless inclusive, and to 0 if the key is nullptr: then
+   * the leftmost leaf is found. Returns nullptr if the tree is empty.
+   */
+  using Seek = std::function<Page *(const KeyType *key, bool inclusive, uint64_t *version, int *idx)>;
+
+  /** An iterator at the end of the index. */
   IndexIterator();
-  IndexIterator(Page *node, int idx, BufferPoolManager *buffer_pool_manager);
+  /**
+   * The leaves are not latched: an entry only counts if the leaf's version did not change while it was read, else the
+   * iterator finds its place again with seek, after the key it returned last.
+   * An iterator given a lock manager locks every key it lands on in shared mode, and the end of the index once it gets
+   * there: a scan that stops at the first key past its range has locked every gap it read.
+   * @param key the key to start at, nullptr to start at the first key
+   * @param end_rid what the end of the index is locked as
+   */
+  IndexIterator(Seek seek, const KeyType *key, BufferPoolManager *buffer_pool_manager,
+                LockManager *lock_manager = nullptr, Transaction *txn = nullptr, const RID &end_rid = RID());
   ~IndexIterator();
 
   bool IsEnd();
@@ -42,11 +61,39 @@ class IndexIterator {
   }
 
  private:
+  /**
+   * Move to the first entry of the next leaf, or to the end.
+   * @return false if the leaf changed before its next page id could be trusted, the iterator did not move then
+   */
+  bool NextLeaf();
+
+  /** Find the place again through seek_, after the key returned last or at the key the scan started at. */
+  void Reseek();
+
+  /** Read the entry at the position, moving on to the next leaf past the end of one, into item_. */
+  void Load();
+
+  /** Load the entry at the position, then lock the key landed on. */
+  void Settle();
+
   // add your own private member variables here
-  BufferPoolManager *buffer_pool_manager_;
-  B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_node;
+  Seek seek_;
+  BufferPoolManager *buffer_pool_manager_{nullptr};
+  LockManager *lock_manager_{nullptr};
+  Transaction *txn_{nullptr};
+  RID end_rid_;
+  /** Where a seek starts: the key returned last, or the key the scan started at while there is none. */
+  KeyType key_{};
+  bool has_key_{false};
+  bool inclusive_{true};
+  /** The current leaf and the version its entries are validated against. */
+  Page *page_{nullptr};
+  uint64_t version_{0};
+  /** A copy of the entry at the position, taken while the leaf was at version_. */
+  MappingType item_{};
+  B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_node{nullptr};
   int idx = 0;
-  page_id_t p_id;
+  page_id_t p_id{INVALID_PAGE_ID};
 };
 
 }  // namespace bustub
@@ -62,7 +62,30 @@ class BPlusTreePage {
 
   void SetLSN(lsn_t lsn = INVALID_LSN);
 
+  /*
+   * Redo-only logging of the changes to this page, nothing is logged unless logging is on. Each call appends one record
+   * and stamps the page with its lsn, the caller holds the page exclusively. entry_size is the size of one key and
+   * value pair of this page.
+   */
+  /** Log the entry at index, after inserting it (INDEX_INSERT) or before removing it (INDEX_DELETE). */
+  void LogEntry(LogManager *log_manager, LogRecordType type, int index, int entry_size);
+  /** Log the header and the entries of the page. */
+  void LogImage(LogManager *log_manager, int entry_size);
+  /** Log the parent page id of the page. */
+  void LogParentPageId(LogManager *log_manager);
+
+  /** Redo of INDEX_INSERT: move the entries from index on up by one and copy the entry in. */
+  void RedoInsert(int index, const char *entry, int entry_size);
+  /** Redo of INDEX_DELETE: move the entries after index down by one. */
+  void RedoRemove(int index, int entry_size);
+
  private:
+  /** @return the entry at index, whatever the page type */
+  char *EntryAt(int index, int entry_size);
+
+  /** Append a log record for this page and stamp the page with its lsn. */
+  void AppendIndexLogRecord(LogManager *log_manager, LogRecord *log_record);
+
   // member variable, attributes that both internal and leaf page share
   IndexPageType page_type_ __attribute__((__unused__));
   lsn_t lsn_ __attribute__((__unused__));
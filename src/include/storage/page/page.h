@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
 
@@ -28,6 +29,8 @@ namespace bustub {
 class Page {
   // There is book-keeping information inside the page that should only be relevant to the buffer pool manager.
   friend class BufferPoolManagerInstance;
+  // The log manager sets the lsn of pages whose changes it publishes from a transaction's log arena.
+  friend class LogManager;
 
  public:
   /** Constructor. Zeros out the page data. */
@@ -48,11 +51,18 @@ class Page {
   /** @return true if the page in memory has been modified from the page on disk, false otherwise */
   inline bool IsDirty() { return is_dirty_; }
 
-  /** Acquire the page write latch. */
-  inline void WLatch() { rwlatch_.WLock(); }
+  /** Acquire the page write latch. The version turns odd while it is held. */
+  inline void WLatch() {
+    rwlatch_.WLock();
+    version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
 
   /** Release the page write latch. */
-  inline void WUnlatch() { rwlatch_.WUnlock(); }
+  inline void WUnlatch() {
+    version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    rwlatch_.WUnlock();
+  }
 
   /** Acquire the page read latch. */
   inline void RLatch() { rwlatch_.RLock(); }
@@ -60,11 +70,72 @@ class Page {
   /** Release the page read latch. */
   inline void RUnlatch() { rwlatch_.RUnlock(); }
 
-  /** @return the page LSN. */
-  inline lsn_t GetLSN() { return *reinterpret_cast<lsn_t *>(GetData() + OFFSET_LSN); }
-
-  /** Sets the page LSN. */
-  inline void SetLSN(lsn_t lsn) { memcpy(GetData() + OFFSET_LSN, &lsn, sizeof(lsn_t)); }
+  /**
+   * Start an optimistic read: the page is read without its latch, and the read only counts if ValidateVersion then
+   * finds the version unchanged. The page must be pinned, only changes made under the write latch are detected.
+   * @return the version of the page, after waiting for a writer that holds the latch
+   */
+  inline uint64_t ReadVersion() {
+    uint64_t version = version_.load(std::memory_order_acquire);
+    while ((version & 1) != 0) {
+      rwlatch_.RLock();
+      rwlatch_.RUnlock();
+      version = version_.load(std::memory_order_acquire);
+    }
+    return version;
+  }
+
+  /** @return true if the page has not been write latched since ReadVersion returned the version */
+  inline bool ValidateVersion(uint64_t version) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+
+  /**
+   * Turn an optimistic read into a write: acquire the write latch if the version is still the one ReadVersion
+   * returned, so that what was read before stays valid under the latch.
+   * @return true if the page is write latched now, false (and not latched) if it changed
+   */
+  inline bool WLatchAtVersion(uint64_t version) {
+    if (version_.load(std::memory_order_relaxed) != version) {
+      return false;
+    }
+    rwlatch_.WLock();
+    if (version_.load(std::memory_order_relaxed) != version) {
+      rwlatch_.WUnlock();
+      return false;
+    }
+    version_.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @return the page LSN. The LSN is accessed atomically: publishing a log arena raises it without the page latch.
+   */
+  inline lsn_t GetLSN() { return __atomic_load_n(LSNField(), __ATOMIC_ACQUIRE); }
+
+  /** Sets the page LSN. The first LSN set after the page was last read or written out becomes its recovery LSN. */
+  inline void SetLSN(lsn_t lsn) {
+    __atomic_store_n(LSNField(), lsn, __ATOMIC_RELEASE);
+    lsn_t no_rec_lsn = INVALID_LSN;
+    rec_lsn_.compare_exchange_strong(no_rec_lsn, lsn);
+  }
+
+  /**
+   * Sets the recovery LSN of a page that has no LSN of its own, like the header page, unless it already has one.
+   * @param lsn the LSN of a change to the page that is not on disk yet
+   */
+  inline void SetRecLSN(lsn_t lsn) {
+    lsn_t no_rec_lsn = INVALID_LSN;
+    rec_lsn_.compare_exchange_strong(no_rec_lsn, lsn);
+  }
+
+  /** @return the LSN of the oldest change that is not on disk yet, INVALID_LSN if the page is clean */
+  inline lsn_t GetRecLSN() { return rec_lsn_; }
+
+  /** @return the transaction whose log arena holds changes to this page that are not in the log yet, or INVALID_TXN_ID */
+  inline txn_id_t GetUnloggedTxn() { return unlogged_txn_; }
 
  protected:
   static_assert(sizeof(page_id_t) == 4);
@@ -75,6 +146,19 @@ class Page {
   static constexpr size_t OFFSET_LSN = 4;
 
  private:
+  /** @return the LSN inside the page data */
+  inline lsn_t *LSNField() { return reinterpret_cast<lsn_t *>(data_ + OFFSET_LSN); }
+
+  /** Raise the page LSN to lsn unless it is already past it, without holding the page latch. */
+  inline void RaiseLSN(lsn_t lsn) {
+    lsn_t page_lsn = GetLSN();
+    while (page_lsn < lsn && !__atomic_compare_exchange_n(LSNField(), &page_lsn, lsn, true, __ATOMIC_ACQ_REL,
+                                                          __ATOMIC_ACQUIRE)) {
+    }
+    lsn_t no_rec_lsn = INVALID_LSN;
+    rec_lsn_.compare_exchange_strong(no_rec_lsn, lsn);
+  }
+
   /** Zeroes out the data that is held within the page. */
   inline void ResetMemory() { memset(data_, OFFSET_PAGE_START, PAGE_SIZE); }
 
@@ -86,8 +170,14 @@ class Page {
   int pin_count_ = 0;
   /** True if the page is dirty, i.e. it is different from its corresponding page on disk. */
   bool is_dirty_ = false;
+  /** The recovery LSN, redo has to start there for this page. */
+  std::atomic<lsn_t> rec_lsn_ = INVALID_LSN;
+  /** The transaction whose log arena holds changes to this page that are not in the log yet. */
+  std::atomic<txn_id_t> unlogged_txn_ = INVALID_TXN_ID;
   /** Page latch. */
   ReaderWriterLatch rwlatch_;
+  /** Bumped when the write latch is taken and again when it is released: a seqlock for optimistic readers. */
+  std::atomic<uint64_t> version_{0};
 };
 
 }  // namespace bustub
@@ -13,6 +13,7 @@
 #pragma once
 
 #include <cstring>
+#include <functional>
 
 #include "common/rid.h"
 #include "concurrency/lock_manager.h"
@@ -73,7 +74,8 @@ class TablePage : public Page {
   }
 
   /**
-   * Insert a tuple into the table.
+   * Insert a tuple into the table and lock it exclusively, which never waits: nobody else can have locked a new tuple.
+   * The transaction must hold the intention lock on the table already.
    * @param tuple tuple to insert
    * @param[out] rid rid of the inserted tuple
    * @param txn transaction performing the insert
@@ -84,27 +86,42 @@ class TablePage : public Page {
   bool InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager);
 
   /**
-   * Mark a tuple as deleted. This does not actually delete the tuple.
+   * Put a tuple at the slot of the given rid, for recovery. Nothing is locked or logged.
+   * @param tuple tuple to insert
+   * @param rid where the tuple goes, the page grows empty slots up to it if it has fewer
+   * @return false if the slot holds a tuple or the page has no room for it
+   */
+  bool InsertTupleAt(const Tuple &tuple, const RID &rid);
+
+  /**
+   * Mark a tuple as deleted. This does not actually delete the tuple. The transaction must hold the row lock already,
+   * TableHeap takes it before latching the page.
    * @param rid rid of the tuple to mark as deleted
    * @param txn transaction performing the delete
-   * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @return true if marking the tuple as deleted is successful (i.e the tuple exists)
    */
-  bool MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager);
+  bool MarkDelete(const RID &rid, Transaction *txn, LogManager *log_manager);
 
   /**
-   * Update a tuple.
+   * Update a tuple. Like MarkDelete, it expects the row lock to be held.
    * @param new_tuple new value of the tuple
    * @param[out] old_tuple old value of the tuple
    * @param rid rid of the tuple
    * @param txn transaction performing the update
-   * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @return true if updating the tuple succeeded
    */
-  bool UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID &rid, Transaction *txn,
-                   LockManager *lock_manager, LogManager *log_manager);
+  bool UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID &rid, Transaction *txn, LogManager *log_manager);
+
+  /**
+   * Write the old or new bytes of a delta-encoded update over a tuple, for recovery. Nothing is locked or logged.
+   * @param rid rid of the tuple
+   * @param log_record an UPDATE_DELTA log record
+   * @param redo true to write the new bytes, false to write the old ones back
+   * @return false if the tuple does not exist or does not have the size the record describes
+   */
+  bool ApplyUpdateDelta(const RID &rid, const LogRecord &log_record, bool redo);
 
   /** To be called on commit or abort. Actually perform the delete or rollback an insert. */
   void ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_manager);
@@ -113,29 +130,58 @@ class TablePage : public Page {
   void RollbackDelete(const RID &rid, Transaction *txn, LogManager *log_manager);
 
   /**
-   * Read a tuple from a table.
+   * Read a tuple from a table. Like MarkDelete, it expects the row lock to be held.
    * @param rid rid of the tuple to read
    * @param[out] tuple the tuple that was read
    * @param txn transaction performing the read
-   * @param lock_manager the lock manager
    * @return true if the read is successful (i.e. the tuple exists)
    */
-  bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager);
+  bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn);
+
+  /**
+   * Copy a tuple out of the page whether or not it is marked deleted. Nothing is locked.
+   * @param rid rid of the tuple to read
+   * @param[out] tuple the tuple that was read
+   * @param[out] deleted whether the tuple is marked deleted
+   * @return false if the slot holds no tuple
+   */
+  bool ReadTuple(const RID &rid, Tuple *tuple, bool *deleted);
 
   /** @return the rid of the first tuple in this page */
 
   /**
    * @param[out] first_rid the RID of the first tuple in this page
+   * @param any_slot true to return the first slot even if it holds no tuple or a deleted one
    * @return true if the first tuple exists, false otherwise
    */
-  bool GetFirstTupleRid(RID *first_rid);
+  bool GetFirstTupleRid(RID *first_rid, bool any_slot = false);
 
   /**
    * @param cur_rid the RID of the current tuple
    * @param[out] next_rid the RID of the tuple following the current tuple
+   * @param any_slot true to return the next slot even if it holds no tuple or a deleted one
    * @return true if the next tuple exists, false otherwise
    */
-  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid);
+  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid, bool any_slot = false);
+
+  /**
+   * Release the empty slots at the end of the slot array, for the vacuum. Slots in the middle keep their numbers.
+   * @param in_use true for the rid of an empty slot that a snapshot may still read
+   * @return the number of slots released
+   */
+  uint32_t TruncateSlots(const std::function<bool(const RID &)> &in_use);
+
+  /** @return true if the page has no slots */
+  bool IsEmpty() { return GetTupleCount() == 0; }
+
+  /**
+   * Leave no room on an empty page that was unlinked from its table, so that an insert which already followed the link
+   * to it moves on to the next page.
+   */
+  void Retire() { SetFreeSpacePointer(SIZE_TABLE_PAGE_HEADER); }
+
+  /** @return false for an optimistic transaction, whose writes are validated at commit instead of locked */
+  static bool LocksRows(Transaction *txn) { return txn->GetIsolationLevel() != IsolationLevel::OPTIMISTIC; }
 
  private:
   static_assert(sizeof(page_id_t) == 4);
@@ -12,7 +12,11 @@
 
 #pragma once
 
+#include <functional>
+
 #include "buffer/buffer_pool_manager.h"
+#include "concurrency/record_version_table.h"
+#include "concurrency/version_store.h"
 #include "recovery/log_manager.h"
 #include "storage/page/table_page.h"
 #include "storage/table/table_iterator.h"
@@ -23,6 +27,8 @@ namespace bustub {
 /**
  * TableHeap represents a physical table on disk.
  * This is just a doubly-linked list of pages.
+ * Its rows are locked with LockManager::LockRow under the oid of the table, so they are escalated to a table lock
+ * once a transaction has locked enough of them, and a transaction holding a table lock takes no row locks at all.
  */
 class TableHeap {
   friend class TableIterator;
@@ -36,9 +42,10 @@ class TableHeap {
    * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @param first_page_id the id of the first page
+   * @param oid the oid of the table, its rows are locked under
    */
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-            page_id_t first_page_id);
+            page_id_t first_page_id, table_oid_t oid = 0);
 
   /**
    * Create a table heap with a transaction. (create table)
@@ -46,9 +53,10 @@ class TableHeap {
    * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @param txn the creating transaction
+   * @param oid the oid of the table, its rows are locked under
    */
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-            Transaction *txn);
+            Transaction *txn, table_oid_t oid = 0);
 
   /**
    * Insert a tuple into the table. If the tuple is too large (>= page_size), return false.
@@ -91,7 +99,8 @@ class TableHeap {
   void RollbackDelete(const RID &rid, Transaction *txn);
 
   /**
-   * Read a tuple from the table.
+   * Read a tuple from the table. A transaction under snapshot isolation takes no lock and reads the version of the
+   * tuple its snapshot sees.
    * @param rid rid of the tuple to read
    * @param tuple output variable for the tuple
    * @param txn transaction performing the read
@@ -99,6 +108,28 @@ class TableHeap {
    */
   bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn);
 
+  /**
+   * Install a write an optimistic transaction buffered, at commit, while it holds the version word of the row.
+   * @param[in,out] item the buffered write, turned into the record that rolls it back
+   * @param txn the committing transaction
+   * @return false if the write could not be installed
+   */
+  bool InstallWrite(TableWriteRecord *item, Transaction *txn);
+
+  /**
+   * Reclaim what no snapshot needs anymore on one page, for the vacuum. The versions no snapshot at or after oldest_ts
+   * sees are dropped and the empty slots at the end of the page are released. A page left without slots is unlinked
+   * from the table, unless it is the first or the last page.
+   * @param page_id the page to vacuum
+   * @param oldest_ts the snapshot of the oldest running transaction
+   * @param on_dead called under the page latch with every dropped version of a tuple that is gone for good, before its
+   * slot can be reused
+   * @param[out] unlinked true if the page was unlinked, it can be deleted once nobody can be following a link to it
+   * @return the id of the page after it
+   */
+  page_id_t VacuumPage(page_id_t page_id, timestamp_t oldest_ts, const std::function<void(const Tuple &)> &on_dead,
+                       bool *unlinked);
+
   /** @return the begin iterator of this table */
   TableIterator Begin(Transaction *txn);
 
@@ -108,11 +139,55 @@ class TableHeap {
   /** @return the id of the first page of this table */
   inline page_id_t GetFirstPageId() const { return first_page_id_; }
 
+  /** @return the oid the rows of this table are locked under */
+  inline table_oid_t GetOid() const { return oid_; }
+
+  /** @return the version words optimistic transactions validate their reads of this table against */
+  inline RecordVersionTable *GetRecordVersions() { return &record_versions_; }
+
+  /** @return the older versions of the tuples of this table */
+  inline VersionStore *GetVersionStore() { return &versions_; }
+
  private:
+  /** @return false, after aborting the transaction, if it may not change the tuple now */
+  bool CanWrite(const RID &rid, Transaction *txn);
+
+  /**
+   * Take the row lock a read or write of the tuple needs, before its page is latched: a transaction waiting for a lock
+   * while it holds a latch stalls the lock holder on that latch, which the deadlock detector cannot see. The intention
+   * lock on the table and escalation go through LockRow, which may wait as well.
+   * @return false if the lock could not be taken
+   */
+  bool LockTuple(const RID &rid, Transaction *txn, bool exclusive);
+
+  /** @return true if the transaction does not lock rows, or holds an exclusive lock on the row or on this table */
+  bool HoldsExclusiveLock(const RID &rid, Transaction *txn);
+
+  /** Read a tuple for an optimistic transaction, recording the version read. */
+  bool ReadOptimistic(const RID &rid, Tuple *tuple, Transaction *txn);
+
+  /** Buffer an update or delete of an optimistic transaction until it commits. */
+  bool BufferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn);
+
+  /** Update or delete a tuple an optimistic transaction inserted itself, which nobody else can see yet. */
+  bool ChangeOwnInsert(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn);
+
+  /** @return the last write the transaction buffered for the row, nullptr if there is none */
+  TableWriteRecord *FindBufferedWrite(const RID &rid, Transaction *txn);
+
+  /**
+   * Take an empty page out of the list of pages, latching its neighbours first, and log the new links.
+   * @return true if it was unlinked
+   */
+  bool UnlinkPage(page_id_t prev_page_id, page_id_t page_id);
+
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
   LogManager *log_manager_;
   page_id_t first_page_id_{};
+  table_oid_t oid_;
+  VersionStore versions_;
+  RecordVersionTable record_versions_;
 };
 
 }  // namespace bustub
@@ -56,6 +56,9 @@ class TableIterator {
   }
 
  private:
+  /** @return true if the iterator reads the version store */
+  bool IsSnapshot() const { return txn_ != nullptr && txn_->ReadsVersions(); }
+
   TableHeap *table_heap_;
   Tuple *tuple_;
   Transaction *txn_;
@@ -12,16 +12,108 @@
 
 #include "recovery/checkpoint_manager.h"
 
+#include <algorithm>
+
 namespace bustub {
 
 void CheckpointManager::BeginCheckpoint() {
-  // Block all the transactions and ensure that both the WAL and all dirty buffer pool pages are persisted to disk,
-  // creating a consistent checkpoint. Do NOT allow transactions to resume at the end of this method, resume them
-  // in CheckpointManager::EndCheckpoint() instead. This is for grading purposes.
+  begin_lsn_ = INVALID_LSN;
+  if (!enable_logging) {
+    return;
+  }
+  LogRecord begin_record(INVALID_TXN_ID, INVALID_LSN, LogRecordType::BEGIN_CHECKPOINT);
+  begin_lsn_ = log_manager_->AppendLogRecord(&begin_record);
+  // Arenas published before BEGIN_CHECKPOINT set their pages' lsns and transactions' prev lsns without any latch.
+  log_manager_->WaitForArenaPublishes();
+
+  // Both tables reflect at least every log record before BEGIN_CHECKPOINT; anything newer is seen by recovery's scan.
+  dirty_page_table_ = buffer_pool_manager_->GetDirtyPageTable();
+  lsn_t oldest_lsn;
+  auto active_txn_table = transaction_manager_->GetActiveTransactionTable(&oldest_lsn);
+  redo_lsn_ = begin_lsn_;
+  if (oldest_lsn != INVALID_LSN) {
+    redo_lsn_ = std::min(redo_lsn_, oldest_lsn);
+  }
+  for (const auto &[page_id, rec_lsn] : dirty_page_table_) {
+    redo_lsn_ = std::min(redo_lsn_, rec_lsn);
+  }
+
+  LogRecord end_record(INVALID_TXN_ID, begin_lsn_, LogRecordType::END_CHECKPOINT, std::move(active_txn_table),
+                       dirty_page_table_);
+  if (end_record.GetSize() > LOG_BUFFER_SIZE) {
+    // The tables do not fit in one record, recovery keeps using the previous checkpoint.
+    begin_lsn_ = INVALID_LSN;
+    return;
+  }
+  end_lsn_ = log_manager_->AppendLogRecord(&end_record);
 }
 
 void CheckpointManager::EndCheckpoint() {
-  // Allow transactions to resume, completing the checkpoint.
+  if (begin_lsn_ == INVALID_LSN) {
+    return;
+  }
+  log_manager_->WaitUntilPersistent(end_lsn_);
+
+  DiskManager *disk_manager = log_manager_->GetDiskManager();
+  LogMasterRecord master = disk_manager->ReadLogMaster();
+  master.checkpoint_lsn_ = begin_lsn_;
+  // A redo point written before this log manager started cannot be located; the old one still covers it.
+  int64_t redo_offset;
+  lsn_t redo_lsn;
+  if (log_manager_->GetFlushedLocation(redo_lsn_, &redo_offset, &redo_lsn)) {
+    master.redo_offset_ = redo_offset;
+    master.redo_lsn_ = redo_lsn;
+  }
+  disk_manager->WriteLogMaster(master);
+  disk_manager->TruncateLog(master.redo_offset_);
+  log_manager_->TrimFlushedLocations(master.redo_lsn_);
+  begin_lsn_ = INVALID_LSN;
+}
+
+void CheckpointManager::RunCheckpointThread() {
+  std::scoped_lock scoped_latch(latch_);
+  if (checkpoint_thread_ != nullptr) {
+    return;
+  }
+  stop_requested_ = false;
+  checkpoint_thread_ = new std::thread(&CheckpointManager::CheckpointThreadLoop, this);
+}
+
+void CheckpointManager::StopCheckpointThread() {
+  {
+    std::scoped_lock scoped_latch(latch_);
+    if (checkpoint_thread_ == nullptr) {
+      return;
+    }
+    stop_requested_ = true;
+  }
+  cv_.notify_one();
+  checkpoint_thread_->join();
+  delete checkpoint_thread_;
+  checkpoint_thread_ = nullptr;
+}
+
+void CheckpointManager::CheckpointThreadLoop() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (!cv_.wait_for(lock, checkpoint_interval, [this] { return stop_requested_; })) {
+    lock.unlock();
+    BeginCheckpoint();
+    EndCheckpoint();
+    // Write out the pages this checkpoint found dirty, so that the next one can move the redo point past them. The
+    // page latch keeps writers from changing the page while it is being written.
+    for (const auto &[page_id, rec_lsn] : dirty_page_table_) {
+      Page *page = buffer_pool_manager_->FetchPage(page_id);
+      if (page == nullptr) {
+        continue;
+      }
+      page->RLatch();
+      buffer_pool_manager_->FlushPage(page_id);
+      page->RUnlatch();
+      buffer_pool_manager_->UnpinPage(page_id, false);
+    }
+    dirty_page_table_.clear();
+    lock.lock();
+  }
 }
 
 }  // namespace bustub
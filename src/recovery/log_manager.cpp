@@ -12,6 +12,9 @@
 
 #include "recovery/log_manager.h"
 
+#include <cstring>
+#include <iterator>
+
 namespace bustub {
 /*
  * set enable_logging = true
@@ -22,33 +25,440 @@ namespace bustub {
  *
  * This thread runs forever until system shutdown/StopFlushThread
  */
-void LogManager::RunFlushThread() {}
+void LogManager::RunFlushThread() {
+  std::scoped_lock scoped_latch(latch_);
+  if (flush_thread_ != nullptr) {
+    return;
+  }
+  enable_logging = true;
+  stop_requested_ = false;
+  flush_thread_ = new std::thread(&LogManager::FlushThreadLoop, this);
+}
 
 /*
  * Stop and join the flush thread, set enable_logging = false
  */
-void LogManager::StopFlushThread() {}
+void LogManager::StopFlushThread() {
+  {
+    std::scoped_lock scoped_latch(latch_);
+    if (flush_thread_ == nullptr) {
+      enable_logging = false;
+      return;
+    }
+    stop_requested_ = true;
+  }
+  cv_.notify_one();
+  flush_thread_->join();
+  delete flush_thread_;
+  flush_thread_ = nullptr;
+  enable_logging = false;
+}
+
+/*
+ * The flush thread sleeps until log_timeout passes or someone requests a flush (the log buffer is full, or a
+ * transaction or the buffer pool is waiting for an lsn to become durable), then writes out the active log buffer.
+ * An asynchronous commit moves the wake-up earlier, to its flush deadline.
+ * Whatever is still buffered when the thread is stopped is flushed before it exits.
+ */
+void LogManager::FlushThreadLoop() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (true) {
+    auto timeout = std::chrono::steady_clock::now() + log_timeout;
+    while (!flush_requested_ && !stop_requested_) {
+      auto wake_up = deadline_flush_requested_ ? std::min(timeout, flush_deadline_) : timeout;
+      if (std::chrono::steady_clock::now() >= wake_up) {
+        break;
+      }
+      cv_.wait_until(lock, wake_up);
+    }
+    flush_requested_ = false;
+    // Everything appended so far goes out with this flush, including the asynchronous commits that set the deadline.
+    deadline_flush_requested_ = false;
+    lock.unlock();
+    FlushLogBuffer();
+    lock.lock();
+    if (stop_requested_ && ReservedOffset(reservation_.load()) == 0) {
+      break;
+    }
+  }
+}
+
+void LogManager::FlushLogBuffer() {
+  std::scoped_lock flush_latch(flush_latch_);
+  // Seal the active buffer: appends from now on go to the other buffer, which the previous flush has emptied.
+  uint64_t reservation = reservation_.load();
+  uint64_t sealed;
+  do {
+    if (ReservedOffset(reservation) == 0) {
+      std::scoped_lock scoped_latch(latch_);
+      persistent_cv_.notify_all();
+      return;
+    }
+    sealed = (reservation & ~(BUFFER_BIT | OFFSET_MASK)) | ((reservation ^ BUFFER_BIT) & BUFFER_BIT);
+  } while (!reservation_.compare_exchange_weak(reservation, sealed));
+  {
+    std::scoped_lock scoped_latch(latch_);
+    append_cv_.notify_all();
+  }
+
+  // Every record before the seal already has its space, wait for the stragglers to finish serializing into it.
+  int buffer = ReservedBuffer(reservation);
+  int flush_size = ReservedOffset(reservation);
+  lsn_t flush_lsn = ReservedLSN(reservation) - 1;
+  while (filled_bytes_[buffer].load(std::memory_order_acquire) != flush_size) {
+    std::this_thread::yield();
+  }
+  disk_manager_->WriteLog(log_buffers_[buffer], flush_size);
+  disk_manager_->PublishLogTail(flush_lsn);
+  filled_bytes_[buffer].store(0, std::memory_order_relaxed);
+  int64_t flush_offset = flushed_offset_;
+  flushed_offset_ += flush_size;
+
+  std::scoped_lock scoped_latch(latch_);
+  flushed_locations_[persistent_lsn_ + 1] = flush_offset;
+  persistent_lsn_ = flush_lsn;
+  persistent_cv_.notify_all();
+}
+
+void LogManager::WaitUntilPersistent(lsn_t lsn) {
+  std::unique_lock<std::mutex> lock(latch_);
+  if (persistent_lsn_ >= lsn) {
+    return;
+  }
+  if (flush_thread_ == nullptr) {
+    // Nobody else is going to flush, do it on the caller's thread.
+    lock.unlock();
+    FlushLogBuffer();
+    return;
+  }
+  flush_requested_ = true;
+  cv_.notify_one();
+  persistent_cv_.wait(lock, [this, lsn] { return persistent_lsn_ >= lsn; });
+}
+
+void LogManager::FlushWithinDelay(lsn_t lsn) {
+  std::unique_lock<std::mutex> lock(latch_);
+  if (persistent_lsn_ >= lsn) {
+    return;
+  }
+  if (flush_thread_ == nullptr) {
+    lock.unlock();
+    FlushLogBuffer();
+    return;
+  }
+  // A pending deadline is never later than a new one would be, only the first asynchronous commit sets it.
+  if (!deadline_flush_requested_) {
+    deadline_flush_requested_ = true;
+    flush_deadline_ = std::chrono::steady_clock::now() + async_commit_delay;
+    cv_.notify_one();
+  }
+}
+
+void LogManager::SetNextLSN(lsn_t lsn) {
+  uint64_t reservation = reservation_.load();
+  BUSTUB_ASSERT(ReservedOffset(reservation) == 0, "The log can only be moved forward while the log buffer is empty.");
+  reservation_ = (reservation & BUFFER_BIT) | (static_cast<uint64_t>(lsn) << LSN_SHIFT);
+  persistent_lsn_ = lsn - 1;
+  std::scoped_lock flush_latch(flush_latch_, latch_);
+  flushed_offset_ = disk_manager_->GetLogTail();
+  flushed_locations_.clear();
+}
+
+bool LogManager::GetFlushedLocation(lsn_t lsn, int64_t *offset, lsn_t *first_lsn) {
+  std::scoped_lock scoped_latch(latch_);
+  if (lsn > persistent_lsn_) {
+    return false;
+  }
+  auto it = flushed_locations_.upper_bound(lsn);
+  if (it == flushed_locations_.begin()) {
+    return false;
+  }
+  --it;
+  *first_lsn = it->first;
+  *offset = it->second;
+  return true;
+}
+
+void LogManager::TrimFlushedLocations(lsn_t lsn) {
+  std::scoped_lock scoped_latch(latch_);
+  auto it = flushed_locations_.upper_bound(lsn);
+  if (it != flushed_locations_.begin()) {
+    flushed_locations_.erase(flushed_locations_.begin(), std::prev(it));
+  }
+}
 
 /*
  * append a log record into log buffer
  * you MUST set the log record's lsn within this method
  * @return: lsn that is assigned to this log record
  *
- *
- * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
- *
- * if (log_record.log_record_type_ == LogRecordType::INSERT) {
- *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
- *    pos += sizeof(RID);
- *    // we have provided serialize function for tuple class
- *    log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
- *  }
- *
+ * The lsn and the space for the record are reserved together with one compare-and-swap on the reservation word, the
+ * record is then serialized outside of any latch. A record that does not fit is never given an lsn, so the log stays
+ * dense even when appenders race a full buffer.
  */
-lsn_t LogManager::AppendLogRecord(LogRecord *log_record) { return INVALID_LSN; }
+lsn_t LogManager::Reserve(int size, int count, int *buffer, int *offset) {
+  uint64_t reservation = reservation_.load();
+  while (true) {
+    if (ReservedOffset(reservation) + size > LOG_BUFFER_SIZE) {
+      // Hand the buffer to the flush thread and wait for the switch.
+      std::unique_lock<std::mutex> lock(latch_);
+      if (flush_thread_ == nullptr) {
+        lock.unlock();
+        FlushLogBuffer();
+      } else {
+        flush_requested_ = true;
+        cv_.notify_one();
+        append_cv_.wait(lock, [this, size] { return ReservedOffset(reservation_.load()) + size <= LOG_BUFFER_SIZE; });
+      }
+      reservation = reservation_.load();
+      continue;
+    }
+    uint64_t reserved = reservation + (static_cast<uint64_t>(count) << LSN_SHIFT) + size;
+    if (reservation_.compare_exchange_weak(reservation, reserved)) {
+      break;
+    }
+  }
+  *buffer = ReservedBuffer(reservation);
+  *offset = ReservedOffset(reservation);
+  return ReservedLSN(reservation);
+}
+
+lsn_t LogManager::AppendLogRecord(LogRecord *log_record) {
+  BUSTUB_ASSERT(log_record->size_ <= LOG_BUFFER_SIZE, "Log record does not fit in the log buffer.");
+  const int size = log_record->size_;
+  int buffer;
+  int offset;
+  log_record->lsn_ = Reserve(size, 1, &buffer, &offset);
+  SerializeLogRecord(*log_record, log_buffers_[buffer] + offset);
+  filled_bytes_[buffer].fetch_add(size, std::memory_order_release);
+  return log_record->lsn_;
+}
+
+/*
+ * The page latch keeps other transactions from changing the page, and from naming it in their arenas, until the
+ * record is in this arena; the arena latch keeps this arena from being published halfway through.
+ */
+void LogManager::AppendToArena(Transaction *txn, LogRecord *log_record, Page *page) {
+  LogArena *arena = txn->GetLogArena();
+  const txn_id_t txn_id = txn->GetTransactionId();
+  if (arena->log_manager_ == nullptr) {
+    std::unique_lock arena_txns_latch(arena_txns_latch_);
+    arena_txns_[txn_id] = txn;
+    arena->log_manager_ = this;
+    arena->txn_id_ = txn_id;
+  }
+  if (page != nullptr) {
+    while (page->unlogged_txn_ != INVALID_TXN_ID && page->unlogged_txn_ != txn_id) {
+      PublishArenaOf(page);
+    }
+  }
+
+  std::scoped_lock arena_latch(arena->latch_);
+  if (!arena->bytes_.empty() && arena->bytes_.size() + log_record->size_ > static_cast<size_t>(LOG_ARENA_SIZE)) {
+    PublishArenaLocked(txn);
+  }
+  BUSTUB_ASSERT(log_record->size_ <= LOG_BUFFER_SIZE, "Log record does not fit in the log buffer.");
+  size_t pos = arena->bytes_.size();
+  arena->bytes_.resize(pos + log_record->size_);
+  SerializeLogRecord(*log_record, arena->bytes_.data() + pos);
+  int index = arena->record_count_++;
+  if (page != nullptr) {
+    if (!arena->pages_.empty() && arena->pages_.back().first == page) {
+      arena->pages_.back().second = index;
+    } else {
+      arena->pages_.emplace_back(page, index);
+    }
+    page->unlogged_txn_ = txn_id;
+  }
+}
+
+lsn_t LogManager::PublishArena(Transaction *txn) {
+  std::scoped_lock arena_latch(txn->GetLogArena()->latch_);
+  return PublishArenaLocked(txn);
+}
+
+/*
+ * The records are copied into the log buffer as they are and then numbered in place: each one's lsn follows the
+ * previous one's, which becomes its prev lsn. Only after that are the pages stamped, so a page that no longer names
+ * the transaction has an lsn covering its changes.
+ */
+lsn_t LogManager::PublishArenaLocked(Transaction *txn) {
+  LogArena *arena = txn->GetLogArena();
+  if (arena->record_count_ == 0) {
+    return txn->GetPrevLSN();
+  }
+  std::shared_lock publish_latch(publish_latch_);
+  const int size = static_cast<int>(arena->bytes_.size());
+  int buffer;
+  int offset;
+  lsn_t first_lsn = Reserve(size, arena->record_count_, &buffer, &offset);
+  char *dest = log_buffers_[buffer] + offset;
+  memcpy(dest, arena->bytes_.data(), size);
+  lsn_t prev_lsn = txn->GetPrevLSN();
+  int pos = 0;
+  for (lsn_t lsn = first_lsn; lsn < first_lsn + arena->record_count_; lsn++) {
+    int32_t record_size;
+    memcpy(&record_size, dest + pos, sizeof(int32_t));
+    memcpy(dest + pos + 4, &lsn, sizeof(lsn_t));
+    memcpy(dest + pos + 12, &prev_lsn, sizeof(lsn_t));
+    prev_lsn = lsn;
+    pos += record_size;
+  }
+  filled_bytes_[buffer].fetch_add(size, std::memory_order_release);
+  txn->SetPrevLSN(prev_lsn);
+
+  for (const auto &[page, index] : arena->pages_) {
+    page->RaiseLSN(first_lsn + index);
+    txn_id_t txn_id = arena->txn_id_;
+    page->unlogged_txn_.compare_exchange_strong(txn_id, INVALID_TXN_ID);
+  }
+  arena->bytes_.clear();
+  arena->record_count_ = 0;
+  arena->pages_.clear();
+  return prev_lsn;
+}
+
+/*
+ * Holding the registry latch shared keeps the transaction from going away while its arena is published. The arena of a
+ * transaction that is already gone cannot be published any more, the page just stops naming it.
+ */
+void LogManager::PublishArenaOf(Page *page) {
+  txn_id_t txn_id = page->unlogged_txn_;
+  if (txn_id == INVALID_TXN_ID) {
+    return;
+  }
+  std::shared_lock arena_txns_latch(arena_txns_latch_);
+  auto it = arena_txns_.find(txn_id);
+  if (it == arena_txns_.end()) {
+    page->unlogged_txn_.compare_exchange_strong(txn_id, INVALID_TXN_ID);
+    return;
+  }
+  PublishArena(it->second);
+}
+
+void LogManager::ReleaseArena(LogArena *arena) {
+  std::unique_lock arena_txns_latch(arena_txns_latch_);
+  if (arena->log_manager_ == this) {
+    arena_txns_.erase(arena->txn_id_);
+    arena->log_manager_ = nullptr;
+  }
+}
+
+void LogManager::WaitForArenaPublishes() { std::unique_lock publish_latch(publish_latch_); }
+
+LogArena::~LogArena() {
+  if (log_manager_ != nullptr) {
+    log_manager_->ReleaseArena(this);
+  }
+}
+
+void LogManager::SerializeLogRecord(const LogRecord &log_record, char *dest) {
+  // First, serialize the must have fields(20 bytes in total)
+  memcpy(dest, &log_record.size_, sizeof(int32_t));
+  memcpy(dest + 4, &log_record.lsn_, sizeof(lsn_t));
+  memcpy(dest + 8, &log_record.txn_id_, sizeof(txn_id_t));
+  memcpy(dest + 12, &log_record.prev_lsn_, sizeof(lsn_t));
+  memcpy(dest + 16, &log_record.log_record_type_, sizeof(LogRecordType));
+  int pos = LogRecord::HEADER_SIZE;
+
+  switch (log_record.log_record_type_) {
+    case LogRecordType::INSERT:
+      memcpy(dest + pos, &log_record.insert_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      log_record.insert_tuple_.SerializeTo(dest + pos);
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      memcpy(dest + pos, &log_record.delete_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      log_record.delete_tuple_.SerializeTo(dest + pos);
+      break;
+    case LogRecordType::UPDATE:
+      memcpy(dest + pos, &log_record.update_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      log_record.old_tuple_.SerializeTo(dest + pos);
+      pos += sizeof(int32_t) + log_record.old_tuple_.GetLength();
+      log_record.new_tuple_.SerializeTo(dest + pos);
+      break;
+    case LogRecordType::UPDATE_DELTA: {
+      memcpy(dest + pos, &log_record.update_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(dest + pos, &log_record.delta_tuple_size_, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      auto range_count = static_cast<int32_t>(log_record.delta_ranges_.size());
+      memcpy(dest + pos, &range_count, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      const char *image = log_record.delta_images_.data();
+      for (const auto &[offset, length] : log_record.delta_ranges_) {
+        memcpy(dest + pos, &offset, sizeof(uint16_t));
+        memcpy(dest + pos + sizeof(uint16_t), &length, sizeof(uint16_t));
+        pos += 2 * sizeof(uint16_t);
+        memcpy(dest + pos, image, 2 * length);
+        pos += 2 * length;
+        image += 2 * length;
+      }
+      break;
+    }
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_PAGE:
+    case LogRecordType::INDEX_SET_PARENT:
+    case LogRecordType::INDEX_ROOT: {
+      auto byte_count = static_cast<int32_t>(log_record.index_bytes_.size());
+      memcpy(dest + pos, &log_record.page_id_, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      memcpy(dest + pos, &log_record.index_value_, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      memcpy(dest + pos, &byte_count, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      memcpy(dest + pos, log_record.index_bytes_.data(), byte_count);
+      break;
+    }
+    case LogRecordType::INDEX_KEY_INSERT:
+    case LogRecordType::INDEX_KEY_DELETE: {
+      auto name_size = static_cast<int32_t>(log_record.index_name_.size());
+      auto key_size = static_cast<int32_t>(log_record.index_bytes_.size());
+      memcpy(dest + pos, &log_record.index_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(dest + pos, &name_size, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      memcpy(dest + pos, log_record.index_name_.data(), name_size);
+      pos += name_size;
+      memcpy(dest + pos, &key_size, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      memcpy(dest + pos, log_record.index_bytes_.data(), key_size);
+      break;
+    }
+    case LogRecordType::NEWPAGE:
+    case LogRecordType::UNLINKPAGE:
+      memcpy(dest + pos, &log_record.prev_page_id_, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      memcpy(dest + pos, &log_record.page_id_, sizeof(page_id_t));
+      break;
+    case LogRecordType::END_CHECKPOINT: {
+      auto txn_count = static_cast<int32_t>(log_record.active_txn_table_.size());
+      memcpy(dest + pos, &txn_count, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      for (const auto &[txn_id, last_lsn] : log_record.active_txn_table_) {
+        memcpy(dest + pos, &txn_id, sizeof(txn_id_t));
+        memcpy(dest + pos + sizeof(txn_id_t), &last_lsn, sizeof(lsn_t));
+        pos += sizeof(txn_id_t) + sizeof(lsn_t);
+      }
+      auto page_count = static_cast<int32_t>(log_record.dirty_page_table_.size());
+      memcpy(dest + pos, &page_count, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      for (const auto &[page_id, rec_lsn] : log_record.dirty_page_table_) {
+        memcpy(dest + pos, &page_id, sizeof(page_id_t));
+        memcpy(dest + pos + sizeof(page_id_t), &rec_lsn, sizeof(lsn_t));
+        pos += sizeof(page_id_t) + sizeof(lsn_t);
+      }
+      break;
+    }
+    default:
+      // BEGIN, COMMIT, ABORT and BEGIN_CHECKPOINT only have the header.
+      break;
+  }
+}
 
 }  // namespace bustub
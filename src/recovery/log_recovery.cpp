@@ -12,6 +12,13 @@
 
 #include "recovery/log_recovery.h"
 
+#include <atomic>
+#include <cstring>
+#include <thread>  // NOLINT
+#include <unordered_set>
+
+#include "storage/page/b_plus_tree_page.h"
+#include "storage/page/header_page.h"
 #include "storage/page/table_page.h"
 
 namespace bustub {
@@ -20,21 +27,679 @@ namespace bustub {
  * @return: true means deserialize succeed, otherwise can't deserialize cause
  * incomplete log record
  */
-bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) { return false; }
+bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) {
+  memcpy(&log_record->size_, data, sizeof(int32_t));
+  memcpy(&log_record->lsn_, data + 4, sizeof(lsn_t));
+  memcpy(&log_record->txn_id_, data + 8, sizeof(txn_id_t));
+  memcpy(&log_record->prev_lsn_, data + 12, sizeof(lsn_t));
+  memcpy(&log_record->log_record_type_, data + 16, sizeof(LogRecordType));
+  // Zeroed or torn tail of the log.
+  if (log_record->size_ < LogRecord::HEADER_SIZE || log_record->size_ > LOG_BUFFER_SIZE ||
+      log_record->lsn_ == INVALID_LSN || log_record->log_record_type_ <= LogRecordType::INVALID ||
+      log_record->log_record_type_ > LogRecordType::INDEX_KEY_DELETE) {
+    return false;
+  }
+
+  int pos = LogRecord::HEADER_SIZE;
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      memcpy(&log_record->insert_rid_, data + pos, sizeof(RID));
+      pos += sizeof(RID);
+      log_record->insert_tuple_.DeserializeFrom(data + pos);
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      memcpy(&log_record->delete_rid_, data + pos, sizeof(RID));
+      pos += sizeof(RID);
+      log_record->delete_tuple_.DeserializeFrom(data + pos);
+      break;
+    case LogRecordType::UPDATE:
+      memcpy(&log_record->update_rid_, data + pos, sizeof(RID));
+      pos += sizeof(RID);
+      log_record->old_tuple_.DeserializeFrom(data + pos);
+      pos += sizeof(int32_t) + log_record->old_tuple_.GetLength();
+      log_record->new_tuple_.DeserializeFrom(data + pos);
+      break;
+    case LogRecordType::UPDATE_DELTA: {
+      int32_t range_count;
+      memcpy(&log_record->update_rid_, data + pos, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(&log_record->delta_tuple_size_, data + pos, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(&range_count, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      log_record->delta_ranges_.clear();
+      log_record->delta_images_.clear();
+      for (int32_t i = 0; i < range_count; i++) {
+        uint16_t offset;
+        uint16_t length;
+        if (pos + static_cast<int>(2 * sizeof(uint16_t)) > log_record->size_) {
+          return false;
+        }
+        memcpy(&offset, data + pos, sizeof(uint16_t));
+        memcpy(&length, data + pos + sizeof(uint16_t), sizeof(uint16_t));
+        pos += 2 * sizeof(uint16_t);
+        if (pos + 2 * length > log_record->size_ || offset + length > log_record->delta_tuple_size_) {
+          return false;
+        }
+        log_record->delta_ranges_.emplace_back(offset, length);
+        log_record->delta_images_.insert(log_record->delta_images_.end(), data + pos, data + pos + 2 * length);
+        pos += 2 * length;
+      }
+      break;
+    }
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_PAGE:
+    case LogRecordType::INDEX_SET_PARENT:
+    case LogRecordType::INDEX_ROOT: {
+      int32_t byte_count;
+      memcpy(&log_record->page_id_, data + pos, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      memcpy(&log_record->index_value_, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      memcpy(&byte_count, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      if (byte_count < 0 || byte_count > PAGE_SIZE || pos + byte_count > log_record->size_) {
+        return false;
+      }
+      log_record->index_bytes_.assign(data + pos, data + pos + byte_count);
+      break;
+    }
+    case LogRecordType::INDEX_KEY_INSERT:
+    case LogRecordType::INDEX_KEY_DELETE: {
+      int32_t name_size;
+      int32_t key_size;
+      memcpy(&log_record->index_rid_, data + pos, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(&name_size, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      if (name_size < 0 || pos + name_size + static_cast<int>(sizeof(int32_t)) > log_record->size_) {
+        return false;
+      }
+      log_record->index_name_.assign(data + pos, name_size);
+      pos += name_size;
+      memcpy(&key_size, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      if (key_size < 0 || pos + key_size > log_record->size_) {
+        return false;
+      }
+      log_record->index_bytes_.assign(data + pos, data + pos + key_size);
+      break;
+    }
+    case LogRecordType::NEWPAGE:
+    case LogRecordType::UNLINKPAGE:
+      memcpy(&log_record->prev_page_id_, data + pos, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      memcpy(&log_record->page_id_, data + pos, sizeof(page_id_t));
+      break;
+    case LogRecordType::END_CHECKPOINT: {
+      const int entry_size = 2 * sizeof(int32_t);
+      int32_t count;
+      log_record->active_txn_table_.clear();
+      log_record->dirty_page_table_.clear();
+      memcpy(&count, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      if (count < 0 || pos + count * entry_size + static_cast<int>(sizeof(int32_t)) > log_record->size_) {
+        return false;
+      }
+      for (int i = 0; i < count; i++, pos += entry_size) {
+        txn_id_t txn_id;
+        lsn_t last_lsn;
+        memcpy(&txn_id, data + pos, sizeof(txn_id_t));
+        memcpy(&last_lsn, data + pos + sizeof(txn_id_t), sizeof(lsn_t));
+        log_record->active_txn_table_.emplace_back(txn_id, last_lsn);
+      }
+      memcpy(&count, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      if (count < 0 || pos + count * entry_size > log_record->size_) {
+        return false;
+      }
+      for (int i = 0; i < count; i++, pos += entry_size) {
+        page_id_t page_id;
+        lsn_t rec_lsn;
+        memcpy(&page_id, data + pos, sizeof(page_id_t));
+        memcpy(&rec_lsn, data + pos + sizeof(page_id_t), sizeof(lsn_t));
+        log_record->dirty_page_table_.emplace_back(page_id, rec_lsn);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return true;
+}
 
 /*
  *redo phase on TABLE PAGE level(table/table_page.h)
- *read log file from the beginning to end (you must prefetch log records into
- *log buffer to reduce unnecessary I/O operations), remember to compare page's
- *LSN with log_record's sequence number, and also build active_txn_ table &
+ *read log file from the last checkpoint to end (log records are prefetched into
+ *log buffer to reduce unnecessary I/O operations), compare page's LSN with
+ *log_record's sequence number, and also build active_txn_ table &
  *lsn_mapping_ table
  */
-void LogRecovery::Redo() {}
+void LogRecovery::Redo() {
+  LogMasterRecord master = disk_manager_->ReadLogMaster();
+  active_txn_.clear();
+  lsn_mapping_.clear();
+  dirty_page_table_.clear();
+
+  // Analysis. Changes before the checkpoint are only redone for the pages in its dirty page table, changes after it
+  // make their pages dirty. Without a checkpoint every page the log touches may be dirty.
+  bool past_checkpoint = master.checkpoint_lsn_ == INVALID_LSN;
+  std::unordered_set<txn_id_t> finished_txns;
+  lsn_t next_lsn = ScanLog(master.redo_offset_, master.redo_lsn_, [&](const LogRecord &log_record, int64_t offset) {
+    lsn_mapping_[log_record.lsn_] = offset;
+    switch (log_record.log_record_type_) {
+      case LogRecordType::COMMIT:
+      case LogRecordType::ABORT:
+        active_txn_.erase(log_record.txn_id_);
+        finished_txns.insert(log_record.txn_id_);
+        break;
+      case LogRecordType::BEGIN_CHECKPOINT:
+        past_checkpoint = past_checkpoint || log_record.lsn_ == master.checkpoint_lsn_;
+        break;
+      case LogRecordType::END_CHECKPOINT:
+        if (log_record.prev_lsn_ != master.checkpoint_lsn_) {
+          break;
+        }
+        for (const auto &[txn_id, last_lsn] : log_record.active_txn_table_) {
+          if (finished_txns.count(txn_id) == 0) {
+            active_txn_.emplace(txn_id, last_lsn);
+          }
+        }
+        for (const auto &[page_id, rec_lsn] : log_record.dirty_page_table_) {
+          auto it = dirty_page_table_.find(page_id);
+          if (it == dirty_page_table_.end() || rec_lsn < it->second) {
+            dirty_page_table_[page_id] = rec_lsn;
+          }
+        }
+        break;
+      default:
+        // Index records and unlinks are redo-only and belong to no transaction.
+        if (!log_record.IsIndexRecord() && log_record.log_record_type_ != LogRecordType::UNLINKPAGE) {
+          active_txn_[log_record.txn_id_] = log_record.lsn_;
+        }
+        if (past_checkpoint && GetPageId(log_record) != INVALID_PAGE_ID) {
+          dirty_page_table_.emplace(GetPageId(log_record), log_record.lsn_);
+        }
+        // Linking the previous page to the new or next one is not logged on its own.
+        if (past_checkpoint && LinksPrevPage(log_record) && log_record.prev_page_id_ != INVALID_PAGE_ID) {
+          dirty_page_table_.emplace(log_record.prev_page_id_, log_record.lsn_);
+        }
+        break;
+    }
+  });
+  int64_t log_tail = offset_;
+  redo_pages_.clear();
+  for (const auto &[page_id, rec_lsn] : dirty_page_table_) {
+    redo_pages_.emplace_back(rec_lsn, page_id);
+  }
+  std::sort(redo_pages_.begin(), redo_pages_.end());
+
+  // Redo, repeating history for the dirty pages from the oldest recLSN on. A NEWPAGE or UNLINKPAGE record also
+  // changes the previous page, so it goes to that page's worker as well.
+  if (!dirty_page_table_.empty()) {
+    lsn_t redo_lsn = next_lsn;
+    for (const auto &[page_id, rec_lsn] : dirty_page_table_) {
+      redo_lsn = std::min(redo_lsn, rec_lsn);
+    }
+    auto it = lsn_mapping_.find(redo_lsn);
+    if (it == lsn_mapping_.end()) {
+      redo_lsn = master.redo_lsn_;
+      it = lsn_mapping_.find(redo_lsn);
+    }
+    if (it != lsn_mapping_.end()) {
+      redo_cursor_ = redo_lsn - 1;
+      prefetch_wait_lsn_ = INVALID_LSN;
+      redo_done_ = false;
+      std::thread prefetcher(&LogRecovery::PrefetchLoop, this,
+                             std::max<size_t>(buffer_pool_manager_->GetPoolSize() / 2, 1));
+      std::vector<RedoPartition> partitions(num_workers_);
+      std::vector<std::thread> workers;
+      for (size_t worker = 0; worker < num_workers_; worker++) {
+        workers.emplace_back(&LogRecovery::RedoWorkerLoop, this, &partitions[worker], worker);
+      }
+      ScanLog(it->second, redo_lsn, [this, &partitions](const LogRecord &log_record, int64_t /*offset*/) {
+        page_id_t page_id = GetPageId(log_record);
+        bool redo_page =
+            log_record.log_record_type_ == LogRecordType::INDEX_ROOT || NeedsRedo(page_id, log_record.lsn_);
+        if (redo_page) {
+          DispatchRedo(&partitions, RedoWorkerOf(page_id), log_record);
+        }
+        if (LinksPrevPage(log_record) && NeedsRedo(log_record.prev_page_id_, log_record.lsn_) &&
+            !(redo_page && RedoWorkerOf(log_record.prev_page_id_) == RedoWorkerOf(page_id))) {
+          DispatchRedo(&partitions, RedoWorkerOf(log_record.prev_page_id_), log_record);
+        }
+        AdvanceRedoCursor(log_record.lsn_);
+      });
+      {
+        std::scoped_lock prefetch_latch(prefetch_latch_);
+        redo_done_ = true;
+      }
+      prefetch_cv_.notify_one();
+      prefetcher.join();
+      for (auto &partition : partitions) {
+        FlushRedoBatch(&partition);
+        {
+          std::scoped_lock partition_latch(partition.latch_);
+          partition.closed_ = true;
+        }
+        partition.cv_.notify_all();
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+    }
+  }
+
+  // The log continues right after the last record that was found, overwriting whatever follows it.
+  offset_ = log_tail;
+  disk_manager_->SetLogTail(offset_);
+  if (log_manager_ != nullptr) {
+    log_manager_->SetNextLSN(next_lsn);
+  }
+}
+
+lsn_t LogRecovery::Replay(int64_t *offset, lsn_t lsn) {
+  lsn_t next_lsn = ScanLog(*offset, lsn, [this](const LogRecord &log_record, int64_t /*offset*/) {
+    RedoLogRecord(log_record);
+    if (LinksPrevPage(log_record)) {
+      RedoPageLink(log_record);
+    }
+  });
+  *offset = offset_;
+  return next_lsn;
+}
+
+void LogRecovery::DispatchRedo(std::vector<RedoPartition> *partitions, size_t worker, const LogRecord &log_record) {
+  RedoPartition *partition = &(*partitions)[worker];
+  partition->pending_.push_back(log_record);
+  if (partition->pending_.size() >= REDO_BATCH_SIZE) {
+    FlushRedoBatch(partition);
+  }
+}
+
+void LogRecovery::FlushRedoBatch(RedoPartition *partition) {
+  if (partition->pending_.empty()) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(partition->latch_);
+  // Bound the memory held by a worker that falls behind.
+  partition->cv_.wait(lock, [partition] { return partition->batches_.size() < REDO_MAX_BATCHES; });
+  partition->batches_.push_back(std::move(partition->pending_));
+  partition->pending_.clear();
+  lock.unlock();
+  partition->cv_.notify_all();
+}
+
+void LogRecovery::RedoWorkerLoop(RedoPartition *partition, size_t worker) {
+  while (true) {
+    std::vector<LogRecord> batch;
+    {
+      std::unique_lock<std::mutex> lock(partition->latch_);
+      partition->cv_.wait(lock, [partition] { return !partition->batches_.empty() || partition->closed_; });
+      if (partition->batches_.empty()) {
+        return;
+      }
+      batch = std::move(partition->batches_.front());
+      partition->batches_.pop_front();
+    }
+    partition->cv_.notify_all();
+
+    for (const auto &log_record : batch) {
+      page_id_t page_id = GetPageId(log_record);
+      // The header page has no lsn to tell what is on disk, root changes are redone whenever they are reached.
+      bool redo_page =
+          log_record.log_record_type_ == LogRecordType::INDEX_ROOT || NeedsRedo(page_id, log_record.lsn_);
+      if (redo_page && RedoWorkerOf(page_id) == worker) {
+        RedoLogRecord(log_record);
+      }
+      if (LinksPrevPage(log_record) && NeedsRedo(log_record.prev_page_id_, log_record.lsn_) &&
+          RedoWorkerOf(log_record.prev_page_id_) == worker) {
+        RedoPageLink(log_record);
+      }
+    }
+  }
+}
+
+void LogRecovery::AdvanceRedoCursor(lsn_t lsn) {
+  redo_cursor_ = lsn;
+  if (lsn >= prefetch_wait_lsn_) {
+    // Taking the latch orders the wakeup after the prefetcher has started to wait.
+    { std::scoped_lock prefetch_latch(prefetch_latch_); }
+    prefetch_cv_.notify_one();
+  }
+}
+
+void LogRecovery::PrefetchLoop(size_t window) {
+  for (size_t i = 0; i < redo_pages_.size(); i++) {
+    const auto &[rec_lsn, page_id] = redo_pages_[i];
+    if (i >= window) {
+      // Stay within window pages of the redo cursor, pages read any earlier could be evicted before they are used.
+      std::unique_lock<std::mutex> lock(prefetch_latch_);
+      prefetch_wait_lsn_ = redo_pages_[i - window].first;
+      prefetch_cv_.wait(lock, [this] { return redo_done_ || redo_cursor_ >= prefetch_wait_lsn_; });
+      if (redo_done_) {
+        return;
+      }
+    }
+    // A page the redo cursor has passed is already being fetched by its worker.
+    if (rec_lsn > redo_cursor_) {
+      buffer_pool_manager_->PrefetchPage(page_id);
+    }
+  }
+}
+
+lsn_t LogRecovery::ScanLog(int64_t offset, lsn_t lsn,
+                           const std::function<void(const LogRecord &, int64_t)> &visit) {
+  offset_ = offset;
+  bool end_of_log = false;
+  while (!end_of_log && disk_manager_->ReadLog(log_buffer_, LOG_BUFFER_SIZE, offset_)) {
+    int pos = 0;
+    LogRecord log_record;
+    while (pos + LogRecord::HEADER_SIZE <= LOG_BUFFER_SIZE) {
+      int32_t size;
+      lsn_t record_lsn;
+      memcpy(&size, log_buffer_ + pos, sizeof(int32_t));
+      memcpy(&record_lsn, log_buffer_ + pos + 4, sizeof(lsn_t));
+      // A record cut off by the end of the buffer is read again at the start of the next one.
+      if (pos > 0 && size >= LogRecord::HEADER_SIZE && pos + size > LOG_BUFFER_SIZE) {
+        break;
+      }
+      // Anything that does not continue the lsn sequence is past the end of the log.
+      if (record_lsn != lsn || pos + size > LOG_BUFFER_SIZE ||
+          !DeserializeLogRecord(log_buffer_ + pos, &log_record)) {
+        end_of_log = true;
+        break;
+      }
+      visit(log_record, offset_ + pos);
+      lsn++;
+      pos += size;
+    }
+    offset_ += pos;
+  }
+  return lsn;
+}
+
+page_id_t LogRecovery::GetPageId(const LogRecord &log_record) {
+  switch (log_record.log_record_type_) {
+    case LogRecordType::INSERT:
+      return log_record.insert_rid_.GetPageId();
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      return log_record.delete_rid_.GetPageId();
+    case LogRecordType::UPDATE:
+    case LogRecordType::UPDATE_DELTA:
+      return log_record.update_rid_.GetPageId();
+    case LogRecordType::NEWPAGE:
+    case LogRecordType::UNLINKPAGE:
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_PAGE:
+    case LogRecordType::INDEX_SET_PARENT:
+      return log_record.page_id_;
+    case LogRecordType::INDEX_ROOT:
+      return HEADER_PAGE_ID;
+    default:
+      return INVALID_PAGE_ID;
+  }
+}
+
+bool LogRecovery::NeedsRedo(page_id_t page_id, lsn_t lsn) {
+  auto it = dirty_page_table_.find(page_id);
+  return it != dirty_page_table_.end() && lsn >= it->second;
+}
 
 /*
  *undo phase on TABLE PAGE level(table/table_page.h)
  *iterate through active txn map and undo each operation
  */
-void LogRecovery::Undo() {}
+void LogRecovery::Undo() {
+  // Losers hold disjoint sets of tuple locks, so they can be rolled back side by side; the page latches keep their
+  // changes to a shared page apart.
+  std::vector<std::pair<txn_id_t, lsn_t>> losers(active_txn_.begin(), active_txn_.end());
+  std::vector<std::vector<LogRecord>> key_records(losers.size());
+  std::atomic<size_t> next_txn{0};
+  auto undo_worker = [this, &losers, &key_records, &next_txn] {
+    std::vector<char> buffer(LOG_BUFFER_SIZE);
+    LogRecord log_record;
+    for (size_t i = next_txn++; i < losers.size(); i = next_txn++) {
+      lsn_t &last_lsn = losers[i].second;
+      lsn_t lsn = last_lsn;
+      while (lsn != INVALID_LSN) {
+        auto it = lsn_mapping_.find(lsn);
+        if (it == lsn_mapping_.end() || !ReadLogRecord(it->second, &log_record, buffer.data())) {
+          break;
+        }
+        if (log_record.log_record_type_ == LogRecordType::INDEX_KEY_INSERT ||
+            log_record.log_record_type_ == LogRecordType::INDEX_KEY_DELETE) {
+          key_records[i].push_back(log_record);
+        } else {
+          last_lsn = UndoLogRecord(log_record, last_lsn);
+        }
+        lsn = log_record.GetPrevLSN();
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t worker = 1; worker < std::min(num_workers_, losers.size()); worker++) {
+    workers.emplace_back(undo_worker);
+  }
+  undo_worker();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  // The keys go back through the trees, which log their page changes only with logging on. The table pages are done
+  // by then, their undo runs with it off. Once its keys are back the loser is over, a later recovery does not undo it
+  // again.
+  bool logging = enable_logging;
+  enable_logging = log_manager_ != nullptr;
+  lsn_t last_abort_lsn = INVALID_LSN;
+  for (size_t i = 0; i < losers.size(); i++) {
+    auto &[txn_id, last_lsn] = losers[i];
+    for (const auto &log_record : key_records[i]) {
+      last_lsn = UndoKeyRecord(log_record, last_lsn);
+    }
+    if (log_manager_ != nullptr) {
+      LogRecord abort_record(txn_id, last_lsn, LogRecordType::ABORT);
+      last_abort_lsn = log_manager_->AppendLogRecord(&abort_record);
+    }
+  }
+  enable_logging = logging;
+  if (last_abort_lsn != INVALID_LSN) {
+    log_manager_->WaitUntilPersistent(last_abort_lsn);
+  }
+  active_txn_.clear();
+}
+
+bool LogRecovery::ReadLogRecord(int64_t offset, LogRecord *log_record, char *buffer) {
+  // Read the header first, then exactly the record.
+  int32_t size;
+  if (!disk_manager_->ReadLog(buffer, LogRecord::HEADER_SIZE, offset)) {
+    return false;
+  }
+  memcpy(&size, buffer, sizeof(int32_t));
+  if (size < LogRecord::HEADER_SIZE || size > LOG_BUFFER_SIZE) {
+    return false;
+  }
+  return disk_manager_->ReadLog(buffer, size, offset) && DeserializeLogRecord(buffer, log_record);
+}
+
+void LogRecovery::RedoLogRecord(const LogRecord &log_record) {
+  page_id_t page_id = GetPageId(log_record);
+  if (page_id == INVALID_PAGE_ID) {
+    return;
+  }
+  if (log_record.log_record_type_ == LogRecordType::INDEX_ROOT) {
+    RedoIndexRoot(log_record);
+    return;
+  }
+
+  auto *page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Recovery needs a free frame for every page it touches.");
+  // Latch before looking at the page, the prefetcher may still be reading it in.
+  page->WLatch();
+  // A page that never reached the disk reads as zeros, with the lsn of the first record in the log. A record that
+  // writes the whole page is redone over a page at its own lsn as well, which changes nothing if it was there.
+  bool whole_page = log_record.log_record_type_ == LogRecordType::INDEX_PAGE ||
+                    log_record.log_record_type_ == LogRecordType::NEWPAGE;
+  bool redo = page->GetLSN() < log_record.lsn_ || (whole_page && page->GetLSN() == log_record.lsn_);
+  if (redo) {
+    RID rid;
+    Tuple old_tuple;
+    auto *index_page = reinterpret_cast<BPlusTreePage *>(page->GetData());
+    const std::vector<char> &index_bytes = log_record.index_bytes_;
+    switch (log_record.log_record_type_) {
+      case LogRecordType::INSERT:
+        // Later records name the tuple by its rid, whatever slot the page on disk would pick.
+        page->InsertTupleAt(log_record.insert_tuple_, log_record.insert_rid_);
+        break;
+      case LogRecordType::MARKDELETE:
+        page->MarkDelete(log_record.delete_rid_, nullptr, nullptr);
+        break;
+      case LogRecordType::APPLYDELETE:
+        page->ApplyDelete(log_record.delete_rid_, nullptr, nullptr);
+        break;
+      case LogRecordType::ROLLBACKDELETE:
+        page->RollbackDelete(log_record.delete_rid_, nullptr, nullptr);
+        break;
+      case LogRecordType::UPDATE:
+        page->UpdateTuple(log_record.new_tuple_, &old_tuple, log_record.update_rid_, nullptr, nullptr);
+        break;
+      case LogRecordType::UPDATE_DELTA:
+        page->ApplyUpdateDelta(log_record.update_rid_, log_record, true);
+        break;
+      case LogRecordType::INDEX_INSERT:
+        index_page->RedoInsert(log_record.index_value_, index_bytes.data(), index_bytes.size());
+        break;
+      case LogRecordType::INDEX_DELETE:
+        index_page->RedoRemove(log_record.index_value_, index_bytes.size());
+        break;
+      case LogRecordType::INDEX_PAGE:
+        memcpy(page->GetData(), index_bytes.data(), index_bytes.size());
+        break;
+      case LogRecordType::INDEX_SET_PARENT:
+        index_page->SetParentPageId(log_record.index_value_);
+        break;
+      case LogRecordType::UNLINKPAGE:
+        page->SetPrevPageId(log_record.prev_page_id_);
+        break;
+      default:
+        page->Init(page_id, PAGE_SIZE, log_record.prev_page_id_, nullptr, nullptr);
+        break;
+    }
+    page->SetLSN(log_record.lsn_);
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, redo);
+}
+
+void LogRecovery::RedoPageLink(const LogRecord &log_record) {
+  if (log_record.prev_page_id_ == INVALID_PAGE_ID) {
+    return;
+  }
+  auto *prev_page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(log_record.prev_page_id_));
+  BUSTUB_ASSERT(prev_page != nullptr, "Recovery needs a free frame for every page it touches.");
+  prev_page->WLatch();
+  bool relink = prev_page->GetNextPageId() != log_record.page_id_;
+  if (relink) {
+    prev_page->SetNextPageId(log_record.page_id_);
+  }
+  prev_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(log_record.prev_page_id_, relink);
+}
+
+void LogRecovery::RedoIndexRoot(const LogRecord &log_record) {
+  auto *header_page = reinterpret_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  BUSTUB_ASSERT(header_page != nullptr, "Recovery needs a free frame for every page it touches.");
+  std::string index_name(log_record.index_bytes_.begin(), log_record.index_bytes_.end());
+  header_page->WLatch();
+  if (!header_page->UpdateRecord(index_name, log_record.page_id_)) {
+    header_page->InsertRecord(index_name, log_record.page_id_);
+  }
+  header_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+}
+
+lsn_t LogRecovery::UndoLogRecord(const LogRecord &log_record, lsn_t prev_lsn) {
+  page_id_t page_id = GetPageId(log_record);
+  // A new page is left in the table, empty.
+  if (page_id == INVALID_PAGE_ID || log_record.log_record_type_ == LogRecordType::NEWPAGE) {
+    return prev_lsn;
+  }
+
+  auto *page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Recovery needs a free frame for every page it touches.");
+  page->WLatch();
+  const txn_id_t txn_id = log_record.txn_id_;
+  Tuple old_tuple;
+  Tuple new_tuple;
+  bool deleted;
+  // The compensation is logged as the change it makes, so that it is redone like any other.
+  LogRecord compensation;
+  switch (log_record.log_record_type_) {
+    case LogRecordType::INSERT:
+      page->ApplyDelete(log_record.insert_rid_, nullptr, nullptr);
+      compensation = LogRecord(txn_id, prev_lsn, LogRecordType::APPLYDELETE, log_record.insert_rid_,
+                               log_record.insert_tuple_);
+      break;
+    case LogRecordType::MARKDELETE:
+      page->RollbackDelete(log_record.delete_rid_, nullptr, nullptr);
+      compensation =
+          LogRecord(txn_id, prev_lsn, LogRecordType::ROLLBACKDELETE, log_record.delete_rid_, log_record.delete_tuple_);
+      break;
+    case LogRecordType::APPLYDELETE:
+      page->InsertTupleAt(log_record.delete_tuple_, log_record.delete_rid_);
+      compensation =
+          LogRecord(txn_id, prev_lsn, LogRecordType::INSERT, log_record.delete_rid_, log_record.delete_tuple_);
+      break;
+    case LogRecordType::ROLLBACKDELETE:
+      page->MarkDelete(log_record.delete_rid_, nullptr, nullptr);
+      compensation =
+          LogRecord(txn_id, prev_lsn, LogRecordType::MARKDELETE, log_record.delete_rid_, log_record.delete_tuple_);
+      break;
+    case LogRecordType::UPDATE_DELTA:
+      page->ReadTuple(log_record.update_rid_, &new_tuple, &deleted);
+      page->ApplyUpdateDelta(log_record.update_rid_, log_record, false);
+      page->ReadTuple(log_record.update_rid_, &old_tuple, &deleted);
+      compensation = LogRecord(txn_id, prev_lsn, LogRecordType::UPDATE, log_record.update_rid_, new_tuple, old_tuple);
+      break;
+    default:
+      page->UpdateTuple(log_record.old_tuple_, &new_tuple, log_record.update_rid_, nullptr, nullptr);
+      compensation =
+          LogRecord(txn_id, prev_lsn, LogRecordType::UPDATE, log_record.update_rid_, new_tuple, log_record.old_tuple_);
+      break;
+  }
+  if (log_manager_ != nullptr) {
+    prev_lsn = log_manager_->AppendLogRecord(&compensation);
+    page->SetLSN(prev_lsn);
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, true);
+  return prev_lsn;
+}
+
+/*
+ * The compensation goes into the log before the tree changes, like the key records the tree logs itself.
+ */
+lsn_t LogRecovery::UndoKeyRecord(const LogRecord &log_record, lsn_t prev_lsn) {
+  auto it = indexes_.find(log_record.index_name_);
+  if (it == indexes_.end()) {
+    return prev_lsn;
+  }
+  if (log_manager_ != nullptr) {
+    LogRecordType type = log_record.log_record_type_ == LogRecordType::INDEX_KEY_INSERT
+                             ? LogRecordType::INDEX_KEY_DELETE
+                             : LogRecordType::INDEX_KEY_INSERT;
+    LogRecord compensation(log_record.txn_id_, prev_lsn, type, log_record.index_name_, log_record.index_bytes_.data(),
+                           log_record.index_bytes_.size(), log_record.index_rid_);
+    prev_lsn = log_manager_->AppendLogRecord(&compensation);
+  }
+  it->second(log_record);
+  return prev_lsn;
+}
 
 }  // namespace bustub
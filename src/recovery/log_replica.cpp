@@ -0,0 +1,60 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_replica.cpp
+//
+// Identification: src/recovery/log_replica.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_replica.h"
+
+namespace bustub {
+
+/*
+ * Records are only read up to the published tail, which the primary moves after the log before it is written, so
+ * replay never sees a record the primary is still writing. Catching up twice at once is serialized by the replay latch.
+ */
+void LogReplica::CatchUp() {
+  disk_manager_->RefreshLogTail();
+  replay_latch_.WLock();
+  next_lsn_ = recovery_.Replay(&offset_, next_lsn_);
+  replay_latch_.WUnlock();
+}
+
+void LogReplica::RunReplayThread() {
+  std::scoped_lock scoped_latch(latch_);
+  if (replay_thread_ != nullptr) {
+    return;
+  }
+  stop_requested_ = false;
+  replay_thread_ = new std::thread(&LogReplica::ReplayThreadLoop, this);
+}
+
+void LogReplica::StopReplayThread() {
+  {
+    std::scoped_lock scoped_latch(latch_);
+    if (replay_thread_ == nullptr) {
+      return;
+    }
+    stop_requested_ = true;
+  }
+  cv_.notify_one();
+  replay_thread_->join();
+  delete replay_thread_;
+  replay_thread_ = nullptr;
+}
+
+void LogReplica::ReplayThreadLoop() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (!cv_.wait_for(lock, replica_poll_interval, [this] { return stop_requested_; })) {
+    lock.unlock();
+    CatchUp();
+    lock.lock();
+  }
+}
+
+}  // namespace bustub
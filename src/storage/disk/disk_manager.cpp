@@ -10,9 +10,15 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <mutex>  // NOLINT
 #include <string>
@@ -20,6 +26,7 @@
 
 #include "common/exception.h"
 #include "common/logger.h"
+#include "common/macros.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
@@ -27,11 +34,10 @@ namespace bustub {
 static char *buffer_used;
 
 /**
- * Constructor: open/create a single database file & log file
+ * Constructor: open/create a single database file & the log
  * @input db_file: database file name
  */
-DiskManager::DiskManager(const std::string &db_file)
-    : file_name_(db_file), num_flushes_(0), num_writes_(0), flush_log_(false), flush_log_f_(nullptr) {
+DiskManager::DiskManager(const std::string &db_file, int64_t log_segment_size) : file_name_(db_file) {
   std::string::size_type n = file_name_.rfind('.');
   if (n == std::string::npos) {
     LOG_DEBUG("wrong file format");
@@ -39,30 +45,65 @@ DiskManager::DiskManager(const std::string &db_file)
   }
   log_name_ = file_name_.substr(0, n) + ".log";
 
-  log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-  // directory or file does not exist
-  if (!log_io_.is_open()) {
-    log_io_.clear();
-    // create a new file
-    log_io_.open(log_name_, std::ios::binary | std::ios::trunc | std::ios::app | std::ios::out);
-    log_io_.close();
-    // reopen with original mode
-    log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-    if (!log_io_.is_open()) {
-      throw Exception("can't open dblog file");
+  std::ifstream master_io(log_name_, std::ios::binary);
+  if (master_io.is_open() && master_io.read(reinterpret_cast<char *>(&log_master_), sizeof(log_master_))) {
+    // An existing log, the tail is somewhere in its last segment and recovery will tell where.
+    master_io.close();
+    int64_t segment = log_master_.redo_offset_ / log_master_.segment_size_;
+    log_start_ = segment * log_master_.segment_size_;
+    last_segment_ = segment - 1;
+    while (GetFileSize(SegmentName(last_segment_ + 1)) >= 0) {
+      last_segment_++;
     }
+    log_tail_ = std::max(log_start_, (last_segment_ + 1) * log_master_.segment_size_);
+  } else {
+    // No master record, whatever segments are left over belong to a log that no longer exists.
+    master_io.close();
+    RemoveStaleSegments();
+    log_master_ = LogMasterRecord();
+    log_master_.segment_size_ = log_segment_size;
+    WriteLogMaster(log_master_);
   }
 
+  OpenDbFile();
+}
+
+/**
+ * Constructor: open/create the replica's database file & follow the primary's log
+ * @input db_file: replica database file name
+ * @input primary_db_file: primary database file name
+ */
+DiskManager::DiskManager(const std::string &db_file, const std::string &primary_db_file)
+    : follower_(true), file_name_(db_file) {
+  std::string::size_type n = primary_db_file.rfind('.');
+  if (n == std::string::npos) {
+    throw Exception("wrong file format");
+  }
+  log_name_ = primary_db_file.substr(0, n) + ".log";
+
+  // The primary owns its master record, the replica only needs to know how its log is laid out.
+  std::ifstream master_io(log_name_, std::ios::binary);
+  if (!master_io.is_open() || !master_io.read(reinterpret_cast<char *>(&log_master_), sizeof(log_master_))) {
+    throw Exception("can't read the primary's log master record");
+  }
+  master_io.close();
+  log_start_ = log_master_.redo_offset_ / log_master_.segment_size_ * log_master_.segment_size_;
+  // Nothing is readable until the primary has published a tail.
+  log_tail_ = log_start_;
+  OpenDbFile();
+}
+
+void DiskManager::OpenDbFile() {
   std::scoped_lock scoped_db_io_latch(db_io_latch_);
-  db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
+  db_io_.open(file_name_, std::ios::binary | std::ios::in | std::ios::out);
   // directory or file does not exist
   if (!db_io_.is_open()) {
     db_io_.clear();
     // create a new file
-    db_io_.open(db_file, std::ios::binary | std::ios::trunc | std::ios::out);
+    db_io_.open(file_name_, std::ios::binary | std::ios::trunc | std::ios::out);
     db_io_.close();
     // reopen with original mode
-    db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
+    db_io_.open(file_name_, std::ios::binary | std::ios::in | std::ios::out);
     if (!db_io_.is_open()) {
       throw Exception("can't open db file");
     }
@@ -78,7 +119,14 @@ void DiskManager::ShutDown() {
     std::scoped_lock scoped_db_io_latch(db_io_latch_);
     db_io_.close();
   }
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
   log_io_.close();
+  log_read_io_.close();
+  log_tail_io_.close();
+  if (log_sync_fd_ >= 0) {
+    close(log_sync_fd_);
+    log_sync_fd_ = -1;
+  }
 }
 
 /**
@@ -110,6 +158,7 @@ void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
   if (offset > GetFileSize(file_name_)) {
     LOG_DEBUG("I/O error reading past end of file");
     // std::cerr << "I/O error while reading" << std::endl;
+    memset(page_data, 0, PAGE_SIZE);
   } else {
     // set read cursor to offset
     db_io_.seekp(offset);
@@ -142,6 +191,10 @@ void DiskManager::WriteLog(char *log_data, int size) {
     return;
   }
 
+  if (follower_) {
+    throw Exception("a replica does not write the log it follows");
+  }
+
   flush_log_ = true;
 
   if (flush_log_f_ != nullptr) {
@@ -149,48 +202,220 @@ void DiskManager::WriteLog(char *log_data, int size) {
     assert(flush_log_f_->wait_for(std::chrono::seconds(10)) == std::future_status::ready);
   }
 
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
   num_flushes_ += 1;
-  // sequence write
-  log_io_.write(log_data, size);
-
-  // check for I/O error
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while writing log");
-    return;
+  // sequence write, split at segment boundaries
+  const int64_t segment_size = log_master_.segment_size_;
+  int written = 0;
+  while (written < size) {
+    int64_t segment = log_tail_ / segment_size;
+    int64_t segment_offset = log_tail_ % segment_size;
+    int chunk = static_cast<int>(std::min<int64_t>(size - written, segment_size - segment_offset));
+    if (segment != log_io_segment_) {
+      if (log_io_segment_ != -1) {
+        SyncLogSegment();
+      }
+      PreallocateSegment(segment);
+      // Have the next segment ready before the log gets there.
+      PreallocateSegment(segment + 1);
+      last_segment_ = std::max(last_segment_, segment + 1);
+      OpenSegment(&log_io_, &log_io_segment_, segment);
+    }
+    log_io_.seekp(segment_offset);
+    log_io_.write(log_data + written, chunk);
+    // check for I/O error
+    if (log_io_.bad()) {
+      LOG_DEBUG("I/O error while writing log");
+      return;
+    }
+    written += chunk;
+    log_tail_ += chunk;
   }
-  // needs to flush to keep disk file in sync
-  log_io_.flush();
+  // The records are only durable once the segment is synced, every commit waiting for them shares this sync.
+  SyncLogSegment();
   flush_log_ = false;
 }
 
 /**
  * Read the contents of the log into the given memory area
- * Always read from the beginning and perform sequence read
+ * Perform sequence read across segments
  * @return: false means already reach the end
  */
-bool DiskManager::ReadLog(char *log_data, int size, int offset) {
-  if (offset >= GetFileSize(log_name_)) {
+bool DiskManager::ReadLog(char *log_data, int size, int64_t offset) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  if (offset < log_start_ || offset >= log_tail_) {
     // LOG_DEBUG("end of log file");
-    // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
     return false;
   }
-  log_io_.seekp(offset);
-  log_io_.read(log_data, size);
-
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while reading log");
-    return false;
+  const int64_t segment_size = log_master_.segment_size_;
+  int read_count = static_cast<int>(std::min<int64_t>(size, log_tail_ - offset));
+  int done = 0;
+  while (done < read_count) {
+    int64_t segment = (offset + done) / segment_size;
+    int64_t segment_offset = (offset + done) % segment_size;
+    int chunk = static_cast<int>(std::min<int64_t>(read_count - done, segment_size - segment_offset));
+    if (segment == log_io_segment_) {
+      // Reads of the segment being written must see everything written to it so far.
+      log_io_.flush();
+    }
+    if (!OpenSegment(&log_read_io_, &log_read_segment_, segment)) {
+      break;
+    }
+    log_read_io_.seekg(segment_offset);
+    log_read_io_.read(log_data + done, chunk);
+    if (log_read_io_.bad()) {
+      LOG_DEBUG("I/O error while reading log");
+      return false;
+    }
+    int got = log_read_io_.gcount();
+    done += got;
+    if (got < chunk) {
+      log_read_io_.clear();
+      break;
+    }
   }
   // if log file ends before reading "size"
-  int read_count = log_io_.gcount();
-  if (read_count < size) {
-    log_io_.clear();
-    memset(log_data + read_count, 0, size - read_count);
+  if (done < size) {
+    memset(log_data + done, 0, size - done);
   }
-
   return true;
 }
 
+int64_t DiskManager::GetLogTail() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  return log_tail_;
+}
+
+void DiskManager::SetLogTail(int64_t offset) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  BUSTUB_ASSERT(offset >= log_start_, "The log tail cannot move before the truncated part of the log.");
+  log_tail_ = offset;
+}
+
+/*
+ * Segments before the one holding offset are renamed past the last segment, where the log will reuse them without
+ * paying for allocation again, until LOG_SEGMENT_SPARES of them are waiting; the rest are deleted.
+ */
+void DiskManager::TruncateLog(int64_t offset) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  if (follower_) {
+    // The primary decides when its log is truncated.
+    return;
+  }
+  const int64_t segment_size = log_master_.segment_size_;
+  int64_t first_live = std::min(offset, log_tail_) / segment_size;
+  if (log_start_ / segment_size >= first_live) {
+    return;
+  }
+  for (int64_t segment = log_start_ / segment_size; segment < first_live; segment++) {
+    if (segment == log_read_segment_) {
+      log_read_io_.close();
+      log_read_segment_ = -1;
+    }
+    if (last_segment_ - log_tail_ / segment_size < LOG_SEGMENT_SPARES &&
+        std::rename(SegmentName(segment).c_str(), SegmentName(last_segment_ + 1).c_str()) == 0) {
+      last_segment_++;
+    } else {
+      std::remove(SegmentName(segment).c_str());
+    }
+  }
+  log_start_ = std::max(log_start_, first_live * segment_size);
+  // A renamed segment must not come back under its old name after a crash, the log would read it as live.
+  SyncPath(LogDirectory());
+}
+
+void DiskManager::EnableLogShipping() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  if (follower_ || log_tail_io_.is_open()) {
+    return;
+  }
+  log_tail_io_.open(log_name_ + ".tail", std::ios::binary | std::ios::trunc | std::ios::out);
+  if (!log_tail_io_.is_open()) {
+    throw Exception("can't create log tail file");
+  }
+}
+
+/*
+ * The tail is only published once the log up to it has been written, so a replica that sees it can read everything
+ * before it.
+ */
+void DiskManager::PublishLogTail(lsn_t last_lsn) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  if (!log_tail_io_.is_open()) {
+    return;
+  }
+  PublishedLogTail tail{log_tail_, last_lsn, 0};
+  tail.check_ = tail.offset_ ^ tail.last_lsn_ ^ LOG_TAIL_MAGIC;
+  log_tail_io_.seekp(0);
+  log_tail_io_.write(reinterpret_cast<const char *>(&tail), sizeof(tail));
+  log_tail_io_.flush();
+  if (log_tail_io_.bad()) {
+    LOG_DEBUG("I/O error while publishing log tail");
+  }
+}
+
+/*
+ * The primary rewrites the tail in place, a read that overlaps a write fails the check and is retried. If the tail
+ * still cannot be read the previous one stays in effect.
+ */
+lsn_t DiskManager::RefreshLogTail() {
+  static constexpr int READ_ATTEMPTS = 3;
+  std::ifstream tail_io(log_name_ + ".tail", std::ios::binary);
+  PublishedLogTail tail;
+  bool valid = false;
+  for (int attempt = 0; attempt < READ_ATTEMPTS && tail_io.is_open() && !valid; attempt++) {
+    tail_io.clear();
+    tail_io.seekg(0);
+    valid = static_cast<bool>(tail_io.read(reinterpret_cast<char *>(&tail), sizeof(tail))) &&
+            (tail.offset_ ^ tail.last_lsn_ ^ LOG_TAIL_MAGIC) == tail.check_;
+  }
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  if (valid && tail.offset_ >= log_tail_) {
+    log_tail_ = tail.offset_;
+    published_lsn_ = static_cast<lsn_t>(tail.last_lsn_);
+  }
+  return published_lsn_;
+}
+
+LogMasterRecord DiskManager::ReadLogMaster() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  return log_master_;
+}
+
+/*
+ * The new master record is written next to the old one and renamed over it, so a crash leaves one or the other.
+ */
+void DiskManager::WriteLogMaster(const LogMasterRecord &master) {
+  if (follower_) {
+    throw Exception("a replica does not write the log it follows");
+  }
+  LogMasterRecord new_master = master;
+  // The segment size is fixed for the life of the log.
+  new_master.segment_size_ = log_master_.segment_size_;
+  // The pages written out before the checkpoint have to be on disk before the redo point moves past their records.
+  if (db_io_.is_open()) {
+    std::scoped_lock scoped_db_io_latch(db_io_latch_);
+    db_io_.flush();
+    SyncPath(file_name_);
+  }
+  std::string tmp_name = log_name_ + ".tmp";
+  int fd = open(tmp_name.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0) {
+    throw Exception("can't write log master record");
+  }
+  bool written = write(fd, &new_master, sizeof(new_master)) == static_cast<ssize_t>(sizeof(new_master)) &&
+                 fsync(fd) == 0;
+  close(fd);
+  if (!written) {
+    throw Exception("can't write log master record");
+  }
+  if (std::rename(tmp_name.c_str(), log_name_.c_str()) != 0) {
+    throw Exception("can't replace log master record");
+  }
+  SyncPath(LogDirectory());
+  log_master_ = new_master;
+}
+
 /**
  * Returns number of flushes made so far
  */
@@ -206,6 +431,85 @@ int DiskManager::GetNumWrites() const { return num_writes_; }
  */
 bool DiskManager::GetFlushState() const { return flush_log_; }
 
+std::string DiskManager::SegmentName(int64_t segment) const { return log_name_ + "." + std::to_string(segment); }
+
+void DiskManager::PreallocateSegment(int64_t segment) {
+  std::string name = SegmentName(segment);
+  // A segment of full size was preallocated and synced already, or recycled by a synced rename.
+  if (GetFileSize(name) >= log_master_.segment_size_) {
+    return;
+  }
+  int fd = open(name.c_str(), O_CREAT | O_WRONLY, 0644);
+  if (fd < 0) {
+    throw Exception("can't create log segment");
+  }
+  // Allocating the blocks now keeps the flushes of this segment from also having to update file metadata. That only
+  // holds once the allocation and the new directory entry are on disk themselves.
+  if (posix_fallocate(fd, 0, log_master_.segment_size_) != 0) {
+    LOG_DEBUG("can't preallocate log segment");
+  }
+  fsync(fd);
+  close(fd);
+  SyncPath(LogDirectory());
+}
+
+void DiskManager::SyncLogSegment() {
+  log_io_.flush();
+  if (log_sync_fd_ >= 0 && fdatasync(log_sync_fd_) != 0) {
+    LOG_DEBUG("I/O error while syncing log");
+  }
+}
+
+std::string DiskManager::LogDirectory() const {
+  std::filesystem::path log_path(log_name_);
+  return log_path.has_parent_path() ? log_path.parent_path().string() : std::string(".");
+}
+
+void DiskManager::SyncPath(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  if (fsync(fd) != 0) {
+    LOG_DEBUG("I/O error while syncing");
+  }
+  close(fd);
+}
+
+bool DiskManager::OpenSegment(std::fstream *io, int64_t *io_segment, int64_t segment) {
+  if (*io_segment == segment && io->is_open()) {
+    return true;
+  }
+  io->close();
+  io->clear();
+  // Only the stream that writes the log opens a segment for writing, a replica reads segments it does not own.
+  io->open(SegmentName(segment),
+           io == &log_io_ ? std::ios::binary | std::ios::in | std::ios::out : std::ios::binary | std::ios::in);
+  *io_segment = io->is_open() ? segment : -1;
+  if (io == &log_io_) {
+    // The stream has no descriptor of its own to sync.
+    if (log_sync_fd_ >= 0) {
+      close(log_sync_fd_);
+    }
+    log_sync_fd_ = io->is_open() ? open(SegmentName(segment).c_str(), O_WRONLY) : -1;
+  }
+  return io->is_open();
+}
+
+void DiskManager::RemoveStaleSegments() {
+  std::filesystem::path log_path(log_name_);
+  std::filesystem::path dir(LogDirectory());
+  std::string prefix = log_path.filename().string() + ".";
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    std::string name = entry.path().filename().string();
+    if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+        std::all_of(name.begin() + prefix.size(), name.end(), ::isdigit)) {
+      std::filesystem::remove(entry.path(), ec);
+    }
+  }
+}
+
 /**
  * Private helper function to get disk file size
  */
@@ -0,0 +1,122 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_memory.cpp
+//
+// Identification: src/storage/disk/disk_manager_memory.cpp
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "storage/disk/disk_manager_memory.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/logger.h"
+#include "common/macros.h"
+
+namespace bustub {
+
+DiskManagerMemory::DiskManagerMemory(size_t initial_pages) { pages_.reserve(initial_pages); }
+
+/**
+ * Write the contents of the specified page into memory
+ */
+void DiskManagerMemory::WritePage(page_id_t page_id, const char *page_data) {
+  std::scoped_lock scoped_pages_latch(pages_latch_);
+  num_writes_ += 1;
+  auto idx = static_cast<size_t>(page_id);
+  if (idx >= pages_.size()) {
+    pages_.resize(idx + 1);
+  }
+  if (pages_[idx] == nullptr) {
+    pages_[idx] = std::make_unique<char[]>(PAGE_SIZE);
+  }
+  memcpy(pages_[idx].get(), page_data, PAGE_SIZE);
+}
+
+/**
+ * Read the contents of the specified page into the given memory area
+ */
+void DiskManagerMemory::ReadPage(page_id_t page_id, char *page_data) {
+  std::scoped_lock scoped_pages_latch(pages_latch_);
+  auto idx = static_cast<size_t>(page_id);
+  if (idx >= pages_.size() || pages_[idx] == nullptr) {
+    LOG_DEBUG("I/O error reading past end of file");
+    memset(page_data, 0, PAGE_SIZE);
+    return;
+  }
+  memcpy(page_data, pages_[idx].get(), PAGE_SIZE);
+}
+
+/**
+ * Append the contents of the log buffer to the in-memory log
+ */
+void DiskManagerMemory::WriteLog(char *log_data, int size) {
+  if (size == 0) {  // no effect on num_flushes_ if log buffer is empty
+    return;
+  }
+  std::scoped_lock scoped_log_latch(log_latch_);
+  flush_log_ = true;
+  num_flushes_ += 1;
+  log_.insert(log_.end(), log_data, log_data + size);
+  flush_log_ = false;
+}
+
+/**
+ * Read the contents of the log into the given memory area
+ * @return: false means already reach the end
+ */
+bool DiskManagerMemory::ReadLog(char *log_data, int size, int64_t offset) {
+  std::scoped_lock scoped_log_latch(log_latch_);
+  int64_t log_tail = log_start_ + static_cast<int64_t>(log_.size());
+  if (offset < log_start_ || offset >= log_tail) {
+    return false;
+  }
+  int read_count = static_cast<int>(std::min<int64_t>(size, log_tail - offset));
+  memcpy(log_data, log_.data() + (offset - log_start_), read_count);
+  // if the log ends before reading "size"
+  if (read_count < size) {
+    memset(log_data + read_count, 0, size - read_count);
+  }
+  return true;
+}
+
+int64_t DiskManagerMemory::GetLogTail() {
+  std::scoped_lock scoped_log_latch(log_latch_);
+  return log_start_ + static_cast<int64_t>(log_.size());
+}
+
+void DiskManagerMemory::SetLogTail(int64_t offset) {
+  std::scoped_lock scoped_log_latch(log_latch_);
+  BUSTUB_ASSERT(offset >= log_start_, "The log tail cannot move before the truncated part of the log.");
+  log_.resize(offset - log_start_);
+}
+
+/**
+ * Drop the log before the given offset, there are no segments to recycle
+ */
+void DiskManagerMemory::TruncateLog(int64_t offset) {
+  std::scoped_lock scoped_log_latch(log_latch_);
+  int64_t drop = std::min(offset - log_start_, static_cast<int64_t>(log_.size()));
+  if (drop <= 0) {
+    return;
+  }
+  log_.erase(log_.begin(), log_.begin() + drop);
+  log_start_ += drop;
+}
+
+LogMasterRecord DiskManagerMemory::ReadLogMaster() {
+  std::scoped_lock scoped_log_latch(log_latch_);
+  return log_master_;
+}
+
+void DiskManagerMemory::WriteLogMaster(const LogMasterRecord &master) {
+  std::scoped_lock scoped_log_latch(log_latch_);
+  log_master_ = master;
+}
+
+}  // namespace bustub
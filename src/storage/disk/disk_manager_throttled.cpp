@@ -0,0 +1,68 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_throttled.cpp
+//
+// Identification: src/storage/disk/disk_manager_throttled.cpp
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "storage/disk/disk_manager_throttled.h"
+
+#include <algorithm>
+#include <thread>  // NOLINT
+
+namespace bustub {
+
+void DiskManagerThrottled::WritePage(page_id_t page_id, const char *page_data) {
+  Throttle(PAGE_SIZE, config_.write_latency_);
+  backend_->WritePage(page_id, page_data);
+}
+
+void DiskManagerThrottled::ReadPage(page_id_t page_id, char *page_data) {
+  Throttle(PAGE_SIZE, config_.read_latency_);
+  backend_->ReadPage(page_id, page_data);
+}
+
+void DiskManagerThrottled::WriteLog(char *log_data, int size) {
+  if (size > 0) {
+    Throttle(size, config_.write_latency_);
+  }
+  backend_->WriteLog(log_data, size);
+}
+
+bool DiskManagerThrottled::ReadLog(char *log_data, int size, int64_t offset) {
+  Throttle(size, config_.read_latency_);
+  return backend_->ReadLog(log_data, size, offset);
+}
+
+LogMasterRecord DiskManagerThrottled::ReadLogMaster() {
+  Throttle(sizeof(LogMasterRecord), config_.read_latency_);
+  return backend_->ReadLogMaster();
+}
+
+void DiskManagerThrottled::WriteLogMaster(const LogMasterRecord &master) {
+  Throttle(sizeof(LogMasterRecord), config_.write_latency_);
+  backend_->WriteLogMaster(master);
+}
+
+/*
+ * The transfer itself is serialized on the shared channel, the latency is not: a request starts transferring once the
+ * channel is idle, and completes one latency after its transfer is done.
+ */
+void DiskManagerThrottled::Throttle(size_t bytes, std::chrono::microseconds latency) {
+  auto now = std::chrono::steady_clock::now();
+  auto done = now;
+  if (config_.bandwidth_bytes_per_sec_ > 0) {
+    auto transfer = std::chrono::nanoseconds(bytes * 1000000000ULL / config_.bandwidth_bytes_per_sec_);
+    std::scoped_lock scoped_channel_latch(channel_latch_);
+    channel_free_at_ = std::max(channel_free_at_, now) + transfer;
+    done = channel_free_at_;
+  }
+  std::this_thread::sleep_until(done + latency);
+}
+
+}  // namespace bustub
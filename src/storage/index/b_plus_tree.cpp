@@ -9,6 +9,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <cstring>
+#include <optional>
 #include <string>
 #include <thread>
 
@@ -20,13 +22,15 @@
 namespace bustub {
 INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_TYPE::BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                          int leaf_max_size, int internal_max_size)
+                          int leaf_max_size, int internal_max_size, LockManager *lock_manager)
     : index_name_(std::move(name)),
       root_page_id_(INVALID_PAGE_ID),
       buffer_pool_manager_(buffer_pool_manager),
       comparator_(comparator),
       leaf_max_size_(leaf_max_size),
-      internal_max_size_(internal_max_size) {}
+      internal_max_size_(internal_max_size),
+      lock_manager_(lock_manager),
+      end_rid_(END_OF_INDEX_PAGE_ID, static_cast<uint32_t>(std::hash<std::string>()(index_name_))) {}
 
 /*
  * Helper function to decide whether current b+tree is empty
@@ -43,22 +47,35 @@ bool BPLUSTREE_TYPE::IsEmpty() const { return root_page_id_ == INVALID_PAGE_ID;
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction) {
-  root_latch_.RLock();
-  Page *raw_leaf_page = FindLeafPage(key, transaction, 0, false);
-  LeafPage *leaf_page = reinterpret_cast<LeafPage *>(raw_leaf_page);
-  // int idx = leaf_page->KeyIndex(key, comparator_);
-  // 查找成功
+  // The key is locked if it is there, the key after it if not: no other transaction can insert it meanwhile.
+  if (LocksRanges(transaction)) {
+    LockNextKey(key, true, transaction, LockMode::SHARED);
+  }
+  // The pages are read without their latches, a leaf that changed while it was read is searched for again.
   bool ans = false;
-  ValueType val;
-  if (leaf_page->Lookup(key, &val, comparator_)) {
-    result->emplace_back(val);
-    ans = true;
+  while (true) {
+    uint64_t version;
+    Page *raw_leaf_page = FindLeafPageOptimistic(key, &version);
+    if (raw_leaf_page == nullptr) {
+      break;
+    }
+    LeafPage *leaf_page = reinterpret_cast<LeafPage *>(raw_leaf_page->GetData());
+    ValueType val;
+    bool found = leaf_page->Lookup(key, &val, comparator_);
+    bool valid = raw_leaf_page->ValidateVersion(version);
+    buffer_pool_manager_->UnpinPage(raw_leaf_page->GetPageId(), false);
+    if (valid) {
+      if (found) {
+        result->emplace_back(val);
+      }
+      ans = found;
+      break;
+    }
   }
-  if(transaction != nullptr){
-    ReleaseTxnPage(transaction, 0);
+  // A key inserted since the lock was taken is not committed before its inserter releases it.
+  if (ans && LocksRanges(transaction)) {
+    lock_manager_->LockShared(transaction, result->back());
   }
-  buffer_pool_manager_->UnpinPage(leaf_page->GetPageId(), false);
-  root_latch_.RUnlock();
   return ans;
 }
 
@@ -74,18 +91,26 @@ bool BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transaction *transaction) { 
+  if (transaction != nullptr && transaction->IsReadOnly()) {
+    transaction->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (LocksKeys(transaction) && !lock_manager_->LockExclusive(transaction, value)) {
+    return false;
+  }
   bool ans = false;
-  root_latch_.WLock();
-  if (IsEmpty()) {
+  if (IsEmpty() && StartNewTree(key, value, transaction)) {
     // auto lock = transaction->GetExclusiveLockSet();
     // std::unique_lock<std::mutex> ul();
-    StartNewTree(key, value);
     ans = true;
   } else {
     ans = InsertIntoLeaf(key, value, transaction);
   }
-  ReleaseTxnPage(transaction, 1);
-  root_latch_.WUnlock();
+  // The key is in the tree already, a scan that reaches it from now on waits for its lock. One that went past it
+  // before holds the key after it.
+  if (ans && LocksKeys(transaction)) {
+    LockNextKey(key, false, transaction, LockMode::EXCLUSIVE, true);
+  }
   return ans;
   // return false;
 }
@@ -96,17 +121,31 @@ bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transact
  * tree's root page id and insert entry directly into leaf page.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {
-  Page *new_page = buffer_pool_manager_->NewPage(&root_page_id_);
+bool BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value, Transaction *transaction) {
+  page_id_t new_page_id;
+  Page *new_page = buffer_pool_manager_->NewPage(&new_page_id);
   if(new_page == nullptr){
     throw("out of memory!");
   }
-  UpdateRootPageId(root_page_id_);
 
   LeafPage *leaf_page = reinterpret_cast<LeafPage *>(new_page->GetData());
-  leaf_page->Init(root_page_id_, INVALID_PAGE_ID, leaf_max_size_);
+  leaf_page->Init(new_page_id, INVALID_PAGE_ID, leaf_max_size_);
   leaf_page->Insert(key, value, comparator_);
-  buffer_pool_manager_->UnpinPage(root_page_id_, true);
+  // The page is filled in before it becomes the root, and stays latched until it is logged and the header has it.
+  new_page->WLatch();
+  page_id_t empty_root = INVALID_PAGE_ID;
+  if (!root_page_id_.compare_exchange_strong(empty_root, new_page_id)) {
+    new_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(new_page_id, false);
+    buffer_pool_manager_->DeletePage(new_page_id);
+    return false;
+  }
+  LogKey(LogRecordType::INDEX_KEY_INSERT, key, value, transaction);
+  leaf_page->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(leaf_page));
+  UpdateRootPageId(1);
+  new_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(new_page_id, true);
+  return true;
 }
 
 /*
@@ -119,26 +158,42 @@ void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction) {
-  Page *raw_leaf_page = FindLeafPage(key, transaction, 1, false);
-  LeafPage *leaf_page = reinterpret_cast<LeafPage *>(raw_leaf_page);
+  // A leaf with room to spare is all the insert latches.
+  Page *raw_leaf_page = LatchLeafOptimistic(key, 1);
+  bool optimistic = raw_leaf_page != nullptr;
+  std::optional<Transaction> local_transaction;
+  if (!optimistic) {
+    // The leaf may split: latch from the root down, the page set keeps the pages the split may reach.
+    if (transaction == nullptr) {
+      transaction = &local_transaction.emplace(INVALID_TXN_ID);
+    }
+    raw_leaf_page = FindLeafPage(key, transaction, 1, false);
+    if (raw_leaf_page == nullptr) {
+      // The last key was removed meanwhile.
+      return StartNewTree(key, value, transaction) || InsertIntoLeaf(key, value, transaction);
+    }
+  }
+  LeafPage *leaf_page = reinterpret_cast<LeafPage *>(raw_leaf_page->GetData());
   int idx = leaf_page->KeyIndex(key, comparator_);
   // 有重复键，没有值的时候idx小于0
-  if(idx >= 0 && comparator_(leaf_page->KeyAt(idx), key) == 0){
-    buffer_pool_manager_->UnpinPage(leaf_page->GetPageId(), false);
-    return false;
-  }
-
-  leaf_page->InsertAt(idx, key, value);
-  // 处理split
-  if(leaf_page->GetSize() >= leaf_page->GetMaxSize()){
-    Split<BPlusTreePage>(leaf_page, transaction);
+  bool ans = !(idx >= 0 && idx < leaf_page->GetSize() && comparator_(leaf_page->KeyAt(idx), key) == 0);
+  if (ans) {
+    LogKey(LogRecordType::INDEX_KEY_INSERT, key, value, transaction);
+    leaf_page->InsertAt(idx, key, value);
+    leaf_page->LogEntry(buffer_pool_manager_->GetLogManager(), LogRecordType::INDEX_INSERT, idx,
+                        EntrySize(leaf_page));
+    // 处理split
+    if(leaf_page->GetSize() >= leaf_page->GetMaxSize()){
+      Split<BPlusTreePage>(leaf_page, transaction);
+    }
   }
-  if(transaction != nullptr){
+  if (optimistic) {
+    raw_leaf_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(raw_leaf_page->GetPageId(), ans);
+  } else {
     ReleaseTxnPage(transaction, 1);
   }
-  buffer_pool_manager_->UnpinPage(leaf_page->GetPageId(), true);
-  
-  return true;
+  return ans;
 }
 
 /*
@@ -165,6 +220,8 @@ N *BPLUSTREE_TYPE::Split(N *node, Transaction *transaction) {
     // 双向链表
     new_node->SetNextPageId(old_node->GetNextPageId());
     old_node->SetNextPageId(new_node->GetPageId());
+    new_node->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(new_node));
+    old_node->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(old_node));
     auto key = new_node->KeyAt(0);
     InsertIntoParent(old_node, key, new_node, transaction);
     ans_node = reinterpret_cast<N *>(new_node);
@@ -174,6 +231,8 @@ N *BPLUSTREE_TYPE::Split(N *node, Transaction *transaction) {
     InternalPage *old_node = reinterpret_cast<InternalPage *>(node);
     new_node->Init(new_page_id, old_node->GetParentPageId(), internal_max_size_);
     old_node->MoveHalfTo(new_node, buffer_pool_manager_);
+    new_node->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(new_node));
+    old_node->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(old_node));
     auto key = new_node->KeyAt(0);
     InsertIntoParent(old_node, key, new_node, transaction);
     ans_node = reinterpret_cast<N *>(new_node);
@@ -209,17 +268,19 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &ke
     Page *raw_root = buffer_pool_manager_->NewPage(&new_root_id);
     InternalPage *new_root = reinterpret_cast<InternalPage *>(raw_root->GetData());
     new_root->Init(new_root_id, INVALID_PAGE_ID, internal_max_size_);
-    root_page_id_ = new_root_id;
-    UpdateRootPageId(new_root_id);
     new_root->PopulateNewRoot(old_node->GetPageId(), key, new_node->GetPageId());
     new_root->SetParentPageId(INVALID_PAGE_ID);
 
     // 更新当前节点与新节点的parentid
     old_node->SetParentPageId(new_root_id);
     new_node->SetParentPageId(new_root_id);
+    new_root->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(new_root));
+    old_node->LogParentPageId(buffer_pool_manager_->GetLogManager());
+    new_node->LogParentPageId(buffer_pool_manager_->GetLogManager());
+    // The new root is complete before searches can find it, the old one stays latched until the split is over.
+    root_page_id_ = new_root_id;
+    UpdateRootPageId();
     buffer_pool_manager_->UnpinPage(new_root_id, true);
-    buffer_pool_manager_->UnpinPage(old_node->GetPageId(), true);
-    buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
 
   } else {
     // 普通的internal节点
@@ -231,16 +292,18 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &ke
     // 将new_node的第一个节点插入到parent节点中，在old_node后面，应该为idx + 1
     int idx = parent_page->ValueIndex(old_node->GetPageId());
     int new_size = parent_page->InsertAt(idx + 1, key, new_node->GetPageId());
+    parent_page->LogEntry(buffer_pool_manager_->GetLogManager(), LogRecordType::INDEX_INSERT, idx + 1,
+                          EntrySize(parent_page));
     // if(old_node->GetPageType() == IndexPageType::INTERNAL_PAGE){
     //   // 如果是internal节点，还需要删除new_node的第一个节点，因为与父节点重合
     //   new_node->Remove(0);
     // }
     // 检查父节点是否需要继续分裂
-    buffer_pool_manager_->UnpinPage(old_node->GetPageId(), true);
-    buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
+    // The split pages are unpinned by whoever pinned them, the parent is latched in the transaction's page set.
     if (new_size >= parent_page->GetMaxSize() + 1) {
-      Split<BPlusTreePage>(parent_page);
+      Split<BPlusTreePage>(parent_page, transaction);
     }
+    buffer_pool_manager_->UnpinPage(parent_p_id, true);
   }
 }
 
@@ -256,39 +319,55 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &ke
  */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {
-  root_latch_.WLock();
-  
+  // A read-only transaction has no deleted page set for a merge to fill.
+  if (transaction != nullptr && transaction->IsReadOnly()) {
+    transaction->SetState(TransactionState::ABORTED);
+    return;
+  }
+  // Once the key is gone, the gap before the key after it covers its own: both stay locked until the end.
+  if (LocksKeys(transaction)) {
+    LockNextKey(key, true, transaction, LockMode::EXCLUSIVE);
+    LockNextKey(key, false, transaction, LockMode::EXCLUSIVE);
+  }
   if (IsEmpty()) {
-    root_latch_.WUnlock();
     return;
   }
 
-  Page *raw_target_page = FindLeafPage(key, transaction, 2, false);
-  LeafPage *target_page = reinterpret_cast<LeafPage *>(raw_target_page);
-  page_id_t target_id = target_page->GetPageId();
-  int idx = target_page->KeyIndex(key, comparator_);
-  if(idx >= target_page->GetSize() || comparator_(key, target_page->KeyAt(idx)) != 0){
-    if(transaction != nullptr){
-      // std::cout << "thread_id = " << std::this_thread::get_id();
-      // std::cout << ", delete key = " << key << " failed. " << std::endl;
-      ReleaseTxnPage(transaction, 2);
+  // A leaf that stays at least half full is all the remove latches.
+  Page *raw_target_page = LatchLeafOptimistic(key, 2);
+  bool optimistic = raw_target_page != nullptr;
+  std::optional<Transaction> local_transaction;
+  if (!optimistic) {
+    // The leaf may merge: latch from the root down, the page set keeps the pages the merge may reach.
+    if (transaction == nullptr) {
+      transaction = &local_transaction.emplace(INVALID_TXN_ID);
+    }
+    raw_target_page = FindLeafPage(key, transaction, 2, false);
+    if (raw_target_page == nullptr) {
+      return;
     }
-    root_latch_.WUnlock();
-    return;
   }
-
-  target_page->Remove(idx);
-  if(target_page->GetSize() < target_page->GetMinSize()){
-    CoalesceOrRedistribute<LeafPage>(target_page, transaction);
+  LeafPage *target_page = reinterpret_cast<LeafPage *>(raw_target_page->GetData());
+  int idx = target_page->KeyIndex(key, comparator_);
+  bool found = idx < target_page->GetSize() && comparator_(key, target_page->KeyAt(idx)) == 0;
+  if (found) {
+    LogKey(LogRecordType::INDEX_KEY_DELETE, key, target_page->GetItem(idx).second, transaction);
+    target_page->LogEntry(buffer_pool_manager_->GetLogManager(), LogRecordType::INDEX_DELETE, idx,
+                          EntrySize(target_page));
+    target_page->Remove(idx);
+    if(target_page->GetSize() < target_page->GetMinSize()){
+      CoalesceOrRedistribute<LeafPage>(target_page, transaction);
+    }
   }
-  if(transaction != nullptr){
-    ReleaseTxnPage(transaction, 2);
-    DeletePages(transaction);
+  if (optimistic) {
+    raw_target_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(raw_target_page->GetPageId(), found);
+  } else {
     // std::cout << "thread_id = " << std::this_thread::get_id();
     // std::cout << ", delete key = " << key << " succeed. " << std::endl;
+    ReleaseTxnPage(transaction, 2);
+    DeletePages(transaction);
   }
-  buffer_pool_manager_->UnpinPage(target_id, true);
-  root_latch_.WUnlock();
 }
 
 /*
@@ -307,7 +386,7 @@ bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) {
     // 查看左右节点是否有对应的值
   // int cur_size = node->GetSize();
   if(node->IsRootPage()){
-    return AdjustRoot(node);
+    return AdjustRoot(node, transaction);
   }
 
   // 找到父节点
@@ -315,18 +394,23 @@ bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) {
   InternalPage *parent = reinterpret_cast<InternalPage *>(parent_page->GetData());
   int idx = parent->ValueIndex(node->GetPageId());
 
+  // The siblings are latched too: a leaf is written by inserts and removes that latch nothing above it.
   N *l_page = nullptr;
   N *r_page = nullptr;
+  Page *raw_l_page = nullptr;
+  Page *raw_r_page = nullptr;
   page_id_t l_p_id = INVALID_PAGE_ID, r_p_id = INVALID_PAGE_ID;
   page_id_t parent_id = parent->GetPageId();
 
   if(idx > 0){
     // 有左节点
     l_p_id = parent->ValueAt(idx - 1);
-    Page *raw_l_page = buffer_pool_manager_->FetchPage(l_p_id);
+    raw_l_page = buffer_pool_manager_->FetchPage(l_p_id);
+    raw_l_page->WLatch();
     l_page = reinterpret_cast<N *>(raw_l_page->GetData());
     if (l_page->GetSize() > l_page->GetMinSize()) {
       Redistribute<N>(l_page, node, 1);
+      raw_l_page->WUnlatch();
       buffer_pool_manager_->UnpinPage(l_p_id, true);
       buffer_pool_manager_->UnpinPage(parent_id, false);
       return false;
@@ -334,10 +418,12 @@ bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) {
   } else if(idx < parent->GetSize() - 1){
     // 找右节点
     r_p_id = parent->ValueAt(idx + 1);
-    Page *raw_r_page = buffer_pool_manager_->FetchPage(r_p_id);
+    raw_r_page = buffer_pool_manager_->FetchPage(r_p_id);
+    raw_r_page->WLatch();
     r_page = reinterpret_cast<N *>(raw_r_page->GetData());
     if(r_page->GetSize() > r_page->GetMinSize()){
       Redistribute<N>(r_page, node, 0);
+      raw_r_page->WUnlatch();
       buffer_pool_manager_->UnpinPage(r_p_id, true);
       buffer_pool_manager_->UnpinPage(parent_id, false);
       return false;
@@ -348,17 +434,18 @@ bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) {
   // 到这里说明左右节点无法借到kv值，那么只有与左or右节点进行合并了
   if (l_page) {
     Coalesce<N>(&l_page, &node, &parent, 1, transaction);
+    raw_l_page->WUnlatch();
     buffer_pool_manager_->UnpinPage(parent_id, true);
     buffer_pool_manager_->UnpinPage(l_p_id, true);
-    if(r_page){
-      buffer_pool_manager_->UnpinPage(r_p_id, false);
-    }
     ans = true;
   } else if(r_page){
     Coalesce<N>(&r_page, &node, &parent, 0, transaction);
+    raw_r_page->WUnlatch();
     buffer_pool_manager_->UnpinPage(parent_id, true);
     buffer_pool_manager_->UnpinPage(r_p_id, true);
     ans = true;
+  } else {
+    buffer_pool_manager_->UnpinPage(parent_id, false);
   }
   return ans;
 }
@@ -390,6 +477,7 @@ bool BPLUSTREE_TYPE::Coalesce(N **neighbor_node, N **node,
                               Transaction *transaction) {
   int node_idx = (*parent)->ValueIndex((*node)->GetPageId());
   bool ret = false;
+  LogManager *log_manager = buffer_pool_manager_->GetLogManager();
   
   if ((*node)->IsLeafPage()) {
     LeafPage **imp_neighbor_page = reinterpret_cast<LeafPage **>(neighbor_node);
@@ -397,14 +485,16 @@ bool BPLUSTREE_TYPE::Coalesce(N **neighbor_node, N **node,
     if(index == 1){
       // neighber是node左边的节点
       (*imp_node_page)->MoveAllTo(*imp_neighbor_page);
-      buffer_pool_manager_->DeletePage((*imp_node_page)->GetPageId());
-      buffer_pool_manager_->UnpinPage((*imp_neighbor_page)->GetPageId(), true);
+      (*imp_neighbor_page)->LogImage(log_manager, EntrySize(*imp_neighbor_page));
+      transaction->AddIntoDeletedPageSet((*imp_node_page)->GetPageId());
+      (*parent)->LogEntry(log_manager, LogRecordType::INDEX_DELETE, node_idx, EntrySize(*parent));
       (*parent)->Remove(node_idx);
     } else {
       // neighber是node右边的节点
       (*imp_neighbor_page)->MoveAllTo(*imp_node_page);
-      buffer_pool_manager_->DeletePage((*imp_neighbor_page)->GetPageId());
-      buffer_pool_manager_->UnpinPage((*imp_node_page)->GetPageId(), true);
+      (*imp_node_page)->LogImage(log_manager, EntrySize(*imp_node_page));
+      transaction->AddIntoDeletedPageSet((*imp_neighbor_page)->GetPageId());
+      (*parent)->LogEntry(log_manager, LogRecordType::INDEX_DELETE, node_idx + 1, EntrySize(*parent));
       (*parent)->Remove(node_idx + 1);
     }
   } else {
@@ -416,18 +506,20 @@ bool BPLUSTREE_TYPE::Coalesce(N **neighbor_node, N **node,
       auto middle_key = (*parent)->KeyAt(node_idx);
 
       (*imp_node_page)->MoveAllTo((*imp_neighbor_page), middle_key, buffer_pool_manager_);
+      (*imp_neighbor_page)->LogImage(log_manager, EntrySize(*imp_neighbor_page));
       transaction->AddIntoDeletedPageSet((*imp_node_page)->GetPageId());
       // buffer_pool_manager_->DeletePage((*imp_node_page)->GetPageId());
-      buffer_pool_manager_->UnpinPage((*imp_neighbor_page)->GetPageId(), true);
+      (*parent)->LogEntry(log_manager, LogRecordType::INDEX_DELETE, node_idx, EntrySize(*parent));
       (*parent)->Remove(node_idx);
     } else {
       // neighber是node右边的节点
       auto middle_key = (*parent)->KeyAt(node_idx + 1);
 
       (*imp_neighbor_page)->MoveAllTo(*imp_node_page, middle_key, buffer_pool_manager_);
+      (*imp_node_page)->LogImage(log_manager, EntrySize(*imp_node_page));
       transaction->AddIntoDeletedPageSet((*imp_neighbor_page)->GetPageId());
       // buffer_pool_manager_->DeletePage((*imp_neighbor_page)->GetPageId());
-      buffer_pool_manager_->UnpinPage((*imp_node_page)->GetPageId(), true);
+      (*parent)->LogEntry(log_manager, LogRecordType::INDEX_DELETE, node_idx + 1, EntrySize(*parent));
       (*parent)->Remove(node_idx + 1);
     }
   }
@@ -502,9 +594,12 @@ void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {
       auto middle_key = parent_page->KeyAt(node_idx + 1);
       auto new_mid_key = imp_neighbor_node->KeyAt(1);
       imp_neighbor_node->MoveFirstToEndOf(imp_node, middle_key, buffer_pool_manager_);
-      parent_page->SetKeyAt(node_idx, new_mid_key);
+      parent_page->SetKeyAt(node_idx + 1, new_mid_key);
     }
   }
+  node->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(node));
+  neighbor_node->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(neighbor_node));
+  parent_page->LogImage(buffer_pool_manager_->GetLogManager(), EntrySize(parent_page));
   buffer_pool_manager_->UnpinPage(parent_p_id, true);
 }
 /*
@@ -518,7 +613,7 @@ void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {
  * happend
  */
 INDEX_TEMPLATE_ARGUMENTS
-bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
+bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node, Transaction *transaction) {
   // 第零种情况：大于等于一个节点，直接返回
   if (old_root_node->GetSize() > 0){
     return true;
@@ -530,12 +625,14 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
       Page *raw_new_root = buffer_pool_manager_->FetchPage(new_root_id);
       InternalPage *new_root = reinterpret_cast<InternalPage *>(raw_new_root->GetData());
       new_root->SetParentPageId(INVALID_PAGE_ID);
-      buffer_pool_manager_->DeletePage(imp_old_root_node->GetPageId());
+      new_root->LogParentPageId(buffer_pool_manager_->GetLogManager());
+      // The old root is latched and pinned in the page set, it is deleted after.
+      transaction->AddIntoDeletedPageSet(imp_old_root_node->GetPageId());
       buffer_pool_manager_->UnpinPage(new_root_id, true);
     } else {
       // 第二种情况：仅有一个节点了
       root_page_id_ = INVALID_PAGE_ID;
-      buffer_pool_manager_->DeletePage(old_root_node->GetPageId());
+      transaction->AddIntoDeletedPageSet(old_root_node->GetPageId());
       return true;
     }
     return false;
@@ -551,10 +648,12 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() {
-  Page *leaf_page = FindLeafPage(KeyType(), nullptr, 0, true);
-  // LeafPage *start_node = reinterpret_cast<LeafPage *>(leaf_page);
-  return INDEXITERATOR_TYPE(leaf_page, 0, buffer_pool_manager_);
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(Transaction *transaction) {
+  auto seek = [this](const KeyType *key, bool inclusive, uint64_t *version, int *idx) {
+    return SeekLeaf(key, inclusive, version, idx);
+  };
+  LockManager *lock_manager = LocksRanges(transaction) ? lock_manager_ : nullptr;
+  return INDEXITERATOR_TYPE(seek, nullptr, buffer_pool_manager_, lock_manager, transaction, end_rid_);
 }
 
 /*
@@ -563,12 +662,13 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) {
-  Page *leaf_page = FindLeafPage(key, nullptr, 0, false);
-  LeafPage *tmp_node = reinterpret_cast<LeafPage *>(leaf_page->GetData());
-  int idx = tmp_node->KeyIndex(key, comparator_);
-  // LeafPage *start_node = reinterpret_cast<LeafPage *>(leaf_page);
-  return INDEXITERATOR_TYPE(leaf_page, idx, buffer_pool_manager_);
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key, Transaction *transaction) {
+  auto seek = [this](const KeyType *key, bool inclusive, uint64_t *version, int *idx) {
+    return SeekLeaf(key, inclusive, version, idx);
+  };
+  // The key the iterator starts at is locked, and with it the gap before: the start of the range.
+  LockManager *lock_manager = LocksRanges(transaction) ? lock_manager_ : nullptr;
+  return INDEXITERATOR_TYPE(seek, &key, buffer_pool_manager_, lock_manager, transaction, end_rid_);
 }
 
 /*
@@ -578,7 +678,7 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) {
  */
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE BPLUSTREE_TYPE::End() {
-  return INDEXITERATOR_TYPE(nullptr, 0, buffer_pool_manager_);
+  return INDEXITERATOR_TYPE();
 }
 
 /*****************************************************************************
@@ -602,7 +702,8 @@ void BPLUSTREE_TYPE::ReleaseTxnPage(Transaction *txn, int mode){
     } else {
       ptr->WUnlatch();
     }
-    buffer_pool_manager_->UnpinPage(p_id, false);
+    // The pages above the leaf are kept only when a split or merge may change them, and then it usually does.
+    buffer_pool_manager_->UnpinPage(p_id, mode != 0);
   }
 }
 
@@ -647,8 +748,12 @@ Page *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key, Transaction *txn, int mod
   //   deque_page = txn->GetPageSet();
   // }
   page_id_t p_id = root_page_id_;
+  if (p_id == INVALID_PAGE_ID) {
+    return nullptr;
+  }
   BPlusTreePage *sub_page;
   Page *raw_sub_page;
+  bool at_root = true;
   while (true) {
     raw_sub_page = buffer_pool_manager_->FetchPage(p_id);
     
@@ -659,6 +764,21 @@ Page *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key, Transaction *txn, int mod
       } else {
         raw_sub_page->WLatch();
       }
+      // The root may have split or emptied before it was latched, the search then starts over from the new one.
+      if (at_root && root_page_id_ != p_id) {
+        if (mode == 0) {
+          raw_sub_page->RUnlatch();
+        } else {
+          raw_sub_page->WUnlatch();
+        }
+        buffer_pool_manager_->UnpinPage(p_id, false);
+        p_id = root_page_id_;
+        if (p_id == INVALID_PAGE_ID) {
+          return nullptr;
+        }
+        continue;
+      }
+      at_root = false;
     }
     sub_page = reinterpret_cast<BPlusTreePage *>(raw_sub_page->GetData());
     if(txn != nullptr){
@@ -679,7 +799,7 @@ Page *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key, Transaction *txn, int mod
       // 正常的二分查找
       p_id = search_page->Lookup(key, comparator_);
     }
-    if(mode == 0 || txn == nullptr){
+    if(txn == nullptr){
       buffer_pool_manager_->UnpinPage(search_page->GetPageId(), false);
     }
   }
@@ -687,11 +807,156 @@ Page *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key, Transaction *txn, int mod
   return ans;
 }
 
+INDEX_TEMPLATE_ARGUMENTS
+RID BPLUSTREE_TYPE::NextKeyLock(const KeyType &key, bool inclusive) {
+  // The leaves are read optimistically like the pages above them, a leaf is only left once its next page id is valid.
+  auto guard = ProtectPageIds();
+  while (true) {
+    uint64_t version;
+    int idx;
+    Page *page = SeekLeaf(&key, inclusive, &version, &idx);
+    if (page == nullptr) {
+      return end_rid_;
+    }
+    auto *leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
+    bool valid = true;
+    while (idx >= leaf_page->GetSize() && leaf_page->GetNextPageId() != INVALID_PAGE_ID) {
+      Page *next_page = buffer_pool_manager_->FetchPage(leaf_page->GetNextPageId());
+      uint64_t next_version = next_page->ReadVersion();
+      valid = page->ValidateVersion(version);
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+      page = next_page;
+      version = next_version;
+      if (!valid) {
+        break;
+      }
+      leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
+      idx = 0;
+    }
+    RID rid = end_rid_;
+    if (valid && idx < leaf_page->GetSize()) {
+      rid = leaf_page->GetItem(idx).second;
+    }
+    valid = valid && page->ValidateVersion(version);
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    if (valid) {
+      return rid;
+    }
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LockNextKey(const KeyType &key, bool inclusive, Transaction *transaction, LockMode lock_mode,
+                                 bool instant) {
+  while (true) {
+    RID rid = NextKeyLock(key, inclusive);
+    bool locked;
+    if (instant) {
+      locked = lock_manager_->LockInstant(transaction, rid);
+    } else if (lock_mode == LockMode::SHARED) {
+      locked = lock_manager_->LockShared(transaction, rid);
+    } else {
+      locked = lock_manager_->LockExclusive(transaction, rid);
+    }
+    // A key may have been inserted in front of it or removed while the lock was waited for.
+    if (!locked || NextKeyLock(key, inclusive) == rid) {
+      return;
+    }
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FindLeafPageOptimistic(const KeyType &key, uint64_t *version, bool left_most) {
+  // A page id read from a page that is then deleted is not handed out again while the guard is held.
+  auto guard = ProtectPageIds();
+  while (true) {
+    page_id_t root_id = root_page_id_;
+    if (root_id == INVALID_PAGE_ID) {
+      return nullptr;
+    }
+    Page *page = buffer_pool_manager_->FetchPage(root_id);
+    uint64_t page_version = page->ReadVersion();
+    // The root id changes while the old root is latched: if it is still the same, the version is one of the root's.
+    if (root_page_id_ != root_id) {
+      buffer_pool_manager_->UnpinPage(root_id, false);
+      continue;
+    }
+    while (true) {
+      auto *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+      if (node->IsLeafPage()) {
+        *version = page_version;
+        return page;
+      }
+      auto *internal_page = reinterpret_cast<InternalPage *>(node);
+      page_id_t child_id = left_most ? internal_page->ValueAt(0) : internal_page->Lookup(key, comparator_);
+      if (!page->ValidateVersion(page_version)) {
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+        break;
+      }
+      Page *child = buffer_pool_manager_->FetchPage(child_id);
+      uint64_t child_version = child->ReadVersion();
+      // Unchanged since, the parent still pointed at the child when the child's version was read.
+      bool valid = page->ValidateVersion(page_version);
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+      if (!valid) {
+        buffer_pool_manager_->UnpinPage(child_id, false);
+        break;
+      }
+      page = child;
+      page_version = child_version;
+    }
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::SeekLeaf(const KeyType *key, bool inclusive, uint64_t *version, int *idx) {
+  Page *page =
+      key == nullptr ? FindLeafPageOptimistic(KeyType(), version, true) : FindLeafPageOptimistic(*key, version);
+  *idx = 0;
+  if (page == nullptr || key == nullptr) {
+    return page;
+  }
+  // Read without the latch like the rest of the leaf, the caller validates the position with what it reads there.
+  auto *leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
+  *idx = leaf_page->KeyIndex(*key, comparator_);
+  if (!inclusive && *idx < leaf_page->GetSize() && comparator_(leaf_page->KeyAt(*idx), *key) == 0) {
+    ++*idx;
+  }
+  return page;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::LatchLeafOptimistic(const KeyType &key, int mode) {
+  while (true) {
+    uint64_t version;
+    Page *page = FindLeafPageOptimistic(key, &version);
+    if (page == nullptr) {
+      return nullptr;
+    }
+    // The size is read without the latch, latching the leaf at the version it was read at validates it.
+    bool safe = CheckSafe(reinterpret_cast<BPlusTreePage *>(page->GetData()), mode);
+    if (safe && page->WLatchAtVersion(version)) {
+      return page;
+    }
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    if (!safe) {
+      return nullptr;
+    }
+  }
+}
+
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::DeletePages(Transaction *txn){
   const auto pages = txn->GetDeletedPageSet();
+  // Nothing reaches the pages from the tree anymore and their ids are not handed out again before they are deleted,
+  // an optimistic reader that pinned one before finds its version changed and lets it go.
+  std::scoped_lock pinned_deleted_pages_latch(pinned_deleted_pages_latch_);
+  pages->insert(pinned_deleted_pages_.begin(), pinned_deleted_pages_.end());
+  pinned_deleted_pages_.clear();
   for(const auto &p : *pages){
-    buffer_pool_manager_->DeletePage(p);
+    if (!buffer_pool_manager_->DeletePage(p)) {
+      pinned_deleted_pages_.push_back(p);
+    }
   }
   pages->clear();
 }
@@ -707,16 +972,69 @@ void BPLUSTREE_TYPE::DeletePages(Transaction *txn){
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
   HeaderPage *header_page = static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
-  if (insert_record != 0) {
-    // create a new record<index_name + root_page_id> in header_page
-    header_page->InsertRecord(index_name_, root_page_id_);
-  } else {
+  // Roots change concurrently: whoever writes the record last reads the root id under the latch, and finds the latest.
+  header_page->WLatch();
+  page_id_t root_page_id = root_page_id_;
+  // A tree that emptied and started over already has its record.
+  if (insert_record == 0 || !header_page->InsertRecord(index_name_, root_page_id)) {
     // update root_page_id in header_page
-    header_page->UpdateRecord(index_name_, root_page_id_);
+    header_page->UpdateRecord(index_name_, root_page_id);
   }
+  // The header page has no lsn, the record is redone whenever recovery reaches it. Redo has to start there as long
+  // as the change is not on disk, the recLSN says so.
+  LogManager *log_manager = buffer_pool_manager_->GetLogManager();
+  if (enable_logging && log_manager != nullptr) {
+    LogRecord log_record(LogRecordType::INDEX_ROOT, root_page_id, 0, index_name_.data(), index_name_.size());
+    log_manager->AppendLogRecord(&log_record);
+    header_page->SetRecLSN(log_record.GetLSN());
+  }
+  header_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
 }
 
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::LoadRootPageId() {
+  auto *header_page = static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  header_page->RLatch();
+  page_id_t root_page_id;
+  bool found = header_page->GetRootId(index_name_, &root_page_id);
+  header_page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+  if (found) {
+    root_page_id_ = root_page_id;
+  }
+  return found;
+}
+
+/*
+ * The key record is in the log before the page records, so a page that reaches the disk with the change has it there
+ * too. Publishing the arena keeps the record in the transaction's chain, after its table changes.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogKey(LogRecordType type, const KeyType &key, const ValueType &value, Transaction *transaction) {
+  LogManager *log_manager = buffer_pool_manager_->GetLogManager();
+  if (!enable_logging || log_manager == nullptr || transaction == nullptr ||
+      transaction->GetTransactionId() == INVALID_TXN_ID) {
+    return;
+  }
+  LogRecord log_record(transaction->GetTransactionId(), transaction->GetPrevLSN(), type, index_name_,
+                       reinterpret_cast<const char *>(&key), sizeof(KeyType), value);
+  log_manager->AppendToArena(transaction, &log_record, nullptr);
+  log_manager->PublishArena(transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::UndoKeyRecord(const LogRecord &log_record) {
+  BUSTUB_ASSERT(log_record.GetIndexBytes().size() == sizeof(KeyType), "The key record is for another key type.");
+  KeyType key;
+  memcpy(&key, log_record.GetIndexBytes().data(), sizeof(KeyType));
+  if (log_record.GetLogRecordType() == LogRecordType::INDEX_KEY_INSERT) {
+    Remove(key);
+  } else {
+    Insert(key, log_record.GetIndexRID());
+  }
+}
+
 /*
  * This method is used for test only
  * Read data from file and insert one by one
@@ -2,6 +2,8 @@
  * index_iterator.cpp
  */
 #include <cassert>
+#include <optional>
+#include <utility>
 
 #include "storage/index/index_iterator.h"
 
@@ -14,18 +16,19 @@ namespace bustub {
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE::IndexIterator() : buffer_pool_manager_ (nullptr),
                                         leaf_node(nullptr), 
-                                        idx(-1) {}
+                                        idx(0) {}
 
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE::IndexIterator(Page *node, int idx, BufferPoolManager *buffer_pool_manager) 
-                                    : buffer_pool_manager_ (buffer_pool_manager), idx(idx) {
-  leaf_node = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node->GetData());
-  if(leaf_node != nullptr){
-    p_id = leaf_node->GetPageId();
-  } else {
-    p_id = INVALID_PAGE_ID;
+INDEXITERATOR_TYPE::IndexIterator(Seek seek, const KeyType *key, BufferPoolManager *buffer_pool_manager,
+                                  LockManager *lock_manager, Transaction *txn, const RID &end_rid)
+    : seek_(std::move(seek)), buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager), txn_(txn),
+      end_rid_(end_rid) {
+  if (key != nullptr) {
+    key_ = *key;
+    has_key_ = true;
   }
-  
+  Reseek();
+  Settle();
 }
 
 INDEX_TEMPLATE_ARGUMENTS
@@ -51,27 +54,97 @@ bool INDEXITERATOR_TYPE::IsEnd() {
 INDEX_TEMPLATE_ARGUMENTS
 const MappingType &INDEXITERATOR_TYPE::operator*() { 
     // throw std::runtime_error("unimplemented");
-    return leaf_node->GetItem(idx);
+    return item_;
 }
 
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE &INDEXITERATOR_TYPE::operator++() {
-    // throw std::runtime_error("unimplemented");
+  key_ = item_.first;
+  has_key_ = true;
+  inclusive_ = false;
   ++idx;
-  if (idx == leaf_node->GetSize()) {
-    idx = 0;
-    page_id_t nxt_p_id = leaf_node->GetNextPageId();
-    if(nxt_p_id == INVALID_PAGE_ID){
-      buffer_pool_manager_->UnpinPage(p_id, false);
-      leaf_node = nullptr;
-    } else {
-      Page *page = buffer_pool_manager_->FetchPage(nxt_p_id);
-      leaf_node = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  Settle();
+  return *this;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool INDEXITERATOR_TYPE::NextLeaf() {
+  // A page id read from a leaf that is then deleted is not handed out again while the guard is held.
+  std::optional<EpochGuard> guard;
+  if (EpochManager *epochs = buffer_pool_manager_->GetEpochManager(); epochs != nullptr) {
+    guard.emplace(epochs->Protect());
+  }
+  page_id_t next_p_id = leaf_node->GetNextPageId();
+  Page *next_page = nullptr;
+  uint64_t next_version = 0;
+  if (next_p_id != INVALID_PAGE_ID) {
+    next_page = buffer_pool_manager_->FetchPage(next_p_id);
+    next_version = next_page->ReadVersion();
+  }
+  // Unchanged since, the leaf still pointed at the next one when the next one's version was read.
+  if (!page_->ValidateVersion(version_)) {
+    if (next_page != nullptr) {
+      buffer_pool_manager_->UnpinPage(next_p_id, false);
     }
+    return false;
+  }
+  buffer_pool_manager_->UnpinPage(p_id, false);
+  page_ = next_page;
+  version_ = next_version;
+  leaf_node = next_page == nullptr ? nullptr : reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(next_page->GetData());
+  p_id = next_p_id;
+  idx = 0;
+  return true;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::Reseek() {
+  if (p_id != INVALID_PAGE_ID) {
     buffer_pool_manager_->UnpinPage(p_id, false);
-    p_id = nxt_p_id;
   }
-  return *this;
+  page_ = seek_(has_key_ ? &key_ : nullptr, inclusive_, &version_, &idx);
+  if (page_ == nullptr) {
+    leaf_node = nullptr;
+    p_id = INVALID_PAGE_ID;
+    idx = 0;
+    return;
+  }
+  leaf_node = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page_->GetData());
+  p_id = page_->GetPageId();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::Load() {
+  while (!IsEnd()) {
+    if (idx < leaf_node->GetSize()) {
+      item_ = leaf_node->GetItem(idx);
+      if (page_->ValidateVersion(version_)) {
+        return;
+      }
+      Reseek();
+    } else if (!NextLeaf()) {
+      Reseek();
+    }
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::Settle() {
+  while (true) {
+    Load();
+    if (lock_manager_ == nullptr) {
+      return;
+    }
+    RID rid = IsEnd() ? end_rid_ : item_.second;
+    if (!lock_manager_->LockShared(txn_, rid)) {
+      return;
+    }
+    // The entry may have moved while the lock was waited for: if the leaf changed, lock what is there now.
+    if (IsEnd() || page_->ValidateVersion(version_)) {
+      return;
+    }
+    Reseek();
+  }
 }
 
 template class IndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
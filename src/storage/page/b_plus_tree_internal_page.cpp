@@ -200,7 +200,7 @@ INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveHalfTo(BPlusTreeInternalPage *recipient,
                                                 BufferPoolManager *buffer_pool_manager) {
   int move_size = GetSize() / 2;
-  for(int i = move_size; i < GetSize(); ++i){
+  for(int i = GetSize() - move_size; i < GetSize(); ++i){
     recipient->CopyLastFrom(array_[i], buffer_pool_manager);
   }
   IncreaseSize(-1 * move_size);
@@ -268,9 +268,10 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveAllTo(BPlusTreeInternalPage *recipient,
   MappingType pair = MappingType{middle_key, array_[0].second};
   recipient->CopyLastFrom(pair, buffer_pool_manager);
   int size = GetSize();
-  for (int i = 0; i < size; ++i){
+  for (int i = 1; i < size; ++i){
     recipient->CopyLastFrom(array_[i], buffer_pool_manager);
   }
+  SetSize(0);
 }
 
 /*****************************************************************************
@@ -294,7 +295,6 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveFirstToEndOf(BPlusTreeInternalPage *rec
   // middle_key = array_[1].first;
   recipient->SetChildParent(array_[0].second, buffer_pool_manager);
   Remove(0);
-  IncreaseSize(-1);
 }
 
 /* Append an entry at the end.
@@ -334,6 +334,7 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetChildParent(ValueType p_id, BufferPoolMa
   Page *page_ = buffer_pool_manager->FetchPage(p_id);
   BPlusTreePage *child_page = reinterpret_cast<BPlusTreePage *>(page_);
   child_page->SetParentPageId(GetPageId());
+  child_page->LogParentPageId(buffer_pool_manager->GetLogManager());
   buffer_pool_manager->UnpinPage(p_id, true);
 }
 
@@ -11,6 +11,11 @@
 
 #include "storage/page/b_plus_tree_page.h"
 
+#include <cstring>
+
+#include "storage/page/b_plus_tree_internal_page.h"
+#include "storage/page/b_plus_tree_leaf_page.h"
+
 namespace bustub {
 
 /*
@@ -62,4 +67,54 @@ void BPlusTreePage::SetPageId(page_id_t page_id) { page_id_ = page_id; }
  */
 void BPlusTreePage::SetLSN(lsn_t lsn) { lsn_ = lsn; }
 
+/*
+ * Redo-only logging of index page changes
+ */
+void BPlusTreePage::LogEntry(LogManager *log_manager, LogRecordType type, int index, int entry_size) {
+  if (!enable_logging || log_manager == nullptr) {
+    return;
+  }
+  LogRecord log_record(type, page_id_, index, EntryAt(index, entry_size), entry_size);
+  AppendIndexLogRecord(log_manager, &log_record);
+}
+
+void BPlusTreePage::LogImage(LogManager *log_manager, int entry_size) {
+  if (!enable_logging || log_manager == nullptr) {
+    return;
+  }
+  LogRecord log_record(LogRecordType::INDEX_PAGE, page_id_, 0, reinterpret_cast<char *>(this),
+                       EntryAt(size_, entry_size) - reinterpret_cast<char *>(this));
+  AppendIndexLogRecord(log_manager, &log_record);
+}
+
+void BPlusTreePage::LogParentPageId(LogManager *log_manager) {
+  if (!enable_logging || log_manager == nullptr) {
+    return;
+  }
+  LogRecord log_record(LogRecordType::INDEX_SET_PARENT, page_id_, parent_page_id_, nullptr, 0);
+  AppendIndexLogRecord(log_manager, &log_record);
+}
+
+void BPlusTreePage::RedoInsert(int index, const char *entry, int entry_size) {
+  memmove(EntryAt(index + 1, entry_size), EntryAt(index, entry_size), (size_ - index) * entry_size);
+  memcpy(EntryAt(index, entry_size), entry, entry_size);
+  size_++;
+}
+
+void BPlusTreePage::RedoRemove(int index, int entry_size) {
+  memmove(EntryAt(index, entry_size), EntryAt(index + 1, entry_size), (size_ - index - 1) * entry_size);
+  size_--;
+}
+
+char *BPlusTreePage::EntryAt(int index, int entry_size) {
+  return reinterpret_cast<char *>(this) + (IsLeafPage() ? LEAF_PAGE_HEADER_SIZE : INTERNAL_PAGE_HEADER_SIZE) +
+         index * entry_size;
+}
+
+void BPlusTreePage::AppendIndexLogRecord(LogManager *log_manager, LogRecord *log_record) {
+  lsn_t lsn = log_manager->AppendLogRecord(log_record);
+  // A tree page lives at the start of its Page, stamping through the Page also sets its recovery lsn.
+  reinterpret_cast<Page *>(this)->SetLSN(lsn);
+}
+
 }  // namespace bustub
@@ -12,6 +12,7 @@
 
 #include "storage/page/table_page.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace bustub {
@@ -24,9 +25,9 @@ void TablePage::Init(page_id_t page_id, uint32_t page_size, page_id_t prev_page_
   if (enable_logging) {
     LogRecord log_record =
         LogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::NEWPAGE, prev_page_id, page_id);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
-    SetLSN(lsn);
-    txn->SetPrevLSN(lsn);
+    log_manager->AppendToArena(txn, &log_record, this);
+    // The record also covers the link from the previous page, which does not name the transaction: publish it now.
+    log_manager->PublishArena(txn);
   }
   // Set the previous and next page IDs.
   SetPrevPageId(prev_page_id);
@@ -73,19 +74,43 @@ bool TablePage::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, Lock
 
   // Write the log record.
   if (enable_logging) {
-    BUSTUB_ASSERT(!txn->IsSharedLocked(*rid) && !txn->IsExclusiveLocked(*rid), "A new tuple should not be locked.");
-    // Acquire an exclusive lock on the new tuple.
-    bool locked = lock_manager->LockExclusive(txn, *rid);
-    BUSTUB_ASSERT(locked, "Locking a new tuple should always work.");
+    if (LocksRows(txn)) {
+      BUSTUB_ASSERT(!txn->IsSharedLocked(*rid) && !txn->IsExclusiveLocked(*rid), "A new tuple should not be locked.");
+      // Acquire an exclusive lock on the new tuple.
+      bool locked = lock_manager->LockExclusive(txn, *rid);
+      BUSTUB_ASSERT(locked, "Locking a new tuple should always work.");
+    }
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::INSERT, *rid, tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
-    SetLSN(lsn);
-    txn->SetPrevLSN(lsn);
+    log_manager->AppendToArena(txn, &log_record, this);
+  }
+  return true;
+}
+
+bool TablePage::InsertTupleAt(const Tuple &tuple, const RID &rid) {
+  BUSTUB_ASSERT(tuple.size_ > 0, "Cannot have empty tuples.");
+  uint32_t slot_num = rid.GetSlotNum();
+  if (slot_num < GetTupleCount() && GetTupleSize(slot_num) != 0) {
+    return false;
+  }
+  // The vacuum truncates empty slots without logging it, the page may have fewer slots than when the tuple was there.
+  uint32_t tuple_count = std::max(GetTupleCount(), slot_num + 1);
+  if (GetFreeSpaceRemaining() < tuple.size_ + SIZE_TUPLE * (tuple_count - GetTupleCount())) {
+    return false;
+  }
+  for (uint32_t i = GetTupleCount(); i < tuple_count; i++) {
+    SetTupleOffsetAtSlot(i, 0);
+    SetTupleSize(i, 0);
   }
+  SetTupleCount(tuple_count);
+
+  SetFreeSpacePointer(GetFreeSpacePointer() - tuple.size_);
+  memcpy(GetData() + GetFreeSpacePointer(), tuple.data_, tuple.size_);
+  SetTupleOffsetAtSlot(slot_num, GetFreeSpacePointer());
+  SetTupleSize(slot_num, tuple.size_);
   return true;
 }
 
-bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager) {
+bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LogManager *log_manager) {
   uint32_t slot_num = rid.GetSlotNum();
   // If the slot number is invalid, abort the transaction.
   if (slot_num >= GetTupleCount()) {
@@ -105,19 +130,9 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_m
   }
 
   if (enable_logging) {
-    // Acquire an exclusive lock, upgrading from a shared lock if necessary.
-    if (txn->IsSharedLocked(rid)) {
-      if (!lock_manager->LockUpgrade(txn, rid)) {
-        return false;
-      }
-    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
-      return false;
-    }
     Tuple dummy_tuple;
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::MARKDELETE, rid, dummy_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
-    SetLSN(lsn);
-    txn->SetPrevLSN(lsn);
+    log_manager->AppendToArena(txn, &log_record, this);
   }
 
   // Mark the tuple as deleted.
@@ -128,7 +143,7 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_m
 }
 
 bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID &rid, Transaction *txn,
-                            LockManager *lock_manager, LogManager *log_manager) {
+                            LogManager *log_manager) {
   BUSTUB_ASSERT(new_tuple.size_ > 0, "Cannot have empty tuples.");
   uint32_t slot_num = rid.GetSlotNum();
   // If the slot number is invalid, abort the transaction.
@@ -163,18 +178,11 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   old_tuple->allocated_ = true;
 
   if (enable_logging) {
-    // Acquire an exclusive lock, upgrading from shared if necessary.
-    if (txn->IsSharedLocked(rid)) {
-      if (!lock_manager->LockUpgrade(txn, rid)) {
-        return false;
-      }
-    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
-      return false;
-    }
-    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::UPDATE, rid, *old_tuple, new_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
-    SetLSN(lsn);
-    txn->SetPrevLSN(lsn);
+    // Updates in place only log the bytes they change.
+    LogRecordType log_record_type =
+        old_tuple->size_ == new_tuple.size_ ? LogRecordType::UPDATE_DELTA : LogRecordType::UPDATE;
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), log_record_type, rid, *old_tuple, new_tuple);
+    log_manager->AppendToArena(txn, &log_record, this);
   }
 
   // Perform the update.
@@ -197,6 +205,19 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   return true;
 }
 
+bool TablePage::ApplyUpdateDelta(const RID &rid, const LogRecord &log_record, bool redo) {
+  uint32_t slot_num = rid.GetSlotNum();
+  if (slot_num >= GetTupleCount()) {
+    return false;
+  }
+  uint32_t tuple_size = GetTupleSize(slot_num);
+  if (IsDeleted(tuple_size) || tuple_size != log_record.GetDeltaTupleSize()) {
+    return false;
+  }
+  log_record.ApplyDelta(GetData() + GetTupleOffsetAtSlot(slot_num), redo);
+  return true;
+}
+
 void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_manager) {
   uint32_t slot_num = rid.GetSlotNum();
   BUSTUB_ASSERT(slot_num < GetTupleCount(), "Cannot have more slots than tuples.");
@@ -218,12 +239,8 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_ma
   delete_tuple.allocated_ = true;
 
   if (enable_logging) {
-    BUSTUB_ASSERT(txn->IsExclusiveLocked(rid), "We must own the exclusive lock!");
-
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::APPLYDELETE, rid, delete_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
-    SetLSN(lsn);
-    txn->SetPrevLSN(lsn);
+    log_manager->AppendToArena(txn, &log_record, this);
   }
 
   uint32_t free_space_pointer = GetFreeSpacePointer();
@@ -247,12 +264,9 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_ma
 void TablePage::RollbackDelete(const RID &rid, Transaction *txn, LogManager *log_manager) {
   // Log the rollback.
   if (enable_logging) {
-    BUSTUB_ASSERT(txn->IsExclusiveLocked(rid), "We must own an exclusive lock on the RID.");
     Tuple dummy_tuple;
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ROLLBACKDELETE, rid, dummy_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
-    SetLSN(lsn);
-    txn->SetPrevLSN(lsn);
+    log_manager->AppendToArena(txn, &log_record, this);
   }
 
   uint32_t slot_num = rid.GetSlotNum();
@@ -265,7 +279,7 @@ void TablePage::RollbackDelete(const RID &rid, Transaction *txn, LogManager *log
   }
 }
 
-bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager) {
+bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
   // Get the current slot number.
   uint32_t slot_num = rid.GetSlotNum();
   // If somehow we have more slots than tuples, abort the transaction.
@@ -285,14 +299,7 @@ bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
     return false;
   }
 
-  // Otherwise we have a valid tuple, try to acquire at least a shared lock.
-  if (enable_logging) {
-    if (!txn->IsSharedLocked(rid) && !txn->IsExclusiveLocked(rid) && !lock_manager->LockShared(txn, rid)) {
-      return false;
-    }
-  }
-
-  // At this point, we have at least a shared lock on the RID. Copy the tuple data into our result.
+  // Otherwise we have a valid tuple, which the caller holds at least a shared lock on. Copy the tuple data out.
   uint32_t tuple_offset = GetTupleOffsetAtSlot(slot_num);
   tuple->size_ = tuple_size;
   if (tuple->allocated_) {
@@ -305,10 +312,28 @@ bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
   return true;
 }
 
-bool TablePage::GetFirstTupleRid(RID *first_rid) {
+bool TablePage::ReadTuple(const RID &rid, Tuple *tuple, bool *deleted) {
+  uint32_t slot_num = rid.GetSlotNum();
+  if (slot_num >= GetTupleCount() || GetTupleSize(slot_num) == 0) {
+    return false;
+  }
+  uint32_t tuple_size = GetTupleSize(slot_num);
+  *deleted = IsDeleted(tuple_size);
+  tuple->size_ = UnsetDeletedFlag(tuple_size);
+  if (tuple->allocated_) {
+    delete[] tuple->data_;
+  }
+  tuple->data_ = new char[tuple->size_];
+  memcpy(tuple->data_, GetData() + GetTupleOffsetAtSlot(slot_num), tuple->size_);
+  tuple->rid_ = rid;
+  tuple->allocated_ = true;
+  return true;
+}
+
+bool TablePage::GetFirstTupleRid(RID *first_rid, bool any_slot) {
   // Find and return the first valid tuple.
   for (uint32_t i = 0; i < GetTupleCount(); ++i) {
-    if (!IsDeleted(GetTupleSize(i))) {
+    if (any_slot || !IsDeleted(GetTupleSize(i))) {
       first_rid->Set(GetTablePageId(), i);
       return true;
     }
@@ -317,11 +342,11 @@ bool TablePage::GetFirstTupleRid(RID *first_rid) {
   return false;
 }
 
-bool TablePage::GetNextTupleRid(const RID &cur_rid, RID *next_rid) {
+bool TablePage::GetNextTupleRid(const RID &cur_rid, RID *next_rid, bool any_slot) {
   BUSTUB_ASSERT(cur_rid.GetPageId() == GetTablePageId(), "Wrong table!");
   // Find and return the first valid tuple after our current slot number.
   for (auto i = cur_rid.GetSlotNum() + 1; i < GetTupleCount(); ++i) {
-    if (!IsDeleted(GetTupleSize(i))) {
+    if (any_slot || !IsDeleted(GetTupleSize(i))) {
       next_rid->Set(GetTablePageId(), i);
       return true;
     }
@@ -330,4 +355,14 @@ bool TablePage::GetNextTupleRid(const RID &cur_rid, RID *next_rid) {
   next_rid->Set(INVALID_PAGE_ID, 0);
   return false;
 }
+
+uint32_t TablePage::TruncateSlots(const std::function<bool(const RID &)> &in_use) {
+  uint32_t slot_count = GetTupleCount();
+  while (slot_count > 0 && GetTupleSize(slot_count - 1) == 0 && !in_use(RID(GetTablePageId(), slot_count - 1))) {
+    slot_count--;
+  }
+  uint32_t released = GetTupleCount() - slot_count;
+  SetTupleCount(slot_count);
+  return released;
+}
 }  // namespace bustub
@@ -18,15 +18,16 @@
 namespace bustub {
 
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-                     page_id_t first_page_id)
+                     page_id_t first_page_id, table_oid_t oid)
     : buffer_pool_manager_(buffer_pool_manager),
       lock_manager_(lock_manager),
       log_manager_(log_manager),
-      first_page_id_(first_page_id) {}
+      first_page_id_(first_page_id),
+      oid_(oid) {}
 
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-                     Transaction *txn)
-    : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager), log_manager_(log_manager) {
+                     Transaction *txn, table_oid_t oid)
+    : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager), log_manager_(log_manager), oid_(oid) {
   // Initialize the first table page.
   auto first_page = reinterpret_cast<TablePage *>(buffer_pool_manager_->NewPage(&first_page_id_));
   BUSTUB_ASSERT(first_page != nullptr, "Couldn't create a page for the table heap.");
@@ -37,11 +38,18 @@ TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_m
 }
 
 bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
-  if (tuple.size_ + 32 > PAGE_SIZE) {  // larger than one page size
+  // A read-only transaction cannot write, and a tuple larger than a page does not fit.
+  if (txn->IsReadOnly() || tuple.size_ + 32 > PAGE_SIZE) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
 
+  // The page locks the new tuple under its latch, where the intention lock on the table must not be waited for.
+  bool locks_rows = enable_logging && TablePage::LocksRows(txn);
+  if (locks_rows && !lock_manager_->LockTable(txn, LockMode::INTENTION_EXCLUSIVE, oid_)) {
+    return false;
+  }
+
   auto cur_page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(first_page_id_));
   if (cur_page == nullptr) {
     txn->SetState(TransactionState::ABORTED);
@@ -81,17 +89,35 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
       cur_page = new_page;
     }
   }
+  // The tuple did not exist in the versions before this one.
+  versions_.BeforeWrite(*rid, txn, nullptr);
+  // An optimistic insert stays hidden until it commits.
+  if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC) {
+    cur_page->MarkDelete(*rid, txn, log_manager_);
+  }
   // This line has caused most of us to double-take and "whoa double unlatch".
   // We are not, in fact, double unlatching. See the invariant above.
   cur_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(cur_page->GetTablePageId(), true);
   // Update the transaction's write set.
   txn->GetWriteSet()->emplace_back(*rid, WType::INSERT, Tuple{}, this);
-  return true;
+  // Count the row the page locked towards escalation, which may wait for the table lock now that nothing is latched.
+  return !locks_rows || lock_manager_->LockRow(txn, LockMode::EXCLUSIVE, oid_, *rid);
 }
 
 bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
   // TODO(Amadou): remove empty page
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC) {
+    return BufferWrite(rid, WType::DELETE, Tuple{}, txn);
+  }
+  // A writer that is going to lose under snapshot isolation does not wait for the lock first.
+  if (!CanWrite(rid, txn) || !LockTuple(rid, txn, true)) {
+    return false;
+  }
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -101,7 +127,18 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
   }
   // Otherwise, mark the tuple as deleted.
   page->WLatch();
-  page->MarkDelete(rid, txn, lock_manager_, log_manager_);
+  if (!CanWrite(rid, txn)) {
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
+  // Keep the deleted version for the snapshots that still see it.
+  Tuple old_tuple;
+  bool deleted = false;
+  page->ReadTuple(rid, &old_tuple, &deleted);
+  if (page->MarkDelete(rid, txn, log_manager_)) {
+    versions_.BeforeWrite(rid, txn, &old_tuple);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
   // Update the transaction's write set.
@@ -110,6 +147,18 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
 }
 
 bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  // The rollback of an aborting optimistic transaction is not buffered.
+  if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC && txn->GetState() != TransactionState::ABORTED) {
+    return BufferWrite(rid, WType::UPDATE, tuple, txn);
+  }
+  // A writer that is going to lose under snapshot isolation does not wait for the lock first.
+  if (!CanWrite(rid, txn) || !LockTuple(rid, txn, true)) {
+    return false;
+  }
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -120,7 +169,15 @@ bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn
   // Update the tuple; but first save the old value for rollbacks.
   Tuple old_tuple;
   page->WLatch();
-  bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, lock_manager_, log_manager_);
+  if (!CanWrite(rid, txn)) {
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
+  bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, log_manager_);
+  if (is_updated) {
+    versions_.BeforeWrite(rid, txn, &old_tuple);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), is_updated);
   // Update the transaction's write set.
@@ -136,8 +193,13 @@ void TableHeap::ApplyDelete(const RID &rid, Transaction *txn) {
   BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
   // Delete the tuple from the page.
   page->WLatch();
+  BUSTUB_ASSERT(HoldsExclusiveLock(rid, txn), "We must own the exclusive lock!");
   page->ApplyDelete(rid, txn, log_manager_);
-  lock_manager_->Unlock(txn, rid);
+  // Rolling back an insert also drops the version it started, a committed delete has no pending version.
+  versions_.Abort(rid, txn);
+  if (txn->GetIsolationLevel() != IsolationLevel::OPTIMISTIC) {
+    lock_manager_->UnlockRow(txn, oid_, rid);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
 }
@@ -148,12 +210,19 @@ void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
   BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
   // Rollback the delete.
   page->WLatch();
+  BUSTUB_ASSERT(HoldsExclusiveLock(rid, txn), "We must own an exclusive lock on the RID.");
   page->RollbackDelete(rid, txn, log_manager_);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
 }
 
 bool TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
+  if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC) {
+    return ReadOptimistic(rid, tuple, txn);
+  }
+  if (!txn->ReadsVersions() && !LockTuple(rid, txn, false)) {
+    return false;
+  }
   // Find the page which contains the tuple.
   auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -163,7 +232,14 @@ bool TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
   }
   // Read the tuple from the page.
   page->RLatch();
-  bool res = page->GetTuple(rid, tuple, txn, lock_manager_);
+  bool res;
+  if (txn->ReadsVersions()) {
+    bool deleted = false;
+    bool on_page = page->ReadTuple(rid, tuple, &deleted) && !deleted;
+    res = versions_.Read(rid, txn, on_page, tuple);
+  } else {
+    res = page->GetTuple(rid, tuple, txn);
+  }
   page->RUnlatch();
   buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
   return res;
@@ -178,7 +254,8 @@ TableIterator TableHeap::Begin(Transaction *txn) {
     auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
     page->RLatch();
     // If this fails because there is no tuple, then RID will be the default-constructed value, which means EOF.
-    auto found_tuple = page->GetFirstTupleRid(&rid);
+    // A snapshot may see a version of a tuple that is deleted on the page, so it visits every slot.
+    auto found_tuple = page->GetFirstTupleRid(&rid, txn->ReadsVersions());
     page->RUnlatch();
     buffer_pool_manager_->UnpinPage(page_id, false);
     if (found_tuple) {
@@ -189,6 +266,234 @@ TableIterator TableHeap::Begin(Transaction *txn) {
   return TableIterator(this, rid, txn);
 }
 
+bool TableHeap::ReadOptimistic(const RID &rid, Tuple *tuple, Transaction *txn) {
+  // The transaction sees its own writes.
+  auto buffered = FindBufferedWrite(rid, txn);
+  if (buffered != nullptr && buffered->wtype_ == WType::UPDATE) {
+    *tuple = buffered->tuple_;
+    tuple->rid_ = rid;
+    return true;
+  }
+  if (buffered != nullptr && buffered->wtype_ == WType::DELETE) {
+    return false;
+  }
+  bool own_insert = buffered != nullptr;
+
+  auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  if (page == nullptr) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  // The tuple is read between two reads of its version word. If a writer installed a change in between, try again.
+  size_t word = RecordVersionTable::WordOf(rid);
+  bool res;
+  while (true) {
+    uint64_t version = record_versions_.StableRead(word);
+    bool deleted = false;
+    page->RLatch();
+    res = page->ReadTuple(rid, tuple, &deleted) && (!deleted || own_insert);
+    page->RUnlatch();
+    if (own_insert) {
+      break;
+    }
+    if (record_versions_.Read(word) == version) {
+      txn->GetReadSet()->emplace_back(rid, version, this);
+      break;
+    }
+  }
+  buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+  return res;
+}
+
+bool TableHeap::BufferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn) {
+  auto buffered = FindBufferedWrite(rid, txn);
+  if (buffered != nullptr && buffered->wtype_ == WType::INSERT) {
+    return ChangeOwnInsert(rid, wtype, tuple, txn);
+  }
+  // Reading the tuple first makes the commit validate that it was not changed since.
+  Tuple current;
+  if (!GetTuple(rid, &current, txn)) {
+    return false;
+  }
+  if (buffered != nullptr && buffered->wtype_ == WType::UPDATE && wtype == WType::UPDATE) {
+    buffered->tuple_ = tuple;
+    return true;
+  }
+  txn->GetWriteSet()->emplace_back(rid, wtype, tuple, this);
+  return true;
+}
+
+bool TableHeap::ChangeOwnInsert(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn) {
+  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  if (page == nullptr) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  bool changed = true;
+  page->WLatch();
+  if (wtype == WType::DELETE) {
+    page->ApplyDelete(rid, txn, log_manager_);
+    versions_.Abort(rid, txn);
+    auto write_set = txn->GetWriteSet();
+    for (auto item = write_set->begin(); item != write_set->end(); ++item) {
+      if (item->table_ == this && item->rid_ == rid) {
+        write_set->erase(item);
+        break;
+      }
+    }
+  } else {
+    // Show the tuple, update it and hide it again.
+    Tuple old_tuple;
+    page->RollbackDelete(rid, txn, log_manager_);
+    changed = page->UpdateTuple(tuple, &old_tuple, rid, txn, log_manager_);
+    page->MarkDelete(rid, txn, log_manager_);
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
+  return changed;
+}
+
+TableWriteRecord *TableHeap::FindBufferedWrite(const RID &rid, Transaction *txn) {
+  auto write_set = txn->GetWriteSet();
+  for (auto item = write_set->rbegin(); item != write_set->rend(); ++item) {
+    if (item->table_ == this && item->rid_ == rid) {
+      return &*item;
+    }
+  }
+  return nullptr;
+}
+
+bool TableHeap::InstallWrite(TableWriteRecord *item, Transaction *txn) {
+  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(item->rid_.GetPageId()));
+  if (page == nullptr) {
+    return false;
+  }
+  bool installed = true;
+  page->WLatch();
+  if (item->wtype_ == WType::INSERT) {
+    page->RollbackDelete(item->rid_, txn, log_manager_);
+  } else if (item->wtype_ == WType::DELETE) {
+    Tuple old_tuple;
+    bool deleted = false;
+    page->ReadTuple(item->rid_, &old_tuple, &deleted);
+    installed = page->MarkDelete(item->rid_, txn, log_manager_);
+    if (installed) {
+      versions_.BeforeWrite(item->rid_, txn, &old_tuple);
+    }
+  } else {
+    Tuple old_tuple;
+    installed = page->UpdateTuple(item->tuple_, &old_tuple, item->rid_, txn, log_manager_);
+    if (installed) {
+      versions_.BeforeWrite(item->rid_, txn, &old_tuple);
+      item->tuple_ = old_tuple;
+    }
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), installed);
+  return installed;
+}
+
+bool TableHeap::CanWrite(const RID &rid, Transaction *txn) {
+  // Under snapshot isolation the first writer of a tuple wins, the others abort instead of waiting for it.
+  if (txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION && !versions_.CanWrite(rid, txn)) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  return true;
+}
+
+bool TableHeap::LockTuple(const RID &rid, Transaction *txn, bool exclusive) {
+  if (HoldsExclusiveLock(rid, txn) || (!exclusive && txn->IsSharedLocked(oid_, rid))) {
+    return true;
+  }
+  return lock_manager_->LockRow(txn, exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED, oid_, rid);
+}
+
+bool TableHeap::HoldsExclusiveLock(const RID &rid, Transaction *txn) {
+  return !enable_logging || !TablePage::LocksRows(txn) || txn->IsExclusiveLocked(oid_, rid);
+}
+
+page_id_t TableHeap::VacuumPage(page_id_t page_id, timestamp_t oldest_ts,
+                                const std::function<void(const Tuple &)> &on_dead, bool *unlinked) {
+  *unlinked = false;
+  auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  if (page == nullptr) {
+    return INVALID_PAGE_ID;
+  }
+  page->WLatch();
+  std::vector<Tuple> dropped;
+  RID rid;
+  for (bool found = page->GetFirstTupleRid(&rid, true); found; found = page->GetNextTupleRid(rid, &rid, true)) {
+    dropped.clear();
+    bool deleted = false;
+    Tuple tuple;
+    // A tuple is gone for good once its slot is empty and no snapshot sees one of its versions anymore.
+    if (!versions_.Prune(rid, oldest_ts, &dropped) && !page->ReadTuple(rid, &tuple, &deleted)) {
+      for (const auto &version : dropped) {
+        on_dead(version);
+      }
+    }
+  }
+  bool is_dirty = page->TruncateSlots([this](const RID &slot_rid) { return versions_.HasVersions(slot_rid); }) > 0;
+  bool is_empty = page->IsEmpty();
+  page_id_t prev_page_id = page->GetPrevPageId();
+  page_id_t next_page_id = page->GetNextPageId();
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, is_dirty);
+
+  // The first page is where the table starts, the last one is where new pages get linked to.
+  if (is_empty && prev_page_id != INVALID_PAGE_ID && next_page_id != INVALID_PAGE_ID) {
+    *unlinked = UnlinkPage(prev_page_id, page_id);
+  }
+  return next_page_id;
+}
+
+bool TableHeap::UnlinkPage(page_id_t prev_page_id, page_id_t page_id) {
+  // Pages are latched front to back, as scans and inserts do.
+  auto prev_page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(prev_page_id));
+  if (prev_page == nullptr) {
+    return false;
+  }
+  prev_page->WLatch();
+  auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  if (page == nullptr) {
+    prev_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(prev_page_id, false);
+    return false;
+  }
+  page->WLatch();
+  bool unlinked = false;
+  page_id_t next_page_id = page->GetNextPageId();
+  if (prev_page->GetNextPageId() == page_id && page->IsEmpty() && next_page_id != INVALID_PAGE_ID) {
+    auto next_page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(next_page_id));
+    if (next_page != nullptr) {
+      next_page->WLatch();
+      if (enable_logging) {
+        // The unlink belongs to no transaction. What the running ones logged for the two pages is published first,
+        // so that the page lsns keep growing. The page id gets reused, redo and replicas have to relink around it too.
+        log_manager_->PublishArenaOf(prev_page);
+        log_manager_->PublishArenaOf(next_page);
+        LogRecord log_record(INVALID_TXN_ID, INVALID_LSN, LogRecordType::UNLINKPAGE, prev_page_id, next_page_id);
+        lsn_t lsn = log_manager_->AppendLogRecord(&log_record);
+        prev_page->SetLSN(lsn);
+        next_page->SetLSN(lsn);
+      }
+      next_page->SetPrevPageId(prev_page_id);
+      prev_page->SetNextPageId(next_page_id);
+      // The page keeps its own links, for whoever is on the way through it.
+      page->Retire();
+      next_page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(next_page_id, true);
+      unlinked = true;
+    }
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, unlinked);
+  prev_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(prev_page_id, unlinked);
+  return unlinked;
+}
+
 TableIterator TableHeap::End() { return TableIterator(this, RID(INVALID_PAGE_ID, 0), nullptr); }
 
 }  // namespace bustub
@@ -18,8 +18,8 @@ namespace bustub {
 
 TableIterator::TableIterator(TableHeap *table_heap, RID rid, Transaction *txn)
     : table_heap_(table_heap), tuple_(new Tuple(rid)), txn_(txn) {
-  if (rid.GetPageId() != INVALID_PAGE_ID) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+  if (rid.GetPageId() != INVALID_PAGE_ID && !table_heap_->GetTuple(tuple_->rid_, tuple_, txn_) && IsSnapshot()) {
+    ++(*this);
   }
 }
 
@@ -39,24 +39,26 @@ TableIterator &TableIterator::operator++() {
   cur_page->RLatch();
   assert(cur_page != nullptr);  // all pages are pinned
 
-  RID next_tuple_rid;
-  if (!cur_page->GetNextTupleRid(tuple_->rid_,
-                                 &next_tuple_rid)) {  // end of this page
-    while (cur_page->GetNextPageId() != INVALID_PAGE_ID) {
-      auto next_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(cur_page->GetNextPageId()));
-      cur_page->RUnlatch();
-      buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
-      cur_page = next_page;
-      cur_page->RLatch();
-      if (cur_page->GetFirstTupleRid(&next_tuple_rid)) {
-        break;
+  // A snapshot visits every slot and skips the ones holding no version it sees.
+  bool any_slot = IsSnapshot();
+  bool found = false;
+  while (!found) {
+    RID next_tuple_rid;
+    if (!cur_page->GetNextTupleRid(tuple_->rid_, &next_tuple_rid, any_slot)) {  // end of this page
+      while (cur_page->GetNextPageId() != INVALID_PAGE_ID) {
+        auto next_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(cur_page->GetNextPageId()));
+        cur_page->RUnlatch();
+        buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
+        cur_page = next_page;
+        cur_page->RLatch();
+        if (cur_page->GetFirstTupleRid(&next_tuple_rid, any_slot)) {
+          break;
+        }
       }
     }
-  }
-  tuple_->rid_ = next_tuple_rid;
+    tuple_->rid_ = next_tuple_rid;
 
-  if (*this != table_heap_->End()) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+    found = *this == table_heap_->End() || table_heap_->GetTuple(tuple_->rid_, tuple_, txn_) || !any_slot;
   }
   // release until copy the tuple
   cur_page->RUnlatch();
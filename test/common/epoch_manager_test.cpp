@@ -0,0 +1,188 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// epoch_manager_test.cpp
+//
+// Identification: test/common/epoch_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <memory>
+#include <shared_mutex>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "common/epoch_manager.h"
+#include "gtest/gtest.h"
+#include "storage/disk/disk_manager_memory.h"
+
+namespace bustub {
+
+TEST(EpochManagerTest, GuardTest) {
+  EpochManager epochs;
+  int freed = 0;
+
+  // Nothing retired while a guard is held is freed before the guard is released.
+  auto guard = epochs.Protect();
+  epochs.Retire([&freed] { freed++; });
+  epochs.Reclaim();
+  epochs.Reclaim();
+  EXPECT_EQ(freed, 0);
+  EXPECT_EQ(epochs.GetRetiredCount(), 1U);
+  guard.Release();
+  epochs.Reclaim();
+  EXPECT_EQ(freed, 1);
+  EXPECT_EQ(epochs.GetRetiredCount(), 0U);
+
+  // What was retired before a guard was taken does not wait for it.
+  epochs.Retire([&freed] { freed++; });
+  {
+    auto later = epochs.Protect();
+    epochs.Reclaim();
+    EXPECT_EQ(freed, 1);
+    auto epoch = epochs.GetEpoch();
+    epochs.Reclaim();
+    // The guard holds the epoch one past the one it entered in.
+    EXPECT_EQ(epochs.GetEpoch(), epoch);
+  }
+  epochs.Reclaim();
+  EXPECT_EQ(freed, 2);
+}
+
+TEST(EpochManagerTest, AdvanceTest) {
+  int freed = 0;
+  {
+    EpochManager epochs;
+    // Without readers the epoch moves on by itself, and the retired objects do not pile up.
+    const int num_objects = 100 * EPOCH_RETIRE_THRESHOLD;
+    for (int i = 0; i < num_objects; i++) {
+      epochs.Retire([&freed] { freed++; });
+    }
+    EXPECT_GT(epochs.GetEpoch(), 0U);
+    EXPECT_LT(epochs.GetRetiredCount(), static_cast<size_t>(EPOCH_SLOTS * EPOCH_RETIRE_THRESHOLD));
+    EXPECT_EQ(freed + static_cast<int>(epochs.GetRetiredCount()), num_objects);
+  }
+  // The rest is freed with the manager.
+  EXPECT_EQ(freed, 100 * EPOCH_RETIRE_THRESHOLD);
+}
+
+/** A node readers find through a shared pointer, marked instead of deleted so that an early free shows. */
+struct Node {
+  explicit Node(int value) : value_(value) {}
+  int value_;
+  std::atomic<bool> freed_{false};
+};
+
+TEST(EpochManagerTest, StressTest) {
+  EpochManager epochs;
+  const int num_readers = 8;
+  const int num_writers = 2;
+  const int swaps_per_writer = 20000;
+  std::atomic<Node *> shared{new Node(0)};
+  std::vector<std::unique_ptr<Node>> graveyard[num_writers];
+  std::atomic<bool> done{false};
+  std::atomic<int> early_frees{0};
+
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_readers; tid++) {
+    threads.emplace_back([&] {
+      while (!done) {
+        auto guard = epochs.Protect();
+        Node *node = shared.load();
+        // Let a writer swap the node out while it is being looked at.
+        std::this_thread::yield();
+        if (node->freed_) {
+          early_frees++;
+        }
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (int tid = 0; tid < num_writers; tid++) {
+    writers.emplace_back([&, tid] {
+      for (int i = 0; i < swaps_per_writer; i++) {
+        Node *old = shared.exchange(new Node(i));
+        epochs.Retire([old, &graveyard, tid] {
+          old->freed_ = true;
+          graveyard[tid].emplace_back(old);
+        });
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  done = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(early_frees, 0);
+  epochs.Reclaim();
+  EXPECT_EQ(epochs.GetRetiredCount(), 0U);
+  delete shared.load();
+}
+
+TEST(EpochManagerTest, PageIdReuseTest) {
+  DiskManagerMemory disk_manager;
+  BufferPoolManagerInstance bpm(4, &disk_manager);
+  page_id_t page_id;
+  ASSERT_NE(bpm.NewPage(&page_id), nullptr);
+  ASSERT_TRUE(bpm.UnpinPage(page_id, false));
+
+  // A reader that read the page id before it was deleted keeps it from being handed out again.
+  auto guard = bpm.GetEpochManager()->Protect();
+  ASSERT_TRUE(bpm.DeletePage(page_id));
+  page_id_t other_page_id;
+  ASSERT_NE(bpm.NewPage(&other_page_id), nullptr);
+  EXPECT_NE(other_page_id, page_id);
+  ASSERT_TRUE(bpm.UnpinPage(other_page_id, false));
+
+  guard.Release();
+  page_id_t reused_page_id;
+  ASSERT_NE(bpm.NewPage(&reused_page_id), nullptr);
+  EXPECT_EQ(reused_page_id, page_id);
+  ASSERT_TRUE(bpm.UnpinPage(reused_page_id, false));
+}
+
+/**
+ * The cost of entering and leaving an epoch next to taking a shared latch, on a growing number of threads.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=EpochManagerTest.DISABLED_ProtectBenchmark
+ */
+TEST(EpochManagerTest, DISABLED_ProtectBenchmark) {
+  const int total_ops = 1 << 24;
+  for (int num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    EpochManager epochs;
+    std::shared_mutex latch;
+    const int ops_per_thread = total_ops / num_threads;
+    for (bool use_epochs : {true, false}) {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int tid = 0; tid < num_threads; tid++) {
+        threads.emplace_back([&, ops_per_thread] {
+          for (int i = 0; i < ops_per_thread; i++) {
+            if (use_epochs) {
+              auto guard = epochs.Protect();
+            } else {
+              std::shared_lock shared_latch(latch);
+            }
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      printf("%2d threads, %-12s: %12.0f ops/sec\n", num_threads, use_epochs ? "epoch guard" : "shared latch",
+             num_threads * ops_per_thread / elapsed);
+    }
+  }
+}
+
+}  // namespace bustub
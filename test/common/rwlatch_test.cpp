@@ -1,60 +1,221 @@
-//===----------------------------------------------------------------------===//
-//
-//                         BusTub
-//
-// rwlatch_test.cpp
-//
-// Identification: test/common/rwlatch_test.cpp
-//
-// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
-//
-//===----------------------------------------------------------------------===//
-
-#include <thread>  // NOLINT
-#include <vector>
-
-#include "common/rwlatch.h"
-#include "gtest/gtest.h"
-
-namespace bustub {
-
-class Counter {
- public:
-  Counter() = default;
-  void Add(int num) {
-    mutex.WLock();
-    count_ += num;
-    mutex.WUnlock();
-  }
-  int Read() {
-    int res;
-    mutex.RLock();
-    res = count_;
-    mutex.RUnlock();
-    return res;
-  }
-
- private:
-  int count_{0};
-  ReaderWriterLatch mutex{};
-};
-
-// NOLINTNEXTLINE
-TEST(RWLatchTest, BasicTest) {
-  int num_threads = 100;
-  Counter counter{};
-  counter.Add(5);
-  std::vector<std::thread> threads;
-  for (int tid = 0; tid < num_threads; tid++) {
-    if (tid % 2 == 0) {
-      threads.emplace_back([&counter]() { counter.Read(); });
-    } else {
-      threads.emplace_back([&counter]() { counter.Add(1); });
-    }
-  }
-  for (int i = 0; i < num_threads; i++) {
-    threads[i].join();
-  }
-  EXPECT_EQ(counter.Read(), 55);
-}
-}  // namespace bustub
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// rwlatch_test.cpp
+//
+// Identification: test/common/rwlatch_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <cstdio>
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/rwlatch.h"
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+class Counter {
+ public:
+  Counter() = default;
+  void Add(int num) {
+    mutex.WLock();
+    count_ += num;
+    mutex.WUnlock();
+  }
+  int Read() {
+    int res;
+    mutex.RLock();
+    res = count_;
+    mutex.RUnlock();
+    return res;
+  }
+
+ private:
+  int count_{0};
+  ReaderWriterLatch mutex{};
+};
+
+// NOLINTNEXTLINE
+TEST(RWLatchTest, BasicTest) {
+  int num_threads = 100;
+  Counter counter{};
+  counter.Add(5);
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    if (tid % 2 == 0) {
+      threads.emplace_back([&counter]() { counter.Read(); });
+    } else {
+      threads.emplace_back([&counter]() { counter.Add(1); });
+    }
+  }
+  for (int i = 0; i < num_threads; i++) {
+    threads[i].join();
+  }
+  EXPECT_EQ(counter.Read(), 55);
+}
+
+TEST(RWLatchTest, WriterPreferenceTest) {
+  ReaderWriterLatch latch;
+  std::atomic<int> stage{0};
+
+  // A writer waits for the reader inside, and a reader that comes after the writer waits for the writer.
+  latch.RLock();
+  std::thread writer([&] {
+    latch.WLock();
+    EXPECT_EQ(stage.exchange(1), 0);
+    latch.WUnlock();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::thread reader([&] {
+    latch.RLock();
+    EXPECT_EQ(stage.exchange(2), 1);
+    latch.RUnlock();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(stage, 0);
+  latch.RUnlock();
+  writer.join();
+  reader.join();
+  EXPECT_EQ(stage, 2);
+}
+
+TEST(RWLatchTest, StressTest) {
+  ReaderWriterLatch latch;
+  const int num_threads = 8;
+  const int rounds = 20000;
+  // Writers keep the two halves equal, readers must never see them differ.
+  int64_t first = 0;
+  int64_t second = 0;
+  std::atomic<int> torn_reads{0};
+
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&, tid] {
+      for (int i = 0; i < rounds; i++) {
+        if ((i + tid) % 4 == 0) {
+          latch.WLock();
+          first++;
+          second++;
+          latch.WUnlock();
+        } else {
+          latch.RLock();
+          if (first != second) {
+            torn_reads++;
+          }
+          latch.RUnlock();
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(torn_reads, 0);
+  EXPECT_EQ(first, num_threads * rounds / 4);
+}
+
+/** The latch ReaderWriterLatch replaced, a std::mutex with two condition variables, to measure against. */
+class MutexReaderWriterLatch {
+ public:
+  void WLock() {
+    std::unique_lock<std::mutex> latch(mutex_);
+    while (writer_entered_) {
+      reader_.wait(latch);
+    }
+    writer_entered_ = true;
+    while (reader_count_ > 0) {
+      writer_.wait(latch);
+    }
+  }
+
+  void WUnlock() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    writer_entered_ = false;
+    reader_.notify_all();
+  }
+
+  void RLock() {
+    std::unique_lock<std::mutex> latch(mutex_);
+    while (writer_entered_) {
+      reader_.wait(latch);
+    }
+    reader_count_++;
+  }
+
+  void RUnlock() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    reader_count_--;
+    if (writer_entered_ && reader_count_ == 0) {
+      writer_.notify_one();
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable writer_;
+  std::condition_variable reader_;
+  uint32_t reader_count_{0};
+  bool writer_entered_{false};
+};
+
+/**
+ * Take and release a latch on a growing number of threads, every write_every-th time for writing.
+ * @return the latch acquisitions per second
+ */
+template <typename Latch>
+double MeasureLatch(int num_threads, int write_every) {
+  const int total_ops = 1 << 22;
+  const int ops_per_thread = total_ops / num_threads;
+  Latch latch;
+  int64_t shared = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&, ops_per_thread] {
+      int64_t sum = 0;
+      for (int i = 0; i < ops_per_thread; i++) {
+        if (write_every != 0 && i % write_every == 0) {
+          latch.WLock();
+          shared++;
+          latch.WUnlock();
+        } else {
+          latch.RLock();
+          sum += shared;
+          latch.RUnlock();
+        }
+      }
+      EXPECT_GE(sum, 0);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return num_threads * ops_per_thread / elapsed;
+}
+
+/**
+ * Uncontended and contended acquisitions of the latch and of the one it replaced: read-only, one write in ten, and
+ * write-only.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=RWLatchTest.DISABLED_LatchBenchmark
+ */
+TEST(RWLatchTest, DISABLED_LatchBenchmark) {
+  for (int write_every : {0, 10, 1}) {
+    const char *mix = write_every == 0 ? "read-only" : write_every == 1 ? "write-only" : "1/10 writes";
+    for (int num_threads = 1; num_threads <= 16; num_threads *= 2) {
+      printf("%2d threads, %-11s: futex %12.0f ops/sec, mutex %12.0f ops/sec\n", num_threads, mix,
+             MeasureLatch<ReaderWriterLatch>(num_threads, write_every),
+             MeasureLatch<MutexReaderWriterLatch>(num_threads, write_every));
+    }
+  }
+}
+}  // namespace bustub
@@ -2,13 +2,21 @@
  * lock_manager_test.cpp
  */
 
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <random>
 #include <thread>  // NOLINT
+#include <vector>
 
+#include "buffer/buffer_pool_manager_instance.h"
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction_manager.h"
 #include "gtest/gtest.h"
+#include "recovery/log_manager.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/table/table_heap.h"
+#include "type/value_factory.h"
 
 namespace bustub {
 
@@ -152,6 +160,327 @@ void UpgradeTest() {
 }
 TEST(LockManagerTest, UpgradeLockTest) { UpgradeTest(); }
 
+// An exclusive lock holds back readers until it is released
+TEST(LockManagerTest, ExclusiveWaitTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  auto *writer = txn_mgr.Begin();
+  auto *reader = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockExclusive(writer, rid));
+  std::atomic<bool> granted{false};
+  std::thread t([&] {
+    EXPECT_TRUE(lock_mgr.LockShared(reader, rid));
+    granted = true;
+    txn_mgr.Commit(reader);
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  txn_mgr.Commit(writer);
+  t.join();
+  EXPECT_TRUE(granted);
+  CheckTxnLockSize(reader, 0, 0);
+
+  delete writer;
+  delete reader;
+}
+
+// An upgrade goes ahead of an exclusive request that was waiting before it
+TEST(LockManagerTest, UpgradeOrderTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  auto *txn0 = txn_mgr.Begin();
+  auto *txn1 = txn_mgr.Begin();
+  auto *txn2 = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockShared(txn0, rid));
+  EXPECT_TRUE(lock_mgr.LockShared(txn1, rid));
+
+  std::atomic<int> order{0};
+  int writer_order = -1;
+  int upgrader_order = -1;
+  std::thread writer([&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(txn2, rid));
+    writer_order = order++;
+    txn_mgr.Commit(txn2);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::thread upgrader([&] {
+    EXPECT_TRUE(lock_mgr.LockUpgrade(txn0, rid));
+    upgrader_order = order++;
+    CheckTxnLockSize(txn0, 0, 1);
+    txn_mgr.Commit(txn0);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(0, order);
+
+  // The last shared lock goes, the upgrade is granted first.
+  txn_mgr.Commit(txn1);
+  writer.join();
+  upgrader.join();
+  EXPECT_EQ(0, upgrader_order);
+  EXPECT_EQ(1, writer_order);
+
+  delete txn0;
+  delete txn1;
+  delete txn2;
+}
+
+// Many transactions lock and unlock overlapping rows, the lock table recycles its queues and requests
+TEST(LockManagerTest, ConcurrentLockTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  const int num_threads = 8;
+  const int num_txns = 200;
+  const int num_rids = 16;
+  std::atomic<int> exclusive_holders[num_rids] = {};
+
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&, tid] {
+      for (int i = 0; i < num_txns; i++) {
+        auto *txn = txn_mgr.Begin();
+        // Rows are always locked in the same order, so there is no deadlock.
+        for (int r = (tid + i) % 4; r < num_rids; r += 4) {
+          RID rid{r, static_cast<uint32_t>(r)};
+          if ((r + i) % 3 == 0) {
+            EXPECT_TRUE(lock_mgr.LockExclusive(txn, rid));
+            EXPECT_EQ(1, ++exclusive_holders[r]);
+          } else {
+            EXPECT_TRUE(lock_mgr.LockShared(txn, rid));
+            EXPECT_EQ(0, exclusive_holders[r]);
+          }
+        }
+        for (auto rid : *txn->GetExclusiveLockSet()) {
+          --exclusive_holders[rid.GetPageId()];
+        }
+        txn_mgr.Commit(txn);
+        CheckTxnLockSize(txn, 0, 0);
+        delete txn;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+/*
+ * Lock and unlock pairs per second from 1 to 64 threads, each thread locking rows of its own.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=LockManagerTest.DISABLED_LockThroughputBenchmark
+ */
+TEST(LockManagerTest, DISABLED_LockThroughputBenchmark) {
+  const int total_locks = 1 << 21;
+  const int locks_per_txn = 16;
+  for (int num_threads = 1; num_threads <= 64; num_threads *= 2) {
+    LockManager lock_mgr{};
+    TransactionManager txn_mgr{&lock_mgr};
+
+    const int txns_per_thread = total_locks / locks_per_txn / num_threads;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; tid++) {
+      threads.emplace_back([&lock_mgr, &txn_mgr, tid, txns_per_thread] {
+        for (int i = 0; i < txns_per_thread; i++) {
+          Transaction txn(tid);
+          txn_mgr.Begin(&txn);
+          for (int r = 0; r < locks_per_txn; r++) {
+            lock_mgr.LockExclusive(&txn, RID{tid, static_cast<uint32_t>(i * locks_per_txn + r)});
+          }
+          txn_mgr.Commit(&txn);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%2d threads: %12.0f locks/sec\n", num_threads, num_threads * txns_per_thread * locks_per_txn / elapsed);
+  }
+}
+
+// Intention locks on a table let transactions lock different rows, S and X on the table wait for them
+TEST(LockManagerTest, TableLockTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  const table_oid_t oid = 0;
+  auto *reader = txn_mgr.Begin();
+  auto *writer = txn_mgr.Begin();
+  auto *scanner = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockRow(reader, LockMode::SHARED, oid, RID{0, 0}));
+  EXPECT_TRUE(lock_mgr.LockRow(writer, LockMode::EXCLUSIVE, oid, RID{0, 1}));
+  EXPECT_EQ(LockMode::INTENTION_SHARED, reader->GetTableLockMap()->at(oid));
+  EXPECT_EQ(LockMode::INTENTION_EXCLUSIVE, writer->GetTableLockMap()->at(oid));
+  CheckTxnLockSize(reader, 1, 0);
+  CheckTxnLockSize(writer, 0, 1);
+
+  // A scan of the whole table waits for the writer, not for the reader.
+  std::atomic<bool> granted{false};
+  std::thread t([&] {
+    EXPECT_TRUE(lock_mgr.LockTable(scanner, LockMode::SHARED, oid));
+    granted = true;
+    // The table lock covers the rows, no row lock is taken.
+    EXPECT_TRUE(lock_mgr.LockRow(scanner, LockMode::SHARED, oid, RID{0, 0}));
+    CheckTxnLockSize(scanner, 0, 0);
+    txn_mgr.Commit(scanner);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  txn_mgr.Commit(writer);
+  t.join();
+  EXPECT_TRUE(granted);
+  EXPECT_TRUE(writer->GetTableLockMap()->empty());
+  EXPECT_TRUE(scanner->GetTableLockMap()->empty());
+
+  // Holding IS and IX, then asking for S, ends in SIX.
+  EXPECT_TRUE(lock_mgr.LockRow(reader, LockMode::EXCLUSIVE, oid, RID{0, 1}));
+  EXPECT_EQ(LockMode::INTENTION_EXCLUSIVE, reader->GetTableLockMap()->at(oid));
+  EXPECT_TRUE(lock_mgr.LockTable(reader, LockMode::SHARED, oid));
+  EXPECT_EQ(LockMode::SHARED_INTENTION_EXCLUSIVE, reader->GetTableLockMap()->at(oid));
+
+  // Rows go before their table.
+  try {
+    lock_mgr.UnlockTable(reader, oid);
+  } catch (TransactionAbortException &e) {
+    EXPECT_EQ(AbortReason::TABLE_UNLOCKED_BEFORE_UNLOCKING_ROWS, e.GetAbortReason());
+  }
+  CheckAborted(reader);
+  txn_mgr.Abort(reader);
+  CheckTxnLockSize(reader, 0, 0);
+  EXPECT_TRUE(reader->GetTableLockMap()->empty());
+
+  delete reader;
+  delete writer;
+  delete scanner;
+}
+
+// Past the threshold, row locks on a table are traded for a table lock
+TEST(LockManagerTest, LockEscalationTest) {
+  const size_t threshold = 10;
+  LockManager lock_mgr{threshold};
+  TransactionManager txn_mgr{&lock_mgr};
+  const table_oid_t oid = 0;
+  auto *txn = txn_mgr.Begin();
+
+  for (uint32_t i = 0; i < threshold; i++) {
+    EXPECT_TRUE(lock_mgr.LockRow(txn, LockMode::SHARED, oid, RID{0, i}));
+  }
+  EXPECT_EQ(0, lock_mgr.GetEscalationCount());
+  CheckTxnLockSize(txn, threshold, 0);
+
+  EXPECT_TRUE(lock_mgr.LockRow(txn, LockMode::SHARED, oid, RID{0, threshold}));
+  EXPECT_EQ(1, lock_mgr.GetEscalationCount());
+  EXPECT_EQ(LockMode::SHARED, txn->GetTableLockMap()->at(oid));
+  CheckTxnLockSize(txn, 0, 0);
+  CheckGrowing(txn);
+
+  // Writes take SIX and row locks again, until those are escalated too.
+  for (uint32_t i = 0; i <= threshold; i++) {
+    EXPECT_TRUE(lock_mgr.LockRow(txn, LockMode::EXCLUSIVE, oid, RID{1, i}));
+  }
+  EXPECT_EQ(2, lock_mgr.GetEscalationCount());
+  EXPECT_EQ(LockMode::EXCLUSIVE, txn->GetTableLockMap()->at(oid));
+  CheckTxnLockSize(txn, 0, 0);
+
+  // Another transaction cannot read the table until the escalated lock is released.
+  auto *reader = txn_mgr.Begin();
+  std::atomic<bool> granted{false};
+  std::thread t([&] {
+    EXPECT_TRUE(lock_mgr.LockRow(reader, LockMode::SHARED, oid, RID{0, 0}));
+    granted = true;
+    txn_mgr.Commit(reader);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  txn_mgr.Commit(txn);
+  t.join();
+  EXPECT_TRUE(granted);
+
+  delete txn;
+  delete reader;
+}
+
+// A table heap locks its rows under its table, so they are escalated like any other row locks
+TEST(LockManagerTest, TableHeapEscalationTest) {
+  const size_t threshold = 5;
+  DiskManagerMemory disk_manager;
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_mgr{threshold};
+  TransactionManager txn_mgr{&lock_mgr, &log_manager};
+  log_manager.RunFlushThread();
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  const table_oid_t oid = 7;
+
+  // Inserts are escalated too, and the commit applies a delete under the escalated lock.
+  auto *loader = txn_mgr.Begin();
+  TableHeap table(&bpm, &lock_mgr, &log_manager, loader, oid);
+  const int num_tuples = 2 * threshold;
+  std::vector<RID> rids(num_tuples);
+  for (int i = 0; i < num_tuples; i++) {
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema), &rids[i], loader));
+  }
+  EXPECT_EQ(1, lock_mgr.GetEscalationCount());
+  EXPECT_EQ(LockMode::EXCLUSIVE, loader->GetTableLockMap()->at(oid));
+  ASSERT_TRUE(table.MarkDelete(rids[0], loader));
+  txn_mgr.Commit(loader);
+  CheckCommitted(loader);
+
+  // Past the threshold, a writer holds the whole table: a reader of a row it never touched waits for it.
+  auto *writer = txn_mgr.Begin();
+  for (size_t i = 1; i <= threshold + 1; i++) {
+    ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(100)}, &schema), rids[i], writer));
+  }
+  EXPECT_EQ(2, lock_mgr.GetEscalationCount());
+  EXPECT_EQ(LockMode::EXCLUSIVE, writer->GetTableLockMap()->at(oid));
+  CheckTxnLockSize(writer, 0, 0);
+
+  auto *reader = txn_mgr.Begin();
+  std::atomic<bool> granted{false};
+  std::thread t([&] {
+    Tuple tuple;
+    EXPECT_TRUE(table.GetTuple(rids[num_tuples - 1], &tuple, reader));
+    granted = true;
+    txn_mgr.Commit(reader);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  txn_mgr.Commit(writer);
+  t.join();
+  EXPECT_TRUE(granted);
+  log_manager.StopFlushThread();
+
+  delete loader;
+  delete writer;
+  delete reader;
+}
+
+/*
+ * One transaction locks every row of a large table exclusively, with and without escalation.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=LockManagerTest.DISABLED_LockEscalationBenchmark
+ */
+TEST(LockManagerTest, DISABLED_LockEscalationBenchmark) {
+  const uint32_t num_rows = 1 << 20;
+  for (size_t threshold : {static_cast<size_t>(num_rows), static_cast<size_t>(LOCK_ESCALATION_THRESHOLD)}) {
+    LockManager lock_mgr{threshold};
+    TransactionManager txn_mgr{&lock_mgr};
+    auto *txn = txn_mgr.Begin();
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < num_rows; i++) {
+      lock_mgr.LockRow(txn, LockMode::EXCLUSIVE, 0, RID{static_cast<page_id_t>(i / 64), i % 64});
+    }
+    size_t row_locks = txn->GetExclusiveLockSet()->size();
+    txn_mgr.Commit(txn);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("threshold %8zu: %8zu row locks held, %12.0f rows/sec\n", threshold, row_locks, num_rows / elapsed);
+    delete txn;
+  }
+}
+
 TEST(LockManagerTest, GraphEdgeTest) {
   LockManager lock_mgr{};
   TransactionManager txn_mgr{&lock_mgr};
@@ -285,4 +614,112 @@ TEST(LockManagerTest, BasicDeadlockDetectionTest) {
   delete txn0;
   delete txn1;
 }
+
+// Transactions that each hold a row and wait for the next one's: only the youngest is aborted
+TEST(LockManagerTest, DeadlockRingTest) {
+  LockManager lock_mgr{};
+  cycle_detection_interval = std::chrono::milliseconds(50);
+  TransactionManager txn_mgr{&lock_mgr};
+  const int num_txns = 8;
+  std::vector<Transaction *> txns;
+  for (int i = 0; i < num_txns; i++) {
+    txns.push_back(txn_mgr.Begin());
+  }
+
+  std::atomic<int> holding{0};
+  std::atomic<int> aborted{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_txns; i++) {
+    threads.emplace_back([&, i] {
+      EXPECT_TRUE(lock_mgr.LockExclusive(txns[i], RID{i, 0}));
+      holding++;
+      while (holding < num_txns) {
+        std::this_thread::yield();
+      }
+      try {
+        EXPECT_TRUE(lock_mgr.LockExclusive(txns[i], RID{(i + 1) % num_txns, 0}));
+        txn_mgr.Commit(txns[i]);
+      } catch (TransactionAbortException &e) {
+        EXPECT_EQ(AbortReason::DEADLOCK, e.GetAbortReason());
+        CheckAborted(txns[i]);
+        aborted++;
+        txn_mgr.Abort(txns[i]);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(1, aborted);
+  CheckAborted(txns[num_txns - 1]);
+  for (int i = 0; i < num_txns - 1; i++) {
+    CheckCommitted(txns[i]);
+  }
+  EXPECT_EQ(1, lock_mgr.GetDeadlockCount());
+  EXPECT_GT(lock_mgr.GetDeadlockTime().count(), 0);
+  EXPECT_EQ(lock_mgr.GetDeadlockTime(), lock_mgr.GetMaxDeadlockTime());
+
+  for (auto *txn : txns) {
+    delete txn;
+  }
+}
+
+/*
+ * Pairs of transactions deadlock on two rows each, from 100 to 2000 transactions waiting at once.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=LockManagerTest.DISABLED_DeadlockDetectionBenchmark
+ */
+TEST(LockManagerTest, DISABLED_DeadlockDetectionBenchmark) {
+  cycle_detection_interval = std::chrono::milliseconds(1);
+  for (int num_txns = 100; num_txns <= 2000; num_txns *= 2) {
+    LockManager lock_mgr{};
+    lock_mgr.StopCycleDetection();
+    TransactionManager txn_mgr{&lock_mgr};
+    std::vector<Transaction *> txns;
+    for (int i = 0; i < num_txns; i++) {
+      txns.push_back(txn_mgr.Begin());
+    }
+
+    // Every transaction locks its own row, then the row of the other one in its pair.
+    std::atomic<int> holding{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_txns; i++) {
+      threads.emplace_back([&, i] {
+        lock_mgr.LockExclusive(txns[i], RID{i, 0});
+        holding++;
+        while (holding < num_txns) {
+          std::this_thread::yield();
+        }
+        try {
+          lock_mgr.LockExclusive(txns[i], RID{i ^ 1, 0});
+          txn_mgr.Commit(txns[i]);
+        } catch (TransactionAbortException &e) {
+          txn_mgr.Abort(txns[i]);
+        }
+      });
+    }
+    // Give every transaction the time to block before the detector runs.
+    while (holding < num_txns) {
+      std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto start = std::chrono::steady_clock::now();
+    lock_mgr.RunCycleDetection();
+    while (lock_mgr.GetDeadlockCount() < static_cast<size_t>(num_txns / 2)) {
+      std::this_thread::yield();
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    lock_mgr.StopCycleDetection();
+
+    EXPECT_EQ(num_txns / 2, lock_mgr.GetDeadlockCount());
+    printf("%4d txns: %4zu deadlocks broken after %8.1f ms\n", num_txns, lock_mgr.GetDeadlockCount(), elapsed);
+    for (auto *txn : txns) {
+      delete txn;
+    }
+  }
+}
+
 }  // namespace bustub
@@ -0,0 +1,290 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// mvcc_test.cpp
+//
+// Identification: test/concurrency/mvcc_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "storage/table/table_heap.h"
+#include "test_util.h"  // NOLINT
+#include "type/value_factory.h"
+
+namespace bustub {
+
+using MVCCTest = TableHeapTest;
+
+TEST_F(MVCCTest, SnapshotReadTest) {
+  StartLogging();
+
+  const int num_tuples = 10;
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  TableHeap table(&bpm_, &lock_manager_, &log_manager_, loader);
+  std::vector<RID> rids(num_tuples);
+  for (int i = 0; i < num_tuples; i++) {
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema_), &rids[i], loader));
+  }
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto *writer = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  RID new_rid;
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(100)}, &schema_), rids[0], writer));
+  ASSERT_TRUE(table.MarkDelete(rids[1], writer));
+  ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(200)}, &schema_), &new_rid, writer));
+
+  // The reader neither waits for the writer's exclusive locks nor sees its changes.
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 0);
+  ASSERT_TRUE(table.GetTuple(rids[1], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 1);
+  EXPECT_FALSE(table.GetTuple(new_rid, &tuple, reader));
+  EXPECT_EQ(CountTuples(&table, reader), num_tuples);
+  EXPECT_TRUE(reader->GetSharedLockSet()->empty());
+  EXPECT_EQ(reader->GetState(), TransactionState::GROWING);
+
+  // The writer sees its own changes.
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, writer));
+  EXPECT_EQ(ValueOf(tuple, schema_), 100);
+  EXPECT_FALSE(table.GetTuple(rids[1], &tuple, writer));
+  EXPECT_EQ(CountTuples(&table, writer), num_tuples);
+  ASSERT_TRUE(txn_manager_.Commit(writer));
+
+  // Once the delete is applied the deleted tuple only lives on in the version store, the reader still sees it.
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 0);
+  ASSERT_TRUE(table.GetTuple(rids[1], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 1);
+  EXPECT_FALSE(table.GetTuple(new_rid, &tuple, reader));
+  EXPECT_EQ(CountTuples(&table, reader), num_tuples);
+  ASSERT_TRUE(txn_manager_.Commit(reader));
+
+  // A later snapshot sees the writer's changes.
+  auto *later = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 100);
+  EXPECT_FALSE(table.GetTuple(rids[1], &tuple, later));
+  ASSERT_TRUE(table.GetTuple(new_rid, &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 200);
+  EXPECT_EQ(CountTuples(&table, later), num_tuples);
+  ASSERT_TRUE(txn_manager_.Commit(later));
+
+  for (auto *txn : {loader, reader, writer, later}) {
+    delete txn;
+  }
+}
+
+TEST_F(MVCCTest, WriteConflictTest) {
+  StartLogging();
+
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  TableHeap table(&bpm_, &lock_manager_, &log_manager_, loader);
+  RID rid;
+  ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(0)}, &schema_), &rid, loader));
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+
+  // Both transactions update the tuple, the one that commits second wrote over a version it did not see.
+  auto *first = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto *second = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(1)}, &schema_), rid, first));
+  ASSERT_TRUE(txn_manager_.Commit(first));
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(2)}, &schema_), rid, second));
+  EXPECT_FALSE(txn_manager_.Commit(second));
+  EXPECT_EQ(second->GetState(), TransactionState::ABORTED);
+
+  // While an update is pending, another writer of the tuple aborts right away.
+  auto *pending = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto *blocked = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(3)}, &schema_), rid, pending));
+  EXPECT_FALSE(table.MarkDelete(rid, blocked));
+  EXPECT_EQ(blocked->GetState(), TransactionState::ABORTED);
+  txn_manager_.Abort(blocked);
+  txn_manager_.Abort(pending);
+
+  // An aborted insert is never seen.
+  auto *inserter = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  RID new_rid;
+  ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(4)}, &schema_), &new_rid, inserter));
+  txn_manager_.Abort(inserter);
+
+  auto *later = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rid, &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 1);
+  EXPECT_FALSE(table.GetTuple(new_rid, &tuple, later));
+  EXPECT_EQ(CountTuples(&table, later), 1);
+  ASSERT_TRUE(txn_manager_.Commit(later));
+
+  for (auto *txn : {loader, first, second, pending, blocked, inserter, later}) {
+    delete txn;
+  }
+}
+
+TEST_F(MVCCTest, ReadOnlyTest) {
+  StartLogging();
+
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  TableHeap table(&bpm_, &lock_manager_, &log_manager_, loader);
+  RID rid;
+  ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(0)}, &schema_), &rid, loader));
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+
+  // A read-only transaction has nothing to track but the index pages it latches.
+  auto *snapshot = txn_manager_.BeginReadOnly();
+  auto *committed = txn_manager_.BeginReadOnly(nullptr, IsolationLevel::READ_COMMITTED);
+  EXPECT_TRUE(snapshot->IsReadOnly());
+  EXPECT_EQ(snapshot->GetWriteSet(), nullptr);
+  EXPECT_EQ(snapshot->GetSharedLockSet(), nullptr);
+  EXPECT_NE(snapshot->GetPageSet(), nullptr);
+  EXPECT_EQ(txn_manager_.GetOldestReadTs(), snapshot->GetReadTs());
+
+  // Neither sees a pending update, nor waits for the writer's lock.
+  auto *writer = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(1)}, &schema_), rid, writer));
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rid, &tuple, snapshot));
+  EXPECT_EQ(ValueOf(tuple, schema_), 0);
+  ASSERT_TRUE(table.GetTuple(rid, &tuple, committed));
+  EXPECT_EQ(ValueOf(tuple, schema_), 0);
+  ASSERT_TRUE(txn_manager_.Commit(writer));
+
+  // Once the update commits, only the read committed transaction sees it.
+  ASSERT_TRUE(table.GetTuple(rid, &tuple, snapshot));
+  EXPECT_EQ(ValueOf(tuple, schema_), 0);
+  ASSERT_TRUE(table.GetTuple(rid, &tuple, committed));
+  EXPECT_EQ(ValueOf(tuple, schema_), 1);
+  EXPECT_EQ(CountTuples(&table, snapshot), 1);
+
+  // A read-only transaction cannot write.
+  EXPECT_FALSE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(2)}, &schema_), rid, committed));
+  EXPECT_EQ(committed->GetState(), TransactionState::ABORTED);
+  txn_manager_.Abort(committed);
+  ASSERT_TRUE(txn_manager_.Commit(snapshot));
+  EXPECT_EQ(txn_manager_.GetOldestReadTs(), txn_manager_.GetLastCommitTs());
+
+  for (auto *txn : {loader, snapshot, committed, writer}) {
+    delete txn;
+  }
+}
+
+TEST_F(MVCCTest, TrimVersionsTest) {
+  StartLogging();
+
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  TableHeap table(&bpm_, &lock_manager_, &log_manager_, loader);
+  std::vector<RID> rids(3);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema_), &rids[i], loader));
+  }
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+  EXPECT_EQ(table.GetVersionStore()->GetVersionCount(), 0U);
+
+  // A transaction that locks what it reads does not keep the replaced versions around.
+  auto *locking = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  auto *writer = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(10)}, &schema_), rids[0], writer));
+  ASSERT_TRUE(table.MarkDelete(rids[1], writer));
+  EXPECT_EQ(table.GetVersionStore()->GetVersionCount(), 2U);
+  ASSERT_TRUE(txn_manager_.Commit(writer));
+  EXPECT_EQ(table.GetVersionStore()->GetVersionCount(), 0U);
+
+  // An older snapshot does.
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto *updater = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(20)}, &schema_), rids[2], updater));
+  ASSERT_TRUE(txn_manager_.Commit(updater));
+  EXPECT_EQ(table.GetVersionStore()->GetVersionCount(), 1U);
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rids[2], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 2);
+  ASSERT_TRUE(txn_manager_.Commit(reader));
+  ASSERT_TRUE(txn_manager_.Commit(locking));
+
+  for (auto *txn : {loader, locking, writer, reader, updater}) {
+    delete txn;
+  }
+}
+
+TEST_F(MVCCTest, LockWaitTest) {
+  StartLogging();
+
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  TableHeap table(&bpm_, &lock_manager_, &log_manager_, loader);
+  std::vector<RID> rids(3);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema_), &rids[i], loader));
+  }
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+
+  // The writers wait for the reader's shared lock without holding the page latch, so the reader can go on reading
+  // the page and commit.
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  auto *updater = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  auto *deleter = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, reader));
+  ASSERT_TRUE(table.GetTuple(rids[1], &tuple, reader));
+  std::thread update_thread(
+      [&] { EXPECT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(10)}, &schema_), rids[0], updater)); });
+  std::thread delete_thread([&] { EXPECT_TRUE(table.MarkDelete(rids[1], deleter)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_TRUE(table.GetTuple(rids[2], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 2);
+  ASSERT_TRUE(txn_manager_.Commit(reader));
+  update_thread.join();
+  delete_thread.join();
+  // Applying the delete latches the page, while the updater is done with it.
+  ASSERT_TRUE(txn_manager_.Commit(deleter));
+  ASSERT_TRUE(txn_manager_.Commit(updater));
+
+  auto *later = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 10);
+  EXPECT_EQ(CountTuples(&table, later), 2);
+  ASSERT_TRUE(txn_manager_.Commit(later));
+
+  for (auto *txn : {loader, reader, updater, deleter, later}) {
+    delete txn;
+  }
+}
+
+/**
+ * The cost of beginning and committing an empty transaction, with logging on. The read-write one commits
+ * asynchronously, so it does not wait for the log flush.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=MVCCTest.DISABLED_ReadOnlyBeginCommitBenchmark
+ */
+TEST_F(MVCCTest, DISABLED_ReadOnlyBeginCommitBenchmark) {
+  const int num_txns = 100000;
+  StartLogging();
+  for (bool read_only : {false, true}) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_txns; i++) {
+      Transaction *txn;
+      if (read_only) {
+        txn = txn_manager_.BeginReadOnly();
+      } else {
+        txn = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+        txn->SetAsyncCommit(true);
+      }
+      txn_manager_.Commit(txn);
+      delete txn;
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-10s: %12.0f txns/sec\n", read_only ? "read-only" : "read-write", num_txns / elapsed);
+  }
+}
+
+}  // namespace bustub
@@ -0,0 +1,214 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// optimistic_test.cpp
+//
+// Identification: test/concurrency/optimistic_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <random>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "storage/table/table_heap.h"
+#include "test_util.h"  // NOLINT
+#include "type/value_factory.h"
+
+namespace bustub {
+
+using OptimisticTest = TableHeapTest;
+
+TEST_F(OptimisticTest, BufferedWriteTest) {
+  StartLogging();
+
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  TableHeap table(&bpm_, &lock_manager_, &log_manager_, loader);
+  std::vector<RID> rids(2);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema_), &rids[i], loader));
+  }
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+
+  auto *writer = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  RID new_rid;
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(100)}, &schema_), rids[0], writer));
+  ASSERT_TRUE(table.MarkDelete(rids[1], writer));
+  ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(200)}, &schema_), &new_rid, writer));
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(300)}, &schema_), new_rid, writer));
+
+  // Nothing the writer did is in the table yet, and nobody took a lock.
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 0);
+  ASSERT_TRUE(table.GetTuple(rids[1], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple, schema_), 1);
+  EXPECT_FALSE(table.GetTuple(new_rid, &tuple, reader));
+  EXPECT_TRUE(writer->GetExclusiveLockSet()->empty());
+  EXPECT_TRUE(reader->GetSharedLockSet()->empty());
+
+  // The writer sees its own writes.
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, writer));
+  EXPECT_EQ(ValueOf(tuple, schema_), 100);
+  EXPECT_FALSE(table.GetTuple(rids[1], &tuple, writer));
+  ASSERT_TRUE(table.GetTuple(new_rid, &tuple, writer));
+  EXPECT_EQ(ValueOf(tuple, schema_), 300);
+  ASSERT_TRUE(txn_manager_.Commit(writer));
+
+  // The reader read what the writer changed, it cannot commit.
+  EXPECT_FALSE(txn_manager_.Commit(reader));
+  EXPECT_EQ(reader->GetState(), TransactionState::ABORTED);
+
+  auto *later = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 100);
+  EXPECT_FALSE(table.GetTuple(rids[1], &tuple, later));
+  ASSERT_TRUE(table.GetTuple(new_rid, &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 300);
+  ASSERT_TRUE(txn_manager_.Commit(later));
+
+  for (auto *txn : {loader, writer, reader, later}) {
+    delete txn;
+  }
+}
+
+TEST_F(OptimisticTest, ValidationTest) {
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  TableHeap table(&bpm_, &lock_manager_, nullptr, loader);
+  std::vector<RID> rids(2);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema_), &rids[i], loader));
+  }
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+
+  // Write skew: each reads the row the other writes. The first to commit wins, the second read a stale row.
+  auto *first = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  auto *second = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, first));
+  ASSERT_TRUE(table.GetTuple(rids[1], &tuple, second));
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(10)}, &schema_), rids[1], first));
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(20)}, &schema_), rids[0], second));
+  RID new_rid;
+  ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(30)}, &schema_), &new_rid, second));
+  ASSERT_TRUE(txn_manager_.Commit(first));
+  EXPECT_FALSE(txn_manager_.Commit(second));
+
+  // Only the first transaction's write is in the table, the second one's insert is gone.
+  auto *later = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 0);
+  ASSERT_TRUE(table.GetTuple(rids[1], &tuple, later));
+  EXPECT_EQ(ValueOf(tuple, schema_), 10);
+  EXPECT_FALSE(table.GetTuple(new_rid, &tuple, later));
+  ASSERT_TRUE(txn_manager_.Commit(later));
+
+  // A transaction that only wrote a row it read itself commits.
+  auto *writer = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(40)}, &schema_), rids[0], writer));
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(50)}, &schema_), rids[0], writer));
+  ASSERT_TRUE(txn_manager_.Commit(writer));
+  auto *check = txn_manager_.Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  ASSERT_TRUE(table.GetTuple(rids[0], &tuple, check));
+  EXPECT_EQ(ValueOf(tuple, schema_), 50);
+  ASSERT_TRUE(txn_manager_.Commit(check));
+
+  for (auto *txn : {loader, first, second, later, writer, check}) {
+    delete txn;
+  }
+}
+
+/**
+ * Read-modify-write transactions over a hot set of rows, with locks and optimistically. The 2PL transactions lock
+ * their rows exclusively up front, a shared lock they upgraded later would deadlock with the other readers of the row.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=OptimisticTest.DISABLED_ContentionBenchmark
+ */
+TEST_F(OptimisticTest, DISABLED_ContentionBenchmark) {
+  const int num_threads = 8;
+  const int txns_per_thread = 200;
+  const int rows_per_txn = 4;
+  for (int num_rows : {10000, 16}) {
+    for (auto isolation_level : {IsolationLevel::REPEATABLE_READ, IsolationLevel::OPTIMISTIC}) {
+      auto *loader = txn_manager_.Begin(nullptr, isolation_level);
+      TableHeap table(&bpm_, &lock_manager_, nullptr, loader);
+      std::vector<RID> rids(num_rows);
+      for (int i = 0; i < num_rows; i++) {
+        table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(0)}, &schema_), &rids[i], loader);
+      }
+      txn_manager_.Commit(loader);
+      delete loader;
+
+      std::atomic<int> aborts{0};
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int tid = 0; tid < num_threads; tid++) {
+        threads.emplace_back([&, tid] {
+          std::mt19937 gen(tid);
+          std::uniform_int_distribution<int> row(0, num_rows - 1);
+          for (int i = 0; i < txns_per_thread; i++) {
+            std::vector<RID> picked;
+            for (int r = 0; r < rows_per_txn; r++) {
+              picked.push_back(rids[row(gen)]);
+            }
+            while (true) {
+              auto *txn = txn_manager_.Begin(nullptr, isolation_level);
+              bool ok = true;
+              try {
+                for (const auto &rid : picked) {
+                  if (isolation_level != IsolationLevel::OPTIMISTIC) {
+                    lock_manager_.LockRow(txn, LockMode::EXCLUSIVE, table.GetOid(), rid);
+                  }
+                  Tuple tuple;
+                  ok = ok && table.GetTuple(rid, &tuple, txn) &&
+                       table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(ValueOf(tuple, schema_) + 1)}, &schema_),
+                                         rid, txn);
+                }
+              } catch (TransactionAbortException &e) {
+                ok = false;
+              }
+              if (!ok) {
+                txn_manager_.Abort(txn);
+              }
+              ok = ok && txn_manager_.Commit(txn);
+              delete txn;
+              if (ok) {
+                break;
+              }
+              aborts++;
+            }
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      const char *name = isolation_level == IsolationLevel::OPTIMISTIC ? "optimistic" : "2PL";
+      printf("%5d rows, %-10s: %10.0f txns/sec, %6d aborts\n", num_rows, name, num_threads * txns_per_thread / elapsed,
+             aborts.load());
+
+      // No increment got lost.
+      auto *checker = txn_manager_.Begin(nullptr, isolation_level);
+      int total = 0;
+      for (const auto &rid : rids) {
+        Tuple tuple;
+        table.GetTuple(rid, &tuple, checker);
+        total += ValueOf(tuple, schema_);
+      }
+      txn_manager_.Commit(checker);
+      delete checker;
+      EXPECT_EQ(total, num_threads * txns_per_thread * rows_per_txn);
+    }
+  }
+}
+
+}  // namespace bustub
@@ -0,0 +1,165 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry_test.cpp
+//
+// Identification: test/concurrency/transaction_registry_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+TEST(TransactionRegistryTest, RunningTransactionsTest) {
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager);
+
+  // Only running transactions are found, a finished one is gone from the registry.
+  std::vector<Transaction *> txns;
+  for (int i = 0; i < 2 * TXN_REGISTRY_SHARDS; i++) {
+    txns.push_back(txn_manager.Begin());
+  }
+  for (auto *txn : txns) {
+    EXPECT_EQ(txn_manager.GetTransaction(txn->GetTransactionId()).Get(), txn);
+  }
+  lsn_t oldest_lsn;
+  EXPECT_EQ(txn_manager.GetActiveTransactionTable(&oldest_lsn).size(), txns.size());
+  for (size_t i = 0; i < txns.size(); i++) {
+    if (i % 2 == 0) {
+      txn_manager.Commit(txns[i]);
+    } else {
+      txn_manager.Abort(txns[i]);
+    }
+    EXPECT_EQ(txn_manager.GetTransaction(txns[i]->GetTransactionId()).Get(), nullptr);
+  }
+  EXPECT_TRUE(txn_manager.GetActiveTransactionTable(&oldest_lsn).empty());
+
+  for (auto *txn : txns) {
+    delete txn;
+  }
+}
+
+TEST(TransactionRegistryTest, ConcurrentBeginTest) {
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager);
+  const int num_threads = 8;
+  const int txns_per_thread = 1000;
+
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&txn_manager] {
+      for (int i = 0; i < txns_per_thread; i++) {
+        auto *txn = txn_manager.Begin();
+        EXPECT_EQ(txn_manager.GetTransaction(txn->GetTransactionId()).Get(), txn);
+        txn_manager.Commit(txn);
+        txn_manager.Retire(txn);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  lsn_t oldest_lsn;
+  EXPECT_TRUE(txn_manager.GetActiveTransactionTable(&oldest_lsn).empty());
+}
+
+TEST(TransactionRegistryTest, HandleTest) {
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager);
+
+  // A transaction finishes without waiting for the handles found on it, and its owner retires it: it is not freed
+  // while a handle is held, so the handle still reads it.
+  auto *txn = txn_manager.Begin();
+  txn_id_t txn_id = txn->GetTransactionId();
+  {
+    auto handle = txn_manager.GetTransaction(txn_id);
+    ASSERT_EQ(handle.Get(), txn);
+    std::thread committer([&] {
+      txn_manager.Commit(txn);
+      txn_manager.Retire(txn);
+    });
+    committer.join();
+    EXPECT_FALSE(txn_manager.GetTransaction(txn_id));
+    EXPECT_EQ(handle->GetTransactionId(), txn_id);
+    EXPECT_EQ(handle->GetState(), TransactionState::COMMITTED);
+  }
+}
+
+TEST(TransactionRegistryTest, CheckpointBarrierTest) {
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager);
+
+  // Blocking waits for the running transactions, of every shard, and keeps new ones from beginning until resumed.
+  std::vector<Transaction *> txns;
+  for (int i = 0; i < TXN_REGISTRY_SHARDS; i++) {
+    txns.push_back(txn_manager.Begin());
+  }
+  std::atomic<bool> blocked{false};
+  std::thread checkpoint([&] {
+    txn_manager.BlockAllTransactions();
+    blocked = true;
+  });
+  for (auto *txn : txns) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_FALSE(blocked);
+    txn_manager.Commit(txn);
+    delete txn;
+  }
+  checkpoint.join();
+  EXPECT_TRUE(blocked);
+
+  std::atomic<bool> begun{false};
+  std::thread beginner([&] {
+    auto *txn = txn_manager.Begin();
+    begun = true;
+    txn_manager.Commit(txn);
+    delete txn;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(begun);
+  txn_manager.ResumeTransactions();
+  beginner.join();
+  EXPECT_TRUE(begun);
+}
+
+/**
+ * Begin and commit empty transactions on a growing number of threads.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=TransactionRegistryTest.DISABLED_BeginThroughputBenchmark
+ */
+TEST(TransactionRegistryTest, DISABLED_BeginThroughputBenchmark) {
+  const int total_txns = 1 << 18;
+  for (int num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager);
+    const int txns_per_thread = total_txns / num_threads;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; tid++) {
+      threads.emplace_back([&txn_manager, txns_per_thread] {
+        for (int i = 0; i < txns_per_thread; i++) {
+          auto *txn = txn_manager.Begin();
+          txn_manager.Commit(txn);
+          txn_manager.Retire(txn);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%2d threads: %12.0f txns/sec\n", num_threads, num_threads * txns_per_thread / elapsed);
+  }
+}
+
+}  // namespace bustub
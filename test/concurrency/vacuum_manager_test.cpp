@@ -0,0 +1,137 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// vacuum_manager_test.cpp
+//
+// Identification: test/concurrency/vacuum_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>  // NOLINT
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "concurrency/transaction_manager.h"
+#include "concurrency/vacuum_manager.h"
+#include "gtest/gtest.h"
+#include "storage/index/b_plus_tree_index.h"
+#include "storage/table/table_heap.h"
+#include "test_util.h"  // NOLINT
+#include "type/value_factory.h"
+
+namespace bustub {
+
+using VacuumManagerTest = TableHeapTest;
+using IntegerIndex = BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>;
+
+/** @return the rids the index has for the tuple's key */
+std::vector<RID> Lookup(Index *index, Tuple *tuple, const Schema &schema) {
+  Transaction txn(INVALID_TXN_ID);
+  std::vector<RID> rids;
+  index->ScanKey(tuple->KeyFromTuple(schema, *index->GetKeySchema(), index->GetKeyAttrs()), &rids, &txn);
+  return rids;
+}
+
+TEST_F(VacuumManagerTest, VacuumTest) {
+  // The index keeps its root in the header page.
+  page_id_t header_page_id;
+  bpm_.NewPage(&header_page_id);
+  bpm_.UnpinPage(header_page_id, true);
+  IntegerIndex index(std::make_unique<IndexMetadata>("a_index", "t", &schema_, std::vector<uint32_t>{0}), &bpm_);
+
+  // Fill three pages, and index every tuple.
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  TableHeap table(&bpm_, &lock_manager_, nullptr, loader);
+  std::vector<Tuple> tuples;
+  std::vector<page_id_t> page_ids;
+  for (int i = 0; page_ids.size() < 3 || tuples.back().GetRid().GetPageId() == page_ids[2]; i++) {
+    RID rid;
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema_), &rid, loader));
+    ASSERT_TRUE(table.GetTuple(rid, &tuples.emplace_back(), loader));
+    index.InsertEntry(tuples.back().KeyFromTuple(schema_, *index.GetKeySchema(), index.GetKeyAttrs()), rid, loader);
+    if (page_ids.empty() || page_ids.back() != rid.GetPageId()) {
+      page_ids.push_back(rid.GetPageId());
+    }
+  }
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+  const auto num_tuples = static_cast<int>(tuples.size());
+
+  // Delete every tuple on the middle page while an older snapshot is still running.
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto *deleter = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  int deleted = 0;
+  for (const auto &tuple : tuples) {
+    if (tuple.GetRid().GetPageId() == page_ids[1]) {
+      ASSERT_TRUE(table.MarkDelete(tuple.GetRid(), deleter));
+      deleted++;
+    }
+  }
+  ASSERT_TRUE(txn_manager_.Commit(deleter));
+
+  VacuumManager vacuum(&txn_manager_, &bpm_);
+  vacuum.AddTable(&table, &schema_, {&index});
+  vacuum.Vacuum();
+  EXPECT_EQ(vacuum.GetRemovedEntryCount(), 0U);
+  EXPECT_EQ(CountTuples(&table, reader), num_tuples);
+  ASSERT_TRUE(txn_manager_.Commit(reader));
+
+  // Nobody sees the deleted tuples anymore: their versions, index entries and page go.
+  vacuum.Vacuum();
+  EXPECT_EQ(table.GetVersionStore()->GetVersionCount(), 0U);
+  EXPECT_EQ(vacuum.GetRemovedEntryCount(), static_cast<size_t>(deleted));
+  EXPECT_EQ(vacuum.GetFreedPageCount(), 0U);
+  for (auto &tuple : tuples) {
+    auto rids = Lookup(&index, &tuple, schema_);
+    EXPECT_EQ(rids.size(), tuple.GetRid().GetPageId() == page_ids[1] ? 0U : 1U);
+  }
+  auto *later = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  EXPECT_EQ(CountTuples(&table, later), num_tuples - deleted);
+  ASSERT_TRUE(txn_manager_.Commit(later));
+
+  // The unlinked page is handed back to the buffer pool by the next round, and its id is reused.
+  vacuum.Vacuum();
+  EXPECT_EQ(vacuum.GetFreedPageCount(), 1U);
+  page_id_t page_id;
+  ASSERT_NE(bpm_.NewPage(&page_id), nullptr);
+  EXPECT_EQ(page_id, page_ids[1]);
+  bpm_.UnpinPage(page_id, false);
+
+  for (auto *txn : {loader, reader, deleter, later}) {
+    delete txn;
+  }
+}
+
+TEST_F(VacuumManagerTest, CostLimitTest) {
+  auto *loader = txn_manager_.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  TableHeap table(&bpm_, &lock_manager_, nullptr, loader);
+  RID rid;
+  for (int i = 0; rid.GetPageId() == INVALID_PAGE_ID || rid.GetPageId() == table.GetFirstPageId(); i++) {
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema_), &rid, loader));
+  }
+  ASSERT_TRUE(txn_manager_.Commit(loader));
+  delete loader;
+
+  // One page per nap: the second page is only visited after a nap.
+  const auto cost_delay = std::chrono::milliseconds(50);
+  VacuumManager vacuum(&txn_manager_, &bpm_, 1, cost_delay);
+  vacuum.AddTable(&table, &schema_);
+  auto start = std::chrono::steady_clock::now();
+  vacuum.Vacuum();
+  EXPECT_GE(std::chrono::steady_clock::now() - start, cost_delay);
+  EXPECT_EQ(table.GetVersionStore()->GetVersionCount(), 0U);
+
+  // Stopping the vacuum thread cuts its nap short.
+  vacuum_interval = std::chrono::milliseconds(1);
+  vacuum.RunVacuumThread();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  start = std::chrono::steady_clock::now();
+  vacuum.StopVacuumThread();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, cost_delay);
+  vacuum_interval = std::chrono::seconds(1);
+}
+
+}  // namespace bustub
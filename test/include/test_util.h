@@ -14,17 +14,25 @@
 
 #include <sys/stat.h>
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "buffer/buffer_pool_manager_instance.h"
 #include "catalog/schema.h"
+#include "common/bustub_instance.h"
 #include "common/exception.h"
 #include "common/logger.h"
 #include "common/util/string_util.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "recovery/log_manager.h"
+#include "storage/disk/disk_manager_memory.h"
 #include "storage/page/header_page.h"
+#include "storage/table/table_heap.h"
 
 namespace bustub {
 
@@ -92,4 +100,65 @@ std::unique_ptr<Schema> ParseCreateStatement(const std::string &sql_base) {
   return std::make_unique<Schema>(v);
 }
 
+/** The value of the single integer column of a tuple. */
+int32_t ValueOf(const Tuple &tuple, const Schema &schema) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); }
+
+/** @return the number of tuples a scan of the table sees */
+int CountTuples(TableHeap *table, Transaction *txn) {
+  int count = 0;
+  for (auto iter = table->Begin(txn); iter != table->End(); ++iter) {
+    count++;
+  }
+  return count;
+}
+
+/**
+ * TableHeapTest is the fixture of the tests that run transactions against table heaps: an in-memory disk, a buffer
+ * pool, the lock and transaction managers, and the schema of a single integer column. Logging stays off unless the
+ * test turns it on with StartLogging, and is turned off again when the test ends.
+ */
+class TableHeapTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    if (enable_logging) {
+      log_manager_.StopFlushThread();
+    }
+  }
+
+  /** Turn logging on, for the tables created with log_manager_ from now on. */
+  void StartLogging() { log_manager_.RunFlushThread(); }
+
+  DiskManagerMemory disk_manager_;
+  LogManager log_manager_{&disk_manager_};
+  BufferPoolManagerInstance bpm_{50, &disk_manager_, &log_manager_};
+  LockManager lock_manager_;
+  TransactionManager txn_manager_{&lock_manager_, &log_manager_};
+  Schema schema_{std::vector<Column>{Column("a", TypeId::INTEGER)}};
+};
+
+/**
+ * Creates the disk manager a test runs against. The backend is chosen with the BUSTUB_TEST_DISK environment variable:
+ * "file" (the default), "memory", "throttled" (the database file behind a simulated local SSD), "throttled_network"
+ * (the database file behind a simulated network volume) or "throttled_memory".
+ * @param db_file the database file name, unused by the memory backends
+ * @return a new disk manager owned by the caller
+ */
+DiskManager *CreateTestDiskManager(const std::string &db_file) {
+  const char *env = std::getenv("BUSTUB_TEST_DISK");
+  std::string backend = env == nullptr ? "file" : env;
+  if (backend == "memory") {
+    return BustubInstance::MakeDiskManager(db_file, DiskBackend::MEMORY, {});
+  }
+  if (backend == "throttled") {
+    return BustubInstance::MakeDiskManager(db_file, DiskBackend::THROTTLED_FILE, DiskThrottleConfig::LocalSsd());
+  }
+  if (backend == "throttled_network") {
+    return BustubInstance::MakeDiskManager(db_file, DiskBackend::THROTTLED_FILE, DiskThrottleConfig::NetworkVolume());
+  }
+  if (backend == "throttled_memory") {
+    return BustubInstance::MakeDiskManager(db_file, DiskBackend::THROTTLED_MEMORY, DiskThrottleConfig::LocalSsd());
+  }
+  return BustubInstance::MakeDiskManager(db_file, DiskBackend::FILE, {});
+}
+
 }  // namespace bustub
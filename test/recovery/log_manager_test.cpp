@@ -0,0 +1,435 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_manager_test.cpp
+//
+// Identification: test/recovery/log_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_recovery.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/disk/disk_manager_throttled.h"
+#include "storage/table/table_heap.h"
+#include "type/value_factory.h"
+
+namespace bustub {
+
+/** The size, lsn, txn id, prev lsn and type every log record starts with. */
+constexpr int LOG_RECORD_HEADER_SIZE = 20;
+
+/** Reads the whole log back, one record at a time. */
+std::vector<LogRecord> ReadAllLogRecords(DiskManager *disk_manager) {
+  std::vector<LogRecord> records;
+  LogRecovery log_recovery(disk_manager, nullptr);
+  std::vector<char> buffer(LOG_BUFFER_SIZE);
+  int offset = 0;
+  while (disk_manager->ReadLog(buffer.data(), LOG_BUFFER_SIZE, offset)) {
+    int pos = 0;
+    LogRecord log_record;
+    // Like LogRecovery::ScanLog, a record is only deserialized once it is known to lie within the buffer.
+    while (pos + LOG_RECORD_HEADER_SIZE <= LOG_BUFFER_SIZE) {
+      int32_t size;
+      memcpy(&size, buffer.data() + pos, sizeof(int32_t));
+      if (size < LOG_RECORD_HEADER_SIZE || pos + size > LOG_BUFFER_SIZE ||
+          !log_recovery.DeserializeLogRecord(buffer.data() + pos, &log_record)) {
+        break;
+      }
+      records.push_back(log_record);
+      pos += size;
+    }
+    if (pos == 0) {
+      break;
+    }
+    offset += pos;
+  }
+  return records;
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, AppendAndReadBackTest) {
+  DiskManagerMemory disk_manager;
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+  EXPECT_TRUE(enable_logging);
+
+  std::vector<Value> values{ValueFactory::GetIntegerValue(42)};
+  std::vector<Column> columns{Column("a", TypeId::INTEGER)};
+  Schema schema(columns);
+  Tuple old_tuple(values, &schema);
+  values[0] = ValueFactory::GetIntegerValue(43);
+  Tuple new_tuple(values, &schema);
+  RID rid(3, 7);
+
+  LogRecord begin(0, INVALID_LSN, LogRecordType::BEGIN);
+  lsn_t lsn = log_manager.AppendLogRecord(&begin);
+  EXPECT_EQ(lsn, 0);
+  LogRecord insert(0, lsn, LogRecordType::INSERT, rid, old_tuple);
+  lsn = log_manager.AppendLogRecord(&insert);
+  LogRecord update(0, lsn, LogRecordType::UPDATE, rid, old_tuple, new_tuple);
+  lsn = log_manager.AppendLogRecord(&update);
+  LogRecord new_page(0, lsn, LogRecordType::NEWPAGE, 3, 4);
+  lsn = log_manager.AppendLogRecord(&new_page);
+  LogRecord commit(0, lsn, LogRecordType::COMMIT);
+  lsn = log_manager.AppendLogRecord(&commit);
+  EXPECT_EQ(lsn, 4);
+
+  log_manager.WaitUntilPersistent(lsn);
+  EXPECT_GE(log_manager.GetPersistentLSN(), lsn);
+  log_manager.StopFlushThread();
+  EXPECT_FALSE(enable_logging);
+
+  auto records = ReadAllLogRecords(&disk_manager);
+  ASSERT_EQ(records.size(), 5);
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(records[i].GetLSN(), static_cast<lsn_t>(i));
+    EXPECT_EQ(records[i].GetTxnId(), 0);
+  }
+  EXPECT_EQ(records[1].GetLogRecordType(), LogRecordType::INSERT);
+  EXPECT_EQ(records[1].GetInsertRID(), rid);
+  EXPECT_EQ(records[1].GetInsertTuple().GetValue(&schema, 0).GetAs<int32_t>(), 42);
+  EXPECT_EQ(records[2].GetLogRecordType(), LogRecordType::UPDATE);
+  EXPECT_EQ(records[2].GetOriginalTuple().GetValue(&schema, 0).GetAs<int32_t>(), 42);
+  EXPECT_EQ(records[2].GetUpdateTuple().GetValue(&schema, 0).GetAs<int32_t>(), 43);
+  EXPECT_EQ(records[3].GetNewPageRecord(), 3);
+  EXPECT_EQ(records[4].GetLogRecordType(), LogRecordType::COMMIT);
+  EXPECT_EQ(records[4].GetPrevLSN(), 3);
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, FullBufferTest) {
+  auto saved_log_timeout = log_timeout;
+  log_timeout = std::chrono::seconds(100);
+  DiskManagerMemory disk_manager;
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+
+  // Nobody waits for durability, so only a full buffer can trigger these flushes.
+  const int num_records = 3 * LOG_BUFFER_SIZE / 20;
+  for (int i = 0; i < num_records; i++) {
+    LogRecord log_record(i, INVALID_LSN, LogRecordType::BEGIN);
+    log_manager.AppendLogRecord(&log_record);
+  }
+  EXPECT_GE(disk_manager.GetNumFlushes(), 2);
+
+  log_manager.StopFlushThread();
+  EXPECT_EQ(log_manager.GetPersistentLSN(), num_records - 1);
+  auto records = ReadAllLogRecords(&disk_manager);
+  ASSERT_EQ(records.size(), num_records);
+  for (int i = 0; i < num_records; i++) {
+    EXPECT_EQ(records[i].GetLSN(), i);
+  }
+  log_timeout = saved_log_timeout;
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, GroupCommitTest) {
+  // Every log flush takes at least 2 ms, commits arriving meanwhile must share the next one.
+  DiskThrottleConfig config{std::chrono::microseconds(0), std::chrono::microseconds(2000), 0};
+  DiskManagerThrottled disk_manager(std::make_unique<DiskManagerMemory>(), config);
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+
+  const int num_threads = 8;
+  const int commits_per_thread = 25;
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&log_manager, tid] {
+      for (int i = 0; i < commits_per_thread; i++) {
+        LogRecord log_record(tid, INVALID_LSN, LogRecordType::COMMIT);
+        lsn_t lsn = log_manager.AppendLogRecord(&log_record);
+        log_manager.WaitUntilPersistent(lsn);
+        EXPECT_GE(log_manager.GetPersistentLSN(), lsn);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  log_manager.StopFlushThread();
+
+  EXPECT_EQ(log_manager.GetPersistentLSN(), num_threads * commits_per_thread - 1);
+  EXPECT_LT(disk_manager.GetNumFlushes(), num_threads * commits_per_thread / 2);
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, ConcurrentAppendTest) {
+  DiskManagerMemory disk_manager;
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+
+  const int num_threads = 8;
+  const int appends_per_thread = 2000;
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&log_manager, tid] {
+      lsn_t prev_lsn = INVALID_LSN;
+      for (int i = 0; i < appends_per_thread; i++) {
+        LogRecord log_record(tid, prev_lsn, LogRecordType::BEGIN);
+        lsn_t lsn = log_manager.AppendLogRecord(&log_record);
+        EXPECT_GT(lsn, prev_lsn);
+        prev_lsn = lsn;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  log_manager.StopFlushThread();
+
+  // Records are written in lsn order with no gaps, and each one still chains to its own transaction's previous record.
+  auto records = ReadAllLogRecords(&disk_manager);
+  ASSERT_EQ(records.size(), num_threads * appends_per_thread);
+  std::vector<lsn_t> last_lsn(num_threads, INVALID_LSN);
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(records[i].GetLSN(), static_cast<lsn_t>(i));
+    txn_id_t txn_id = records[i].GetTxnId();
+    ASSERT_TRUE(txn_id >= 0 && txn_id < num_threads);
+    EXPECT_EQ(records[i].GetPrevLSN(), last_lsn[txn_id]);
+    last_lsn[txn_id] = records[i].GetLSN();
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, LogArenaTest) {
+  DiskManagerMemory disk_manager;
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  log_manager.RunFlushThread();
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+
+  const int num_tuples = 100;
+  Transaction *txns[2];
+  std::unique_ptr<TableHeap> tables[2];
+  for (int t = 0; t < 2; t++) {
+    txns[t] = txn_manager.Begin();
+    tables[t] = std::make_unique<TableHeap>(&bpm, &lock_manager, &log_manager, txns[t]);
+  }
+  // The two transactions take turns, but none of their inserts reserves room in the log buffer.
+  lsn_t next_lsn = log_manager.GetNextLSN();
+  RID rid;
+  for (int i = 0; i < num_tuples; i++) {
+    for (int t = 0; t < 2; t++) {
+      std::vector<Value> values{ValueFactory::GetIntegerValue(i)};
+      ASSERT_TRUE(tables[t]->InsertTuple(Tuple(values, &schema), &rid, txns[t]));
+    }
+  }
+  EXPECT_EQ(log_manager.GetNextLSN(), next_lsn);
+  EXPECT_FALSE(txns[0]->GetLogArena()->IsEmpty());
+  for (auto *txn : txns) {
+    txn_manager.Commit(txn);
+    EXPECT_TRUE(txn->GetLogArena()->IsEmpty());
+  }
+  log_manager.StopFlushThread();
+
+  // Each transaction's inserts and commit were published as one block of consecutive lsns, chained to its BEGIN.
+  auto records = ReadAllLogRecords(&disk_manager);
+  for (auto *txn : txns) {
+    lsn_t prev_lsn = INVALID_LSN;
+    lsn_t first_insert = INVALID_LSN;
+    int inserts = 0;
+    for (auto &log_record : records) {
+      if (log_record.GetTxnId() != txn->GetTransactionId()) {
+        continue;
+      }
+      EXPECT_EQ(log_record.GetPrevLSN(), prev_lsn);
+      prev_lsn = log_record.GetLSN();
+      if (log_record.GetLogRecordType() == LogRecordType::INSERT) {
+        first_insert = first_insert == INVALID_LSN ? log_record.GetLSN() : first_insert;
+        EXPECT_EQ(log_record.GetLSN(), first_insert + inserts);
+        inserts++;
+      }
+    }
+    EXPECT_EQ(inserts, num_tuples);
+    EXPECT_EQ(records[prev_lsn].GetLogRecordType(), LogRecordType::COMMIT);
+    EXPECT_EQ(prev_lsn, first_insert + num_tuples);
+    delete txn;
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, AsyncCommitTest) {
+  auto saved_log_timeout = log_timeout;
+  auto saved_async_commit_delay = async_commit_delay;
+  log_timeout = std::chrono::seconds(100);
+  async_commit_delay = std::chrono::milliseconds(200);
+  DiskManagerMemory disk_manager;
+  LogManager log_manager(&disk_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  log_manager.RunFlushThread();
+
+  // The asynchronous commit returns before its record is durable, and becomes durable once the delay has passed.
+  auto start = std::chrono::steady_clock::now();
+  Transaction *txn = txn_manager.Begin();
+  txn->SetAsyncCommit(true);
+  txn_manager.Commit(txn);
+  lsn_t commit_lsn = txn->GetPrevLSN();
+  EXPECT_LT(txn_manager.GetDurableLSN(), commit_lsn);
+  while (txn_manager.GetDurableLSN() < commit_lsn) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, async_commit_delay);
+  EXPECT_LT(elapsed, std::chrono::seconds(5));
+  delete txn;
+
+  // A synchronous commit is durable when it returns.
+  txn = txn_manager.Begin();
+  txn_manager.Commit(txn);
+  EXPECT_GE(txn_manager.GetDurableLSN(), txn->GetPrevLSN());
+  delete txn;
+
+  log_manager.StopFlushThread();
+  log_timeout = saved_log_timeout;
+  async_commit_delay = saved_async_commit_delay;
+}
+
+/** A 200-byte row of 25 BIGINT columns, column i holding base + i. */
+Tuple MakeWideTuple(const Schema &schema, int64_t base) {
+  std::vector<Value> values;
+  for (uint32_t i = 0; i < schema.GetColumnCount(); i++) {
+    values.push_back(ValueFactory::GetBigIntValue(base + i));
+  }
+  return Tuple(values, &schema);
+}
+
+Schema MakeWideSchema() {
+  std::vector<Column> columns;
+  for (int i = 0; i < 25; i++) {
+    columns.emplace_back("c" + std::to_string(i), TypeId::BIGINT);
+  }
+  return Schema(columns);
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DeltaUpdateTest) {
+  DiskManagerMemory disk_manager;
+  LogManager log_manager(&disk_manager);
+  Schema schema = MakeWideSchema();
+  Tuple old_tuple = MakeWideTuple(schema, 100);
+  std::vector<Value> values;
+  for (uint32_t i = 0; i < schema.GetColumnCount(); i++) {
+    values.push_back(old_tuple.GetValue(&schema, i));
+  }
+  values[3] = ValueFactory::GetBigIntValue(-7);
+  values[20] = ValueFactory::GetBigIntValue(1LL << 40);
+  Tuple new_tuple(values, &schema);
+  RID rid(1, 2);
+
+  LogRecord full(0, INVALID_LSN, LogRecordType::UPDATE, rid, old_tuple, new_tuple);
+  LogRecord delta(0, INVALID_LSN, LogRecordType::UPDATE_DELTA, rid, old_tuple, new_tuple);
+  EXPECT_LT(delta.GetSize(), full.GetSize() / 4);
+  log_manager.AppendLogRecord(&delta);
+  log_manager.WaitUntilPersistent(0);
+
+  auto records = ReadAllLogRecords(&disk_manager);
+  ASSERT_EQ(records.size(), 1);
+  LogRecord &read_back = records[0];
+  EXPECT_EQ(read_back.GetLogRecordType(), LogRecordType::UPDATE_DELTA);
+  EXPECT_EQ(read_back.GetUpdateRID(), rid);
+  ASSERT_EQ(read_back.GetDeltaTupleSize(), old_tuple.GetLength());
+
+  // Redo turns the old bytes into the new ones, undo turns them back.
+  std::vector<char> data(old_tuple.GetData(), old_tuple.GetData() + old_tuple.GetLength());
+  read_back.ApplyDelta(data.data(), true);
+  EXPECT_EQ(memcmp(data.data(), new_tuple.GetData(), data.size()), 0);
+  read_back.ApplyDelta(data.data(), false);
+  EXPECT_EQ(memcmp(data.data(), old_tuple.GetData(), data.size()), 0);
+}
+
+/*
+ * Log volume of updates that change one 8-byte column of a 200-byte row, logged with full before and after images
+ * and delta-encoded.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=LogManagerTest.DISABLED_UpdateLogVolumeBenchmark
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_UpdateLogVolumeBenchmark) {
+  const int num_updates = 1 << 20;
+  Schema schema = MakeWideSchema();
+  std::vector<Tuple> rows;
+  for (int i = 0; i < 64; i++) {
+    rows.push_back(MakeWideTuple(schema, i * 1000));
+  }
+  int64_t log_bytes[2];
+  double elapsed[2];
+  for (int delta = 0; delta < 2; delta++) {
+    DiskManagerMemory disk_manager;
+    LogManager log_manager(&disk_manager);
+    log_manager.RunFlushThread();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_updates; i++) {
+      const Tuple &old_tuple = rows[i % rows.size()];
+      std::vector<Value> values;
+      for (uint32_t col = 0; col < schema.GetColumnCount(); col++) {
+        values.push_back(old_tuple.GetValue(&schema, col));
+      }
+      values[i % schema.GetColumnCount()] = ValueFactory::GetBigIntValue(i);
+      Tuple new_tuple(values, &schema);
+      LogRecord log_record(0, INVALID_LSN, delta != 0 ? LogRecordType::UPDATE_DELTA : LogRecordType::UPDATE,
+                           RID(i, 0), old_tuple, new_tuple);
+      log_manager.AppendLogRecord(&log_record);
+    }
+    elapsed[delta] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log_manager.StopFlushThread();
+    log_bytes[delta] = disk_manager.GetLogTail();
+  }
+  printf("full images: %8.1f MB, %6.1f bytes/update, %10.0f updates/sec\n", log_bytes[0] / 1048576.0,
+         static_cast<double>(log_bytes[0]) / num_updates, num_updates / elapsed[0]);
+  printf("delta:       %8.1f MB, %6.1f bytes/update, %10.0f updates/sec\n", log_bytes[1] / 1048576.0,
+         static_cast<double>(log_bytes[1]) / num_updates, num_updates / elapsed[1]);
+  printf("saved:       %8.1f %%\n", 100.0 * (log_bytes[0] - log_bytes[1]) / log_bytes[0]);
+}
+
+/*
+ * Appends per second against an in-memory log, from 1 to 64 threads.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=LogManagerTest.DISABLED_AppendThroughputBenchmark
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_AppendThroughputBenchmark) {
+  const int total_appends = 1 << 21;
+  for (int num_threads = 1; num_threads <= 64; num_threads *= 2) {
+    DiskManagerMemory disk_manager;
+    LogManager log_manager(&disk_manager);
+    log_manager.RunFlushThread();
+
+    const int appends_per_thread = total_appends / num_threads;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; tid++) {
+      threads.emplace_back([&log_manager, tid, appends_per_thread] {
+        for (int i = 0; i < appends_per_thread; i++) {
+          LogRecord log_record(tid, INVALID_LSN, LogRecordType::COMMIT);
+          log_manager.AppendLogRecord(&log_record);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log_manager.StopFlushThread();
+
+    EXPECT_EQ(log_manager.GetPersistentLSN(), num_threads * appends_per_thread - 1);
+    printf("%2d threads: %12.0f appends/sec\n", num_threads, num_threads * appends_per_thread / elapsed);
+  }
+}
+
+}  // namespace bustub
@@ -0,0 +1,1051 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_recovery_test.cpp
+//
+// Identification: test/recovery/log_recovery_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "concurrency/lock_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "concurrency/vacuum_manager.h"
+#include "gtest/gtest.h"
+#include "recovery/checkpoint_manager.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_recovery.h"
+#include "recovery/log_replica.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/disk/disk_manager_throttled.h"
+#include "storage/index/b_plus_tree.h"
+#include "storage/page/header_page.h"
+#include "storage/table/table_heap.h"
+#include "type/value_factory.h"
+
+namespace bustub {
+
+/** A one-column tuple holding the given integer. */
+Tuple MakeTuple(const Schema &schema, int32_t value) {
+  std::vector<Value> values{ValueFactory::GetIntegerValue(value)};
+  return Tuple(values, &schema);
+}
+
+/** @return true if the table holds the given value at rid */
+bool HasTuple(TableHeap *table, const Schema &schema, const RID &rid, int32_t value, Transaction *txn) {
+  Tuple tuple;
+  return table->GetTuple(rid, &tuple, txn) && tuple.GetValue(&schema, 0).GetAs<int32_t>() == value;
+}
+
+void RemoveLogFiles(const std::string &db_file) {
+  std::string log_file = db_file.substr(0, db_file.rfind('.')) + ".log";
+  remove(db_file.c_str());
+  remove(log_file.c_str());
+  for (const auto &entry : std::filesystem::directory_iterator(".")) {
+    if (entry.path().filename().string().rfind(log_file + ".", 0) == 0) {
+      std::filesystem::remove(entry.path());
+    }
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, RedoUndoTest) {
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  DiskManagerMemory disk_manager;
+  lsn_t next_lsn;
+  page_id_t first_page_id;
+  std::vector<RID> rids(3);
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, 1), &rids[0], txn));
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, 2), &rids[1], txn));
+    txn_manager.Commit(txn);
+    delete txn;
+
+    // A loser: its changes reach the log but it never commits.
+    Transaction *loser = txn_manager.Begin();
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, 3), &rids[2], loser));
+    ASSERT_TRUE(table.MarkDelete(rids[0], loser));
+    ASSERT_TRUE(table.UpdateTuple(MakeTuple(schema, 20), rids[1], loser));
+    next_lsn = log_manager.GetNextLSN();
+    log_manager.StopFlushThread();
+    delete loser;
+    // Crash: the buffer pool goes away without flushing a single page.
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+  log_recovery.Redo();
+  EXPECT_EQ(log_manager.GetNextLSN(), next_lsn);
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  EXPECT_TRUE(HasTuple(&table, schema, rids[0], 1, txn));
+  EXPECT_TRUE(HasTuple(&table, schema, rids[1], 2, txn));
+  Tuple tuple;
+  EXPECT_FALSE(table.GetTuple(rids[2], &tuple, txn));
+  txn_manager.Commit(txn);
+  delete txn;
+}
+
+/*
+ * Two transactions take turns inserting into the same pages. Their records wait in their log arenas, but each page's
+ * changes must still reach the log in the order they were made, or redo would give the tuples different slots.
+ */
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, LogArenaPageOrderTest) {
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  DiskManagerMemory disk_manager;
+  const int num_tuples = 300;
+  page_id_t first_page_id;
+  std::vector<std::pair<RID, int32_t>> inserted;
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    txn_manager.Commit(txn);
+    delete txn;
+
+    Transaction *txns[2] = {txn_manager.Begin(), txn_manager.Begin()};
+    RID rid;
+    for (int i = 0; i < num_tuples; i++) {
+      for (int t = 0; t < 2; t++) {
+        int32_t value = t * num_tuples + i;
+        ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, value), &rid, txns[t]));
+        inserted.emplace_back(rid, value);
+      }
+    }
+    for (auto *txn : txns) {
+      txn_manager.Commit(txn);
+      delete txn;
+    }
+    log_manager.StopFlushThread();
+    // Crash: the buffer pool goes away without flushing a single page.
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  for (const auto &[rid, value] : inserted) {
+    ASSERT_TRUE(HasTuple(&table, schema, rid, value, txn));
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, CheckpointTruncateTest) {
+  const std::string db_file = "test_log_recovery.db";
+  const int64_t segment_size = 2 * PAGE_SIZE;
+  const int num_tuples = 1000;
+  RemoveLogFiles(db_file);
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  std::vector<RID> rids(2 * num_tuples + 1);
+  page_id_t first_page_id;
+  lsn_t next_lsn;
+  int64_t log_tail;
+  {
+    DiskManager disk_manager(db_file, segment_size);
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    CheckpointManager checkpoint_manager(&txn_manager, &log_manager, &bpm);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    for (int i = 0; i < num_tuples; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+    ASSERT_GT(disk_manager.GetLogTail(), 2 * segment_size);
+
+    // With every page on disk and no transaction running, recovery only needs the checkpoint itself.
+    bpm.FlushAllPages();
+    checkpoint_manager.BeginCheckpoint();
+    checkpoint_manager.EndCheckpoint();
+    LogMasterRecord master = disk_manager.ReadLogMaster();
+    EXPECT_EQ(master.checkpoint_lsn_, log_manager.GetNextLSN() - 2);
+    EXPECT_EQ(master.redo_lsn_, master.checkpoint_lsn_);
+    EXPECT_GT(master.redo_offset_, 2 * segment_size);
+    // The segments before the redo point are gone, the log now starts at the checkpoint's segment.
+    char buf[16];
+    EXPECT_FALSE(disk_manager.ReadLog(buf, sizeof(buf), 0));
+    EXPECT_TRUE(disk_manager.ReadLog(buf, sizeof(buf), master.redo_offset_ / segment_size * segment_size));
+
+    // These records land in recycled segments, on top of stale records from before the checkpoint.
+    txn = txn_manager.Begin();
+    for (int i = num_tuples; i < 2 * num_tuples; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+    Transaction *loser = txn_manager.Begin();
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, -1), &rids[2 * num_tuples], loser));
+    next_lsn = log_manager.GetNextLSN();
+    log_manager.StopFlushThread();
+    log_tail = disk_manager.GetLogTail();
+    delete loser;
+    disk_manager.ShutDown();
+  }
+
+  // Restart from the files alone.
+  DiskManager disk_manager(db_file);
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+  log_recovery.Redo();
+  EXPECT_EQ(log_manager.GetNextLSN(), next_lsn);
+  EXPECT_EQ(disk_manager.GetLogTail(), log_tail);
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  for (int i = 0; i < 2 * num_tuples; i++) {
+    EXPECT_TRUE(HasTuple(&table, schema, rids[i], i, txn));
+  }
+  Tuple tuple;
+  EXPECT_FALSE(table.GetTuple(rids[2 * num_tuples], &tuple, txn));
+  txn_manager.Commit(txn);
+  delete txn;
+  disk_manager.ShutDown();
+  RemoveLogFiles(db_file);
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, FuzzyCheckpointTest) {
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  DiskManagerMemory disk_manager;
+  const int num_tuples = 200;
+  std::vector<RID> rids(2 * num_tuples + 2);
+  page_id_t first_page_id;
+  lsn_t loser_begin_lsn;
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    CheckpointManager checkpoint_manager(&txn_manager, &log_manager, &bpm);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    for (int i = 0; i < num_tuples; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+
+    // The checkpoint runs while a loser and a winner are in flight, and with none of the pages written out.
+    Transaction *loser = txn_manager.Begin();
+    loser_begin_lsn = loser->GetPrevLSN();
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, -1), &rids[2 * num_tuples], loser));
+    Transaction *winner = txn_manager.Begin();
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, num_tuples), &rids[num_tuples], winner));
+    checkpoint_manager.BeginCheckpoint();
+    checkpoint_manager.EndCheckpoint();
+    LogMasterRecord master = disk_manager.ReadLogMaster();
+    EXPECT_NE(master.checkpoint_lsn_, INVALID_LSN);
+    EXPECT_LE(master.redo_lsn_, loser_begin_lsn);
+
+    for (int i = num_tuples + 1; i < 2 * num_tuples; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], winner));
+    }
+    txn_manager.Commit(winner);
+    delete winner;
+    ASSERT_TRUE(table.MarkDelete(rids[0], loser));
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, -2), &rids[2 * num_tuples + 1], loser));
+    // Some pages reach disk after the checkpoint, the rest are lost with the buffer pool.
+    bpm.FlushPage(first_page_id);
+    log_manager.StopFlushThread();
+    delete loser;
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  for (int i = 0; i < 2 * num_tuples; i++) {
+    EXPECT_TRUE(HasTuple(&table, schema, rids[i], i, txn));
+  }
+  Tuple tuple;
+  EXPECT_FALSE(table.GetTuple(rids[2 * num_tuples], &tuple, txn));
+  EXPECT_FALSE(table.GetTuple(rids[2 * num_tuples + 1], &tuple, txn));
+  txn_manager.Commit(txn);
+  delete txn;
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, CheckpointThreadTest) {
+  const std::string db_file = "test_checkpoint_thread.db";
+  const int64_t segment_size = 2 * PAGE_SIZE;
+  RemoveLogFiles(db_file);
+  auto saved_checkpoint_interval = checkpoint_interval;
+  checkpoint_interval = std::chrono::milliseconds(10);
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  std::vector<RID> rids;
+  page_id_t first_page_id;
+  {
+    DiskManager disk_manager(db_file, segment_size);
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    CheckpointManager checkpoint_manager(&txn_manager, &log_manager, &bpm);
+    log_manager.RunFlushThread();
+    checkpoint_manager.RunCheckpointThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    txn_manager.Commit(txn);
+    delete txn;
+    // Keep inserting until the background checkpoints have flushed pages and recycled the first segments.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (disk_manager.ReadLogMaster().redo_offset_ < 4 * segment_size && std::chrono::steady_clock::now() < deadline) {
+      txn = txn_manager.Begin();
+      for (int i = 0; i < 100; i++) {
+        rids.emplace_back();
+        ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, rids.size() - 1), &rids.back(), txn));
+      }
+      txn_manager.Commit(txn);
+      delete txn;
+    }
+    checkpoint_manager.StopCheckpointThread();
+    log_manager.StopFlushThread();
+    EXPECT_GE(disk_manager.ReadLogMaster().redo_offset_, 4 * segment_size);
+    char buf[16];
+    EXPECT_FALSE(disk_manager.ReadLog(buf, sizeof(buf), 0));
+    disk_manager.ShutDown();
+  }
+
+  DiskManager disk_manager(db_file);
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  for (size_t i = 0; i < rids.size(); i++) {
+    EXPECT_TRUE(HasTuple(&table, schema, rids[i], i, txn));
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+  disk_manager.ShutDown();
+  RemoveLogFiles(db_file);
+  checkpoint_interval = saved_checkpoint_interval;
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, ParallelRedoUndoTest) {
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  DiskManagerMemory disk_manager;
+  const int num_tuples = 2000;
+  const int num_losers = 6;
+  std::vector<RID> rids(num_tuples);
+  std::vector<RID> loser_rids(num_losers);
+  page_id_t first_page_id;
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    for (int i = 0; i < num_tuples; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+
+    // Losers interleave their changes all over the table.
+    std::vector<Transaction *> losers;
+    for (int i = 0; i < num_losers; i++) {
+      losers.push_back(txn_manager.Begin());
+    }
+    for (int i = 0; i < num_tuples; i++) {
+      ASSERT_TRUE(table.UpdateTuple(MakeTuple(schema, -i), rids[i], losers[i % num_losers]));
+    }
+    for (int i = 0; i < num_losers; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, -1), &loser_rids[i], losers[i]));
+    }
+    log_manager.StopFlushThread();
+    for (auto *loser : losers) {
+      delete loser;
+    }
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager, 4);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  for (int i = 0; i < num_tuples; i++) {
+    EXPECT_TRUE(HasTuple(&table, schema, rids[i], i, txn));
+  }
+  Tuple tuple;
+  for (const auto &rid : loser_rids) {
+    EXPECT_FALSE(table.GetTuple(rid, &tuple, txn));
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+}
+
+/*
+ * Undo logs what it does and ends every loser with an ABORT. After a second crash the loser is not undone again, so
+ * its old image does not overwrite a row a later transaction committed.
+ */
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, RepeatedCrashTest) {
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  DiskManagerMemory disk_manager;
+  page_id_t first_page_id;
+  std::vector<RID> rids(3);
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, 1), &rids[0], txn));
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, 2), &rids[1], txn));
+    txn_manager.Commit(txn);
+    delete txn;
+
+    Transaction *loser = txn_manager.Begin();
+    ASSERT_TRUE(table.UpdateTuple(MakeTuple(schema, 10), rids[0], loser));
+    ASSERT_TRUE(table.MarkDelete(rids[1], loser));
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, 3), &rids[2], loser));
+    // The loser's changes reach the disk, and its records the log ahead of them.
+    bpm.FlushAllPages();
+    log_manager.StopFlushThread();
+    delete loser;
+  }
+
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+    log_recovery.Redo();
+    log_recovery.Undo();
+    log_manager.RunFlushThread();
+
+    // The rows the loser touched are free again, a winner changes them and commits.
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+    ASSERT_TRUE(table.UpdateTuple(MakeTuple(schema, 100), rids[0], txn));
+    ASSERT_TRUE(table.MarkDelete(rids[1], txn));
+    txn_manager.Commit(txn);
+    delete txn;
+    log_manager.StopFlushThread();
+    // Crash again, before a single page is flushed.
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  EXPECT_TRUE(HasTuple(&table, schema, rids[0], 100, txn));
+  Tuple tuple;
+  EXPECT_FALSE(table.GetTuple(rids[1], &tuple, txn));
+  EXPECT_FALSE(table.GetTuple(rids[2], &tuple, txn));
+  txn_manager.Commit(txn);
+  delete txn;
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, PrefetchRedoTest) {
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  auto disk_manager = std::make_unique<DiskManagerMemory>();
+  const int num_tuples = 6000;
+  std::vector<RID> rids(num_tuples);
+  page_id_t first_page_id;
+  {
+    LogManager log_manager(disk_manager.get());
+    BufferPoolManagerInstance bpm(50, disk_manager.get(), &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    for (int i = 0; i < num_tuples; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+    }
+    // Write out the first version of every page, so redo has to read each one back.
+    bpm.FlushAllPages();
+    for (int i = 0; i < num_tuples; i++) {
+      ASSERT_TRUE(table.UpdateTuple(MakeTuple(schema, 2 * i), rids[i], txn));
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+    log_manager.StopFlushThread();
+  }
+
+  // The table is about twice the size of the buffer pool, so the prefetcher's window keeps getting evicted behind it.
+  DiskThrottleConfig config{std::chrono::microseconds(200), std::chrono::microseconds(0), 0};
+  DiskManagerThrottled throttled_disk_manager(std::move(disk_manager), config);
+  LogManager log_manager(&throttled_disk_manager);
+  BufferPoolManagerInstance bpm(10, &throttled_disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&throttled_disk_manager, &bpm, &log_manager, 2);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  for (int i = 0; i < num_tuples; i++) {
+    EXPECT_TRUE(HasTuple(&table, schema, rids[i], 2 * i, txn));
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+}
+
+/** Reads the keys of a B+ tree in order, going down its leftmost path and along the leaves. */
+std::vector<int64_t> ReadTreeKeys(BufferPoolManager *bpm, page_id_t root_page_id) {
+  using LeafPage = BPlusTreeLeafPage<GenericKey<8>, RID, GenericComparator<8>>;
+  using InternalPage = BPlusTreeInternalPage<GenericKey<8>, page_id_t, GenericComparator<8>>;
+  std::vector<int64_t> keys;
+  page_id_t page_id = root_page_id;
+  while (true) {
+    auto *node = reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(page_id)->GetData());
+    if (node->IsLeafPage()) {
+      break;
+    }
+    page_id_t child_id = reinterpret_cast<InternalPage *>(node)->ValueAt(0);
+    bpm->UnpinPage(page_id, false);
+    page_id = child_id;
+  }
+  while (page_id != INVALID_PAGE_ID) {
+    auto *leaf = reinterpret_cast<LeafPage *>(bpm->FetchPage(page_id)->GetData());
+    for (int i = 0; i < leaf->GetSize(); i++) {
+      keys.push_back(leaf->KeyAt(i).ToString());
+    }
+    page_id_t next_page_id = leaf->GetNextPageId();
+    bpm->UnpinPage(page_id, false);
+    page_id = next_page_id;
+  }
+  return keys;
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, IndexRedoTest) {
+  Schema key_schema(std::vector<Column>{Column("a", TypeId::BIGINT)});
+  GenericComparator<8> comparator(&key_schema);
+  auto disk_manager = std::make_unique<DiskManagerMemory>();
+  const int num_keys = 10000;
+  std::vector<int64_t> keys(num_keys);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(7));
+  std::vector<int64_t> expected_keys;
+  {
+    LogManager log_manager(disk_manager.get());
+    BufferPoolManagerInstance bpm(50, disk_manager.get(), &log_manager);
+    log_manager.RunFlushThread();
+    page_id_t header_page_id;
+    bpm.NewPage(&header_page_id);
+    bpm.UnpinPage(header_page_id, true);
+
+    // The tree outgrows the pool, so some of its pages reach the disk and the latest versions of the rest are lost.
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("idx", &bpm, comparator);
+    Transaction txn(0);
+    GenericKey<8> index_key;
+    for (int64_t key : keys) {
+      index_key.SetFromInteger(key);
+      ASSERT_TRUE(tree.Insert(index_key, RID(0, key), &txn));
+    }
+    for (int64_t key = 0; key < num_keys; key++) {
+      if (key % 10 == 0) {
+        index_key.SetFromInteger(key);
+        tree.Remove(index_key, &txn);
+      } else {
+        expected_keys.push_back(key);
+      }
+    }
+    // Crash with the log durable and only the pages the pool happened to evict on disk.
+    log_manager.StopFlushThread();
+  }
+
+  LogManager log_manager(disk_manager.get());
+  BufferPoolManagerInstance bpm(50, disk_manager.get(), &log_manager);
+  LogRecovery log_recovery(disk_manager.get(), &bpm, &log_manager, 2);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  page_id_t root_page_id;
+  auto *header_page = reinterpret_cast<HeaderPage *>(bpm.FetchPage(HEADER_PAGE_ID));
+  ASSERT_TRUE(header_page->GetRootId("idx", &root_page_id));
+  bpm.UnpinPage(HEADER_PAGE_ID, false);
+  EXPECT_EQ(ReadTreeKeys(&bpm, root_page_id), expected_keys);
+}
+
+/*
+ * A loser's inserts and removes reach the disk with the index page. Undo takes its keys back through the tree, and logs
+ * doing so: a second crash right after finds the same keys. The keys fit in the root leaf, a restarted buffer pool
+ * does not know which page ids are taken.
+ */
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, IndexUndoTest) {
+  Schema key_schema(std::vector<Column>{Column("a", TypeId::BIGINT)});
+  GenericComparator<8> comparator(&key_schema);
+  DiskManagerMemory disk_manager;
+  const int num_keys = 200;
+  std::vector<int64_t> expected_keys;
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+    page_id_t header_page_id;
+    bpm.NewPage(&header_page_id);
+    bpm.UnpinPage(header_page_id, true);
+
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("idx", &bpm, comparator);
+    GenericKey<8> index_key;
+    Transaction *txn = txn_manager.Begin();
+    for (int64_t key = 0; key < num_keys; key += 2) {
+      index_key.SetFromInteger(key);
+      ASSERT_TRUE(tree.Insert(index_key, RID(0, key), txn));
+      expected_keys.push_back(key);
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+
+    Transaction *loser = txn_manager.Begin();
+    for (int64_t key = 1; key < num_keys; key += 6) {
+      index_key.SetFromInteger(key);
+      ASSERT_TRUE(tree.Insert(index_key, RID(0, key), loser));
+    }
+    for (int64_t key = 0; key < num_keys; key += 8) {
+      index_key.SetFromInteger(key);
+      tree.Remove(index_key, loser);
+    }
+    bpm.FlushAllPages();
+    log_manager.StopFlushThread();
+    delete loser;
+  }
+
+  for (int run = 0; run < 2; run++) {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LogRecovery log_recovery(&disk_manager, &bpm, &log_manager, 2);
+    log_recovery.Redo();
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("idx", &bpm, comparator);
+    ASSERT_TRUE(tree.LoadRootPageId());
+    log_recovery.AddIndex("idx", [&tree](const LogRecord &log_record) { tree.UndoKeyRecord(log_record); });
+    log_recovery.Undo();
+
+    page_id_t root_page_id;
+    auto *header_page = reinterpret_cast<HeaderPage *>(bpm.FetchPage(HEADER_PAGE_ID));
+    ASSERT_TRUE(header_page->GetRootId("idx", &root_page_id));
+    bpm.UnpinPage(HEADER_PAGE_ID, false);
+    EXPECT_EQ(ReadTreeKeys(&bpm, root_page_id), expected_keys);
+    // Crash again, nothing undo changed is on disk.
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, IndexRootCheckpointTest) {
+  Schema key_schema(std::vector<Column>{Column("a", TypeId::BIGINT)});
+  GenericComparator<8> comparator(&key_schema);
+  DiskManagerMemory disk_manager;
+  const int num_keys = 200;
+  std::vector<int64_t> expected_keys;
+  page_id_t expected_root_page_id;
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(500, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    CheckpointManager checkpoint_manager(&txn_manager, &log_manager, &bpm);
+    log_manager.RunFlushThread();
+    page_id_t header_page_id;
+    bpm.NewPage(&header_page_id);
+    bpm.UnpinPage(header_page_id, true);
+
+    // Nothing is evicted. The header page is written out once it holds the index's record and dirtied again by the
+    // next root change, it is dirty at the checkpoint, and the root keeps changing after it.
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("idx", &bpm, comparator, 3, 4);
+    Transaction txn(0);
+    GenericKey<8> index_key;
+    for (int64_t key = 0; key < num_keys; key++) {
+      if (key == 10) {
+        bpm.FlushPage(HEADER_PAGE_ID);
+      }
+      if (key == 50) {
+        checkpoint_manager.BeginCheckpoint();
+        checkpoint_manager.EndCheckpoint();
+      }
+      index_key.SetFromInteger(key);
+      ASSERT_TRUE(tree.Insert(index_key, RID(0, key), &txn));
+      expected_keys.push_back(key);
+    }
+    auto *header_page = reinterpret_cast<HeaderPage *>(bpm.FetchPage(HEADER_PAGE_ID));
+    ASSERT_TRUE(header_page->GetRootId("idx", &expected_root_page_id));
+    bpm.UnpinPage(HEADER_PAGE_ID, false);
+    log_manager.StopFlushThread();
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(500, &disk_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager, 2);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  page_id_t root_page_id;
+  auto *header_page = reinterpret_cast<HeaderPage *>(bpm.FetchPage(HEADER_PAGE_ID));
+  ASSERT_TRUE(header_page->GetRootId("idx", &root_page_id));
+  bpm.UnpinPage(HEADER_PAGE_ID, false);
+  EXPECT_EQ(root_page_id, expected_root_page_id);
+  EXPECT_EQ(ReadTreeKeys(&bpm, root_page_id), expected_keys);
+}
+
+/** @return the values in a one-column table, sorted */
+std::vector<int32_t> ReadTableValues(TableHeap *table, const Schema &schema, Transaction *txn) {
+  std::vector<int32_t> values;
+  for (auto it = table->Begin(txn); it != table->End(); ++it) {
+    values.push_back(it->GetValue(&schema, 0).GetAs<int32_t>());
+  }
+  std::sort(values.begin(), values.end());
+  return values;
+}
+
+/*
+ * The vacuum unlinks an emptied page from the middle of a table and frees it, and the next new page gets its id. Redo
+ * has to relink the table around it, or the table would run into the other table's page.
+ */
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, VacuumUnlinkTest) {
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  DiskManagerMemory disk_manager;
+  const int num_tuples = 1200;
+  page_id_t first_page_id;
+  page_id_t other_page_id;
+  page_id_t unlinked_page_id = INVALID_PAGE_ID;
+  std::vector<int32_t> kept_values;
+  {
+    LogManager log_manager(&disk_manager);
+    BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    VacuumManager vacuum(&txn_manager, &bpm);
+    log_manager.RunFlushThread();
+
+    Transaction *txn = txn_manager.Begin();
+    TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+    first_page_id = table.GetFirstPageId();
+    std::vector<RID> rids(num_tuples);
+    for (int i = 0; i < num_tuples; i++) {
+      ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+
+    // Empty the second page.
+    txn = txn_manager.Begin();
+    for (int i = 0; i < num_tuples; i++) {
+      if (rids[i].GetPageId() == first_page_id) {
+        kept_values.push_back(i);
+      } else if (unlinked_page_id == INVALID_PAGE_ID || rids[i].GetPageId() == unlinked_page_id) {
+        unlinked_page_id = rids[i].GetPageId();
+        ASSERT_TRUE(table.MarkDelete(rids[i], txn));
+      } else {
+        kept_values.push_back(i);
+      }
+    }
+    txn_manager.Commit(txn);
+    delete txn;
+    vacuum.AddTable(&table, &schema);
+    vacuum.Vacuum();
+    vacuum.Vacuum();
+    ASSERT_EQ(vacuum.GetFreedPageCount(), 1U);
+
+    txn = txn_manager.Begin();
+    TableHeap other(&bpm, &lock_manager, &log_manager, txn);
+    other_page_id = other.GetFirstPageId();
+    ASSERT_EQ(other_page_id, unlinked_page_id);
+    RID rid;
+    ASSERT_TRUE(other.InsertTuple(MakeTuple(schema, -1), &rid, txn));
+    txn_manager.Commit(txn);
+    delete txn;
+    log_manager.StopFlushThread();
+    // Crash: the buffer pool goes away without flushing a single page.
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  LogRecovery log_recovery(&disk_manager, &bpm, &log_manager);
+  log_recovery.Redo();
+  log_recovery.Undo();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, first_page_id);
+  TableHeap other(&bpm, &lock_manager, &log_manager, other_page_id);
+  EXPECT_EQ(ReadTableValues(&table, schema, txn), kept_values);
+  EXPECT_EQ(ReadTableValues(&other, schema, txn), std::vector<int32_t>{-1});
+  txn_manager.Commit(txn);
+  delete txn;
+}
+
+/*
+ * The replica runs in a child process, as it would on its own, and follows the primary through the shared directory.
+ * The pipes only tell the replica what the primary has committed so that it can check what it serves.
+ */
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, ReplicaTest) {
+  const std::string primary_file = "test_primary.db";
+  const std::string replica_file = "test_replica.db";
+  const int num_tuples = 500;
+  RemoveLogFiles(primary_file);
+  RemoveLogFiles(replica_file);
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  std::vector<int32_t> first_values(num_tuples);
+  std::iota(first_values.begin(), first_values.end(), 0);
+  // The second transaction negates the first one's values and inserts as many again.
+  std::vector<int32_t> second_values(2 * num_tuples);
+  std::iota(second_values.begin(), second_values.begin() + num_tuples, -num_tuples + 1);
+  std::iota(second_values.begin() + num_tuples, second_values.end(), num_tuples);
+
+  DiskManager disk_manager(primary_file);
+  disk_manager.EnableLogShipping();
+  int to_replica[2];
+  int to_primary[2];
+  ASSERT_EQ(pipe(to_replica), 0);
+  ASSERT_EQ(pipe(to_primary), 0);
+  pid_t replica_pid = fork();
+  ASSERT_GE(replica_pid, 0);
+  if (replica_pid == 0) {
+    // The replica process does not log.
+    enable_logging = false;
+    auto check = [](bool ok, int code) {
+      if (!ok) {
+        _exit(code);
+      }
+    };
+    std::pair<page_id_t, lsn_t> committed;
+    check(read(to_replica[0], &committed, sizeof(committed)) == sizeof(committed), 1);
+    DiskManager replica_disk_manager(replica_file, primary_file);
+    BufferPoolManagerInstance replica_bpm(20, &replica_disk_manager);
+    TableHeap replica_table(&replica_bpm, nullptr, nullptr, committed.first);
+    Transaction reader(0);
+    LogReplica replica(&replica_disk_manager, &replica_bpm);
+    check(replica.GetReplayedLSN() == INVALID_LSN, 2);
+    check(replica.GetReplicationLag() == committed.second + 1, 3);
+    replica.CatchUp();
+    check(replica.GetReplicationLag() == 0, 4);
+    check(ReadTableValues(&replica_table, schema, &reader) == first_values, 5);
+
+    // Follow the primary while it keeps changing the table.
+    replica.RunReplayThread();
+    char ack = 0;
+    check(write(to_primary[1], &ack, 1) == 1, 6);
+    check(read(to_replica[0], &committed, sizeof(committed)) == sizeof(committed), 7);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (replica.GetReplayedLSN() < committed.second && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(replica_poll_interval);
+    }
+    check(replica.GetReplayedLSN() == committed.second, 8);
+    replica.RLatch();
+    bool caught_up = ReadTableValues(&replica_table, schema, &reader) == second_values;
+    replica.RUnlatch();
+    replica.StopReplayThread();
+    check(caught_up, 9);
+    _exit(0);
+  }
+
+  LogManager log_manager(&disk_manager);
+  BufferPoolManagerInstance bpm(50, &disk_manager, &log_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  log_manager.RunFlushThread();
+
+  Transaction *txn = txn_manager.Begin();
+  TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+  std::vector<RID> rids(num_tuples);
+  for (int i = 0; i < num_tuples; i++) {
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+  std::pair<page_id_t, lsn_t> committed{table.GetFirstPageId(), log_manager.GetPersistentLSN()};
+  ASSERT_EQ(write(to_replica[1], &committed, sizeof(committed)), sizeof(committed));
+  char ack;
+  ASSERT_EQ(read(to_primary[0], &ack, 1), 1);
+
+  txn = txn_manager.Begin();
+  RID rid;
+  for (int i = 0; i < num_tuples; i++) {
+    ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, num_tuples + i), &rid, txn));
+    ASSERT_TRUE(table.UpdateTuple(MakeTuple(schema, -i), rids[i], txn));
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+  committed.second = log_manager.GetPersistentLSN();
+  ASSERT_EQ(write(to_replica[1], &committed, sizeof(committed)), sizeof(committed));
+
+  int status;
+  ASSERT_EQ(waitpid(replica_pid, &status, 0), replica_pid);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+  log_manager.StopFlushThread();
+  disk_manager.ShutDown();
+  for (int fd : {to_replica[0], to_replica[1], to_primary[0], to_primary[1]}) {
+    close(fd);
+  }
+  RemoveLogFiles(primary_file);
+  RemoveLogFiles(replica_file);
+}
+
+/*
+ * Redo and undo time against generated logs of 1 to 10 GB, with 1 to 8 recovery workers. The log is made of small
+ * updates to a table that fits in the buffer pool, and ends with a loser that updated every tuple.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=LogRecoveryTest.DISABLED_RecoveryTimeBenchmark
+ */
+// NOLINTNEXTLINE
+TEST(LogRecoveryTest, DISABLED_RecoveryTimeBenchmark) {
+  const std::string db_file = "test_recovery_benchmark.db";
+  const std::vector<int64_t> log_sizes{1LL << 30, 2LL << 30, 5LL << 30, 10LL << 30};
+  const int num_tuples = 20000;
+  const int updates_per_txn = 1000;
+  const size_t pool_size = 1024;
+  Schema schema(std::vector<Column>{Column("a", TypeId::INTEGER)});
+  for (int64_t log_size : log_sizes) {
+    RemoveLogFiles(db_file);
+    std::vector<RID> rids(num_tuples);
+    {
+      DiskManager disk_manager(db_file);
+      LogManager log_manager(&disk_manager);
+      BufferPoolManagerInstance bpm(pool_size, &disk_manager, &log_manager);
+      LockManager lock_manager;
+      TransactionManager txn_manager(&lock_manager, &log_manager);
+      log_manager.RunFlushThread();
+
+      Transaction *txn = txn_manager.Begin();
+      TableHeap table(&bpm, &lock_manager, &log_manager, txn);
+      for (int i = 0; i < num_tuples; i++) {
+        ASSERT_TRUE(table.InsertTuple(MakeTuple(schema, i), &rids[i], txn));
+      }
+      txn_manager.Commit(txn);
+      delete txn;
+      std::mt19937 rng(42);
+      while (disk_manager.GetLogTail() < log_size) {
+        txn = txn_manager.Begin();
+        for (int i = 0; i < updates_per_txn; i++) {
+          int slot = static_cast<int>(rng() % num_tuples);
+          table.UpdateTuple(MakeTuple(schema, static_cast<int32_t>(rng())), rids[slot], txn);
+        }
+        txn_manager.Commit(txn);
+        delete txn;
+      }
+      Transaction *loser = txn_manager.Begin();
+      for (int i = 0; i < num_tuples; i++) {
+        table.UpdateTuple(MakeTuple(schema, -i), rids[i], loser);
+      }
+      log_manager.StopFlushThread();
+      delete loser;
+      disk_manager.ShutDown();
+    }
+
+    // Recovery does not write pages or log records, so every run starts from the same crash.
+    for (size_t num_workers = 1; num_workers <= 8; num_workers *= 2) {
+      DiskManager disk_manager(db_file);
+      LogManager log_manager(&disk_manager);
+      BufferPoolManagerInstance bpm(pool_size, &disk_manager, &log_manager);
+      LogRecovery log_recovery(&disk_manager, &bpm, &log_manager, num_workers);
+      auto start = std::chrono::steady_clock::now();
+      log_recovery.Redo();
+      auto redone = std::chrono::steady_clock::now();
+      log_recovery.Undo();
+      auto undone = std::chrono::steady_clock::now();
+      printf("%5.1f GB log, %d workers: redo %8.2f s, undo %6.2f s\n", static_cast<double>(log_size) / (1LL << 30),
+             static_cast<int>(num_workers), std::chrono::duration<double>(redone - start).count(),
+             std::chrono::duration<double>(undone - redone).count());
+      disk_manager.ShutDown();
+    }
+  }
+  RemoveLogFiles(db_file);
+}
+
+}  // namespace bustub
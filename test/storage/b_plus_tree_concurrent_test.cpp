@@ -10,9 +10,13 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>  // NOLINT
 #include <cstdio>
 #include <functional>
+#include <numeric>
+#include <random>
 #include <thread>  // NOLINT
 
 #include "buffer/buffer_pool_manager_instance.h"
@@ -100,12 +104,26 @@ void DeleteHelperSplit(BPlusTree<GenericKey<8>, RID, GenericComparator<8>> *tree
   delete transaction;
 }
 
+// helper function to look up, counting the keys that are not found
+void LookupHelper(BPlusTree<GenericKey<8>, RID, GenericComparator<8>> *tree, const std::vector<int64_t> &keys,
+                  std::atomic<int> *missing, __attribute__((unused)) uint64_t thread_itr = 0) {
+  GenericKey<8> index_key;
+  std::vector<RID> rids;
+  for (auto key : keys) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    if (!tree->GetValue(index_key, &rids) || rids[0].GetSlotNum() != key) {
+      (*missing)++;
+    }
+  }
+}
+
 TEST(BPlusTreeConcurrentTest, InsertTest1) {
   // create KeyComparator and index schema
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
 
-  DiskManager *disk_manager = new DiskManager("test.db");
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
   BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
   // create b+ tree
   BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
@@ -156,7 +174,7 @@ TEST(BPlusTreeConcurrentTest, InsertTest2) {
   // create KeyComparator and index schema
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
-  DiskManager *disk_manager = new DiskManager("test.db");
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
   BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
   // create b+ tree
   BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
@@ -208,7 +226,7 @@ TEST(BPlusTreeConcurrentTest, DeleteTest1) {
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
 
-  DiskManager *disk_manager = new DiskManager("test.db");
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
   BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
   // create b+ tree
   BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
@@ -250,7 +268,7 @@ TEST(BPlusTreeConcurrentTest, DeleteTest2) {
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
 
-  DiskManager *disk_manager = new DiskManager("test.db");
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
   BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
   // create b+ tree
   BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
@@ -293,7 +311,7 @@ TEST(BPlusTreeConcurrentTest, MixTest) {
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
 
-  DiskManager *disk_manager = new DiskManager("test.db");
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
   BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
   // create b+ tree
   BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
@@ -333,4 +351,112 @@ TEST(BPlusTreeConcurrentTest, MixTest) {
   remove("test.log");
 }
 
+// scan the whole tree: the keys come in order, and none of the given keys, which stay in the tree, is skipped
+void ScanHelper(BPlusTree<GenericKey<8>, RID, GenericComparator<8>> *tree, const std::vector<int64_t> &keys,
+                std::atomic<int> *missing) {
+  size_t next = 0;
+  int64_t last = 0;
+  for (auto iterator = tree->Begin(); iterator != tree->End(); ++iterator) {
+    int64_t key = (*iterator).second.GetSlotNum();
+    if (key <= last) {
+      (*missing)++;
+    }
+    last = key;
+    for (; next < keys.size() && keys[next] <= key; next++) {
+      if (keys[next] < key) {
+        (*missing)++;
+      }
+    }
+  }
+  *missing += static_cast<int>(keys.size() - next);
+}
+
+TEST(BPlusTreeConcurrentTest, SplitMergeTest) {
+  // create KeyComparator and index schema
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
+  // create b+ tree, small pages split and merge all the time
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator, 3, 4);
+  // create and fetch header_page
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(&page_id);
+  (void)header_page;
+  std::vector<int64_t> keys;
+  for (int64_t key = 1; key < 1000; key++) {
+    keys.push_back(key);
+  }
+  LaunchParallelTest(4, InsertHelperSplit, &tree, keys, 4);
+
+  // Remove the odd keys and insert more while the even ones are looked up and scanned for.
+  std::vector<int64_t> remove_keys;
+  std::vector<int64_t> lookup_keys;
+  for (auto key : keys) {
+    (key % 2 == 1 ? remove_keys : lookup_keys).push_back(key);
+  }
+  std::vector<int64_t> more_keys;
+  for (int64_t key = 1000; key < 1500; key++) {
+    more_keys.push_back(key);
+  }
+  std::atomic<int> missing{0};
+  std::vector<std::thread> threads;
+  threads.emplace_back(DeleteHelperSplit, &tree, remove_keys, 2, 0);
+  threads.emplace_back(DeleteHelperSplit, &tree, remove_keys, 2, 1);
+  threads.emplace_back(InsertHelper, &tree, more_keys, 0);
+  threads.emplace_back(LookupHelper, &tree, lookup_keys, &missing, 0);
+  threads.emplace_back(ScanHelper, &tree, lookup_keys, &missing);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(missing, 0);
+
+  lookup_keys.insert(lookup_keys.end(), more_keys.begin(), more_keys.end());
+  LookupHelper(&tree, lookup_keys, &missing);
+  EXPECT_EQ(missing, 0);
+  std::vector<int64_t> scanned;
+  for (auto iterator = tree.Begin(); iterator != tree.End(); ++iterator) {
+    scanned.push_back((*iterator).second.GetSlotNum());
+  }
+  EXPECT_EQ(scanned, lookup_keys);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+/**
+ * Insert the same keys, in random order, on a growing number of threads.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=BPlusTreeConcurrentTest.DISABLED_InsertBenchmark
+ */
+TEST(BPlusTreeConcurrentTest, DISABLED_InsertBenchmark) {
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+  std::vector<int64_t> keys(1 << 18);
+  std::iota(keys.begin(), keys.end(), 1);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(15445));
+
+  for (int num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    DiskManager *disk_manager = CreateTestDiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManagerInstance(4096, disk_manager);
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
+    page_id_t page_id;
+    bpm->NewPage(&page_id);
+
+    auto start = std::chrono::steady_clock::now();
+    LaunchParallelTest(num_threads, InsertHelperSplit, &tree, keys, num_threads);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%2d threads: %12.0f inserts/sec\n", num_threads, keys.size() / elapsed);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+  }
+}
+
 }  // namespace bustub
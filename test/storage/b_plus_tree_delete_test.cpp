@@ -25,7 +25,7 @@ TEST(BPlusTreeTests, DeleteTest1) {
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
 
-  DiskManager *disk_manager = new DiskManager("test.db");
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
   BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
   // create b+ tree
   BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
@@ -103,7 +103,7 @@ TEST(BPlusTreeTests, DeleteTest2) {
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
 
-  DiskManager *disk_manager = new DiskManager("test.db");
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
   BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
   // create b+ tree
   BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
@@ -175,4 +175,58 @@ TEST(BPlusTreeTests, DeleteTest2) {
   remove("test.db");
   remove("test.log");
 }
+
+/*
+ * An optimistic reader still has the last leaf pinned when a remove merges it away. The page is deleted by a later
+ * remove, and its id is handed out again.
+ */
+TEST(BPlusTreeTests, DeletePinnedPageTest) {
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+
+  DiskManager *disk_manager = CreateTestDiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManagerInstance(50, disk_manager);
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator, 3, 3);
+  GenericKey<8> index_key;
+  Transaction *transaction = new Transaction(0);
+
+  page_id_t page_id;
+  bpm->NewPage(&page_id);
+
+  const int64_t num_keys = 20;
+  for (int64_t key = 1; key <= num_keys; key++) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(tree.Insert(index_key, RID(0, key), transaction));
+  }
+  uint64_t version;
+  index_key.SetFromInteger(num_keys);
+  Page *last_leaf = tree.FindLeafPageOptimistic(index_key, &version);
+  page_id_t last_leaf_id = last_leaf->GetPageId();
+  for (int64_t key = num_keys; key > num_keys / 2; key--) {
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key, transaction);
+  }
+  EXPECT_FALSE(last_leaf->ValidateVersion(version));
+  bpm->UnpinPage(last_leaf_id, false);
+  for (int64_t key = 1; key <= num_keys / 2; key++) {
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key, transaction);
+  }
+
+  // The ids of deleted pages are handed out before new ones.
+  bool reused = false;
+  for (int i = 0; i < 40 && !reused; i++) {
+    ASSERT_NE(bpm->NewPage(&page_id), nullptr);
+    bpm->UnpinPage(page_id, false);
+    reused = page_id == last_leaf_id;
+  }
+  EXPECT_TRUE(reused);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete transaction;
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
 }  // namespace bustub
@@ -0,0 +1,161 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// b_plus_tree_range_lock_test.cpp
+//
+// Identification: test/storage/b_plus_tree_range_lock_test.cpp
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/index/b_plus_tree.h"
+#include "test_util.h"  // NOLINT
+
+namespace bustub {
+
+using RangeLockTree = BPlusTree<GenericKey<8>, RID, GenericComparator<8>>;
+
+class BPlusTreeRangeLockTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    page_id_t header_page_id;
+    bpm_.NewPage(&header_page_id);
+    bpm_.UnpinPage(header_page_id, true);
+    auto *txn = txn_manager_.Begin();
+    for (int64_t key : {10, 20, 30}) {
+      ASSERT_TRUE(tree_.Insert(Key(key), Rid(key), txn));
+    }
+    txn_manager_.Commit(txn);
+    delete txn;
+  }
+
+  static GenericKey<8> Key(int64_t key) {
+    GenericKey<8> index_key;
+    index_key.SetFromInteger(key);
+    return index_key;
+  }
+
+  static RID Rid(int64_t key) { return RID(0, static_cast<uint32_t>(key)); }
+
+  /**
+   * Insert a key in a transaction of its own on another thread, and check whether it has to wait for the reader.
+   * @return true if the insert waited until the reader committed
+   */
+  bool InsertWaitsFor(Transaction *reader, int64_t key) {
+    std::atomic<bool> inserted{false};
+    std::thread writer([&] {
+      auto *txn = txn_manager_.Begin();
+      EXPECT_TRUE(tree_.Insert(Key(key), Rid(key), txn));
+      inserted = true;
+      txn_manager_.Commit(txn);
+      delete txn;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    bool waited = !inserted;
+    txn_manager_.Commit(reader);
+    writer.join();
+    return waited;
+  }
+
+  std::unique_ptr<Schema> key_schema_{ParseCreateStatement("a bigint")};
+  GenericComparator<8> comparator_{key_schema_.get()};
+  DiskManagerMemory disk_manager_;
+  BufferPoolManagerInstance bpm_{50, &disk_manager_};
+  LockManager lock_manager_;
+  TransactionManager txn_manager_{&lock_manager_};
+  RangeLockTree tree_{"foo_pk", &bpm_, comparator_, 3, 4, &lock_manager_};
+};
+
+TEST_F(BPlusTreeRangeLockTest, ScanTest) {
+  // A scan of [10, 25] stops at 30, and has locked every gap up to it.
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::SERIALIZABLE);
+  std::vector<int64_t> keys;
+  for (auto iterator = tree_.Begin(Key(10), reader); iterator != tree_.End(); ++iterator) {
+    auto slot = (*iterator).second.GetSlotNum();
+    if (slot > 25) {
+      break;
+    }
+    keys.push_back(slot);
+  }
+  EXPECT_EQ(keys, (std::vector<int64_t>{10, 20}));
+  EXPECT_EQ(reader->GetSharedLockSet()->size(), 3U);
+  EXPECT_TRUE(InsertWaitsFor(reader, 15));
+  delete reader;
+
+  // Past the end of the range, inserts do not wait.
+  reader = txn_manager_.Begin(nullptr, IsolationLevel::SERIALIZABLE);
+  auto iterator = tree_.Begin(Key(10), reader);
+  while ((*iterator).second.GetSlotNum() <= 15) {
+    ++iterator;
+  }
+  EXPECT_FALSE(InsertWaitsFor(reader, 25));
+  delete reader;
+}
+
+TEST_F(BPlusTreeRangeLockTest, EndOfIndexTest) {
+  // A scan to the end of the index locks the gap after the last key.
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::SERIALIZABLE);
+  int count = 0;
+  for (auto iterator = tree_.Begin(reader); iterator != tree_.End(); ++iterator) {
+    count++;
+  }
+  EXPECT_EQ(count, 3);
+  EXPECT_TRUE(InsertWaitsFor(reader, 40));
+  delete reader;
+}
+
+TEST_F(BPlusTreeRangeLockTest, LookupTest) {
+  // Looking up a missing key locks the key after it, so the key cannot show up.
+  auto *reader = txn_manager_.Begin(nullptr, IsolationLevel::SERIALIZABLE);
+  std::vector<RID> result;
+  EXPECT_FALSE(tree_.GetValue(Key(25), &result, reader));
+  EXPECT_TRUE(reader->IsSharedLocked(Rid(30)));
+  EXPECT_TRUE(InsertWaitsFor(reader, 25));
+  delete reader;
+
+  // Below SERIALIZABLE, nothing but the rows themselves is locked.
+  reader = txn_manager_.Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  EXPECT_FALSE(tree_.GetValue(Key(35), &result, reader));
+  int count = 0;
+  for (auto iterator = tree_.Begin(reader); iterator != tree_.End(); ++iterator) {
+    count++;
+  }
+  EXPECT_EQ(count, 4);
+  EXPECT_TRUE(reader->GetSharedLockSet()->empty());
+  EXPECT_FALSE(InsertWaitsFor(reader, 35));
+  delete reader;
+}
+
+TEST_F(BPlusTreeRangeLockTest, ReadOnlyTest) {
+  // A read-only transaction looks keys up without locks. It has no lock sets and no deleted page set, it cannot lock
+  // or write.
+  auto *reader = txn_manager_.BeginReadOnly();
+  std::vector<RID> result;
+  EXPECT_TRUE(tree_.GetValue(Key(10), &result, reader));
+  EXPECT_FALSE(lock_manager_.LockShared(reader, Rid(10)));
+  EXPECT_EQ(reader->GetState(), TransactionState::ABORTED);
+  txn_manager_.Abort(reader);
+  delete reader;
+
+  // Removing the key would merge the leaf.
+  reader = txn_manager_.BeginReadOnly();
+  tree_.Remove(Key(10), reader);
+  EXPECT_EQ(reader->GetState(), TransactionState::ABORTED);
+  txn_manager_.Abort(reader);
+  delete reader;
+  result.clear();
+  EXPECT_TRUE(tree_.GetValue(Key(10), &result));
+}
+
+}  // namespace bustub
@@ -10,11 +10,16 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <chrono>  // NOLINT
 #include <cstring>
+#include <fstream>
+#include <memory>
 
 #include "common/exception.h"
 #include "gtest/gtest.h"
 #include "storage/disk/disk_manager.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/disk/disk_manager_throttled.h"
 
 namespace bustub {
 
@@ -72,6 +77,128 @@ TEST_F(DiskManagerTest, ReadWriteLogTest) {
   dm.ShutDown();
 }
 
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, SegmentedLogTest) {
+  const int64_t segment_size = 64;
+  char buf[40] = {0};
+  char data[2][40];
+  std::memset(data[0], 'a', sizeof(data[0]));
+  std::memset(data[1], 'b', sizeof(data[1]));
+  auto dm = DiskManager("test.db", segment_size);
+
+  // 10 writes of 40 bytes spread over 7 segments, most of them straddling two.
+  for (int i = 0; i < 10; i++) {
+    dm.WriteLog(data[i % 2], sizeof(data[i % 2]));
+  }
+  EXPECT_EQ(dm.GetLogTail(), 400);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_TRUE(dm.ReadLog(buf, sizeof(buf), i * 40));
+    EXPECT_EQ(std::memcmp(buf, data[i % 2], sizeof(buf)), 0);
+  }
+  EXPECT_FALSE(dm.ReadLog(buf, sizeof(buf), 400));
+
+  // Everything before the segment holding offset 200 goes. Segment 7 is already preallocated, so only segment 0 is
+  // kept as a second spare.
+  LogMasterRecord master;
+  master.checkpoint_lsn_ = 5;
+  master.redo_offset_ = 200;
+  master.redo_lsn_ = 5;
+  dm.WriteLogMaster(master);
+  dm.TruncateLog(200);
+  EXPECT_FALSE(dm.ReadLog(buf, sizeof(buf), 0));
+  EXPECT_TRUE(dm.ReadLog(buf, sizeof(buf), 192));
+  EXPECT_TRUE(dm.ReadLog(buf, sizeof(buf), 200));
+  EXPECT_EQ(std::memcmp(buf, data[1], sizeof(buf)), 0);
+  EXPECT_FALSE(std::ifstream("test.log.0").good());
+  EXPECT_FALSE(std::ifstream("test.log.2").good());
+  EXPECT_TRUE(std::ifstream("test.log.7").good());
+  EXPECT_TRUE(std::ifstream("test.log.8").good());
+  EXPECT_FALSE(std::ifstream("test.log.9").good());
+  dm.ShutDown();
+
+  // After a restart the log is readable from the checkpoint's segment until its tail is set.
+  auto restarted = DiskManager("test.db");
+  EXPECT_EQ(restarted.ReadLogMaster().checkpoint_lsn_, 5);
+  EXPECT_EQ(restarted.ReadLogMaster().segment_size_, segment_size);
+  EXPECT_TRUE(restarted.ReadLog(buf, sizeof(buf), 360));
+  EXPECT_EQ(std::memcmp(buf, data[1], sizeof(buf)), 0);
+  restarted.SetLogTail(400);
+  restarted.WriteLog(data[0], sizeof(data[0]));
+  EXPECT_TRUE(restarted.ReadLog(buf, sizeof(buf), 400));
+  EXPECT_EQ(std::memcmp(buf, data[0], sizeof(buf)), 0);
+  restarted.ShutDown();
+
+  // Without the master record the segments are stale and a new log starts from scratch.
+  remove("test.log");
+  auto fresh = DiskManager("test.db");
+  EXPECT_EQ(fresh.GetLogTail(), 0);
+  EXPECT_FALSE(std::ifstream("test.log.8").good());
+  fresh.ShutDown();
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, MemoryReadWriteTest) {
+  char buf[PAGE_SIZE] = {0};
+  char data[PAGE_SIZE] = {0};
+  char zeros[PAGE_SIZE] = {0};
+  DiskManagerMemory dm;
+  std::strncpy(data, "A test string.", sizeof(data));
+
+  dm.ReadPage(3, buf);  // tolerate empty read
+  EXPECT_EQ(std::memcmp(buf, zeros, sizeof(buf)), 0);
+
+  dm.WritePage(0, data);
+  dm.WritePage(5, data);
+  dm.ReadPage(5, buf);
+  EXPECT_EQ(std::memcmp(buf, data, sizeof(buf)), 0);
+  dm.ReadPage(2, buf);
+  EXPECT_EQ(std::memcmp(buf, zeros, sizeof(buf)), 0);
+  EXPECT_EQ(dm.GetNumWrites(), 2);
+
+  char log_buf[16] = {0};
+  char log_data[16] = {0};
+  std::strncpy(log_data, "A test string.", sizeof(log_data));
+  EXPECT_FALSE(dm.ReadLog(log_buf, sizeof(log_buf), 0));
+  dm.WriteLog(log_data, sizeof(log_data));
+  dm.WriteLog(log_data, sizeof(log_data));
+  EXPECT_TRUE(dm.ReadLog(log_buf, sizeof(log_buf), sizeof(log_data)));
+  EXPECT_EQ(std::memcmp(log_buf, log_data, sizeof(log_buf)), 0);
+  EXPECT_EQ(dm.GetNumFlushes(), 2);
+
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, ThrottledLatencyTest) {
+  char buf[PAGE_SIZE] = {0};
+  char data[PAGE_SIZE] = {0};
+  std::strncpy(data, "A test string.", sizeof(data));
+  DiskThrottleConfig config{std::chrono::microseconds(2000), std::chrono::microseconds(3000), 0};
+  DiskManagerThrottled dm(std::make_unique<DiskManagerMemory>(), config);
+
+  auto start = std::chrono::steady_clock::now();
+  dm.WritePage(0, data);
+  dm.ReadPage(0, buf);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(std::memcmp(buf, data, sizeof(buf)), 0);
+  EXPECT_GE(elapsed, std::chrono::microseconds(5000));
+  EXPECT_EQ(dm.GetNumWrites(), 1);
+
+  // 16 pages over a 4 MB/s channel take at least 16 ms no matter the latency.
+  DiskThrottleConfig slow_config{std::chrono::microseconds(0), std::chrono::microseconds(0), 4ULL * 1024 * 1024};
+  DiskManagerThrottled slow_dm(std::make_unique<DiskManagerMemory>(), slow_config);
+  start = std::chrono::steady_clock::now();
+  for (page_id_t page_id = 0; page_id < 16; page_id++) {
+    slow_dm.WritePage(page_id, data);
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(15));
+
+  dm.ShutDown();
+  slow_dm.ShutDown();
+}
+
 // NOLINTNEXTLINE
 TEST_F(DiskManagerTest, ThrowBadFileTest) { EXPECT_THROW(DiskManager("dev/null\\/foo/bar/baz/test.db"), Exception); }
 
@@ -0,0 +1,141 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// page_version_test.cpp
+//
+// Identification: test/storage/page_version_test.cpp
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstring>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "storage/page/page.h"
+
+namespace bustub {
+
+TEST(PageVersionTest, ValidateTest) {
+  Page page;
+  auto version = page.ReadVersion();
+  EXPECT_TRUE(page.ValidateVersion(version));
+
+  // Read latches leave the version alone, a write latch changes it.
+  page.RLatch();
+  page.RUnlatch();
+  EXPECT_TRUE(page.ValidateVersion(version));
+  page.WLatch();
+  EXPECT_FALSE(page.ValidateVersion(version));
+  page.WUnlatch();
+  EXPECT_FALSE(page.ValidateVersion(version));
+  EXPECT_TRUE(page.ValidateVersion(page.ReadVersion()));
+}
+
+TEST(PageVersionTest, WaitForWriterTest) {
+  Page page;
+  std::atomic<bool> released{false};
+
+  // A reader does not start while a writer holds the latch.
+  page.WLatch();
+  std::thread reader([&] {
+    auto version = page.ReadVersion();
+    EXPECT_TRUE(released);
+    EXPECT_TRUE(page.ValidateVersion(version));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  released = true;
+  page.WUnlatch();
+  reader.join();
+}
+
+TEST(PageVersionTest, OptimisticReadTest) {
+  Page page;
+  const int num_readers = 2;
+  const int64_t num_writes = 1000;
+  std::atomic<bool> done{false};
+  std::atomic<int> torn_reads{0};
+  std::atomic<int> validated_reads{0};
+
+  // The writer keeps two words of the page equal, a read that validates must never see them differ.
+  std::vector<std::thread> readers;
+  for (int tid = 0; tid < num_readers; tid++) {
+    readers.emplace_back([&] {
+      while (!done) {
+        auto version = page.ReadVersion();
+        int64_t first;
+        int64_t second;
+        memcpy(&first, page.GetData() + 64, sizeof(first));
+        memcpy(&second, page.GetData() + 2048, sizeof(second));
+        if (page.ValidateVersion(version)) {
+          validated_reads++;
+          if (first != second) {
+            torn_reads++;
+          }
+        }
+      }
+    });
+  }
+  for (int64_t i = 1; i <= num_writes; i++) {
+    page.WLatch();
+    memcpy(page.GetData() + 64, &i, sizeof(i));
+    std::this_thread::yield();
+    memcpy(page.GetData() + 2048, &i, sizeof(i));
+    page.WUnlatch();
+  }
+  done = true;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(torn_reads, 0);
+  EXPECT_GT(validated_reads, 0);
+}
+
+/**
+ * Read one page on a growing number of threads, under the read latch and optimistically.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=PageVersionTest.DISABLED_ReadBenchmark
+ */
+TEST(PageVersionTest, DISABLED_ReadBenchmark) {
+  const int total_reads = 1 << 22;
+  for (int num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    Page page;
+    const int reads_per_thread = total_reads / num_threads;
+    for (bool optimistic : {false, true}) {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int tid = 0; tid < num_threads; tid++) {
+        threads.emplace_back([&, reads_per_thread] {
+          int64_t sum = 0;
+          for (int i = 0; i < reads_per_thread; i++) {
+            if (optimistic) {
+              uint64_t version;
+              do {
+                version = page.ReadVersion();
+                sum += page.GetData()[i % PAGE_SIZE];
+              } while (!page.ValidateVersion(version));
+            } else {
+              page.RLatch();
+              sum += page.GetData()[i % PAGE_SIZE];
+              page.RUnlatch();
+            }
+          }
+          EXPECT_EQ(sum, 0);
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      printf("%2d threads, %-10s: %12.0f reads/sec\n", num_threads, optimistic ? "optimistic" : "read latch",
+             num_threads * reads_per_thread / elapsed);
+    }
+  }
+}
+
+}  // namespace bustub